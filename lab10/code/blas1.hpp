@@ -0,0 +1,36 @@
+#pragma once
+
+#include <hpcdefs.hpp>
+
+/*
+ * Vectorized, multithreaded (OpenMP) BLAS-1 kernels on double-precision vectors.
+ * The fused kernels do the work of two or three of the plain ones in one pass over memory
+ * (two for normalization: the norm must be known before the vector is scaled).
+ */
+
+/* Vectors shorter than this are processed by the calling thread only */
+#define BLAS1_PARALLEL_MIN (size_t(1) << 15)
+/* Outputs larger than this do not fit in the last-level cache and are written with non-temporal stores */
+#define BLAS1_STREAMING_BYTES (size_t(8) << 20)
+
+/* x := alpha * x */
+void blas1_scal(double *CSE6230_RESTRICT vector_x, size_t length, double alpha);
+/* y := alpha * x + y */
+void blas1_axpy(double *CSE6230_RESTRICT vector_y, const double *CSE6230_RESTRICT vector_x, size_t length, double alpha);
+/* Returns x . y */
+double blas1_dot(const double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_y, size_t length);
+/* Returns ||x||_2 */
+double blas1_nrm2(const double *CSE6230_RESTRICT vector_x, size_t length);
+/* Returns max_i |x[i] - y[i]| */
+double blas1_amax_diff(const double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_y, size_t length);
+
+/* Fused kernels */
+
+/* y := alpha * x + y, and returns y . z for the updated y */
+double blas1_axpy_dot(double *CSE6230_RESTRICT vector_y, const double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_z, size_t length, double alpha);
+/* x := alpha * x, and returns ||x||_2 for the updated x */
+double blas1_scal_nrm2(double *CSE6230_RESTRICT vector_x, size_t length, double alpha);
+/* x := x / ||x||_2, and returns the original ||x||_2 */
+double blas1_normalize(double *CSE6230_RESTRICT vector_x, size_t length);
+/* x := x / ||x||_2, and returns x . y for the normalized x */
+double blas1_normalize_dot(double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_y, size_t length);
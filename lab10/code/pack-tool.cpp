@@ -0,0 +1,148 @@
+#include <hpcdefs.hpp>
+#include <pack.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+/*
+ * Converts data sets to pack files (see pack.hpp) and inspects them.
+ *
+ *   pack-tool images <width> <height> <output.pack> <image.y>...
+ *       8-bit grayscale raw images, as one item with the images back to back
+ *   pack-tool csr <input.mat> <output.pack>
+ *       the PageRank matrix dump (links, pages, 1-based column indices and row starts)
+ *   pack-tool info <input.pack>
+ *       prints the header and item table and verifies every checksum
+ */
+
+static void* read_whole_file(const char* file_path, size_t& file_size) {
+	FILE* file = fopen(file_path, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open the input file %s\n", file_path);
+		return NULL;
+	}
+	struct stat file_status;
+	if (fstat(fileno(file), &file_status) == -1) {
+		fprintf(stderr, "Failed to query the size of the input file %s\n", file_path);
+		fclose(file);
+		return NULL;
+	}
+	file_size = file_status.st_size;
+	void* data = allocate_aligned_memory(file_size + 1, 64);
+	const size_t bytes_read = fread(data, 1, file_size, file);
+	fclose(file);
+	if (bytes_read != file_size) {
+		fprintf(stderr, "Could only read %u out of %u expected bytes from %s\n",
+			unsigned(bytes_read), unsigned(file_size), file_path);
+		release_aligned_memory(data);
+		return NULL;
+	}
+	return data;
+}
+
+static int pack_images(size_t image_width, size_t image_height, const char* output_path, char** image_paths, size_t image_count) {
+	const size_t image_size = image_width * image_height;
+	uint8_t* images = static_cast<uint8_t*>(allocate_aligned_memory(image_size * image_count, 64));
+	bool ok = true;
+	for (size_t i = 0; ok && i < image_count; i++) {
+		size_t file_size = 0;
+		void* image = read_whole_file(image_paths[i], file_size);
+		if (image == NULL)
+			ok = false;
+		else if (file_size != image_size) {
+			fprintf(stderr, "%s has %u bytes; a %ux%u image has %u\n", image_paths[i],
+				unsigned(file_size), unsigned(image_width), unsigned(image_height), unsigned(image_size));
+			ok = false;
+		} else {
+			memcpy(images + i * image_size, image, image_size);
+		}
+		if (image != NULL)
+			release_aligned_memory(image);
+	}
+	ok = ok && pack_write_image_stack(output_path, images, image_width, image_height, image_count);
+	release_aligned_memory(images);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int pack_csr(const char* input_path, const char* output_path) {
+	size_t file_size = 0;
+	uint8_t* data = static_cast<uint8_t*>(read_whole_file(input_path, file_size));
+	if (data == NULL)
+		return EXIT_FAILURE;
+	uint32_t links_count = 0, pages_count = 0;
+	if (file_size >= 2 * sizeof(uint32_t)) {
+		memcpy(&links_count, data, sizeof(uint32_t));
+		memcpy(&pages_count, data + sizeof(uint32_t), sizeof(uint32_t));
+	}
+	const size_t expected_file_size = (2 + size_t(links_count) + size_t(pages_count) + 1) * sizeof(int32_t);
+	if (file_size != expected_file_size) {
+		fprintf(stderr, "%s has %u bytes; a matrix with %u links and %u pages has %u\n", input_path,
+			unsigned(file_size), unsigned(links_count), unsigned(pages_count), unsigned(expected_file_size));
+		release_aligned_memory(data);
+		return EXIT_FAILURE;
+	}
+
+	/* The pack stores 0-based indices, so that the loader can hand out the mapping as is */
+	int32_t* columns = static_cast<int32_t*>(allocate_aligned_memory(links_count * sizeof(int32_t), 64));
+	int32_t* rows = static_cast<int32_t*>(allocate_aligned_memory((pages_count + 1) * sizeof(int32_t), 64));
+	memcpy(columns, data + 2 * sizeof(uint32_t), links_count * sizeof(int32_t));
+	memcpy(rows, data + (2 + size_t(links_count)) * sizeof(uint32_t), (pages_count + 1) * sizeof(int32_t));
+	for (size_t link = 0; link < links_count; link++)
+		columns[link] -= 1;
+	for (size_t page = 0; page <= pages_count; page++)
+		rows[page] -= 1;
+
+	pack_source items[2];
+	items[0].data = columns;
+	items[0].count = links_count;
+	items[0].dtype = PACK_DTYPE_INT32;
+	items[1].data = rows;
+	items[1].count = pages_count + 1;
+	items[1].dtype = PACK_DTYPE_INT32;
+	const uint32_t dims[4] = { pages_count, pages_count, links_count, 1 };
+	const bool ok = pack_write(output_path, PACK_KIND_CSR_MATRIX, 3, dims, items, 2);
+
+	release_aligned_memory(rows);
+	release_aligned_memory(columns);
+	release_aligned_memory(data);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int print_info(const char* input_path) {
+	pack_file pack;
+	if (!pack_open(input_path, pack, true)) {
+		fprintf(stderr, "Failed to open %s as a valid pack\n", input_path);
+		return EXIT_FAILURE;
+	}
+	const pack_header* header = pack.header;
+	printf("%s: version %u, kind %u, %u items, %llu bytes\n", input_path, unsigned(header->version),
+		unsigned(header->kind), unsigned(header->item_count), (unsigned long long)header->file_size);
+	printf("\tDims:");
+	for (size_t d = 0; d < header->rank; d++)
+		printf(" %u", unsigned(header->dims[d]));
+	printf("\n\tChecksum: %08x (all checksums verified)\n", unsigned(header->checksum));
+	for (size_t i = 0; i < header->item_count; i++) {
+		const pack_item& item = pack.items[i];
+		printf("\t%6u  offset %10llu  count %10llu  dtype %u  checksum %08x\n", unsigned(i),
+			(unsigned long long)item.offset, (unsigned long long)item.count, unsigned(item.dtype), unsigned(item.checksum));
+	}
+	pack_close(pack);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+	if (argc >= 6 && strcmp(argv[1], "images") == 0) {
+		return pack_images(strtoul(argv[2], NULL, 10), strtoul(argv[3], NULL, 10), argv[4], argv + 5, argc - 5);
+	} else if (argc == 4 && strcmp(argv[1], "csr") == 0) {
+		return pack_csr(argv[2], argv[3]);
+	} else if (argc == 3 && strcmp(argv[1], "info") == 0) {
+		return print_info(argv[2]);
+	}
+	fprintf(stderr, "Usage: %s images <width> <height> <output.pack> <image.y>...\n", argv[0]);
+	fprintf(stderr, "       %s csr <input.mat> <output.pack>\n", argv[0]);
+	fprintf(stderr, "       %s info <input.pack>\n", argv[0]);
+	return EXIT_FAILURE;
+}
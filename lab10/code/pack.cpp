@@ -0,0 +1,258 @@
+#include <pack.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static size_t round_up(size_t size) {
+	return (size + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+}
+
+size_t pack_dtype_size(uint32_t dtype) {
+	switch (dtype) {
+		case PACK_DTYPE_UINT8:
+			return 1;
+		case PACK_DTYPE_INT32:
+		case PACK_DTYPE_UINT32:
+		case PACK_DTYPE_FLOAT:
+			return 4;
+		case PACK_DTYPE_DOUBLE:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+/* CRC-32C with the SSE4.2 crc32 instruction, 8 bytes at a time */
+uint32_t pack_checksum(const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t crc = 0xFFFFFFFFu;
+	for (; size >= 8; size -= 8, bytes += 8) {
+		uint64_t word;
+		memcpy(&word, bytes, sizeof(word));
+		crc = _mm_crc32_u64(crc, word);
+	}
+	uint32_t crc32 = uint32_t(crc);
+	for (; size != 0; size--, bytes++)
+		crc32 = _mm_crc32_u8(crc32, *bytes);
+	return ~crc32;
+}
+
+static uint32_t header_checksum(const pack_header* header, const pack_item* items) {
+	pack_header copy = *header;
+	copy.checksum = 0;
+	const uint32_t header_crc = pack_checksum(&copy, sizeof(copy));
+	return header_crc ^ pack_checksum(items, header->item_count * sizeof(pack_item));
+}
+
+static bool write_all(int file_descriptor, const void* data, size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	while (size != 0) {
+		const ssize_t bytes_written = write(file_descriptor, bytes, size);
+		if (bytes_written <= 0) {
+			if (bytes_written == -1 && errno == EINTR)
+				continue;
+			return false;
+		}
+		bytes += bytes_written;
+		size -= bytes_written;
+	}
+	return true;
+}
+
+bool pack_write(const char* file_path, uint32_t kind, uint32_t rank, const uint32_t dims[4],
+	const pack_source* items, size_t item_count)
+{
+	const size_t header_size = round_up(sizeof(pack_header) + item_count * sizeof(pack_item));
+	uint8_t* header_block = static_cast<uint8_t*>(calloc(header_size, 1));
+	pack_header* header = reinterpret_cast<pack_header*>(header_block);
+	pack_item* table = reinterpret_cast<pack_item*>(header_block + sizeof(pack_header));
+
+	size_t offset = header_size;
+	for (size_t i = 0; i < item_count; i++) {
+		const size_t payload_size = items[i].count * pack_dtype_size(items[i].dtype);
+		table[i].offset = offset;
+		table[i].count = items[i].count;
+		table[i].dtype = items[i].dtype;
+		table[i].checksum = pack_checksum(items[i].data, payload_size);
+		offset += round_up(payload_size);
+	}
+	strncpy(header->magic, PACK_MAGIC, sizeof(header->magic));
+	header->version = PACK_VERSION;
+	header->header_size = header_size;
+	header->item_count = item_count;
+	header->rank = rank;
+	for (size_t d = 0; d < 4; d++)
+		header->dims[d] = (d < rank) ? dims[d] : 1;
+	header->file_size = offset;
+	header->kind = kind;
+	header->checksum = header_checksum(header, table);
+
+	const int file_descriptor = open(file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (file_descriptor == -1) {
+		fprintf(stderr, "Failed to open the output file %s\n", file_path);
+		free(header_block);
+		return false;
+	}
+	static const uint8_t padding[PACK_ALIGNMENT] = { 0 };
+	bool written = write_all(file_descriptor, header_block, header_size);
+	for (size_t i = 0; written && i < item_count; i++) {
+		const size_t payload_size = items[i].count * pack_dtype_size(items[i].dtype);
+		written = write_all(file_descriptor, items[i].data, payload_size)
+			&& write_all(file_descriptor, padding, round_up(payload_size) - payload_size);
+	}
+	written = (close(file_descriptor) == 0) && written;
+	if (!written) {
+		fprintf(stderr, "Failed to write the output file %s: error code %d\n", file_path, errno);
+	}
+	free(header_block);
+	return written;
+}
+
+static bool check_header(const char* file_path, const uint8_t* data, size_t size) {
+	const pack_header* header = reinterpret_cast<const pack_header*>(data);
+	if (size < sizeof(pack_header) || memcmp(header->magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0) {
+		fprintf(stderr, "%s is not a pack file\n", file_path);
+		return false;
+	}
+	if (header->version != PACK_VERSION) {
+		fprintf(stderr, "%s is a version %u pack; only version %u is supported\n",
+			file_path, unsigned(header->version), unsigned(PACK_VERSION));
+		return false;
+	}
+	if (header->file_size != size || header->header_size > size
+		|| sizeof(pack_header) + uint64_t(header->item_count) * sizeof(pack_item) > header->header_size)
+	{
+		fprintf(stderr, "%s is truncated or has a corrupt header\n", file_path);
+		return false;
+	}
+	const pack_item* items = reinterpret_cast<const pack_item*>(data + sizeof(pack_header));
+	if (header_checksum(header, items) != header->checksum) {
+		fprintf(stderr, "%s has a corrupt header (checksum mismatch)\n", file_path);
+		return false;
+	}
+	for (size_t i = 0; i < header->item_count; i++) {
+		const size_t element_size = pack_dtype_size(items[i].dtype);
+		if (element_size == 0 || items[i].offset % PACK_ALIGNMENT != 0 || items[i].offset < header->header_size
+			|| items[i].offset > size || items[i].count > (size - items[i].offset) / element_size)
+		{
+			fprintf(stderr, "%s has a corrupt entry for item %u\n", file_path, unsigned(i));
+			return false;
+		}
+	}
+	return true;
+}
+
+bool pack_open(const char* file_path, pack_file& pack, bool verify_payloads) {
+	memset(&pack, 0, sizeof(pack));
+	const int file_descriptor = open(file_path, O_RDONLY);
+	if (file_descriptor == -1) {
+		return false;
+	}
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) == -1 || file_status.st_size == 0) {
+		fprintf(stderr, "Failed to query the size of the input file %s\n", file_path);
+		close(file_descriptor);
+		return false;
+	}
+	void* data = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	close(file_descriptor);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Failed to map the input file %s: error code %d\n", file_path, errno);
+		return false;
+	}
+	madvise(data, file_status.st_size, MADV_WILLNEED);
+	pack.data = static_cast<const uint8_t*>(data);
+	pack.size = file_status.st_size;
+	if (!check_header(file_path, pack.data, pack.size)) {
+		pack_close(pack);
+		return false;
+	}
+	pack.header = reinterpret_cast<const pack_header*>(pack.data);
+	pack.items = reinterpret_cast<const pack_item*>(pack.data + sizeof(pack_header));
+	if (verify_payloads) {
+		for (size_t i = 0; i < pack.header->item_count; i++) {
+			const pack_item& item = pack.items[i];
+			if (pack_checksum(pack.data + item.offset, item.count * pack_dtype_size(item.dtype)) != item.checksum) {
+				fprintf(stderr, "%s has a corrupt payload for item %u (checksum mismatch)\n", file_path, unsigned(i));
+				pack_close(pack);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void pack_close(pack_file& pack) {
+	if (pack.data != NULL) {
+		munmap(const_cast<uint8_t*>(pack.data), pack.size);
+	}
+	memset(&pack, 0, sizeof(pack));
+}
+
+const void* pack_item_data(const pack_file& pack, size_t index, uint32_t dtype, uint64_t* count) {
+	if (pack.header == NULL || index >= pack.header->item_count || pack.items[index].dtype != dtype)
+		return NULL;
+	if (count != NULL)
+		*count = pack.items[index].count;
+	return pack.data + pack.items[index].offset;
+}
+
+bool pack_write_image_stack(const char* file_path, const uint8_t* images, size_t image_width, size_t image_height, size_t image_count) {
+	/* One item for the whole stack: items are padded to PACK_ALIGNMENT, so one item per image would not be contiguous */
+	pack_source item;
+	item.data = images;
+	item.count = uint64_t(image_width) * image_height * image_count;
+	item.dtype = PACK_DTYPE_UINT8;
+	const uint32_t dims[4] = { uint32_t(image_width), uint32_t(image_height), uint32_t(image_count), 1 };
+	return pack_write(file_path, PACK_KIND_IMAGE_STACK, 3, dims, &item, 1);
+}
+
+const uint8_t* pack_image_stack(const pack_file& pack, size_t image_width, size_t image_height, size_t image_count) {
+	if (pack.header == NULL || pack.header->kind != PACK_KIND_IMAGE_STACK || pack.header->item_count != 1
+		|| pack.header->dims[0] != image_width || pack.header->dims[1] != image_height || pack.header->dims[2] < image_count)
+	{
+		return NULL;
+	}
+	uint64_t count = 0;
+	const void* images = pack_item_data(pack, 0, PACK_DTYPE_UINT8, &count);
+	if (images == NULL || count != uint64_t(image_width) * image_height * pack.header->dims[2])
+		return NULL;
+	return static_cast<const uint8_t*>(images);
+}
+
+bool pack_csr_matrix(const pack_file& pack, const int32_t** columns, const int32_t** rows, uint32_t* nonzeros_count, uint32_t* rows_count) {
+	if (pack.header == NULL || pack.header->kind != PACK_KIND_CSR_MATRIX || pack.header->item_count != 2)
+		return false;
+	/* The outputs are only written once every check has passed */
+	uint64_t columns_count = 0, row_starts_count = 0;
+	const int32_t* column_indices = static_cast<const int32_t*>(pack_item_data(pack, 0, PACK_DTYPE_INT32, &columns_count));
+	const int32_t* row_starts = static_cast<const int32_t*>(pack_item_data(pack, 1, PACK_DTYPE_INT32, &row_starts_count));
+	if (column_indices == NULL || row_starts == NULL || row_starts_count != uint64_t(pack.header->dims[0]) + 1
+		|| columns_count != pack.header->dims[2])
+	{
+		return false;
+	}
+	/* The checksums only catch damage after writing: the structure must also keep every index in bounds */
+	const uint32_t rows_total = pack.header->dims[0], columns_total = pack.header->dims[1];
+	if (row_starts[0] != 0 || uint64_t(uint32_t(row_starts[rows_total])) != columns_count)
+		return false;
+	for (uint32_t row = 0; row < rows_total; row++) {
+		if (row_starts[row + 1] < row_starts[row])
+			return false;
+	}
+	for (uint64_t index = 0; index < columns_count; index++) {
+		if (column_indices[index] < 0 || uint32_t(column_indices[index]) >= columns_total)
+			return false;
+	}
+	*columns = column_indices;
+	*rows = row_starts;
+	*nonzeros_count = columns_count;
+	*rows_count = pack.header->dims[0];
+	return true;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <hpcdefs.hpp>
+
+/*
+ * Pack files: a versioned container for arrays that are loaded with one read-only mmap.
+ *
+ * Layout (little-endian):
+ *   pack_header                    64 bytes
+ *   pack_item[item_count]          32 bytes each
+ *   payloads                       each at a 64-byte aligned offset, zero padded
+ *
+ * The header checksum covers the header (with the checksum field zeroed) and the item
+ * table; every item has its own payload checksum. Both are CRC-32C.
+ */
+
+#define PACK_MAGIC "CSEPACK"
+#define PACK_VERSION 1
+#define PACK_ALIGNMENT 64
+
+enum pack_dtype {
+	PACK_DTYPE_UINT8 = 1,
+	PACK_DTYPE_INT32 = 2,
+	PACK_DTYPE_UINT32 = 3,
+	PACK_DTYPE_FLOAT = 4,
+	PACK_DTYPE_DOUBLE = 5
+};
+
+/* pack_header::kind of the packs that the loaders below read */
+enum pack_kind {
+	PACK_KIND_IMAGE_STACK = 1,   // One uint8 item with the images back to back; dims = { width, height, count }
+	PACK_KIND_CSR_MATRIX = 2     // int32 column indices, then int32 row starts, 0-based; dims = { rows, columns, nonzeros }
+};
+
+struct pack_header {
+	char magic[8];          // PACK_MAGIC, zero terminated
+	uint32_t version;       // PACK_VERSION
+	uint32_t header_size;   // Header and item table, rounded up to PACK_ALIGNMENT
+	uint32_t item_count;
+	uint32_t rank;          // Number of meaningful entries in dims
+	uint32_t dims[4];       // What the items make up, e.g. { width, height, count } of an image stack
+	uint64_t file_size;
+	uint32_t kind;          // User-defined, e.g. which loader the pack is meant for
+	uint32_t checksum;
+	uint64_t reserved;
+};
+
+struct pack_item {
+	uint64_t offset;        // From the start of the file, a multiple of PACK_ALIGNMENT
+	uint64_t count;         // Elements
+	uint32_t dtype;         // pack_dtype
+	uint32_t checksum;      // Of the count * element size payload bytes
+	uint64_t reserved;
+};
+
+/* An open pack: views into one read-only mapping, valid until pack_close */
+struct pack_file {
+	const uint8_t* data;
+	size_t size;
+	const pack_header* header;
+	const pack_item* items;
+};
+
+/* What pack_write stores for one item */
+struct pack_source {
+	const void* data;
+	uint64_t count;
+	uint32_t dtype;
+};
+
+size_t pack_dtype_size(uint32_t dtype);
+uint32_t pack_checksum(const void* data, size_t size);
+
+/* Writes items in order; returns false (with a message on stderr) on failure */
+bool pack_write(const char* file_path, uint32_t kind, uint32_t rank, const uint32_t dims[4],
+	const pack_source* items, size_t item_count);
+
+/* Maps a pack and checks its header, and with verify_payloads also every item's checksum */
+bool pack_open(const char* file_path, pack_file& pack, bool verify_payloads);
+void pack_close(pack_file& pack);
+
+/* Item index, or NULL if it does not exist or is not of the given dtype */
+const void* pack_item_data(const pack_file& pack, size_t index, uint32_t dtype, uint64_t* count);
+
+/* Writes image_count images of image_width x image_height bytes, stored back to back, as an image stack */
+bool pack_write_image_stack(const char* file_path, const uint8_t* images, size_t image_width, size_t image_height, size_t image_count);
+
+/* Loaders: views of a pack of the right kind and shape, or NULL / false (leaving the outputs untouched) */
+const uint8_t* pack_image_stack(const pack_file& pack, size_t image_width, size_t image_height, size_t image_count);
+/* Also checks that the row starts rise from 0 to nonzeros and that every column index is below dims[1] */
+bool pack_csr_matrix(const pack_file& pack, const int32_t** columns, const int32_t** rows, uint32_t* nonzeros_count, uint32_t* rows_count);
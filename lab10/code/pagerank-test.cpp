@@ -1,5 +1,7 @@
 #include <hpcdefs.hpp>
 #include <pagerank.hpp>
+#include <pack.hpp>
+#include <blas1.hpp>
 #include <timer.hpp>
 
 #include <stdio.h>
@@ -88,16 +90,50 @@ int main(int argc, char** argv) {
 	}
 
 	uint32_t links_count = 0, pages_count = 0;
-	FILE* matrix_file = fopen("web-16384.mat", "r");
-	assert(matrix_file != NULL);
-	ssize_t elements_read;
-	elements_read = fread(&links_count, sizeof(uint32_t), 1, matrix_file);
-	assert(elements_read == 1);
-	elements_read = fread(&pages_count, sizeof(uint32_t), 1, matrix_file);
-	assert(elements_read == 1);
-
-	int32_t* columns = (int32_t*)allocate_aligned_memory(links_count * sizeof(int32_t), 64);
-	int32_t* rows = (int32_t*)allocate_aligned_memory((pages_count + 1) * sizeof(int32_t), 64);
+	const int32_t* columns = NULL;
+	const int32_t* rows = NULL;
+	int32_t* columns_buffer = NULL;
+	int32_t* rows_buffer = NULL;
+
+	/* The matrix is mapped from web-16384.pack if it exists (make web-16384.pack), or read from the dump */
+	pack_file matrix_pack;
+	if (pack_open("web-16384.pack", matrix_pack, false)) {
+		if (!pack_csr_matrix(matrix_pack, &columns, &rows, &links_count, &pages_count)) {
+			fprintf(stderr, "web-16384.pack does not hold a CSR matrix\n");
+			pack_close(matrix_pack);
+			columns = rows = NULL;
+			links_count = pages_count = 0;
+		}
+	}
+	if (columns == NULL) {
+		FILE* matrix_file = fopen("web-16384.mat", "r");
+		assert(matrix_file != NULL);
+		ssize_t elements_read;
+		elements_read = fread(&links_count, sizeof(uint32_t), 1, matrix_file);
+		assert(elements_read == 1);
+		elements_read = fread(&pages_count, sizeof(uint32_t), 1, matrix_file);
+		assert(elements_read == 1);
+
+		columns_buffer = (int32_t*)allocate_aligned_memory(links_count * sizeof(int32_t), 64);
+		rows_buffer = (int32_t*)allocate_aligned_memory((pages_count + 1) * sizeof(int32_t), 64);
+		elements_read = fread(columns_buffer, sizeof(int32_t), links_count, matrix_file);
+		assert(elements_read == links_count);
+		elements_read = fread(rows_buffer, sizeof(int32_t), (pages_count + 1), matrix_file);
+		assert(elements_read == (pages_count + 1));
+
+		fclose(matrix_file);
+
+		/* Convert 1-based indices of CSR format to 0-base indices */
+		for (size_t link = 0; link < links_count; link++) {
+			columns_buffer[link] -= 1;
+		}
+		for (size_t page = 0; page <= pages_count; page++) {
+			rows_buffer[page] -= 1;
+		}
+		columns = columns_buffer;
+		rows = rows_buffer;
+	}
+
 	double* matrix = (double*)allocate_aligned_memory(links_count * sizeof(double), 64);
 	vector_set(matrix, links_count, 1.0);
 
@@ -109,21 +145,6 @@ int main(int argc, char** argv) {
 	int32_t* page_links_count = (int32_t*)allocate_aligned_memory(pages_count * sizeof(int32_t), 64);
 	memset(page_links_count, 0, pages_count * sizeof(int32_t));
 
-	elements_read = fread(columns, sizeof(int32_t), links_count, matrix_file);
-	assert(elements_read == links_count);
-	elements_read = fread(rows, sizeof(int32_t), (pages_count + 1), matrix_file);
-	assert(elements_read == (pages_count + 1));
-
-	fclose(matrix_file);
-
-	/* Convert 1-based indices of CSR format to 0-base indices */
-	for (size_t link = 0; link < links_count; link++) {
-		columns[link] -= 1;
-	}
-	for (size_t page = 0; page <= pages_count; page++) {
-		rows[page] -= 1;
-	}
-
 	for (size_t link = 0; link < links_count; link++) {
 		const int32_t column_index = columns[link];
 		page_links_count[column_index]++;
@@ -207,7 +228,7 @@ int main(int argc, char** argv) {
 				fflush(stdout);
 			}
 			swap(probabilities_old, probabilities_new);
-			if (vector_max_abs_diff(probabilities_old, probabilities_new, pages_count) < 1.0e-9) {
+			if (blas1_amax_diff(probabilities_old, probabilities_new, pages_count) < 1.0e-9) {
 				printf("Iteration stopped\n");
 				break;
 			}
@@ -231,8 +252,11 @@ int main(int argc, char** argv) {
 	release_aligned_memory(probabilities_new);
 	release_aligned_memory(probabilities_ref);
 	release_aligned_memory(matrix);
-	release_aligned_memory(rows);
-	release_aligned_memory(columns);
+	if (columns_buffer != NULL) {
+		release_aligned_memory(rows_buffer);
+		release_aligned_memory(columns_buffer);
+	}
+	pack_close(matrix_pack);
 
 	dlclose(libprturbo);
 }
@@ -24,6 +24,7 @@
 #include "timer.c"
 
 #include "sort.hh"
+#include "tune.h"
 
 /* ============================================================
  */
@@ -42,6 +43,12 @@ main (int argc, char* argv[])
     return -1;
   }
 
+  /* Settings from sort-tune, if it has been run */
+  sort_base_case = (int) tuneGetLong ("sort", N, "base_case", sort_base_case);
+  sort_partition_min = (int) tuneGetLong ("sort", N, "partition_min", sort_partition_min);
+  sort_merge_base_case = (int) tuneGetLong ("mergesort", N, "base_case", sort_merge_base_case);
+  sort_merge_min = (int) tuneGetLong ("mergesort", N, "merge_min", sort_merge_min);
+
   stopwatch_init ();
   struct stopwatch_t* timer = stopwatch_create (); assert (timer);
 
@@ -50,7 +57,9 @@ main (int argc, char* argv[])
   for (int i = 0; i < N; ++i)
     A_in[i] = lrand48 ();
 
-  printf ("\nN == %d\n\n", N);
+  printf ("\nN == %d\n", N);
+  printf ("Base case: %d keys; sequential partition: up to %d keys\n\n",
+	  sort_base_case, sort_partition_min);
 
   /* Sort sequentially */
   keytype* A_seq = newCopy (N, A_in);
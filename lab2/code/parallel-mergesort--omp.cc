@@ -130,10 +130,9 @@ void pmerge(keytype *arr, int l_start, int l_end, int r_start, int r_end)
   printf("l_start  %3d l_end %3d  r_start %3d r_end %3d l_len %3d r_len %3d\n",
 				 l_start, l_end, r_start, r_end, l_len, r_len);
   printf(" N is %3d\n", N);
-  const int G = 2;
 #endif
 
-  const int G = 10;
+  const int G = sort_merge_min;
   if(N <= G)
   {
 #ifdef DEBUG1
@@ -210,10 +209,9 @@ void mergeSort(int start, int end, keytype* a)
 
 #ifdef DEBUG1
   printf("N  value is %3d\n", N);
-  const int G = 3; 
 #endif
 
-  const int G = 100;
+  const int G = sort_merge_base_case;
   if(N <= G)
   {
     sequentialSort(N, a+start); 
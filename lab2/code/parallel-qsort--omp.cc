@@ -160,7 +160,7 @@ partition (keytype pivot, int N, keytype* A,
   assert (p_n_eq != NULL);
   assert (p_n_gt != NULL);
 
-  const int G = 1024*1024;
+  const int G = sort_partition_min;
   if (N <= G) {
     partition__seq (pivot, N, A, p_n_lt, p_n_eq, p_n_gt);
     return;
@@ -189,7 +189,7 @@ partition (keytype pivot, int N, keytype* A,
 void
 quickSort (int N, keytype* A)
 {
-  const int G = 1024; /* base case size, a tuning parameter */
+  const int G = sort_base_case; /* base case size, a tuning parameter */
   if (N < G)
     sequentialSort (N, A);
   else {
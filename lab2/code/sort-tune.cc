@@ -0,0 +1,107 @@
+/**
+ *  \file sort-tune.cc
+ *  \brief Tunes the base case and partition sizes of parallelSort ()
+ *  for each array length, and saves the fastest settings in the
+ *  tuning config file (see tune.h), which the driver reads at
+ *  startup.
+ *
+ *  Usage: sort-tune [n ...]
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+#include "timer.c"
+
+#include "sort.hh"
+#include "tune.h"
+
+/** Array lengths tuned when none are given */
+static const int SIZES[] = { 1 << 16, 1 << 18, 1 << 20, 1 << 22 };
+static const int BASE_CASE[] = { 64, 256, 1024, 4096, 16384 };
+static const int PARTITION_MIN[] = { 1 << 14, 1 << 16, 1 << 18, 1 << 20, 1 << 22 };
+
+#define LEN(X) ((int)(sizeof (X) / sizeof ((X)[0])))
+
+/** Returns the time to sort a copy of A_in into A, and checks it */
+static long double
+timeSort (int N, const keytype* A_in, keytype* A, const keytype* A_ref,
+	  struct stopwatch_t* timer)
+{
+  memcpy (A, A_in, N * sizeof (keytype));
+  stopwatch_start (timer);
+  parallelSort (N, A);
+  long double t = stopwatch_stop (timer);
+  assertIsEqual (N, A, A_ref);
+  return t;
+}
+
+static void
+tuneSize (int N, struct stopwatch_t* timer)
+{
+  keytype* A_in = newKeys (N);
+  for (int i = 0; i < N; ++i)
+    A_in[i] = lrand48 ();
+  keytype* A_ref = newCopy (N, A_in);
+  sequentialSort (N, A_ref);
+  keytype* A = newKeys (N);
+
+  /* The partition size only matters with more than one thread */
+  const int n_partition = (omp_get_max_threads () > 1) ? LEN (PARTITION_MIN) : 1;
+  const int partition_default = sort_partition_min;
+
+  int best_base = sort_base_case, best_partition = partition_default;
+  long double t_best = -1;
+  for (int i = 0; i < LEN (BASE_CASE); ++i)
+    for (int j = 0; j < n_partition; ++j) {
+      sort_base_case = BASE_CASE[i];
+      sort_partition_min = (n_partition > 1) ? PARTITION_MIN[j] : partition_default;
+      long double t = timeSort (N, A_in, A, A_ref, timer);
+      printf ("%9d  base_case=%-6d partition_min=%-8d %8.3Lf Mkeys/s\n",
+	      N, sort_base_case, sort_partition_min, 1e-6 * N / t);
+      if (t_best < 0 || t < t_best) {
+	t_best = t;
+	best_base = sort_base_case;
+	best_partition = sort_partition_min;
+      }
+    }
+
+  char params[128];
+  snprintf (params, sizeof (params), "base_case=%d partition_min=%d",
+	    best_base, best_partition);
+  printf ("%9d  best: %s\n", N, params);
+  if (tuneSave ("sort", N, params) != 0)
+    fprintf (stderr, "*** Could not write %s ***\n", tuneFile ());
+
+  sort_partition_min = partition_default;
+  free (A);
+  free (A_ref);
+  free (A_in);
+}
+
+int
+main (int argc, char* argv[])
+{
+  stopwatch_init ();
+  struct stopwatch_t* timer = stopwatch_create (); assert (timer);
+  fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+  fprintf (stderr, "Host: %s, config: %s\n", tuneHost (), tuneFile ());
+
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i) {
+      int N = atoi (argv[i]);
+      assert (N > 0);
+      tuneSize (N, timer);
+    }
+  } else {
+    for (int i = 0; i < LEN (SIZES); ++i)
+      tuneSize (SIZES[i], timer);
+  }
+
+  stopwatch_destroy (timer);
+  return 0;
+}
+
+/* eof */
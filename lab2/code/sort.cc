@@ -34,6 +34,15 @@ void sequentialSort (int N, keytype* A)
   qsort (A, N, sizeof (keytype), compare);
 }
 
+/* ============================================================
+ * Tuning parameters (see 'sort.hh').
+ */
+
+int sort_base_case = 1024;
+int sort_partition_min = 1024*1024;
+int sort_merge_base_case = 100;
+int sort_merge_min = 10;
+
 /* ============================================================
  * Some helper routines for managing an array of keys.
  */
@@ -23,6 +23,26 @@ void sequentialSort (int N, keytype* A);
  */
 void parallelSort (int N, keytype* A);
 
+/**
+ *  Tuning parameters of the parallel quicksorts: subarrays of fewer
+ *  than sort_base_case keys are sorted by sequentialSort (), and
+ *  arrays of at most sort_partition_min keys are partitioned
+ *  sequentially. The driver sets them from the tuning config file
+ *  (see tune.h and 'sort-tune.cc').
+ */
+extern int sort_base_case;
+extern int sort_partition_min;
+
+/**
+ *  Tuning parameters of the parallel mergesort: subarrays of at most
+ *  sort_merge_base_case keys are sorted by sequentialSort (), and
+ *  merges of at most sort_merge_min keys are done sequentially. The
+ *  driver sets them from the "mergesort" lines of the tuning config
+ *  file, if there are any.
+ */
+extern int sort_merge_base_case;
+extern int sort_merge_min;
+
 /** Returns a new uninitialized array of length N */
 keytype* newKeys (int N);
 
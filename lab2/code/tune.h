@@ -0,0 +1,62 @@
+/**
+ *  \file tune.h
+ *
+ *  \brief Reads and writes the autotuning config file.
+ *
+ *  The *-tune tools sweep the tuning parameters of a kernel and save
+ *  the fastest setting for each (host, size bucket) pair; the drivers
+ *  read them back at startup. The file is plain text, one setting per
+ *  line:
+ *
+ *    <host> <kernel> <bucket> <param>=<value> [<param>=<value> ...]
+ *
+ *  where <bucket> is floor (log2 (size)), for a size whose meaning
+ *  (elements, keys, matrix dimension) is up to the kernel. Lines that
+ *  start with '#' are comments. A lookup uses the line of this host
+ *  and kernel whose bucket is nearest to that of the given size.
+ *
+ *  The file is TUNE_DEFAULT_FILE in the current directory, or the
+ *  file named by the environment variable TUNE_CONFIG.
+ */
+
+#if !defined (INC_TUNE_H)
+#define INC_TUNE_H
+
+#include <stddef.h>
+
+#define TUNE_DEFAULT_FILE "tune.conf"
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/** \brief Name of the config file. */
+const char* tuneFile (void);
+
+/** \brief Short name of this host, as used in the config file. */
+const char* tuneHost (void);
+
+/** \brief Returns the size bucket of 'size', floor (log2 (size)). */
+int tuneBucket (size_t size);
+
+/**
+ *  \brief Returns the value of 'param' for 'kernel' at 'size', or
+ *  def_val if the config file has none.
+ */
+long tuneGetLong (const char* kernel, size_t size, const char* param,
+                  long def_val);
+
+/**
+ *  \brief Saves 'params' ("<param>=<value> ...") for 'kernel' at
+ *  'size', replacing any earlier line of this host, kernel and
+ *  bucket. Returns 0 on success, or -1 if the file cannot be written.
+ */
+int tuneSave (const char* kernel, size_t size, const char* params);
+
+#if defined (__cplusplus)
+} // extern "C"
+#endif
+
+#endif
+
+/* eof */
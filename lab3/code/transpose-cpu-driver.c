@@ -0,0 +1,189 @@
+/**
+ *  \file transpose-cpu-driver.c
+ *
+ *  \brief Checks and times the CPU transpose library against a naive
+ *  loop, and reports effective bandwidth relative to memcpy().
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#include "timer.h"
+#include "transpose-cpu.h"
+#include "tune.h"
+
+/** Timed repetitions; the fastest one is reported. */
+#define TRIALS 5
+
+/** Rows are padded to a multiple of this many bytes, plus one more. */
+#define PITCH_ALIGN 64
+
+/** Value of the padding bytes; they must survive the transpose. */
+#define PAD_BYTE 0xA5
+
+void
+parseArg (int argc, char** argv, int* M, int* N)
+{
+	if(argc == 2 || argc == 3) {
+		*M = atoi (argv[1]);
+		*N = (argc == 3) ? atoi (argv[2]) : *M;
+		assert (*M > 0 && *N > 0);
+	} else {
+		fprintf (stderr, "usage: %s <M> [<N>]\n", argv[0]);
+		exit (EXIT_FAILURE);
+	}
+}
+
+/** Buffers are aligned to (transparent) huge pages. */
+#define HUGE_PAGE (2 * 1024 * 1024)
+
+/**
+ *  Allocates a buffer backed by huge pages where the OS allows it. A
+ *  transpose touches a new page on nearly every row, so with 4 KiB
+ *  pages it is bound by TLB misses rather than by bandwidth.
+ */
+void*
+allocBuffer (size_t bytes)
+{
+	void* p = NULL;
+	size_t len = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+	if(posix_memalign (&p, HUGE_PAGE, len ? len : HUGE_PAGE)) return NULL;
+#if defined (MADV_HUGEPAGE)
+	madvise (p, len, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+/** Returns a row pitch for rows of 'width' bytes that is not 'width'. */
+size_t
+getPitch (size_t width)
+{
+	return (width + PITCH_ALIGN - 1) / PITCH_ALIGN * PITCH_ALIGN + PITCH_ALIGN;
+}
+
+/** Returns the best of TRIALS runs of memcpy() of 'bytes' bytes. */
+long double
+timeMemcpy (size_t bytes)
+{
+	char* src = (char *) allocBuffer (bytes);
+	char* dst = (char *) allocBuffer (bytes);
+	assert (src && dst);
+	memset (src, 1, bytes);
+	memset (dst, 0, bytes);
+
+	struct stopwatch_t* timer = stopwatch_create ();
+	long double t_best = -1;
+	for(int trial = 0; trial < TRIALS; trial++) {
+		stopwatch_start (timer);
+		memcpy (dst, src, bytes);
+		long double t = stopwatch_stop (timer);
+		if(t_best < 0 || t < t_best) t_best = t;
+	}
+	stopwatch_destroy (timer);
+	free (src);
+	free (dst);
+	return t_best;
+}
+
+/*
+ * The rest is the same for float and double, so it is generated for
+ * each type by DEFINE_BENCH.
+ */
+#define DEFINE_BENCH(NAME, T, TRANSPOSE)				\
+void									\
+naive_##NAME (T* AT, size_t pt, const T* A, size_t p, int M, int N)	\
+{									\
+	for(int i = 0; i < M; i++)					\
+		for(int j = 0; j < N; j++)				\
+			((T *)((char *)AT + j * pt))[i] =		\
+				((const T *)((const char *)A + i * p))[j]; \
+}									\
+									\
+void									\
+bench_##NAME (int M, int N, long double t_memcpy)			\
+{									\
+	const size_t pitch = getPitch (N * sizeof (T));			\
+	const size_t pitch_trans = getPitch (M * sizeof (T));		\
+	char* A = (char *) allocBuffer (M * pitch);			\
+	char* AT = (char *) allocBuffer (N * pitch_trans);		\
+	char* AT_ref = (char *) allocBuffer (N * pitch_trans);		\
+	assert (A && AT && AT_ref);					\
+	for(int i = 0; i < M; i++)					\
+		for(int j = 0; j < N; j++)				\
+			((T *)(A + i * pitch))[j] = (T) (i * N + j);	\
+	memset (AT, PAD_BYTE, N * pitch_trans);				\
+	memset (AT_ref, PAD_BYTE, N * pitch_trans);			\
+									\
+	struct stopwatch_t* timer = stopwatch_create ();		\
+	long double t_naive = -1, t_fast = -1;				\
+	for(int trial = 0; trial < TRIALS; trial++) {			\
+		stopwatch_start (timer);				\
+		naive_##NAME ((T *)AT_ref, pitch_trans, (const T *)A, pitch, M, N); \
+		long double t = stopwatch_stop (timer);			\
+		if(t_naive < 0 || t < t_naive) t_naive = t;		\
+									\
+		stopwatch_start (timer);				\
+		TRANSPOSE ((T *)AT, pitch_trans, (const T *)A, pitch, M, N); \
+		t = stopwatch_stop (timer);				\
+		if(t_fast < 0 || t < t_fast) t_fast = t;		\
+	}								\
+	stopwatch_destroy (timer);					\
+									\
+	/* Exact, including the untouched padding */			\
+	int err = memcmp (AT, AT_ref, N * pitch_trans) != 0;		\
+	const long double bytes = 2.0L * M * N * sizeof (T);		\
+	printf ("%-6s %6d x %-6d naive: %8.3Lf GB/s   %s: %8.3Lf GB/s"	\
+		" (%5.1Lf%% of memcpy)   %s\n",				\
+		#T, M, N, bytes / t_naive * 1e-9, cpuTransposeIsa (),	\
+		bytes / t_fast * 1e-9, 100.0L * t_memcpy / t_fast,	\
+		err ? "FAILED" : "passed");				\
+	if(err) exit (EXIT_FAILURE);					\
+									\
+	free (A);							\
+	free (AT);							\
+	free (AT_ref);							\
+}
+
+DEFINE_BENCH (float, float, cpuTransposeFloat)
+DEFINE_BENCH (double, double, cpuTransposeDouble)
+
+int
+main (int argc, char** argv)
+{
+	int M = -1, N = -1;
+	parseArg (argc, argv, &M, &N);
+
+	/* Leaf and task sizes from transpose-tune, if it has been run */
+	const size_t elems = (size_t)M * N;
+	cpuTransposeSetParams (tuneGetLong ("transpose", elems, "leaf_bytes", 0),
+			       tuneGetLong ("transpose", elems, "task_bytes", 0));
+
+	stopwatch_init ();
+#if defined (_OPENMP)
+	fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+#endif
+	size_t leaf_bytes, task_bytes;
+	cpuTransposeGetParams (&leaf_bytes, &task_bytes);
+	fprintf (stderr, "Leaf bytes: %zu, task bytes: %zu\n", leaf_bytes, task_bytes);
+
+	/* memcpy () reads and writes the same number of bytes as the
+	 * transpose; it is the bandwidth roofline. */
+	long double t_memcpy_f = timeMemcpy ((size_t)M * N * sizeof (float));
+	long double t_memcpy_d = timeMemcpy ((size_t)M * N * sizeof (double));
+	printf ("memcpy %6d x %-6d float: %8.3Lf GB/s   double: %8.3Lf GB/s\n", M, N,
+		2.0L * M * N * sizeof (float) / t_memcpy_f * 1e-9,
+		2.0L * M * N * sizeof (double) / t_memcpy_d * 1e-9);
+
+	bench_float (M, N, t_memcpy_f);
+	bench_double (M, N, t_memcpy_d);
+	return 0;
+}
+
+/* eof */
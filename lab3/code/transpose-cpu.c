@@ -0,0 +1,284 @@
+/**
+ *  \file transpose-cpu.c
+ *
+ *  \brief Cache-oblivious, SIMD-blocked out-of-place transpose; see
+ *  transpose-cpu.h.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE2__)
+#  include <immintrin.h>
+#endif
+
+#include "transpose-cpu.h"
+
+/** Blocks of at most this many bytes (of A) are done without recursing. */
+static size_t leaf_bytes = TRANSPOSE_LEAF_BYTES;
+
+/** Blocks larger than this many bytes (of A) are split into OpenMP tasks. */
+static size_t task_bytes = TRANSPOSE_TASK_BYTES;
+
+/** Splits are rounded to this many rows/columns, so leaves stay tile-aligned. */
+#define SPLIT_ALIGN 8
+
+/** Transposes the m x n block A (pitch p) into AT (pitch pt). */
+typedef void (*leaf_t) (char* AT, size_t pt, const char* A, size_t p,
+			int m, int n);
+
+#define ELEM(T, X, pitch, i, j) (((T *)((X) + (size_t)(i) * (pitch)))[j])
+
+/* =================================================== */
+/*
+ * In-register tile transposes. Each reads a T x T tile of A and
+ * writes its transpose to AT.
+ */
+
+#if defined (__AVX__)
+#  define FLOAT_TILE 8
+#  define DOUBLE_TILE 4
+
+static inline
+void
+tileFloat (char* AT, size_t pt, const char* A, size_t p)
+{
+	__m256 r0 = _mm256_loadu_ps ((const float *)(A + 0*p));
+	__m256 r1 = _mm256_loadu_ps ((const float *)(A + 1*p));
+	__m256 r2 = _mm256_loadu_ps ((const float *)(A + 2*p));
+	__m256 r3 = _mm256_loadu_ps ((const float *)(A + 3*p));
+	__m256 r4 = _mm256_loadu_ps ((const float *)(A + 4*p));
+	__m256 r5 = _mm256_loadu_ps ((const float *)(A + 5*p));
+	__m256 r6 = _mm256_loadu_ps ((const float *)(A + 6*p));
+	__m256 r7 = _mm256_loadu_ps ((const float *)(A + 7*p));
+
+	/* Interleave pairs of rows ... */
+	__m256 t0 = _mm256_unpacklo_ps (r0, r1);
+	__m256 t1 = _mm256_unpackhi_ps (r0, r1);
+	__m256 t2 = _mm256_unpacklo_ps (r2, r3);
+	__m256 t3 = _mm256_unpackhi_ps (r2, r3);
+	__m256 t4 = _mm256_unpacklo_ps (r4, r5);
+	__m256 t5 = _mm256_unpackhi_ps (r4, r5);
+	__m256 t6 = _mm256_unpacklo_ps (r6, r7);
+	__m256 t7 = _mm256_unpackhi_ps (r6, r7);
+
+	/* ... then pairs of pairs, giving 4 x 4 transposes per lane ... */
+	__m256 s0 = _mm256_shuffle_ps (t0, t2, _MM_SHUFFLE (1, 0, 1, 0));
+	__m256 s1 = _mm256_shuffle_ps (t0, t2, _MM_SHUFFLE (3, 2, 3, 2));
+	__m256 s2 = _mm256_shuffle_ps (t1, t3, _MM_SHUFFLE (1, 0, 1, 0));
+	__m256 s3 = _mm256_shuffle_ps (t1, t3, _MM_SHUFFLE (3, 2, 3, 2));
+	__m256 s4 = _mm256_shuffle_ps (t4, t6, _MM_SHUFFLE (1, 0, 1, 0));
+	__m256 s5 = _mm256_shuffle_ps (t4, t6, _MM_SHUFFLE (3, 2, 3, 2));
+	__m256 s6 = _mm256_shuffle_ps (t5, t7, _MM_SHUFFLE (1, 0, 1, 0));
+	__m256 s7 = _mm256_shuffle_ps (t5, t7, _MM_SHUFFLE (3, 2, 3, 2));
+
+	/* ... and finally swap the off-diagonal 128-bit lanes. */
+	_mm256_storeu_ps ((float *)(AT + 0*pt), _mm256_permute2f128_ps (s0, s4, 0x20));
+	_mm256_storeu_ps ((float *)(AT + 1*pt), _mm256_permute2f128_ps (s1, s5, 0x20));
+	_mm256_storeu_ps ((float *)(AT + 2*pt), _mm256_permute2f128_ps (s2, s6, 0x20));
+	_mm256_storeu_ps ((float *)(AT + 3*pt), _mm256_permute2f128_ps (s3, s7, 0x20));
+	_mm256_storeu_ps ((float *)(AT + 4*pt), _mm256_permute2f128_ps (s0, s4, 0x31));
+	_mm256_storeu_ps ((float *)(AT + 5*pt), _mm256_permute2f128_ps (s1, s5, 0x31));
+	_mm256_storeu_ps ((float *)(AT + 6*pt), _mm256_permute2f128_ps (s2, s6, 0x31));
+	_mm256_storeu_ps ((float *)(AT + 7*pt), _mm256_permute2f128_ps (s3, s7, 0x31));
+}
+
+static inline
+void
+tileDouble (char* AT, size_t pt, const char* A, size_t p)
+{
+	__m256d r0 = _mm256_loadu_pd ((const double *)(A + 0*p));
+	__m256d r1 = _mm256_loadu_pd ((const double *)(A + 1*p));
+	__m256d r2 = _mm256_loadu_pd ((const double *)(A + 2*p));
+	__m256d r3 = _mm256_loadu_pd ((const double *)(A + 3*p));
+
+	__m256d t0 = _mm256_unpacklo_pd (r0, r1);
+	__m256d t1 = _mm256_unpackhi_pd (r0, r1);
+	__m256d t2 = _mm256_unpacklo_pd (r2, r3);
+	__m256d t3 = _mm256_unpackhi_pd (r2, r3);
+
+	_mm256_storeu_pd ((double *)(AT + 0*pt), _mm256_permute2f128_pd (t0, t2, 0x20));
+	_mm256_storeu_pd ((double *)(AT + 1*pt), _mm256_permute2f128_pd (t1, t3, 0x20));
+	_mm256_storeu_pd ((double *)(AT + 2*pt), _mm256_permute2f128_pd (t0, t2, 0x31));
+	_mm256_storeu_pd ((double *)(AT + 3*pt), _mm256_permute2f128_pd (t1, t3, 0x31));
+}
+
+#elif defined (__SSE2__)
+#  define FLOAT_TILE 4
+#  define DOUBLE_TILE 2
+
+static inline
+void
+tileFloat (char* AT, size_t pt, const char* A, size_t p)
+{
+	__m128 r0 = _mm_loadu_ps ((const float *)(A + 0*p));
+	__m128 r1 = _mm_loadu_ps ((const float *)(A + 1*p));
+	__m128 r2 = _mm_loadu_ps ((const float *)(A + 2*p));
+	__m128 r3 = _mm_loadu_ps ((const float *)(A + 3*p));
+	_MM_TRANSPOSE4_PS (r0, r1, r2, r3);
+	_mm_storeu_ps ((float *)(AT + 0*pt), r0);
+	_mm_storeu_ps ((float *)(AT + 1*pt), r1);
+	_mm_storeu_ps ((float *)(AT + 2*pt), r2);
+	_mm_storeu_ps ((float *)(AT + 3*pt), r3);
+}
+
+static inline
+void
+tileDouble (char* AT, size_t pt, const char* A, size_t p)
+{
+	__m128d r0 = _mm_loadu_pd ((const double *)(A + 0*p));
+	__m128d r1 = _mm_loadu_pd ((const double *)(A + 1*p));
+	_mm_storeu_pd ((double *)(AT + 0*pt), _mm_unpacklo_pd (r0, r1));
+	_mm_storeu_pd ((double *)(AT + 1*pt), _mm_unpackhi_pd (r0, r1));
+}
+
+#else
+#  define FLOAT_TILE 1
+#  define DOUBLE_TILE 1
+
+static inline
+void
+tileFloat (char* AT, size_t pt, const char* A, size_t p)
+{
+	ELEM (float, AT, pt, 0, 0) = ELEM (const float, A, p, 0, 0);
+}
+
+static inline
+void
+tileDouble (char* AT, size_t pt, const char* A, size_t p)
+{
+	ELEM (double, AT, pt, 0, 0) = ELEM (const double, A, p, 0, 0);
+}
+#endif
+
+/* =================================================== */
+/*
+ * Leaves: full tiles, then scalar loops over the ragged right and
+ * bottom edges.
+ */
+
+#define DEFINE_LEAF(NAME, T, TILE, TILE_FN)				\
+static									\
+void									\
+NAME (char* AT, size_t pt, const char* A, size_t p, int m, int n)	\
+{									\
+	const int m_tiles = m - m % (TILE);				\
+	const int n_tiles = n - n % (TILE);				\
+	for (int i = 0; i < m_tiles; i += (TILE))			\
+		for (int j = 0; j < n_tiles; j += (TILE))		\
+			TILE_FN (AT + (size_t)j * pt + i * sizeof (T), pt, \
+				 A + (size_t)i * p + j * sizeof (T), p); \
+	for (int i = 0; i < m_tiles; ++i)				\
+		for (int j = n_tiles; j < n; ++j)			\
+			ELEM (T, AT, pt, j, i) = ELEM (const T, A, p, i, j); \
+	for (int i = m_tiles; i < m; ++i)				\
+		for (int j = 0; j < n; ++j)				\
+			ELEM (T, AT, pt, j, i) = ELEM (const T, A, p, i, j); \
+}
+
+DEFINE_LEAF (leafFloat, float, FLOAT_TILE, tileFloat)
+DEFINE_LEAF (leafDouble, double, DOUBLE_TILE, tileDouble)
+
+/* =================================================== */
+
+/**
+ *  Halves the longer dimension of the m x n block until it fits in
+ *  leaf_bytes. The halves are independent, so large ones become
+ *  OpenMP tasks.
+ */
+static
+void
+transposeRec (leaf_t leaf, size_t elem, char* AT, size_t pt,
+	      const char* A, size_t p, int m, int n)
+{
+	const size_t bytes = (size_t)m * n * elem;
+	if (bytes <= leaf_bytes || (m == 1 && n == 1)) {
+		leaf (AT, pt, A, p, m, n);
+		return;
+	}
+
+	const int is_rows = (m >= n);
+	const int len = is_rows ? m : n;
+	int half = (len / 2 + SPLIT_ALIGN - 1) / SPLIT_ALIGN * SPLIT_ALIGN;
+	if (half <= 0 || half >= len)
+		half = len / 2;
+
+	const char* A2;
+	char* AT2;
+	int m1 = m, n1 = n, m2 = m, n2 = n;
+	if (is_rows) { /* top rows of A -> left columns of AT */
+		m1 = half;
+		m2 = m - half;
+		A2 = A + (size_t)half * p;
+		AT2 = AT + (size_t)half * elem;
+	} else { /* left columns of A -> top rows of AT */
+		n1 = half;
+		n2 = n - half;
+		A2 = A + (size_t)half * elem;
+		AT2 = AT + (size_t)half * pt;
+	}
+
+	#pragma omp task if (bytes > task_bytes)
+	transposeRec (leaf, elem, AT, pt, A, p, m1, n1);
+	transposeRec (leaf, elem, AT2, pt, A2, p, m2, n2);
+	#pragma omp taskwait
+}
+
+static
+void
+transpose (leaf_t leaf, size_t elem, void* AT, size_t pitch_trans,
+	   const void* A, size_t pitch, int M, int N)
+{
+	assert (M >= 0 && N >= 0);
+	assert (pitch % elem == 0 && pitch_trans % elem == 0);
+	assert (pitch >= N * elem && pitch_trans >= M * elem);
+	if (!M || !N) return;
+
+	#pragma omp parallel if ((size_t)M * N * elem > task_bytes)
+	#pragma omp single
+	transposeRec (leaf, elem, (char *)AT, pitch_trans,
+		      (const char *)A, pitch, M, N);
+}
+
+void
+cpuTransposeFloat (float* AT, size_t pitch_trans,
+		   const float* A, size_t pitch, int M, int N)
+{
+	transpose (leafFloat, sizeof (float), AT, pitch_trans, A, pitch, M, N);
+}
+
+void
+cpuTransposeDouble (double* AT, size_t pitch_trans,
+		    const double* A, size_t pitch, int M, int N)
+{
+	transpose (leafDouble, sizeof (double), AT, pitch_trans, A, pitch, M, N);
+}
+
+void
+cpuTransposeSetParams (size_t leaf, size_t task)
+{
+	leaf_bytes = leaf ? leaf : TRANSPOSE_LEAF_BYTES;
+	task_bytes = task ? task : TRANSPOSE_TASK_BYTES;
+}
+
+void
+cpuTransposeGetParams (size_t* leaf, size_t* task)
+{
+	if (leaf) *leaf = leaf_bytes;
+	if (task) *task = task_bytes;
+}
+
+const char*
+cpuTransposeIsa (void)
+{
+#if defined (__AVX__)
+	return "AVX";
+#elif defined (__SSE2__)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
+
+/* eof */
@@ -0,0 +1,60 @@
+/**
+ *  \file transpose-cpu.h
+ *
+ *  \brief Out-of-place matrix transpose for the CPU.
+ *
+ *  The matrices are row-major with a row pitch given in bytes, as
+ *  with cudaMallocPitch() in transpose.cu: A is M x N, where row i
+ *  starts at (char *)A + i*pitch, and AT is N x M with row pitch
+ *  pitch_trans. Both pitches must be multiples of the element size.
+ *
+ *  Large matrices are split recursively (cache-obliviously) along
+ *  their longer dimension, and the outer pieces of the recursion run
+ *  as OpenMP tasks when compiled with OpenMP. The leaves transpose
+ *  8 x 8 (float) or 4 x 4 (double) tiles in registers, using AVX when
+ *  available and SSE otherwise. The leaf and task sizes can be set
+ *  at run time (see transpose-tune.c).
+ */
+
+#if !defined (INC_TRANSPOSE_CPU_H)
+#define INC_TRANSPOSE_CPU_H
+
+#include <stddef.h>
+
+/** Default bytes of A below which a block is transposed without recursing. */
+#define TRANSPOSE_LEAF_BYTES (16 * 1024)
+
+/** Default bytes of A above which the halves of a block run as OpenMP tasks. */
+#define TRANSPOSE_TASK_BYTES (1024 * 1024)
+
+#if defined (__cplusplus)
+extern "C" {
+#endif
+
+/** \brief AT <- A^T, for an M x N matrix A of floats. */
+void cpuTransposeFloat (float* AT, size_t pitch_trans,
+			const float* A, size_t pitch, int M, int N);
+
+/** \brief AT <- A^T, for an M x N matrix A of doubles. */
+void cpuTransposeDouble (double* AT, size_t pitch_trans,
+			 const double* A, size_t pitch, int M, int N);
+
+/**
+ *  \brief Sets the leaf and task sizes, in bytes of A; 0 restores a
+ *  default. Not thread-safe with respect to running transposes.
+ */
+void cpuTransposeSetParams (size_t leaf_bytes, size_t task_bytes);
+
+/** \brief Gets the leaf and task sizes. */
+void cpuTransposeGetParams (size_t* leaf_bytes, size_t* task_bytes);
+
+/** \brief Name of the SIMD instruction set used by the leaf kernels. */
+const char* cpuTransposeIsa (void);
+
+#if defined (__cplusplus)
+} // extern "C"
+#endif
+
+#endif
+
+/* eof */
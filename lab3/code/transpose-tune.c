@@ -0,0 +1,132 @@
+/**
+ *  \file transpose-tune.c
+ *
+ *  \brief Sweeps the leaf and task sizes of the CPU transpose for
+ *  n x n float matrices, and saves the fastest setting for each size
+ *  in the tuning config file (see tune.h), which transpose-cpu reads
+ *  at startup.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#include "timer.h"
+#include "transpose-cpu.h"
+#include "tune.h"
+
+/** Timed repetitions of each setting; the fastest one counts. */
+#define TRIALS 3
+
+/** Sizes tuned when none are given. */
+static const int SIZES[] = { 256, 512, 1024, 2048, 4096 };
+#define N_SIZES (sizeof (SIZES) / sizeof (SIZES[0]))
+
+static const size_t LEAF_BYTES[] = { 4 << 10, 8 << 10, 16 << 10, 32 << 10, 64 << 10, 128 << 10 };
+#define N_LEAF (sizeof (LEAF_BYTES) / sizeof (LEAF_BYTES[0]))
+
+static const size_t TASK_BYTES[] = { 256 << 10, 1 << 20, 4 << 20, 16 << 20 };
+#define N_TASK (sizeof (TASK_BYTES) / sizeof (TASK_BYTES[0]))
+
+/** Returns the best of TRIALS transposes, or -1 if the result is not ref. */
+long double
+timeSetting (float* AT, const float* A, const float* ref, int n)
+{
+	const size_t pitch = n * sizeof (float);
+	struct stopwatch_t* timer = stopwatch_create ();
+	long double t_best = -1;
+	for(int trial = 0; trial < TRIALS; trial++) {
+		stopwatch_start (timer);
+		cpuTransposeFloat (AT, pitch, A, pitch, n, n);
+		long double t = stopwatch_stop (timer);
+		if(t_best < 0 || t < t_best) t_best = t;
+	}
+	stopwatch_destroy (timer);
+	return memcmp (AT, ref, (size_t)n * n * sizeof (float)) ? -1 : t_best;
+}
+
+/** Tunes size n; returns 0 if every setting gave the right answer. */
+int
+tuneSize (int n)
+{
+	const size_t len = (size_t)n * n;
+	float* A = (float *) malloc (len * sizeof (float));
+	float* AT = (float *) malloc (len * sizeof (float));
+	float* ref = (float *) malloc (len * sizeof (float));
+	assert (A && AT && ref);
+	for(size_t i = 0; i < len; i++)
+		A[i] = (float) i;
+	for(int i = 0; i < n; i++)
+		for(int j = 0; j < n; j++)
+			ref[(size_t)j * n + i] = A[(size_t)i * n + j];
+
+	/* The task size only matters with more than one thread */
+	int n_task = N_TASK;
+#if defined (_OPENMP)
+	if(omp_get_max_threads () == 1)
+#endif
+		n_task = 1;
+
+	int failed = 0;
+	size_t best_leaf = TRANSPOSE_LEAF_BYTES, best_task = TRANSPOSE_TASK_BYTES;
+	long double t_best = -1;
+	for(unsigned int l = 0; l < N_LEAF; l++)
+		for(int k = 0; k < n_task; k++) {
+			const size_t task = (n_task > 1) ? TASK_BYTES[k] : TRANSPOSE_TASK_BYTES;
+			cpuTransposeSetParams (LEAF_BYTES[l], task);
+			long double t = timeSetting (AT, A, ref, n);
+			printf ("%6d %10zu %10zu %10.3Lf\n", n, LEAF_BYTES[l], task,
+				(t > 0) ? 2.0L * len * sizeof (float) / t * 1e-9 : 0.0L);
+			if(t < 0) {
+				failed = 1;
+				continue;
+			}
+			if(t_best < 0 || t < t_best) {
+				t_best = t;
+				best_leaf = LEAF_BYTES[l];
+				best_task = task;
+			}
+		}
+
+	char params[128];
+	snprintf (params, sizeof (params), "leaf_bytes=%zu task_bytes=%zu",
+		  best_leaf, best_task);
+	printf ("%6d best: %s\n", n, params);
+	if(tuneSave ("transpose", len, params) != 0)
+		fprintf (stderr, "*** Could not write %s ***\n", tuneFile ());
+
+	free (A);
+	free (AT);
+	free (ref);
+	return failed;
+}
+
+int
+main (int argc, char** argv)
+{
+	stopwatch_init ();
+#if defined (_OPENMP)
+	fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+#endif
+	fprintf (stderr, "Host: %s, config: %s\n", tuneHost (), tuneFile ());
+
+	printf ("%6s %10s %10s %10s\n", "n", "leaf_bytes", "task_bytes", "GB/s");
+	int failed = 0;
+	if(argc > 1) {
+		for(int i = 1; i < argc; i++)
+			failed |= tuneSize (atoi (argv[i]));
+	} else {
+		for(unsigned int s = 0; s < N_SIZES; s++)
+			failed |= tuneSize (SIZES[s]);
+	}
+	if(failed)
+		fprintf (stderr, "*** Some settings gave a wrong transpose ***\n");
+	return failed ? EXIT_FAILURE : 0;
+}
+
+/* eof */
@@ -0,0 +1,306 @@
+/**
+ *  \file overlap.c
+ *
+ *  \brief Message-size and compute-delay sweep of communication /
+ *  computation overlap between two MPI ranks.
+ *
+ *  This generalizes async.c. For every message size from min_bytes
+ *  to max_bytes (doubling) and every send strategy, rank 0 sends a
+ *  message to rank 1 while "computing" (busy waiting) for a given
+ *  delay, then waits for a zero-byte acknowledgement from rank 1.
+ *  The strategies are:
+ *
+ *  - send:   blocking MPI_Send, then compute (never overlaps).
+ *  - isend:  MPI_Isend, compute, MPI_Wait.
+ *  - test:   MPI_Isend, compute while calling MPI_Test every
+ *            POLL_INTERVAL seconds, MPI_Wait.
+ *  - thread: MPI_Isend, compute while a dedicated progress thread
+ *            calls MPI_Test until the send completes.
+ *
+ *  Each (strategy, size) is first timed with no delay, which gives
+ *  t_comm. It is then timed with delays of DELAY_FACTORS * t_comm.
+ *  The overlap is the fraction of the shorter of the two activities
+ *  that was hidden, i.e., (t_comm + t_delay - t_total) / min (t_comm,
+ *  t_delay); the effective bandwidth is bytes / t_comm. Results go to
+ *  a CSV file (default: overlap.csv).
+ *
+ *  Run on a single host with the shared-memory transport, e.g.,
+ *
+ *    mpirun -np 2 --mca btl self,vader ./overlap
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <mpi.h>
+
+/** Send strategies */
+typedef enum { MODE_SEND = 0, MODE_ISEND, MODE_TEST, MODE_THREAD, N_MODES } mode_t__;
+
+static const char* mode_names__[N_MODES] = { "send", "isend", "test", "thread" };
+
+/** Compute delays to sweep, as multiples of t_comm */
+static const double DELAY_FACTORS[] = { 0.25, 0.5, 1.0, 2.0, 4.0 };
+#define N_DELAYS ((int)(sizeof (DELAY_FACTORS) / sizeof (DELAY_FACTORS[0])))
+
+/** Interval between MPI_Test calls in the 'test' strategy (seconds) */
+static const double POLL_INTERVAL = 1e-5;
+
+static const int MSG_TAG = 1000; /* Arbitrary message tag numbers */
+static const int ACK_TAG = 1001;
+
+/* ============================================================ */
+
+/** Pauses for approximately the specified number of seconds. */
+static
+void
+busywait (const double t_delay)
+{
+  double t_start = MPI_Wtime ();
+  while (MPI_Wtime () - t_start < t_delay)
+    ;
+}
+
+/**
+ *  Same as busywait (), but calls MPI_Test on *req every
+ *  POLL_INTERVAL seconds to drive the progress engine.
+ */
+static
+void
+busywaitPolling (const double t_delay, MPI_Request* req)
+{
+  int done = 0;
+  double t_start = MPI_Wtime ();
+  double t_poll = t_start;
+  double t_now;
+  while ((t_now = MPI_Wtime ()) - t_start < t_delay) {
+    if (!done && t_now - t_poll >= POLL_INTERVAL) {
+      MPI_Test (req, &done, MPI_STATUS_IGNORE);
+      t_poll = t_now;
+    }
+  }
+}
+
+/* ============================================================
+ * Dedicated progress thread. The main thread hands it a request by
+ * setting 'req' and then 'state' to PROGRESS_ACTIVE; the progress
+ * thread tests the request until completion and sets 'state' back
+ * to PROGRESS_IDLE. Both threads spin, so that the hand-off costs
+ * only a cache-line transfer, but the idle thread yields, so that it
+ * does not starve the other strategies when cores are oversubscribed.
+ */
+
+enum { PROGRESS_IDLE = 0, PROGRESS_ACTIVE, PROGRESS_EXIT };
+
+static MPI_Request progress_req__;
+static int progress_state__ = PROGRESS_IDLE;
+
+static
+void *
+progressThread__ (void* arg)
+{
+  int state;
+  while ((state = __atomic_load_n (&progress_state__, __ATOMIC_ACQUIRE)) != PROGRESS_EXIT) {
+    if (state == PROGRESS_ACTIVE) {
+      int done = 0;
+      while (!done)
+	MPI_Test (&progress_req__, &done, MPI_STATUS_IGNORE);
+      __atomic_store_n (&progress_state__, PROGRESS_IDLE, __ATOMIC_RELEASE);
+    } else {
+      sched_yield ();
+    }
+  }
+  return NULL;
+}
+
+/* ============================================================ */
+
+/**
+ *  Times one message exchange of 'len' bytes, with the given
+ *  strategy and compute delay. Returns the elapsed time on rank 0
+ *  (including the acknowledgement), and 0 on rank 1.
+ */
+static
+double
+overlapTest (mode_t__ mode, const double t_delay, const int rank,
+	     char* msgbuf, const int len)
+{
+  MPI_Barrier (MPI_COMM_WORLD);
+  if (rank == 1) {
+    MPI_Recv (msgbuf, len, MPI_BYTE, 0, MSG_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    MPI_Send (NULL, 0, MPI_BYTE, 0, ACK_TAG, MPI_COMM_WORLD);
+    return 0;
+  }
+
+  double t_start = MPI_Wtime ();
+  MPI_Request req;
+  switch (mode) {
+  case MODE_SEND:
+    MPI_Send (msgbuf, len, MPI_BYTE, 1, MSG_TAG, MPI_COMM_WORLD);
+    busywait (t_delay);
+    break;
+  case MODE_ISEND:
+    MPI_Isend (msgbuf, len, MPI_BYTE, 1, MSG_TAG, MPI_COMM_WORLD, &req);
+    busywait (t_delay);
+    MPI_Wait (&req, MPI_STATUS_IGNORE);
+    break;
+  case MODE_TEST:
+    MPI_Isend (msgbuf, len, MPI_BYTE, 1, MSG_TAG, MPI_COMM_WORLD, &req);
+    busywaitPolling (t_delay, &req);
+    MPI_Wait (&req, MPI_STATUS_IGNORE);
+    break;
+  case MODE_THREAD:
+    MPI_Isend (msgbuf, len, MPI_BYTE, 1, MSG_TAG, MPI_COMM_WORLD, &progress_req__);
+    __atomic_store_n (&progress_state__, PROGRESS_ACTIVE, __ATOMIC_RELEASE);
+    busywait (t_delay);
+    while (__atomic_load_n (&progress_state__, __ATOMIC_ACQUIRE) != PROGRESS_IDLE)
+      ;
+    break;
+  default:
+    assert (0);
+  }
+  MPI_Recv (NULL, 0, MPI_BYTE, 1, ACK_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  return MPI_Wtime () - t_start;
+}
+
+/** Returns the minimum time over 'trials' runs of overlapTest (). */
+static
+double
+overlapTestMin (mode_t__ mode, const double t_delay, const int rank,
+		char* msgbuf, const int len, const int trials)
+{
+  double t_min = -1;
+  for (int trial = 0; trial < trials; ++trial) {
+    double t = overlapTest (mode, t_delay, rank, msgbuf, len);
+    if (t_min < 0 || t < t_min)
+      t_min = t;
+  }
+  return t_min;
+}
+
+/** Returns the number of trials to run for a message of len bytes. */
+static
+int
+getTrials (long len, int max_trials)
+{
+  /* Keep roughly <= 64 MiB of traffic per data point */
+  long trials = (64L << 20) / (len ? len : 1);
+  if (trials > max_trials) trials = max_trials;
+  return (trials < 3) ? 3 : (int)trials;
+}
+
+/* ============================================================ */
+
+static
+void
+usage__ (const char* progname)
+{
+  fprintf (stderr, "\n");
+  fprintf (stderr, "usage: %s [<min_bytes> [<max_bytes> [<max_trials> [<outfile>]]]]\n",
+	   progname);
+  fprintf (stderr, "\n");
+  fprintf (stderr, "Defaults: 8 B to 256 MiB, at most 100 trials, 'overlap.csv'.\n");
+  fprintf (stderr, "\n");
+}
+
+/** Program start */
+int
+main (int argc, char *argv[])
+{
+  int rank = 0;
+  int np = 0;
+
+  long min_bytes = 8;
+  long max_bytes = 256L << 20;
+  int max_trials = 100;
+  const char* outfile = "overlap.csv";
+
+  int thread_level;
+  MPI_Init_thread (&argc, &argv, MPI_THREAD_MULTIPLE, &thread_level);
+  MPI_Comm_rank (MPI_COMM_WORLD, &rank);
+  MPI_Comm_size (MPI_COMM_WORLD, &np);
+
+  if (np != 2 || argc > 5) {
+    if (rank == 0) {
+      if (np != 2) fprintf (stderr, "*** This benchmark needs exactly 2 processes ***\n");
+      usage__ (argv[0]);
+    }
+    MPI_Abort (MPI_COMM_WORLD, 1);
+  }
+  if (argc > 1) min_bytes = atol (argv[1]);
+  if (argc > 2) max_bytes = atol (argv[2]);
+  if (argc > 3) max_trials = atoi (argv[3]);
+  if (argc > 4) outfile = argv[4];
+  assert (min_bytes > 0 && min_bytes <= max_bytes && max_bytes <= (1L << 30));
+  assert (max_trials > 0);
+
+  const int has_thread = (thread_level == MPI_THREAD_MULTIPLE);
+  pthread_t progress_thread;
+  if (rank == 0) {
+    if (has_thread) {
+      int retcode = pthread_create (&progress_thread, NULL, progressThread__, NULL);
+      assert (retcode == 0);
+    } else {
+      fprintf (stderr, "*** MPI_THREAD_MULTIPLE unavailable; skipping 'thread' ***\n");
+    }
+  }
+
+  char* msgbuf = (char *)malloc (max_bytes);
+  assert (msgbuf);
+  memset (msgbuf, rank, max_bytes);
+
+  FILE* fp = NULL; /* output file, only valid on rank 0 */
+  if (rank == 0) {
+    fp = fopen (outfile, "w");
+    assert (fp != NULL);
+    fprintf (fp, "mode,bytes,t_delay,t_total,t_comm,overlap_pct,bandwidth_MBps\n");
+  }
+
+  for (long len = min_bytes; len <= max_bytes; len *= 2) {
+    const int trials = getTrials (len, max_trials);
+    for (int mode = 0; mode < N_MODES; ++mode) {
+      if (mode == MODE_THREAD && !has_thread)
+	continue;
+
+      double t_comm = overlapTestMin (mode, 0, rank, msgbuf, len, trials);
+      MPI_Bcast (&t_comm, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+      const double bw = 1e-6 * len / t_comm;
+      if (rank == 0) {
+	fprintf (fp, "%s,%ld,%g,%g,%g,%g,%g\n", mode_names__[mode], len,
+		 0.0, t_comm, t_comm, 0.0, bw);
+	fprintf (stderr, "%-6s %10ld bytes: t_comm = %g s (%g MB/s)\n",
+		 mode_names__[mode], len, t_comm, bw);
+      }
+
+      for (int d = 0; d < N_DELAYS; ++d) {
+	const double t_delay = DELAY_FACTORS[d] * t_comm;
+	const double t_total = overlapTestMin (mode, t_delay, rank, msgbuf, len, trials);
+	if (rank == 0) {
+	  double t_hidden = t_comm + t_delay - t_total;
+	  double overlap = 100.0 * t_hidden / ((t_comm < t_delay) ? t_comm : t_delay);
+	  if (overlap < 0) overlap = 0;
+	  if (overlap > 100) overlap = 100;
+	  fprintf (fp, "%s,%ld,%g,%g,%g,%g,%g\n", mode_names__[mode], len,
+		   t_delay, t_total, t_comm, overlap, bw);
+	}
+      }
+      if (rank == 0) fflush (fp);
+    }
+  }
+
+  if (rank == 0) {
+    fclose (fp);
+    if (has_thread) {
+      __atomic_store_n (&progress_state__, PROGRESS_EXIT, __ATOMIC_RELEASE);
+      pthread_join (progress_thread, NULL);
+    }
+  }
+  free (msgbuf);
+  MPI_Finalize ();
+  return 0;
+}
+
+/* eof */
@@ -0,0 +1,26 @@
+# Plots the output of 'overlap' (overlap.csv), one curve per strategy.
+set term png
+set datafile separator ","
+set key autotitle columnhead
+set grid
+set logscale x 2
+set xlabel "Message size (bytes)"
+
+# Effective bandwidth, from the zero-delay runs
+set output 'overlap-bw.png'
+set title "Effective Bandwidth"
+set ylabel "MB/s"
+set key left top
+plot for [m in "send isend test thread"] "overlap.csv" \
+     using 2:(strcol(1) eq m && $3 == 0 ? $7 : 1/0) title m with linespoints
+
+# Overlap when the compute delay equals the communication time
+set output 'overlap-pct.png'
+set title "Overlap at t_delay = t_comm"
+set ylabel "Overlap (%)"
+set yrange [0:105]
+plot for [m in "send isend test thread"] "overlap.csv" \
+     using 2:(strcol(1) eq m && $3 > 0 && abs ($3 - $5) <= 1e-3 * $5 ? $6 : 1/0) \
+     title m with linespoints
+
+# eof
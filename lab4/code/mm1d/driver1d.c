@@ -24,6 +24,7 @@
 
 #include "mat.h" // sequential algorithm
 #include "mm1d.h" // 1D block column algorithm
+#include "tune.h" // settings found by mat-tune
 
 /* ------------------------------------------------------------ */
 
@@ -78,6 +79,20 @@ main (int argc, char** argv)
   MPI_Bcast (&K, 1, MPI_INT, 0, MPI_COMM_WORLD);
   mpih_debugmsg (MPI_COMM_WORLD, "Matrix dimensions: M=%d, N=%d, K=%d\n", M, N, K);
 
+  /* p0 also reads the tuned blocking of the sequential multiply */
+  int blocking[3];
+  if (rank == 0) {
+    const int size = min_int (M, min_int (N, K));
+    blocking[0] = (int)tuneGetLong ("mat", size, "mc", 0);
+    blocking[1] = (int)tuneGetLong ("mat", size, "kc", 0);
+    blocking[2] = (int)tuneGetLong ("mat", size, "nc", 0);
+  }
+  MPI_Bcast (blocking, 3, MPI_INT, 0, MPI_COMM_WORLD);
+  mat_setBlocking (blocking[0], blocking[1], blocking[2]);
+  mat_getBlocking (&blocking[0], &blocking[1], &blocking[2]);
+  mpih_debugmsg (MPI_COMM_WORLD, "Blocking: mc=%d, kc=%d, nc=%d\n",
+		 blocking[0], blocking[1], blocking[2]);
+
   verify__ (M, N, K);
   benchmark__ (M, N, K);
 
@@ -121,6 +136,48 @@ static void setupSeqProblem__ (int m, int n, int k,
 			       double** p_A, double** p_B,
 			       double** p_C, double** p_C_bound);
 
+/**
+ *  \brief Checks that scattering the m x n matrix A (on p0) in a
+ *  block-cyclic layout and gathering it back is exact, and that
+ *  writing the local blocks with mm1d_write() and reading them back
+ *  with mm1d_read() is exact and stores A in column-major order.
+ */
+static
+void
+verifyLayouts__ (int m, int n, const double* A, MPI_Comm comm)
+{
+  int rank = mpih_getRank (comm);
+  int P = mpih_getSize (comm);
+  const int nb = 3; /* Deliberately leaves a partial last block */
+  const int n_local = mm1d_getLayoutLength (n, nb, P, rank);
+  double* A_local = (double *)malloc (m * n_local * sizeof (double));
+  double* A_copy = (rank == 0) ? mat_create (m, n) : NULL;
+  mpih_assert (A_local || !n_local);
+
+  mm1d_scatter (m, n, nb, A, m, A_local, comm);
+  mm1d_gather (m, n, nb, A_local, A_copy, m, comm);
+  if (rank == 0)
+    mpih_assert (memcmp (A, A_copy, m * n * sizeof (double)) == 0);
+
+  const char* filename = "mm1d-verify.dat";
+  double* A_read = (double *)malloc (m * n_local * sizeof (double));
+  mpih_assert (A_read || !n_local);
+  mm1d_write (filename, m, n, nb, A_local, comm);
+  mm1d_read (filename, m, n, nb, A_read, comm);
+  mpih_assert (memcmp (A_local, A_read, m * n_local * sizeof (double)) == 0);
+  if (rank == 0) {
+    FILE* fp = fopen (filename, "rb");
+    mpih_assert (fp != NULL);
+    mpih_assert (fread (A_copy, sizeof (double), m * n, fp) == (size_t)(m * n));
+    fclose (fp);
+    mpih_assert (memcmp (A, A_copy, m * n * sizeof (double)) == 0);
+    remove (filename);
+    mat_free (A_copy);
+  }
+  free (A_read);
+  free (A_local);
+}
+
 static
 void
 verify__ (int m, int n, int k)
@@ -157,35 +214,41 @@ verify__ (int m, int n, int k)
   double* C_local = mm1d_alloc (m, n, comm);
   mm1d_setZero (m, n, C_local, comm);
 
-  /* Do multiply */
+  /* Do multiply, twice, to check that the plan can be reused */
   if (rank == 0) mpih_debugmsg (comm, "Computing C <- C + A*B...\n");
-  mm1d_mult (m, n, k, A_local, B_local, C_local, comm, NULL, NULL);
+  mm1d_plan_t* plan = mm1d_plan_create (m, n, k, comm);
+  mm1d_plan_execute (plan, A_local, B_local, C_local, NULL, NULL);
+  mm1d_setZero (m, n, C_local, comm);
+  mm1d_plan_execute (plan, A_local, B_local, C_local, NULL, NULL);
+  mm1d_plan_destroy (plan);
 
-  /* Compare the two answers (in parallel) */
+  /* Collect the answer on p0 and compare it to the trusted one */
   if (rank == 0) mpih_debugmsg (comm, "Verifying...\n");
-  int P = mpih_getSize (comm);
-  double* C_soln_local = mm1d_distribute (m, n, C_soln, comm);
-  double* C_bound_local = mm1d_distribute (m, n, C_bound, comm);
-  for (int i = 0; i < m; ++i) {
-    int n_local = mm1d_getBlockLength (n, P, rank);
-    for (int j = 0; j < n_local; ++j) {
-      const double errbound = C_bound_local[i + j*m] * 3.0 * k * DBL_EPSILON;
-      const double c_trusted = C_soln_local[i + j*m]; 
-      const double c_untrusted = C_local[i + j*m];
-      double delta = fabs (c_untrusted - c_trusted);
-      if (delta > errbound)
-	mpih_debugmsg (comm,
-		       "*** Entry (%d, %d) --- Error bound violated ***\n    ==> |%g - %g| == %g > %g\n",
-		       c_untrusted, c_trusted, delta, errbound, i, j);
-      mpih_assert (delta <= errbound);
+  double* C = (rank == 0) ? mat_create (m, n) : NULL;
+  mm1d_gather (m, n, 0, C_local, C, m, comm);
+  if (rank == 0) {
+    for (int j = 0; j < n; ++j) {
+      for (int i = 0; i < m; ++i) {
+	const double errbound = C_bound[i + j*m] * 3.0 * k * DBL_EPSILON;
+	const double c_trusted = C_soln[i + j*m];
+	const double c_untrusted = C[i + j*m];
+	double delta = fabs (c_untrusted - c_trusted);
+	if (delta > errbound)
+	  mpih_debugmsg (comm,
+			 "*** Entry (%d, %d) --- Error bound violated ***\n    ==> |%g - %g| == %g > %g\n",
+			 i, j, c_untrusted, c_trusted, delta, errbound);
+	mpih_assert (delta <= errbound);
+      }
     }
   }
+  verifyLayouts__ (m, k, A, comm);
   if (rank == 0) mpih_debugmsg (comm, "Passed!\n");
 
   /* Cleanup */
   if (rank == 0) {
     free (A);
     free (B);
+    free (C);
     free (C_soln);
     free (C_bound);
   }
@@ -273,13 +336,15 @@ benchmark__ (int m, int n, int k)
   const int COMM = 2;
   double t[3];  bzero (t, sizeof (t));
 
+  mm1d_plan_t* plan = mm1d_plan_create (m, n, k, comm);
   const int MAX_TRIALS = 10;
   for (int trial = 0; trial < MAX_TRIALS; ++trial) {
     mm1d_setZero (m, n, C_local, comm);
     double t_start = MPI_Wtime ();
-    mm1d_mult (m, n, k, A_local, B_local, C_local, comm, &t[COMP], &t[COMM]);
+    mm1d_plan_execute (plan, A_local, B_local, C_local, &t[COMP], &t[COMM]);
     t[TOTAL] += MPI_Wtime () - t_start;
   }
+  mm1d_plan_destroy (plan);
   t[TOTAL] /= MAX_TRIALS;
   t[COMP] /= MAX_TRIALS;
   t[COMM] /= MAX_TRIALS;
@@ -0,0 +1,168 @@
+/**
+ *  \file mat-bench.c
+ *  \brief Compares the classical (mat_multiply) and Strassen-Winograd
+ *  (mat_multiplyStrassen) sequential multiplies on n x n matrices, for
+ *  n = n_min, 2*n_min, ..., n_max, and checks their accuracy against
+ *  the error bound of mat_multiplyErrorbound.
+ *
+ *  Usage: mat-bench [n_min [n_max [crossover]]]
+ *
+ *  The blocking and crossover found by mat-tune for each n are used,
+ *  unless the crossover is given on the command line or by the
+ *  environment variable MAT_STRASSEN_CROSSOVER.
+ */
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mat.h"
+#include "tune.h"
+#include "util.h"
+
+/** Rows of C checked against mat_multiplyErrorbound, which is O(n^3) naive. */
+#define CHECK_ROWS 64
+
+static
+double
+getTime__ (void)
+{
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/** Returns the largest |X(i,j)| of an m x n matrix. */
+static
+double
+maxAbs__ (int m, int n, const double* X, int ldx)
+{
+  double x_max = 0.0;
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < m; ++i)
+      x_max = fmax (x_max, fabs (X[i + (size_t)j*ldx]));
+  return x_max;
+}
+
+/**
+ *  Compares the first CHECK_ROWS rows of C against C_ref. Returns the
+ *  largest |error| / (k*u*C_bound), the elementwise bound of the
+ *  classical algorithm, and stores in *p_norm the largest |error| /
+ *  (u*max|A|*max|B|).
+ */
+static
+double
+checkRows__ (int rows, int n, int k, const double* C, int ldc,
+	     const double* C_ref, const double* C_bound,
+	     double ab_max, double* p_norm)
+{
+  const double u = DBL_EPSILON / 2;
+  double ratio = 0.0, err_max = 0.0;
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < rows; ++i) {
+      const double err = fabs (C[i + (size_t)j*ldc] - C_ref[i + (size_t)j*rows]);
+      const double bound = k * u * C_bound[i + (size_t)j*rows];
+      err_max = fmax (err_max, err);
+      ratio = fmax (ratio, (bound > 0) ? err / bound : (err > 0 ? INFINITY : 0));
+    }
+  *p_norm = err_max / (u * ab_max);
+  return ratio;
+}
+
+/** Returns the Strassen-Winograd normwise error factor for n x n (Higham, 23.2.2). */
+static
+double
+winogradFactor__ (int n)
+{
+  int n0 = n, levels = 0;
+  while (n0 > mat_getStrassenCrossover ()) {
+    n0 /= 2;
+    ++levels;
+  }
+  return pow (18.0, levels) * ((double)n0 * n0 + 6.0 * n0) + 6.0 * n;
+}
+
+int
+main (int argc, char** argv)
+{
+  const int n_min = (argc > 1) ? atoi (argv[1]) : 512;
+  const int n_max = (argc > 2) ? atoi (argv[2]) : 8192;
+  const int crossover = (argc > 3) ? atoi (argv[3])
+    : env_getInt ("MAT_STRASSEN_CROSSOVER", 0);
+  if (n_min < 1 || n_max < n_min) {
+    fprintf (stderr, "usage: %s [n_min [n_max [crossover]]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  printf ("%6s %12s %9s %12s %9s %8s %11s %11s %11s\n",
+	  "n", "t_classical", "GFLOP/s", "t_strassen", "GFLOP/s", "speedup",
+	  "err_cl/bnd", "err_st/bnd", "err_st/nrm");
+
+  srand48 (2013);
+  int ok = 1;
+  for (int n = n_min; n <= n_max; n *= 2) {
+    mat_setBlocking ((int)tuneGetLong ("mat", n, "mc", 0),
+		     (int)tuneGetLong ("mat", n, "kc", 0),
+		     (int)tuneGetLong ("mat", n, "nc", 0));
+    mat_setStrassenCrossover (crossover > 0 ? crossover
+			      : (int)tuneGetLong ("mat", n, "crossover", MAT_STRASSEN_CROSSOVER));
+    int mc, kc, nc;
+    mat_getBlocking (&mc, &kc, &nc);
+    fprintf (stderr, "n=%d: blocking mc=%d kc=%d nc=%d, Strassen crossover %d\n",
+	     n, mc, kc, nc, mat_getStrassenCrossover ());
+
+    double* A = mat_create (n, n);
+    double* B = mat_create (n, n);
+    double* C = mat_create (n, n);
+    double* C_st = mat_create (n, n);
+    const int rows = (n < CHECK_ROWS) ? n : CHECK_ROWS;
+    double* C_ref = mat_create (rows, n);
+    double* C_bound = mat_create (rows, n);
+    mat_randomize (n, n, A);
+    mat_randomize (n, n, B);
+    mat_setZero (n, n, C);
+    mat_setZero (n, n, C_st);
+
+    mat_arena_t* arena = mat_arena_create (mat_strassenWorkspace (n, n, n));
+
+    double t_start = getTime__ ();
+    mat_multiply (n, n, n, A, n, B, n, C, n);
+    const double t_cl = getTime__ () - t_start;
+
+    t_start = getTime__ ();
+    mat_multiplyStrassen (n, n, n, A, n, B, n, C_st, n, arena);
+    const double t_st = getTime__ () - t_start;
+
+    mat_arena_destroy (arena);
+
+    /* A strip of the reference, from the leading rows of A */
+    mat_multiplyErrorbound (rows, n, n, A, n, B, n, C_ref, rows, C_bound, rows);
+    const double ab_max = maxAbs__ (n, n, A, n) * maxAbs__ (n, n, B, n);
+    double norm_cl, norm_st;
+    const double ratio_cl = checkRows__ (rows, n, n, C, n, C_ref, C_bound, ab_max, &norm_cl);
+    const double ratio_st = checkRows__ (rows, n, n, C_st, n, C_ref, C_bound, ab_max, &norm_st);
+
+    const double flops = 2.0 * n * n * n;
+    printf ("%6d %12.4f %9.2f %12.4f %9.2f %8.2f %11.3g %11.3g %11.3g\n",
+	    n, t_cl, flops / t_cl * 1e-9, t_st, flops / t_st * 1e-9, t_cl / t_st,
+	    ratio_cl, ratio_st, norm_st);
+    fflush (stdout);
+
+    /* The reference itself has error up to the bound, so allow twice it */
+    ok &= ratio_cl <= 2.0 && norm_st <= 2.0 * winogradFactor__ (n);
+
+    mat_free (A);
+    mat_free (B);
+    mat_free (C);
+    mat_free (C_st);
+    mat_free (C_ref);
+    mat_free (C_bound);
+  }
+
+  printf ("%s\n", ok ? "Correct answer" : "Incorrect answer");
+  return ok ? 0 : EXIT_FAILURE;
+}
+
+/* eof */
@@ -0,0 +1,148 @@
+/**
+ *  \file mat-tune.c
+ *  \brief Tunes the sequential multiplies of mat.c for n x n matrices
+ *  and saves the fastest settings for each n in the tuning config file
+ *  (see tune.h), which mm1d and mat-bench read at startup.
+ *
+ *  Usage: mat-tune [n ...]
+ *
+ *  The cache blocking of mat_multiply is tuned first, with mc and kc
+ *  swept together and then nc; the Strassen crossover is then swept
+ *  with that blocking. A crossover of n means that mat_multiplyStrassen
+ *  is no faster than mat_multiply at this size.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mat.h"
+#include "tune.h"
+
+/** Timed repetitions of each setting; the fastest one counts. */
+#define TRIALS 2
+
+static const int SIZES[] = { 256, 512, 1024, 2048 };
+static const int MC[] = { 64, 96, 128, 192, 256 };
+static const int KC[] = { 128, 192, 256, 384, 512 };
+static const int NC[] = { 510, 1020, 2040, 4080 };
+static const int CROSSOVER[] = { 128, 256, 512, 1024, 2048 };
+
+#define LEN(X) ((int)(sizeof (X) / sizeof ((X)[0])))
+
+static
+double
+getTime__ (void)
+{
+  struct timespec t;
+  clock_gettime (CLOCK_MONOTONIC, &t);
+  return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+/** Returns the best of TRIALS runs of C <- A*B, classical or Strassen. */
+static
+double
+timeMultiply__ (int n, const double* A, const double* B, double* C,
+		int strassen, mat_arena_t* arena)
+{
+  double t_best = -1;
+  for (int trial = 0; trial < TRIALS; ++trial) {
+    mat_setZero (n, n, C);
+    const double t_start = getTime__ ();
+    if (strassen)
+      mat_multiplyStrassen (n, n, n, A, n, B, n, C, n, arena);
+    else
+      mat_multiply (n, n, n, A, n, B, n, C, n);
+    const double t = getTime__ () - t_start;
+    if (t_best < 0 || t < t_best) t_best = t;
+  }
+  return t_best;
+}
+
+static
+void
+tuneSize__ (int n)
+{
+  double* A = mat_create (n, n);
+  double* B = mat_create (n, n);
+  double* C = mat_create (n, n);
+  mat_randomize (n, n, A);
+  mat_randomize (n, n, B);
+  const double gflop = 2e-9 * n * n * n;
+
+  int best_mc = MAT_BLOCK_MC, best_kc = MAT_BLOCK_KC, best_nc = MAT_BLOCK_NC;
+  double t_best = -1;
+  for (int i = 0; i < LEN (MC); ++i)
+    for (int j = 0; j < LEN (KC); ++j) {
+      mat_setBlocking (MC[i], KC[j], best_nc);
+      const double t = timeMultiply__ (n, A, B, C, 0, NULL);
+      printf ("%6d  mc=%-4d kc=%-4d nc=%-5d %8.2f GFLOP/s\n",
+	      n, MC[i], KC[j], best_nc, gflop / t);
+      if (t_best < 0 || t < t_best) {
+	t_best = t;
+	best_mc = MC[i];
+	best_kc = KC[j];
+      }
+    }
+  for (int i = 0; i < LEN (NC); ++i) {
+    if (NC[i] == best_nc)
+      continue;
+    mat_setBlocking (best_mc, best_kc, NC[i]);
+    const double t = timeMultiply__ (n, A, B, C, 0, NULL);
+    printf ("%6d  mc=%-4d kc=%-4d nc=%-5d %8.2f GFLOP/s\n",
+	    n, best_mc, best_kc, NC[i], gflop / t);
+    if (t < t_best) {
+      t_best = t;
+      best_nc = NC[i];
+    }
+  }
+  mat_setBlocking (best_mc, best_kc, best_nc);
+
+  /* Strassen only pays off with at least one level of recursion */
+  int best_crossover = n;
+  for (int i = 0; i < LEN (CROSSOVER) && 2 * CROSSOVER[i] <= n; ++i) {
+    mat_setStrassenCrossover (CROSSOVER[i]);
+    mat_arena_t* arena = mat_arena_create (mat_strassenWorkspace (n, n, n));
+    const double t = timeMultiply__ (n, A, B, C, 1, arena);
+    mat_arena_destroy (arena);
+    printf ("%6d  crossover=%-5d %8.2f GFLOP/s (effective)\n",
+	    n, CROSSOVER[i], gflop / t);
+    if (t < t_best) {
+      t_best = t;
+      best_crossover = CROSSOVER[i];
+    }
+  }
+
+  char params[128];
+  snprintf (params, sizeof (params), "mc=%d kc=%d nc=%d crossover=%d",
+	    best_mc, best_kc, best_nc, best_crossover);
+  printf ("%6d  best: %s\n", n, params);
+  fflush (stdout);
+  if (tuneSave ("mat", n, params) != 0)
+    fprintf (stderr, "*** Could not write %s ***\n", tuneFile ());
+
+  mat_free (A);
+  mat_free (B);
+  mat_free (C);
+}
+
+int
+main (int argc, char** argv)
+{
+  srand48 (2013);
+  fprintf (stderr, "Host: %s, config: %s\n", tuneHost (), tuneFile ());
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i) {
+      const int n = atoi (argv[i]);
+      assert (n > 0);
+      tuneSize__ (n);
+    }
+  } else {
+    for (int i = 0; i < LEN (SIZES); ++i)
+      tuneSize__ (SIZES[i]);
+  }
+  return 0;
+}
+
+/* eof */
@@ -9,10 +9,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+#if defined (__AVX2__) && defined (__FMA__)
+#  include <immintrin.h>
+#endif
+
 #include "mat.h"
 
 /* ------------------------------------------------------------ */
 
+#define MAT_MR 8   /*!< Rows of a micro-tile of the classical multiply */
+#define MAT_NR 6   /*!< Columns of a micro-tile */
+
+/** Cache blocking of the classical multiply (unused with MKL) */
+static int block_mc__ = MAT_BLOCK_MC;
+static int block_kc__ = MAT_BLOCK_KC;
+static int block_nc__ = MAT_BLOCK_NC;
+
+void
+mat_setBlocking (int mc, int kc, int nc)
+{
+  block_mc__ = (mc > 0) ? (mc + MAT_MR - 1) / MAT_MR * MAT_MR : MAT_BLOCK_MC;
+  block_kc__ = (kc > 0) ? kc : MAT_BLOCK_KC;
+  block_nc__ = (nc > 0) ? (nc + MAT_NR - 1) / MAT_NR * MAT_NR : MAT_BLOCK_NC;
+}
+
+void
+mat_getBlocking (int* mc, int* kc, int* nc)
+{
+  if (mc) *mc = block_mc__;
+  if (kc) *kc = block_kc__;
+  if (nc) *nc = block_nc__;
+}
+
+/* ------------------------------------------------------------ */
+
 #if defined(USE_MKL)
 
 extern void dgemm_ (const char* transa, const char* transb,
@@ -35,6 +69,114 @@ mat_multiply (int m, int n, int k,
   dgemm_ ("N", "N", &m, &n, &k, &ONE, A, &lda, B, &ldb, &ONE, C, &ldc);
 }
 #else
+
+/*
+ * Blocked classical multiply, in the style of GotoBLAS: a KC x NC
+ * panel of B and an MC x KC block of A are packed into contiguous
+ * buffers (zero-padded to whole micro-tiles), and an MR x NR
+ * micro-kernel then updates C from the packed data.
+ */
+
+/** Per-thread packing buffer, grown on demand and reused. */
+static __thread double* pack_buf__ = NULL;
+static __thread size_t pack_len__ = 0;
+
+static
+double *
+getPackBuffer__ (size_t len)
+{
+  if (len > pack_len__) {
+    free (pack_buf__);
+    pack_buf__ = NULL;
+    int err = posix_memalign ((void **)&pack_buf__, 64, len * sizeof (double));
+    assert (!err && pack_buf__);
+    pack_len__ = len;
+  }
+  return pack_buf__;
+}
+
+/** Packs an mc x kc block of A as row panels of height MAT_MR. */
+static
+void
+packA__ (int mc, int kc, const double* A, int lda, double* restrict Ap)
+{
+  for (int i = 0; i < mc; i += MAT_MR) {
+    const int mr = (mc - i < MAT_MR) ? mc - i : MAT_MR;
+    for (int p = 0; p < kc; ++p) {
+      const double* a = A + i + (size_t)p*lda;
+      int r = 0;
+      for (; r < mr; ++r) Ap[r] = a[r];
+      for (; r < MAT_MR; ++r) Ap[r] = 0.0;
+      Ap += MAT_MR;
+    }
+  }
+}
+
+/** Packs a kc x nc panel of B as column panels of width MAT_NR. */
+static
+void
+packB__ (int kc, int nc, const double* B, int ldb, double* restrict Bp)
+{
+  for (int j = 0; j < nc; j += MAT_NR) {
+    const int nr = (nc - j < MAT_NR) ? nc - j : MAT_NR;
+    for (int p = 0; p < kc; ++p) {
+      int c = 0;
+      for (; c < nr; ++c) Bp[c] = B[p + (size_t)(j + c)*ldb];
+      for (; c < MAT_NR; ++c) Bp[c] = 0.0;
+      Bp += MAT_NR;
+    }
+  }
+}
+
+/** C(0:mr, 0:nr) <- C + Ap*Bp, where Ap and Bp are packed micro-panels. */
+static
+void
+kernel__ (int kc, const double* restrict Ap, const double* restrict Bp,
+	  double* C, int ldc, int mr, int nr)
+{
+#if defined (__AVX2__) && defined (__FMA__)
+  __m256d c[MAT_NR][2];
+  for (int j = 0; j < MAT_NR; ++j)
+    c[j][0] = c[j][1] = _mm256_setzero_pd ();
+  for (int p = 0; p < kc; ++p) {
+    const __m256d a0 = _mm256_load_pd (Ap);
+    const __m256d a1 = _mm256_load_pd (Ap + 4);
+    for (int j = 0; j < MAT_NR; ++j) {
+      const __m256d b = _mm256_broadcast_sd (Bp + j);
+      c[j][0] = _mm256_fmadd_pd (a0, b, c[j][0]);
+      c[j][1] = _mm256_fmadd_pd (a1, b, c[j][1]);
+    }
+    Ap += MAT_MR;
+    Bp += MAT_NR;
+  }
+  if (mr == MAT_MR && nr == MAT_NR) {
+    for (int j = 0; j < MAT_NR; ++j) {
+      double* cj = C + (size_t)j*ldc;
+      _mm256_storeu_pd (cj, _mm256_add_pd (_mm256_loadu_pd (cj), c[j][0]));
+      _mm256_storeu_pd (cj + 4, _mm256_add_pd (_mm256_loadu_pd (cj + 4), c[j][1]));
+    }
+    return;
+  }
+  double t[MAT_NR][MAT_MR];
+  for (int j = 0; j < MAT_NR; ++j) {
+    _mm256_storeu_pd (t[j], c[j][0]);
+    _mm256_storeu_pd (t[j] + 4, c[j][1]);
+  }
+#else
+  double t[MAT_NR][MAT_MR] = {{0}};
+  for (int p = 0; p < kc; ++p) {
+    for (int j = 0; j < MAT_NR; ++j)
+      for (int i = 0; i < MAT_MR; ++i)
+	t[j][i] += Ap[i] * Bp[j];
+    Ap += MAT_MR;
+    Bp += MAT_NR;
+  }
+#endif
+  for (int j = 0; j < nr; ++j)
+    for (int i = 0; i < mr; ++i)
+      C[i + (size_t)j*ldc] += t[j][i];
+}
+
 void
 mat_multiply (int m, int n, int k,
 	      const double* A, int lda, const double* B, int ldb,
@@ -43,19 +185,389 @@ mat_multiply (int m, int n, int k,
   assert (A || m <= 0 || k <= 0); assert (lda >= m);
   assert (B || k <= 0 || n <= 0); assert (ldb >= k);
   assert (C || m <= 0 || n <= 0); assert (ldc >= m);
-  for (int ii = 0; ii < m; ++ii) {
-    for (int jj = 0; jj < n; ++jj) {
-      double cij = C[ii + jj*ldc];
-      for (int kk = 0; kk < k; ++kk) {
-	double tij = A[ii + kk*lda] * B[kk + jj*ldb];
-	cij += tij;
+  if (m <= 0 || n <= 0 || k <= 0)
+    return;
+
+  const int MC = block_mc__, KC = block_kc__, NC = block_nc__;
+  const int nc_max = (n < NC) ? n : NC;
+  double* Ap = getPackBuffer__ ((size_t)KC * (MC + nc_max + MAT_NR));
+  double* Bp = Ap + (size_t)KC * MC;
+  for (int jc = 0; jc < n; jc += NC) {
+    const int nc = (n - jc < NC) ? n - jc : NC;
+    for (int pc = 0; pc < k; pc += KC) {
+      const int kc = (k - pc < KC) ? k - pc : KC;
+      packB__ (kc, nc, B + pc + (size_t)jc*ldb, ldb, Bp);
+      for (int ic = 0; ic < m; ic += MC) {
+	const int mc = (m - ic < MC) ? m - ic : MC;
+	packA__ (mc, kc, A + ic + (size_t)pc*lda, lda, Ap);
+	for (int jr = 0; jr < nc; jr += MAT_NR) {
+	  const int nr = (nc - jr < MAT_NR) ? nc - jr : MAT_NR;
+	  for (int ir = 0; ir < mc; ir += MAT_MR) {
+	    const int mr = (mc - ir < MAT_MR) ? mc - ir : MAT_MR;
+	    kernel__ (kc, Ap + (size_t)ir*kc, Bp + (size_t)jr*kc,
+		      C + (ic + ir) + (size_t)(jc + jr)*ldc, ldc, mr, nr);
+	  }
+	}
       }
-      C[ii + jj*ldc] = cij;
     }
   }
 }
 #endif
 
+/* ------------------------------------------------------------ */
+/*
+ * Strassen-Winograd. Each level splits A, B, and C into 2 x 2 blocks
+ * (peeling off a last row, column, or inner index when a dimension is
+ * odd) and forms the product from seven half-size products:
+ *
+ *   S1 = A21 + A22   T1 = B12 - B11   M1 = A11*B11   M5 = S1*T1
+ *   S2 = S1 - A11    T2 = B22 - T1    M2 = A12*B21   M6 = S2*T2
+ *   S3 = A11 - A21   T3 = B22 - B12   M3 = S4*B22    M7 = S3*T3
+ *   S4 = A12 - S2    T4 = T2 - B21    M4 = A22*T4
+ *
+ *   C11 += M1 + M2          C12 += M1 + M6 + M5 + M3
+ *   C21 += M1 + M6 + M7 - M4    C22 += M1 + M6 + M7 + M5
+ *
+ * Below we use -T4 instead of T4, so that every product is added.
+ * Products run sequentially in a fixed order that needs only two
+ * A-sized, two B-sized, and one C-sized quarter blocks of workspace
+ * per level; at the top MAT_STRASSEN_TASK_DEPTH levels, if there is
+ * more than one OpenMP thread, the seven products instead run as
+ * tasks, each with its own buffers.
+ */
+
+#if !defined (MAT_STRASSEN_TASK_DEPTH)
+#  define MAT_STRASSEN_TASK_DEPTH 2
+#endif
+
+static int strassen_crossover__ = MAT_STRASSEN_CROSSOVER;
+
+void
+mat_setStrassenCrossover (int n0)
+{
+  strassen_crossover__ = (n0 > 1) ? n0 : 1;
+}
+
+int
+mat_getStrassenCrossover (void)
+{
+  return strassen_crossover__;
+}
+
+/** Returns the number of levels at which the products run as tasks. */
+static
+int
+getTaskDepth__ (void)
+{
+#if defined (_OPENMP)
+  return (omp_get_max_threads () > 1) ? MAT_STRASSEN_TASK_DEPTH : 0;
+#else
+  return 0;
+#endif
+}
+
+static
+int
+isBaseCase__ (int m, int n, int k)
+{
+  const int n0 = strassen_crossover__;
+  return m <= n0 || n <= n0 || k <= n0;
+}
+
+/** Returns the workspace (in doubles) of strassen__ () at this depth. */
+static
+size_t
+workspace__ (int m, int n, int k, int depth, int task_depth)
+{
+  if (isBaseCase__ (m, n, k))
+    return 0;
+  const size_t m2 = m/2, n2 = n/2, k2 = k/2;
+  const size_t child = workspace__ (m2, n2, k2, depth+1, task_depth);
+  if (depth < task_depth)
+    return 4*m2*k2 + 4*k2*n2 + 4*m2*n2 + 7*child;
+  return 2*m2*k2 + 2*k2*n2 + m2*n2 + child;
+}
+
+/** Z <- X + Y, for m x n blocks */
+static
+void
+add__ (int m, int n, const double* X, int ldx, const double* Y, int ldy,
+       double* Z, int ldz)
+{
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < m; ++i)
+      Z[i + (size_t)j*ldz] = X[i + (size_t)j*ldx] + Y[i + (size_t)j*ldy];
+}
+
+/** Z <- X - Y, for m x n blocks */
+static
+void
+sub__ (int m, int n, const double* X, int ldx, const double* Y, int ldy,
+       double* Z, int ldz)
+{
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < m; ++i)
+      Z[i + (size_t)j*ldz] = X[i + (size_t)j*ldx] - Y[i + (size_t)j*ldy];
+}
+
+/** C <- C + X, for m x n blocks */
+static
+void
+accum__ (int m, int n, const double* X, int ldx, double* C, int ldc)
+{
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < m; ++i)
+      C[i + (size_t)j*ldc] += X[i + (size_t)j*ldx];
+}
+
+static void strassen__ (int m, int n, int k,
+			const double* A, int lda, const double* B, int ldb,
+			double* C, int ldc, double* W, int depth, int task_depth);
+
+/** The seven products, with the combination after them, as tasks. */
+static
+void
+strassenTasks__ (int m2, int n2, int k2,
+		 const double* A11, const double* A12,
+		 const double* A21, const double* A22, int lda,
+		 const double* B11, const double* B12,
+		 const double* B21, const double* B22, int ldb,
+		 double* C11, double* C12, double* C21, double* C22, int ldc,
+		 double* W, int depth, int task_depth)
+{
+  const size_t a_len = (size_t)m2*k2, b_len = (size_t)k2*n2, c_len = (size_t)m2*n2;
+  double* S1 = W;        double* S2 = S1 + a_len;
+  double* S3 = S2 + a_len; double* S4 = S3 + a_len;
+  double* T1 = S4 + a_len; double* T2 = T1 + b_len;
+  double* T3 = T2 + b_len; double* T4 = T3 + b_len;
+  double* M1 = T4 + b_len; double* M5 = M1 + c_len;
+  double* M6 = M5 + c_len; double* M7 = M6 + c_len;
+  double* Wc = M7 + c_len;
+  const size_t w_child = workspace__ (m2, n2, k2, depth+1, task_depth);
+
+  add__ (m2, k2, A21, lda, A22, lda, S1, m2);
+  sub__ (m2, k2, S1, m2, A11, lda, S2, m2);
+  sub__ (m2, k2, A11, lda, A21, lda, S3, m2);
+  sub__ (m2, k2, A12, lda, S2, m2, S4, m2);
+  sub__ (k2, n2, B12, ldb, B11, ldb, T1, k2);
+  sub__ (k2, n2, B22, ldb, T1, k2, T2, k2);
+  sub__ (k2, n2, B22, ldb, B12, ldb, T3, k2);
+  sub__ (k2, n2, B21, ldb, T2, k2, T4, k2);
+  memset (M1, 0, 4 * c_len * sizeof (double));
+
+#pragma omp task
+  strassen__ (m2, n2, k2, A11, lda, B11, ldb, M1, m2, Wc, depth+1, task_depth);
+#pragma omp task
+  strassen__ (m2, n2, k2, A12, lda, B21, ldb, C11, ldc, Wc + w_child, depth+1, task_depth);
+#pragma omp task
+  strassen__ (m2, n2, k2, S4, m2, B22, ldb, C12, ldc, Wc + 2*w_child, depth+1, task_depth);
+#pragma omp task
+  strassen__ (m2, n2, k2, A22, lda, T4, k2, C21, ldc, Wc + 3*w_child, depth+1, task_depth);
+#pragma omp task
+  strassen__ (m2, n2, k2, S1, m2, T1, k2, M5, m2, Wc + 4*w_child, depth+1, task_depth);
+#pragma omp task
+  strassen__ (m2, n2, k2, S2, m2, T2, k2, M6, m2, Wc + 5*w_child, depth+1, task_depth);
+#pragma omp task
+  strassen__ (m2, n2, k2, S3, m2, T3, k2, M7, m2, Wc + 6*w_child, depth+1, task_depth);
+#pragma omp taskwait
+
+  for (int j = 0; j < n2; ++j)
+    for (int i = 0; i < m2; ++i) {
+      const size_t ij = i + (size_t)j*m2, ijc = i + (size_t)j*ldc;
+      const double u2 = M1[ij] + M6[ij];
+      const double u3 = u2 + M7[ij];
+      C11[ijc] += M1[ij];
+      C12[ijc] += u2 + M5[ij];
+      C21[ijc] += u3;
+      C22[ijc] += u3 + M5[ij];
+    }
+}
+
+/** The seven products in sequence, reusing five quarter blocks. */
+static
+void
+strassenSeq__ (int m2, int n2, int k2,
+	       const double* A11, const double* A12,
+	       const double* A21, const double* A22, int lda,
+	       const double* B11, const double* B12,
+	       const double* B21, const double* B22, int ldb,
+	       double* C11, double* C12, double* C21, double* C22, int ldc,
+	       double* W, int depth, int task_depth)
+{
+  const size_t a_len = (size_t)m2*k2, b_len = (size_t)k2*n2, c_len = (size_t)m2*n2;
+  double* X = W;          double* X2 = X + a_len;
+  double* Y = X2 + a_len; double* Y2 = Y + b_len;
+  double* P = Y2 + b_len;
+  double* Wc = P + c_len;
+
+  /* P = M1; C11 += M1 */
+  memset (P, 0, c_len * sizeof (double));
+  strassen__ (m2, n2, k2, A11, lda, B11, ldb, P, m2, Wc, depth+1, task_depth);
+  accum__ (m2, n2, P, m2, C11, ldc);
+
+  /* P = M1 + M6; C21 += P */
+  add__ (m2, k2, A21, lda, A22, lda, X, m2);   /* S1 */
+  sub__ (k2, n2, B12, ldb, B11, ldb, Y, k2);   /* T1 */
+  sub__ (m2, k2, X, m2, A11, lda, X2, m2);     /* S2 */
+  sub__ (k2, n2, B22, ldb, Y, k2, Y2, k2);     /* T2 */
+  strassen__ (m2, n2, k2, X2, m2, Y2, k2, P, m2, Wc, depth+1, task_depth);
+  accum__ (m2, n2, P, m2, C21, ldc);
+
+  /* P = M1 + M6 + M5; C12 += P; C22 += P */
+  strassen__ (m2, n2, k2, X, m2, Y, k2, P, m2, Wc, depth+1, task_depth);
+  accum__ (m2, n2, P, m2, C12, ldc);
+  accum__ (m2, n2, P, m2, C22, ldc);
+
+  /* C12 += M3; C21 += M4 */
+  sub__ (m2, k2, A12, lda, X2, m2, X, m2);     /* S4 */
+  strassen__ (m2, n2, k2, X, m2, B22, ldb, C12, ldc, Wc, depth+1, task_depth);
+  sub__ (k2, n2, B21, ldb, Y2, k2, Y, k2);     /* -T4 */
+  strassen__ (m2, n2, k2, A22, lda, Y, k2, C21, ldc, Wc, depth+1, task_depth);
+
+  /* P = M7; C21 += P; C22 += P */
+  sub__ (m2, k2, A11, lda, A21, lda, X, m2);   /* S3 */
+  sub__ (k2, n2, B22, ldb, B12, ldb, Y, k2);   /* T3 */
+  memset (P, 0, c_len * sizeof (double));
+  strassen__ (m2, n2, k2, X, m2, Y, k2, P, m2, Wc, depth+1, task_depth);
+  accum__ (m2, n2, P, m2, C21, ldc);
+  accum__ (m2, n2, P, m2, C22, ldc);
+
+  /* C11 += M2 */
+  strassen__ (m2, n2, k2, A12, lda, B21, ldb, C11, ldc, Wc, depth+1, task_depth);
+}
+
+/** C <- C + A*B, using the workspace W of workspace__ () */
+static
+void
+strassen__ (int m, int n, int k,
+	    const double* A, int lda, const double* B, int ldb,
+	    double* C, int ldc, double* W, int depth, int task_depth)
+{
+  if (isBaseCase__ (m, n, k)) {
+    mat_multiply (m, n, k, A, lda, B, ldb, C, ldc);
+    return;
+  }
+
+  const int m2 = m/2, n2 = n/2, k2 = k/2;
+  const double* A11 = A;                    const double* A12 = A + (size_t)k2*lda;
+  const double* A21 = A + m2;               const double* A22 = A12 + m2;
+  const double* B11 = B;                    const double* B12 = B + (size_t)n2*ldb;
+  const double* B21 = B + k2;               const double* B22 = B12 + k2;
+  double* C11 = C;                          double* C12 = C + (size_t)n2*ldc;
+  double* C21 = C + m2;                     double* C22 = C12 + m2;
+  if (depth < task_depth)
+    strassenTasks__ (m2, n2, k2, A11, A12, A21, A22, lda, B11, B12, B21, B22, ldb,
+		     C11, C12, C21, C22, ldc, W, depth, task_depth);
+  else
+    strassenSeq__ (m2, n2, k2, A11, A12, A21, A22, lda, B11, B12, B21, B22, ldb,
+		   C11, C12, C21, C22, ldc, W, depth, task_depth);
+
+  /* Fringes left by odd dimensions */
+  if (k > 2*k2) /* rank-1 update from the last column of A */
+    mat_multiply (2*m2, 2*n2, 1, A + (size_t)(2*k2)*lda, lda, B + 2*k2, ldb, C, ldc);
+  if (n > 2*n2) /* last column of C */
+    mat_multiply (m, 1, k, A, lda, B + (size_t)(2*n2)*ldb, ldb, C + (size_t)(2*n2)*ldc, ldc);
+  if (m > 2*m2) /* last row of C, less its last column */
+    mat_multiply (1, 2*n2, k, A + 2*m2, lda, B, ldb, C + 2*m2, ldc);
+}
+
+size_t
+mat_strassenWorkspace (int m, int n, int k)
+{
+  return workspace__ (m, n, k, 0, getTaskDepth__ ());
+}
+
+void
+mat_multiplyStrassen (int m, int n, int k,
+		      const double* A, int lda, const double* B, int ldb,
+		      double* C, int ldc, mat_arena_t* arena)
+{
+  assert (A || m <= 0 || k <= 0); assert (lda >= m);
+  assert (B || k <= 0 || n <= 0); assert (ldb >= k);
+  assert (C || m <= 0 || n <= 0); assert (ldc >= m);
+  if (m <= 0 || n <= 0 || k <= 0)
+    return;
+
+  const int task_depth = getTaskDepth__ ();
+  const size_t len = workspace__ (m, n, k, 0, task_depth);
+  mat_arena_t* own = NULL;
+  if (!arena && len) {
+    own = mat_arena_create (len);
+    arena = own;
+  }
+  double* W = len ? mat_arena_alloc (arena, len) : NULL;
+  assert (W || !len);
+
+#pragma omp parallel if (task_depth > 0)
+#pragma omp single
+  strassen__ (m, n, k, A, lda, B, ldb, C, ldc, W, 0, task_depth);
+
+  if (len)
+    mat_arena_release (arena, W);
+  mat_arena_destroy (own);
+}
+
+/* ------------------------------------------------------------ */
+
+struct mat_arena_t_
+{
+  double* base;  /*!< Buffer */
+  size_t len;    /*!< Capacity, in doubles */
+  size_t used;   /*!< Doubles allocated so far */
+};
+
+mat_arena_t *
+mat_arena_create (size_t len)
+{
+  mat_arena_t* arena = (mat_arena_t *)malloc (sizeof (mat_arena_t));
+  assert (arena);
+  arena->base = NULL;
+  if (len) {
+    int err = posix_memalign ((void **)&arena->base, 64, len * sizeof (double));
+    assert (!err && arena->base);
+  }
+  arena->len = len;
+  arena->used = 0;
+  return arena;
+}
+
+void
+mat_arena_destroy (mat_arena_t* arena)
+{
+  if (arena) {
+    free (arena->base);
+    free (arena);
+  }
+}
+
+double *
+mat_arena_alloc (mat_arena_t* arena, size_t len)
+{
+  assert (arena);
+  if (arena->len - arena->used < len) {
+    fprintf (stderr, "*** mat_arena_alloc: %lu doubles requested, %lu free ***\n",
+	     (unsigned long)len, (unsigned long)(arena->len - arena->used));
+    return NULL;
+  }
+  double* p = arena->base + arena->used;
+  arena->used += len;
+  return p;
+}
+
+void
+mat_arena_release (mat_arena_t* arena, double* p)
+{
+  assert (arena);
+  assert (p >= arena->base && p <= arena->base + arena->used);
+  arena->used = p - arena->base;
+}
+
+size_t
+mat_arena_available (const mat_arena_t* arena)
+{
+  return arena ? arena->len - arena->used : 0;
+}
+
 /* ------------------------------------------------------------ */
 
 void
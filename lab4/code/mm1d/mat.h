@@ -6,6 +6,8 @@
 #if !defined (INC_MAT_H)
 #define INC_MAT_H /*!< mat.h included */
 
+#include <stddef.h>
+
 /** \brief Returns an uninitialized buffer for an m x n matrix. */
 double* mat_create (int m, int n);
 
@@ -41,6 +43,85 @@ void mat_multiply (int m, int n, int k,
 		   double* C, int ldc);
 
 
+/** \brief Default cache blocking of mat_multiply (see mat_setBlocking). */
+#if !defined (MAT_BLOCK_MC)
+#  define MAT_BLOCK_MC 128
+#endif
+#if !defined (MAT_BLOCK_KC)
+#  define MAT_BLOCK_KC 256
+#endif
+#if !defined (MAT_BLOCK_NC)
+#  define MAT_BLOCK_NC 2040
+#endif
+
+/**
+ *  \brief Sets the cache blocking of mat_multiply: it packs mc x kc
+ *  blocks of A and kc x nc panels of B. mc is rounded up to a
+ *  multiple of 8 and nc to a multiple of 6; a value <= 0 restores the
+ *  default. Has no effect when mat_multiply calls MKL.
+ */
+void mat_setBlocking (int mc, int kc, int nc);
+
+/** \brief Gets the cache blocking of mat_multiply. */
+void mat_getBlocking (int* mc, int* kc, int* nc);
+
+/** \brief Default value of mat_getStrassenCrossover (). */
+#if !defined (MAT_STRASSEN_CROSSOVER)
+#  define MAT_STRASSEN_CROSSOVER 512
+#endif
+
+/**
+ *  \brief Preallocated workspace for mat_multiplyStrassen.
+ *
+ *  An arena is one buffer from which blocks are allocated in stack
+ *  order: mat_arena_release (arena, p) frees p and every block
+ *  allocated after it.
+ */
+typedef struct mat_arena_t_ mat_arena_t;
+
+/** \brief Creates an arena that holds 'len' doubles. */
+mat_arena_t* mat_arena_create (size_t len);
+
+/** \brief Frees an arena and its buffer. */
+void mat_arena_destroy (mat_arena_t* arena);
+
+/** \brief Returns a block of 'len' doubles, or NULL if it does not fit. */
+double* mat_arena_alloc (mat_arena_t* arena, size_t len);
+
+/** \brief Releases p, and every block allocated after it. */
+void mat_arena_release (mat_arena_t* arena, double* p);
+
+/** \brief Returns the number of doubles that remain free. */
+size_t mat_arena_available (const mat_arena_t* arena);
+
+/**
+ *  \brief Performs C <- C + A*B, as mat_multiply, using the
+ *  Strassen-Winograd algorithm.
+ *
+ *  The recursion halves m, n, and k until one of them is at most the
+ *  crossover (see mat_setStrassenCrossover), and then calls
+ *  mat_multiply. The workspace, mat_strassenWorkspace (m, n, k)
+ *  doubles, comes from 'arena'; if arena is NULL, it is allocated and
+ *  freed by the call. With more than one OpenMP thread, the seven
+ *  sub-products of the top levels run as OpenMP tasks.
+ *
+ *  \note The result is not as accurate as that of mat_multiply: the
+ *  error is bounded normwise, by a factor that grows with the number
+ *  of levels, instead of elementwise.
+ */
+void mat_multiplyStrassen (int m, int n, int k,
+			   const double* A, int lda, const double* B, int ldb,
+			   double* C, int ldc, mat_arena_t* arena);
+
+/** \brief Returns the workspace, in doubles, of mat_multiplyStrassen. */
+size_t mat_strassenWorkspace (int m, int n, int k);
+
+/** \brief Sets the largest dimension multiplied by mat_multiply directly. */
+void mat_setStrassenCrossover (int n0);
+
+/** \brief Returns the Strassen crossover. */
+int mat_getStrassenCrossover (void);
+
 /** \brief Same as mat_multiply, but with a computed error bound. */
 void mat_multiplyErrorbound (int m, int n, int k,
 			     const double* A, int lda,
@@ -9,58 +9,291 @@
 #include "mm1d.h"
 #include "mpi_helper.h"
 
-double *
-mm1d_distribute (int m, int n, const double* A, MPI_Comm comm)
+int
+mm1d_getLayoutLength (int n, int nb, int P, int rank)
+{
+  if (nb <= 0)
+    return mm1d_getBlockLength (n, P, rank);
+
+  const int n_blocks = (n + nb - 1) / nb;
+  const int n_owned = (n_blocks / P) + (rank < (n_blocks % P));
+  if (n_owned == 0)
+    return 0;
+
+  /* Only the last block of the matrix may be partial. */
+  const int last_owned = rank + (n_owned - 1) * P;
+  if (last_owned == n_blocks - 1)
+    return (n_owned - 1) * nb + (n - last_owned * nb);
+  return n_owned * nb;
+}
+
+MPI_Datatype
+mm1d_createLayoutType (int m, int n, int lda, int nb, int P, int rank)
+{
+  MPI_Datatype layout = MPI_DATATYPE_NULL;
+  if (m <= 0 || mm1d_getLayoutLength (n, nb, P, rank) == 0)
+    return layout;
+
+  if (nb <= 0) {
+    /* One block column, viewed as a subarray of the n x lda C-order
+     * array that has the same memory image as A. */
+    int sizes[2] = { n, lda };
+    int subsizes[2] = { mm1d_getBlockLength (n, P, rank), m };
+    int starts[2] = { mm1d_getBlockStart (n, P, rank), 0 };
+    MPI_Type_create_subarray (2, sizes, subsizes, starts, MPI_ORDER_C,
+			      MPI_DOUBLE, &layout);
+  } else {
+    /* Full blocks repeat with a stride of P blocks; the (partial) last
+     * block of the matrix, if this rank owns it, is appended. */
+    const MPI_Aint col_bytes = (MPI_Aint)lda * sizeof (double);
+    const int n_blocks = (n + nb - 1) / nb;
+    const int n_owned = (n_blocks / P) + (rank < (n_blocks % P));
+    const int last_owned = rank + (n_owned - 1) * P;
+    const int n_tail = (last_owned == n_blocks - 1) ? (n - last_owned * nb) : 0;
+    const int n_full = n_owned - (n_tail > 0);
+
+    MPI_Datatype parts[2] = { MPI_DATATYPE_NULL, MPI_DATATYPE_NULL };
+    int lengths[2] = { 1, 1 };
+    MPI_Aint displs[2] = { 0, 0 };
+    int n_parts = 0;
+    if (n_full > 0) {
+      MPI_Datatype block;
+      MPI_Type_vector (nb, m, lda, MPI_DOUBLE, &block);
+      MPI_Type_create_hvector (n_full, 1, P * nb * col_bytes, block,
+			       &parts[n_parts]);
+      MPI_Type_free (&block);
+      displs[n_parts++] = rank * nb * col_bytes;
+    }
+    if (n_tail > 0) {
+      MPI_Type_vector (n_tail, m, lda, MPI_DOUBLE, &parts[n_parts]);
+      displs[n_parts++] = last_owned * nb * col_bytes;
+    }
+    MPI_Type_create_struct (n_parts, lengths, displs, parts, &layout);
+    for (int i = 0; i < n_parts; ++i)
+      MPI_Type_free (&parts[i]);
+  }
+  MPI_Type_commit (&layout);
+  return layout;
+}
+
+/* ------------------------------------------------------------ */
+
+/**
+ *  \brief Implements mm1d_scatter() (is_gather == 0) and
+ *  mm1d_gather() (is_gather != 0).
+ *
+ *  Since each destination needs a different derived datatype on
+ *  process 0, this uses MPI_Alltoallw with only the process-0 row
+ *  (resp. column) of the exchange non-empty.
+ */
+static
+void
+exchangeLayout__ (int m, int n, int nb, double* A, int lda,
+		  double* A_local, MPI_Comm comm, int is_gather)
 {
   int P = mpih_getSize (comm);
   int rank = mpih_getRank (comm);
-  int n_local = mm1d_getBlockLength (n, P, rank);
+  int n_local = mm1d_getLayoutLength (n, nb, P, rank);
+  mpih_assert (A_local || !m || !n_local);
+  mpih_assert (rank != 0 || A || !m || !n);
+  mpih_assert (rank != 0 || lda >= m);
 
-  double* A_local = (double *)malloc (m * n_local * sizeof (double));
-  mpih_assert (A_local != NULL);
+  int* root_counts = (int *)calloc (P, sizeof (int));
+  int* local_counts = (int *)calloc (P, sizeof (int));
+  int* displs = (int *)calloc (P, sizeof (int));
+  MPI_Datatype* root_types = (MPI_Datatype *)malloc (P * sizeof (MPI_Datatype));
+  MPI_Datatype* local_types = (MPI_Datatype *)malloc (P * sizeof (MPI_Datatype));
+  mpih_assert (root_counts && local_counts && displs && root_types && local_types);
 
-  int* sendcounts = NULL;
-  int* offsets = NULL;
+  for (int r = 0; r < P; ++r)
+    root_types[r] = local_types[r] = MPI_DOUBLE;
   if (rank == 0) {
-    sendcounts = (int *)malloc (P * sizeof (int));
-    offsets = (int *)malloc (P * sizeof (int));
-    mpih_assert (sendcounts && offsets);
-    for (int r_dest = 0; r_dest < P; ++r_dest) {
-      int j = mm1d_getBlockStart (n, P, r_dest);
-      int n_j = mm1d_getBlockLength (n, P, r_dest);
-      sendcounts[r_dest] = m * n_j;
-      offsets[r_dest] = m * j;
+    for (int r = 0; r < P; ++r) {
+      MPI_Datatype t = mm1d_createLayoutType (m, n, lda, nb, P, r);
+      if (t != MPI_DATATYPE_NULL) {
+	root_types[r] = t;
+	root_counts[r] = 1;
+      }
     }
   }
+  local_counts[0] = m * n_local;
 
-  int retcode = MPI_Scatterv ((void *)A, sendcounts, offsets, MPI_DOUBLE,
-			      A_local, m * n_local, MPI_DOUBLE,
-			      0, comm);
+  int retcode;
+  if (is_gather)
+    retcode = MPI_Alltoallw (A_local, local_counts, displs, local_types,
+			     A, root_counts, displs, root_types, comm);
+  else
+    retcode = MPI_Alltoallw (A, root_counts, displs, root_types,
+			     A_local, local_counts, displs, local_types, comm);
   mpih_assert (retcode == MPI_SUCCESS);
+
+  for (int r = 0; r < P; ++r)
+    if (root_counts[r])
+      MPI_Type_free (&root_types[r]);
+  free (root_counts);
+  free (local_counts);
+  free (displs);
+  free (root_types);
+  free (local_types);
+}
+
+void
+mm1d_scatter (int m, int n, int nb, const double* A, int lda,
+	      double* A_local, MPI_Comm comm)
+{
+  exchangeLayout__ (m, n, nb, (double *)A, lda, A_local, comm, 0);
+}
+
+void
+mm1d_gather (int m, int n, int nb, const double* A_local,
+	     double* A, int lda, MPI_Comm comm)
+{
+  exchangeLayout__ (m, n, nb, A, lda, (double *)A_local, comm, 1);
+}
+
+double *
+mm1d_distribute (int m, int n, const double* A, MPI_Comm comm)
+{
+  double* A_local = mm1d_alloc (m, n, comm);
+  mm1d_scatter (m, n, 0, A, m, A_local, comm);
   return A_local;
 }
 
 /* ------------------------------------------------------------ */
 
+/**
+ *  \brief Opens 'filename' and sets each process's file view to the
+ *  columns it owns, so that a single collective call moves all of
+ *  the local data.
+ */
+static
+MPI_File
+openLayoutView__ (const char* filename, int amode, int m, int n, int nb,
+		  MPI_Comm comm)
+{
+  int P = mpih_getSize (comm);
+  int rank = mpih_getRank (comm);
+  MPI_File fh;
+  int retcode = MPI_File_open (comm, (char *)filename, amode,
+			       MPI_INFO_NULL, &fh);
+  if (retcode != MPI_SUCCESS)
+    mpih_debugmsg (comm, "*** Can't open '%s' ***\n", filename);
+  mpih_assert (retcode == MPI_SUCCESS);
+
+  MPI_Datatype view = mm1d_createLayoutType (m, n, m, nb, P, rank);
+  retcode = MPI_File_set_view (fh, 0, MPI_DOUBLE,
+			       (view != MPI_DATATYPE_NULL) ? view : MPI_DOUBLE,
+			       "native", MPI_INFO_NULL);
+  mpih_assert (retcode == MPI_SUCCESS);
+  if (view != MPI_DATATYPE_NULL)
+    MPI_Type_free (&view);
+  return fh;
+}
+
 void
-mm1d_mult (int m, int n, int k,
-	   const double* A_local, const double* B_local,
-	   double* C_local, MPI_Comm comm,
-	   double* p_t_comp, double* p_t_comm)
+mm1d_read (const char* filename, int m, int n, int nb,
+	   double* A_local, MPI_Comm comm)
+{
+  int P = mpih_getSize (comm);
+  int rank = mpih_getRank (comm);
+  int n_local = mm1d_getLayoutLength (n, nb, P, rank);
+  mpih_assert (A_local || !m || !n_local);
+
+  MPI_File fh = openLayoutView__ (filename, MPI_MODE_RDONLY, m, n, nb, comm);
+  MPI_Offset file_size;
+  MPI_File_get_size (fh, &file_size);
+  mpih_assert (file_size == (MPI_Offset)m * n * (MPI_Offset)sizeof (double));
+
+  MPI_Status stat;
+  int retcode = MPI_File_read_all (fh, A_local, m * n_local, MPI_DOUBLE, &stat);
+  mpih_assert (retcode == MPI_SUCCESS);
+  MPI_File_close (&fh);
+}
+
+void
+mm1d_write (const char* filename, int m, int n, int nb,
+	    const double* A_local, MPI_Comm comm)
+{
+  int P = mpih_getSize (comm);
+  int rank = mpih_getRank (comm);
+  int n_local = mm1d_getLayoutLength (n, nb, P, rank);
+  mpih_assert (A_local || !m || !n_local);
+
+  MPI_File fh = openLayoutView__ (filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+				  m, n, nb, comm);
+  MPI_File_set_size (fh, (MPI_Offset)m * n * sizeof (double));
+
+  MPI_Status stat;
+  int retcode = MPI_File_write_all (fh, (void *)A_local, m * n_local,
+				    MPI_DOUBLE, &stat);
+  mpih_assert (retcode == MPI_SUCCESS);
+  MPI_File_close (&fh);
+}
+
+/* ------------------------------------------------------------ */
+
+/** \brief Plan for mm1d_plan_execute(); see mm1d_plan_create(). */
+struct mm1d_plan_t__ {
+  int m, n, k;
+  MPI_Comm comm;
+  double* A_buf[2];   /*!< Block columns of A, used alternately */
+  int n_shifts;       /*!< Number of ring shifts, P-1 */
+  MPI_Request* reqs;  /*!< Send/receive pair for each shift */
+};
+
+mm1d_plan_t *
+mm1d_plan_create (int m, int n, int k, MPI_Comm comm)
 {
   int P = mpih_getSize (comm); /* No. of processes */
   int r = mpih_getRank (comm); /* Rank (logical ID) of current process */
   int r_left = (r + P - 1) % P; /* Rank of left neighbor */
   int r_right = (r + 1) % P; /* Rank of right neighbor */
 
-  int k_local = mm1d_getBlockLength (k, P, r);
-  const int n_local = mm1d_getBlockLength (n, P, r);
+  mm1d_plan_t* plan = (mm1d_plan_t *)malloc (sizeof (mm1d_plan_t));
+  mpih_assert (plan != NULL);
+  plan->m = m;
+  plan->n = n;
+  plan->k = k;
+  plan->comm = comm;
+
   const int k_local_max = mm1d_getBlockLength (k, P, 0);
+  for (int b = 0; b < 2; ++b) {
+    plan->A_buf[b] = (double *)malloc (m * k_local_max * sizeof (double));
+    mpih_assert (plan->A_buf[b] || (size_t)m * k_local_max == 0);
+  }
+
+  /* During iteration 'iter', the block of A in A_buf[iter % 2] goes
+   * to the right while the next one arrives from the left. The last
+   * iteration needs no shift. */
+  plan->n_shifts = P - 1;
+  plan->reqs = (MPI_Request *)malloc (2 * plan->n_shifts * sizeof (MPI_Request));
+  mpih_assert (plan->reqs || !plan->n_shifts);
+  for (int iter = 0; iter < plan->n_shifts; ++iter) {
+    int k_local = mm1d_getBlockLength (k, P, (r + P - iter) % P);
+    int k_local_next = mm1d_getBlockLength (k, P, (r + P - iter - 1) % P);
+    MPI_Send_init (plan->A_buf[iter % 2], m * k_local, MPI_DOUBLE,
+		   r_right, r, comm, &plan->reqs[2*iter]);
+    MPI_Recv_init (plan->A_buf[(iter + 1) % 2], m * k_local_next, MPI_DOUBLE,
+		   r_left, r_left, comm, &plan->reqs[2*iter + 1]);
+  }
+  return plan;
+}
+
+void
+mm1d_plan_execute (mm1d_plan_t* plan,
+		   const double* A_local, const double* B_local,
+		   double* C_local,
+		   double* p_t_comp, double* p_t_comm)
+{
+  mpih_assert (plan != NULL);
+  const int m = plan->m;
+  const int k = plan->k;
+  int P = mpih_getSize (plan->comm);
+  int r = mpih_getRank (plan->comm);
+  const int n_local = mm1d_getBlockLength (plan->n, P, r);
 
-  double* A_local_working = (double *)malloc (m * k_local_max * sizeof (double));
-  double* A_local_recv = (double *)malloc (m * k_local_max * sizeof (double));
-  mpih_assert (A_local_working && A_local_recv);
-  memcpy (A_local_working, A_local, m * k_local * sizeof (double));
+  memcpy (plan->A_buf[0], A_local,
+	  m * mm1d_getBlockLength (k, P, r) * sizeof (double));
 
   /* Internal timers */
   double t_comp = 0;
@@ -69,31 +302,55 @@ mm1d_mult (int m, int n, int k,
   for (int iter = 0; iter < P; ++iter) {
     int r_effective = (r + P - iter) % P;
     int k0 = mm1d_getBlockStart (k, P, r_effective);
-    k_local = mm1d_getBlockLength (k, P, r_effective);
+    int k_local = mm1d_getBlockLength (k, P, r_effective);
+    MPI_Request* reqs = &plan->reqs[2*iter];
+    const int has_shift = (iter < plan->n_shifts);
 
     double t_start = MPI_Wtime ();
+    if (has_shift)
+      MPI_Startall (2, reqs);
+    t_comm += MPI_Wtime () - t_start;
+
+    /* The send only reads A_buf[iter % 2], so it may proceed
+     * concurrently with the multiply. */
+    t_start = MPI_Wtime ();
     mat_multiply (m, n_local, k_local,
-		  A_local_working, m, &(B_local[k0]), k, C_local, m);
+		  plan->A_buf[iter % 2], m, &(B_local[k0]), k, C_local, m);
     t_comp += MPI_Wtime () - t_start;
 
-    int r_effective_next = (r + P - iter - 1) % P;
-    int k_local_next = mm1d_getBlockLength (k, P, r_effective_next);
-    MPI_Status stat;
     t_start = MPI_Wtime ();
-    MPI_Sendrecv (A_local_working, m * k_local, MPI_DOUBLE, r_right, r,
-		  A_local_recv, m * k_local_next, MPI_DOUBLE, r_left, r_left,
-		  comm, &stat);
+    if (has_shift)
+      MPI_Waitall (2, reqs, MPI_STATUSES_IGNORE);
     t_comm += MPI_Wtime () - t_start;
-    swapPointers_double (&A_local_working, &A_local_recv);
   }
 
-  free (A_local_working);
-  free (A_local_recv);
-
   if (p_t_comp) *p_t_comp += t_comp;
   if (p_t_comm) *p_t_comm += t_comm;
 }
 
+void
+mm1d_plan_destroy (mm1d_plan_t* plan)
+{
+  if (!plan) return;
+  for (int i = 0; i < 2 * plan->n_shifts; ++i)
+    MPI_Request_free (&plan->reqs[i]);
+  free (plan->reqs);
+  free (plan->A_buf[0]);
+  free (plan->A_buf[1]);
+  free (plan);
+}
+
+void
+mm1d_mult (int m, int n, int k,
+	   const double* A_local, const double* B_local,
+	   double* C_local, MPI_Comm comm,
+	   double* p_t_comp, double* p_t_comm)
+{
+  mm1d_plan_t* plan = mm1d_plan_create (m, n, k, comm);
+  mm1d_plan_execute (plan, A_local, B_local, C_local, p_t_comp, p_t_comm);
+  mm1d_plan_destroy (plan);
+}
+
 /* ------------------------------------------------------------ */
 
 double *
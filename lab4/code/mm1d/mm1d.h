@@ -27,6 +27,27 @@ inline int mm1d_getBlockLength (int n, int P, int rank)
   return (n / P) + (rank < (n % P));
 }
 
+/**
+ *  \brief Returns the number of columns owned by proc 'rank' when n
+ *  columns are dealt out among P procs in blocks of nb consecutive
+ *  columns, round-robin (a 1D block-cyclic layout).
+ *
+ *  \note If nb <= 0, the layout is instead the consecutive-chunk
+ *  layout of mm1d_getBlockLength(), i.e., the one that mm1d_mult()
+ *  expects. The same convention holds for every 'nb' argument below.
+ */
+int mm1d_getLayoutLength (int n, int nb, int P, int rank);
+
+/**
+ *  \brief Returns a derived datatype that selects, in place, the
+ *  columns owned by proc 'rank' from an m x n column-major matrix
+ *  with leading dimension lda, or MPI_DATATYPE_NULL if 'rank' owns
+ *  no columns. The caller must free a non-null result with
+ *  MPI_Type_free().
+ */
+MPI_Datatype mm1d_createLayoutType (int m, int n, int lda, int nb,
+				    int P, int rank);
+
 /**
  *  \brief Given an m x n matrix A stored on process 0, this
  *  collective routine distributes block columns of A among all
@@ -34,6 +55,43 @@ inline int mm1d_getBlockLength (int n, int P, int rank)
  */
 double* mm1d_distribute (int m, int n, const double* A, MPI_Comm comm);
 
+/**
+ *  \brief Scatters the m x n matrix A, stored on process 0 with
+ *  leading dimension lda, into the caller-allocated local blocks
+ *  A_local using the layout given by nb.
+ *
+ *  Process 0 sends directly out of A through derived datatypes, so
+ *  no packing buffer is needed. Each A_local is stored densely (with
+ *  leading dimension m) and must hold m * mm1d_getLayoutLength (n,
+ *  nb, P, rank) entries. A is only referenced on process 0.
+ */
+void mm1d_scatter (int m, int n, int nb, const double* A, int lda,
+		   double* A_local, MPI_Comm comm);
+
+/**
+ *  \brief Inverse of mm1d_scatter: collects the local blocks into
+ *  the m x n matrix A, stored on process 0 with leading dimension
+ *  lda. A is only referenced on process 0.
+ */
+void mm1d_gather (int m, int n, int nb, const double* A_local,
+		  double* A, int lda, MPI_Comm comm);
+
+/**
+ *  \brief Collectively reads the local blocks of an m x n matrix
+ *  from 'filename' using MPI-IO, where the file holds the entire
+ *  matrix as raw column-major doubles. Every process reads its own
+ *  columns, so there is no single-process I/O bottleneck.
+ */
+void mm1d_read (const char* filename, int m, int n, int nb,
+		double* A_local, MPI_Comm comm);
+
+/**
+ *  \brief Collectively writes the local blocks of an m x n matrix
+ *  to 'filename' in the format read by mm1d_read().
+ */
+void mm1d_write (const char* filename, int m, int n, int nb,
+		 const double* A_local, MPI_Comm comm);
+
 /**
  *  \brief Performs a distributed 1D block row matrix multiply.
  *
@@ -42,12 +100,46 @@ double* mm1d_distribute (int m, int n, const double* A, MPI_Comm comm);
  *  may optionally provide non-NULL values for p_t_comp and p_t_comm
  *  to get the computation and communication time breakdown,
  *  respectively.
+ *
+ *  \note Equivalent to creating, executing, and destroying a plan;
+ *  callers that multiply repeatedly should keep the plan instead.
  */
 void mm1d_mult (int m, int n, int k,
 		const double* A_local, const double* B_local,
 		double* C_local, MPI_Comm comm,
 		double* p_t_comp, double* p_t_comm);
 
+/**
+ *  \brief Precomputed communication schedule for repeatedly
+ *  multiplying matrices of the same shapes; see mm1d_plan_create().
+ */
+typedef struct mm1d_plan_t__ mm1d_plan_t;
+
+/**
+ *  \brief Sets up everything mm1d_mult (m, n, k, ...) needs that does
+ *  not depend on the matrix values: two buffers for the block columns
+ *  of A that circulate around the ring, and a persistent
+ *  MPI_Send_init / MPI_Recv_init pair for each of the P-1 shifts.
+ *  This is a collective call.
+ */
+mm1d_plan_t* mm1d_plan_create (int m, int n, int k, MPI_Comm comm);
+
+/**
+ *  \brief Computes C <- C + A*B like mm1d_mult(), but only starts and
+ *  completes the plan's requests.
+ *
+ *  Each shift is started before the multiply by the current block of
+ *  A and completed after it, so *p_t_comm only accumulates the
+ *  communication time that the multiply did not hide.
+ */
+void mm1d_plan_execute (mm1d_plan_t* plan,
+			const double* A_local, const double* B_local,
+			double* C_local,
+			double* p_t_comp, double* p_t_comm);
+
+/** \brief Frees the plan's requests and buffers. */
+void mm1d_plan_destroy (mm1d_plan_t* plan);
+
 /**
  * \brief Allocates a M x N matrix across all processes in comm using
  * a 1D block column partitioning, returning a pointer to the local
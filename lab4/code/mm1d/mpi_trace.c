@@ -0,0 +1,571 @@
+/**
+ *  \file mpi_trace.c
+ *  \brief PMPI interposition layer that records a communication
+ *  trace; see mpi_trace.h for the file format.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "mpi_trace.h"
+
+/** Number of records buffered in memory before flushing to disk. */
+#define MPIT_BUFFER_LEN 4096
+
+/** Maximum number of simultaneously pending nonblocking requests. */
+#define MPIT_MAX_PENDING 1024
+
+/** \brief A posted, not yet completed, nonblocking operation. */
+typedef struct {
+  MPI_Request req;
+  mpit_record_t rec;
+} pending__t;
+
+static FILE* fp__ = NULL;
+static int rank__ = -1;
+static double t_origin__ = 0;
+static mpit_record_t buffer__[MPIT_BUFFER_LEN];
+static int n_buffered__ = 0;
+static pending__t pending__[MPIT_MAX_PENDING];
+static int n_pending__ = 0;
+static pending__t persistent__[MPIT_MAX_PENDING];
+static int n_persistent__ = 0;
+
+/** Serializes the buffers when the program calls MPI from threads. */
+static pthread_mutex_t lock__ = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------------------------------------------------ */
+
+static
+void
+flush__ (void)
+{
+  if (fp__ && n_buffered__) {
+    size_t n_written = fwrite (buffer__, sizeof (mpit_record_t), n_buffered__, fp__);
+    assert (n_written == (size_t)n_buffered__);
+  }
+  n_buffered__ = 0;
+}
+
+static
+void
+append__ (const mpit_record_t* rec)
+{
+  pthread_mutex_lock (&lock__);
+  if (n_buffered__ == MPIT_BUFFER_LEN)
+    flush__ ();
+  buffer__[n_buffered__++] = *rec;
+  pthread_mutex_unlock (&lock__);
+}
+
+static
+double
+now__ (void)
+{
+  return PMPI_Wtime () - t_origin__;
+}
+
+/** Returns count elements of type t, in bytes. */
+static
+int64_t
+bytes__ (int count, MPI_Datatype t)
+{
+  int size = 0;
+  if (count <= 0 || t == MPI_DATATYPE_NULL) return 0;
+  PMPI_Type_size (t, &size);
+  return (int64_t)count * size;
+}
+
+/** Translates rank r of comm into a rank of MPI_COMM_WORLD. */
+static
+int
+worldRank__ (MPI_Comm comm, int r)
+{
+  if (r < 0 || comm == MPI_COMM_WORLD)
+    return (r == MPI_PROC_NULL || r == MPI_ANY_SOURCE) ? -1 : r;
+
+  int r_world = -1;
+  MPI_Group g, g_world;
+  PMPI_Comm_group (comm, &g);
+  PMPI_Comm_group (MPI_COMM_WORLD, &g_world);
+  PMPI_Group_translate_ranks (g, 1, &r, g_world, &r_world);
+  PMPI_Group_free (&g);
+  PMPI_Group_free (&g_world);
+  return (r_world == MPI_UNDEFINED) ? -1 : r_world;
+}
+
+static
+void
+record__ (mpit_op_t op, MPI_Comm comm, int peer, int tag, int64_t bytes,
+	  double t_start, double t_end)
+{
+  mpit_record_t rec;
+  rec.op = op;
+  rec.rank = rank__;
+  rec.peer = worldRank__ (comm, peer);
+  rec.tag = tag;
+  rec.bytes = bytes;
+  rec.t_start = t_start;
+  rec.t_end = t_end;
+  append__ (&rec);
+}
+
+/* ------------------------------------------------------------
+ * Nonblocking requests: remember the post, emit the record at
+ * completion.
+ */
+
+static
+void
+post__ (MPI_Request req, mpit_op_t op, MPI_Comm comm, int peer, int tag,
+	int64_t bytes, double t_start)
+{
+  pthread_mutex_lock (&lock__);
+  if (n_pending__ < MPIT_MAX_PENDING) {
+    pending__t* p = &pending__[n_pending__++];
+    p->req = req;
+    p->rec.op = op;
+    p->rec.rank = rank__;
+    p->rec.peer = worldRank__ (comm, peer);
+    p->rec.tag = tag;
+    p->rec.bytes = bytes;
+    p->rec.t_start = t_start;
+    p->rec.t_end = t_start;
+  }
+  pthread_mutex_unlock (&lock__);
+}
+
+/**
+ *  Removes the pending entry for req, if any, returning 1 and a copy
+ *  of its record in *rec.
+ */
+static
+int
+claim__ (MPI_Request req, mpit_record_t* rec)
+{
+  int found = 0;
+  if (req == MPI_REQUEST_NULL) return 0;
+  pthread_mutex_lock (&lock__);
+  for (int i = 0; i < n_pending__; ++i) {
+    if (pending__[i].req == req) {
+      *rec = pending__[i].rec;
+      pending__[i] = pending__[--n_pending__];
+      found = 1;
+      break;
+    }
+  }
+  pthread_mutex_unlock (&lock__);
+  return found;
+}
+
+/** Emits the record of a completed request. */
+static
+void
+complete__ (mpit_record_t* rec, const MPI_Status* stat, double t_end)
+{
+  if (rec->op == MPIT_IRECV && stat && stat != MPI_STATUS_IGNORE
+      && rec->peer < 0)
+    rec->peer = stat->MPI_SOURCE; /* Only correct for MPI_COMM_WORLD */
+  rec->t_end = t_end;
+  append__ (rec);
+}
+
+/* ------------------------------------------------------------
+ * Persistent requests: remember the arguments at MPI_*_init, and post
+ * a pending entry at each MPI_Start. The handle does not change when
+ * the request completes, so claim__ () finds it as usual.
+ */
+
+static
+void
+init__ (MPI_Request req, mpit_op_t op, MPI_Comm comm, int peer, int tag,
+	int64_t bytes)
+{
+  pthread_mutex_lock (&lock__);
+  if (n_persistent__ < MPIT_MAX_PENDING) {
+    pending__t* p = &persistent__[n_persistent__++];
+    p->req = req;
+    p->rec.op = op;
+    p->rec.rank = rank__;
+    p->rec.peer = worldRank__ (comm, peer);
+    p->rec.tag = tag;
+    p->rec.bytes = bytes;
+  }
+  pthread_mutex_unlock (&lock__);
+}
+
+/** Posts a pending entry for the persistent request req, if known. */
+static
+void
+start__ (MPI_Request req, double t_start)
+{
+  pthread_mutex_lock (&lock__);
+  for (int i = 0; i < n_persistent__; ++i) {
+    if (persistent__[i].req == req) {
+      if (n_pending__ < MPIT_MAX_PENDING) {
+	pending__t* p = &pending__[n_pending__++];
+	*p = persistent__[i];
+	p->rec.t_start = t_start;
+	p->rec.t_end = t_start;
+      }
+      break;
+    }
+  }
+  pthread_mutex_unlock (&lock__);
+}
+
+/** Forgets the persistent request req, if known. */
+static
+void
+forget__ (MPI_Request req)
+{
+  pthread_mutex_lock (&lock__);
+  for (int i = 0; i < n_persistent__; ++i) {
+    if (persistent__[i].req == req) {
+      persistent__[i] = persistent__[--n_persistent__];
+      break;
+    }
+  }
+  pthread_mutex_unlock (&lock__);
+}
+
+/* ------------------------------------------------------------ */
+
+static
+void
+open__ (void)
+{
+  PMPI_Comm_rank (MPI_COMM_WORLD, &rank__);
+  int nprocs;
+  PMPI_Comm_size (MPI_COMM_WORLD, &nprocs);
+
+  const char* prefix = getenv ("MPIH_TRACE");
+  if (!prefix || !strlen (prefix))
+    prefix = MPIT_DEFAULT_PREFIX;
+  char filename[FILENAME_MAX];
+  snprintf (filename, sizeof (filename), "%s.%d.bin", prefix, rank__);
+  fp__ = fopen (filename, "wb");
+  if (!fp__)
+    fprintf (stderr, "[p%d] *** mpi_trace: Can't open '%s'; tracing disabled ***\n",
+	     rank__, filename);
+
+  /* Approximately align the clocks of all ranks */
+  PMPI_Barrier (MPI_COMM_WORLD);
+  t_origin__ = PMPI_Wtime ();
+
+  if (fp__) {
+    mpit_header_t h;
+    memcpy (h.magic, MPIT_MAGIC, sizeof (h.magic));
+    h.version = MPIT_VERSION;
+    h.rank = rank__;
+    h.nprocs = nprocs;
+    h.t_origin = t_origin__;
+    fwrite (&h, sizeof (h), 1, fp__);
+  }
+}
+
+int
+MPI_Init (int* argc, char*** argv)
+{
+  int retcode = PMPI_Init (argc, argv);
+  open__ ();
+  return retcode;
+}
+
+int
+MPI_Init_thread (int* argc, char*** argv, int required, int* provided)
+{
+  int retcode = PMPI_Init_thread (argc, argv, required, provided);
+  open__ ();
+  return retcode;
+}
+
+int
+MPI_Finalize (void)
+{
+  pthread_mutex_lock (&lock__);
+  flush__ ();
+  if (fp__) fclose (fp__);
+  fp__ = NULL;
+  pthread_mutex_unlock (&lock__);
+  return PMPI_Finalize ();
+}
+
+/* ------------------------------------------------------------
+ * Point-to-point
+ */
+
+int
+MPI_Send (const void* buf, int count, MPI_Datatype datatype, int dest,
+	  int tag, MPI_Comm comm)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Send (buf, count, datatype, dest, tag, comm);
+  record__ (MPIT_SEND, comm, dest, tag, bytes__ (count, datatype),
+	    t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Recv (void* buf, int count, MPI_Datatype datatype, int source,
+	  int tag, MPI_Comm comm, MPI_Status* status)
+{
+  MPI_Status stat;
+  double t_start = now__ ();
+  int retcode = PMPI_Recv (buf, count, datatype, source, tag, comm, &stat);
+  int n_recv = 0;
+  PMPI_Get_count (&stat, datatype, &n_recv);
+  record__ (MPIT_RECV, comm, stat.MPI_SOURCE, stat.MPI_TAG,
+	    bytes__ (n_recv, datatype), t_start, now__ ());
+  if (status != MPI_STATUS_IGNORE)
+    *status = stat;
+  return retcode;
+}
+
+int
+MPI_Sendrecv (const void* sendbuf, int sendcount, MPI_Datatype sendtype,
+	      int dest, int sendtag,
+	      void* recvbuf, int recvcount, MPI_Datatype recvtype,
+	      int source, int recvtag, MPI_Comm comm, MPI_Status* status)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Sendrecv (sendbuf, sendcount, sendtype, dest, sendtag,
+			       recvbuf, recvcount, recvtype, source, recvtag,
+			       comm, status);
+  record__ (MPIT_SENDRECV, comm, dest, sendtag, bytes__ (sendcount, sendtype),
+	    t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Isend (const void* buf, int count, MPI_Datatype datatype, int dest,
+	   int tag, MPI_Comm comm, MPI_Request* request)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Isend (buf, count, datatype, dest, tag, comm, request);
+  post__ (*request, MPIT_ISEND, comm, dest, tag, bytes__ (count, datatype),
+	  t_start);
+  return retcode;
+}
+
+int
+MPI_Irecv (void* buf, int count, MPI_Datatype datatype, int source,
+	   int tag, MPI_Comm comm, MPI_Request* request)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Irecv (buf, count, datatype, source, tag, comm, request);
+  post__ (*request, MPIT_IRECV, comm, source, tag, bytes__ (count, datatype),
+	  t_start);
+  return retcode;
+}
+
+int
+MPI_Wait (MPI_Request* request, MPI_Status* status)
+{
+  mpit_record_t rec;
+  int is_traced = claim__ (*request, &rec);
+  MPI_Status stat;
+  int retcode = PMPI_Wait (request, &stat);
+  if (is_traced)
+    complete__ (&rec, &stat, now__ ());
+  if (status != MPI_STATUS_IGNORE)
+    *status = stat;
+  return retcode;
+}
+
+int
+MPI_Waitall (int count, MPI_Request array_of_requests[],
+	     MPI_Status* array_of_statuses)
+{
+  mpit_record_t* recs = (mpit_record_t *)malloc (count * sizeof (mpit_record_t));
+  int* is_traced = (int *)malloc (count * sizeof (int));
+  MPI_Status* stats = (MPI_Status *)malloc (count * sizeof (MPI_Status));
+  assert ((recs && is_traced && stats) || !count);
+  for (int i = 0; i < count; ++i)
+    is_traced[i] = claim__ (array_of_requests[i], &recs[i]);
+
+  int retcode = PMPI_Waitall (count, array_of_requests, stats);
+
+  double t_end = now__ ();
+  for (int i = 0; i < count; ++i)
+    if (is_traced[i])
+      complete__ (&recs[i], &stats[i], t_end);
+  if (array_of_statuses != MPI_STATUSES_IGNORE)
+    memcpy (array_of_statuses, stats, count * sizeof (MPI_Status));
+  free (recs);
+  free (is_traced);
+  free (stats);
+  return retcode;
+}
+
+int
+MPI_Test (MPI_Request* request, int* flag, MPI_Status* status)
+{
+  MPI_Request req = *request;
+  MPI_Status stat;
+  int retcode = PMPI_Test (request, flag, &stat);
+  mpit_record_t rec;
+  if (*flag && claim__ (req, &rec))
+    complete__ (&rec, &stat, now__ ());
+  if (status != MPI_STATUS_IGNORE)
+    *status = stat;
+  return retcode;
+}
+
+int
+MPI_Send_init (const void* buf, int count, MPI_Datatype datatype, int dest,
+	       int tag, MPI_Comm comm, MPI_Request* request)
+{
+  int retcode = PMPI_Send_init (buf, count, datatype, dest, tag, comm, request);
+  init__ (*request, MPIT_ISEND, comm, dest, tag, bytes__ (count, datatype));
+  return retcode;
+}
+
+int
+MPI_Recv_init (void* buf, int count, MPI_Datatype datatype, int source,
+	       int tag, MPI_Comm comm, MPI_Request* request)
+{
+  int retcode = PMPI_Recv_init (buf, count, datatype, source, tag, comm, request);
+  init__ (*request, MPIT_IRECV, comm, source, tag, bytes__ (count, datatype));
+  return retcode;
+}
+
+int
+MPI_Start (MPI_Request* request)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Start (request);
+  start__ (*request, t_start);
+  return retcode;
+}
+
+int
+MPI_Startall (int count, MPI_Request array_of_requests[])
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Startall (count, array_of_requests);
+  for (int i = 0; i < count; ++i)
+    start__ (array_of_requests[i], t_start);
+  return retcode;
+}
+
+int
+MPI_Request_free (MPI_Request* request)
+{
+  MPI_Request req = *request;
+  mpit_record_t rec;
+  claim__ (req, &rec); /* Drop any pending entry, too */
+  forget__ (req);
+  return PMPI_Request_free (request);
+}
+
+/* ------------------------------------------------------------
+ * Collectives
+ */
+
+int
+MPI_Barrier (MPI_Comm comm)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Barrier (comm);
+  record__ (MPIT_BARRIER, comm, -1, -1, 0, t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Bcast (void* buffer, int count, MPI_Datatype datatype, int root,
+	   MPI_Comm comm)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Bcast (buffer, count, datatype, root, comm);
+  record__ (MPIT_BCAST, comm, root, -1, bytes__ (count, datatype),
+	    t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Reduce (const void* sendbuf, void* recvbuf, int count,
+	    MPI_Datatype datatype, MPI_Op op, int root, MPI_Comm comm)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Reduce (sendbuf, recvbuf, count, datatype, op, root, comm);
+  record__ (MPIT_REDUCE, comm, root, -1, bytes__ (count, datatype),
+	    t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Allreduce (const void* sendbuf, void* recvbuf, int count,
+	       MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+  double t_start = now__ ();
+  int retcode = PMPI_Allreduce (sendbuf, recvbuf, count, datatype, op, comm);
+  record__ (MPIT_ALLREDUCE, comm, -1, -1, 2 * bytes__ (count, datatype),
+	    t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Scatterv (const void* sendbuf, const int sendcounts[], const int displs[],
+	      MPI_Datatype sendtype, void* recvbuf, int recvcount,
+	      MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+  int rank, P;
+  PMPI_Comm_rank (comm, &rank);
+  PMPI_Comm_size (comm, &P);
+  int64_t bytes = bytes__ (recvcount, recvtype);
+  if (rank == root)
+    for (int r = 0; r < P; ++r)
+      bytes += bytes__ (sendcounts[r], sendtype);
+
+  double t_start = now__ ();
+  int retcode = PMPI_Scatterv (sendbuf, sendcounts, displs, sendtype,
+			       recvbuf, recvcount, recvtype, root, comm);
+  record__ (MPIT_SCATTERV, comm, root, -1, bytes, t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Gatherv (const void* sendbuf, int sendcount, MPI_Datatype sendtype,
+	     void* recvbuf, const int recvcounts[], const int displs[],
+	     MPI_Datatype recvtype, int root, MPI_Comm comm)
+{
+  int rank, P;
+  PMPI_Comm_rank (comm, &rank);
+  PMPI_Comm_size (comm, &P);
+  int64_t bytes = bytes__ (sendcount, sendtype);
+  if (rank == root)
+    for (int r = 0; r < P; ++r)
+      bytes += bytes__ (recvcounts[r], recvtype);
+
+  double t_start = now__ ();
+  int retcode = PMPI_Gatherv (sendbuf, sendcount, sendtype,
+			      recvbuf, recvcounts, displs, recvtype, root, comm);
+  record__ (MPIT_GATHERV, comm, root, -1, bytes, t_start, now__ ());
+  return retcode;
+}
+
+int
+MPI_Alltoallw (const void* sendbuf, const int sendcounts[], const int sdispls[],
+	       const MPI_Datatype sendtypes[],
+	       void* recvbuf, const int recvcounts[], const int rdispls[],
+	       const MPI_Datatype recvtypes[], MPI_Comm comm)
+{
+  int P;
+  PMPI_Comm_size (comm, &P);
+  int64_t bytes = 0;
+  for (int r = 0; r < P; ++r)
+    bytes += bytes__ (sendcounts[r], sendtypes[r])
+      + bytes__ (recvcounts[r], recvtypes[r]);
+
+  double t_start = now__ ();
+  int retcode = PMPI_Alltoallw (sendbuf, sendcounts, sdispls, sendtypes,
+				recvbuf, recvcounts, rdispls, recvtypes, comm);
+  record__ (MPIT_ALLTOALLW, comm, -1, -1, bytes, t_start, now__ ());
+  return retcode;
+}
+
+/* eof */
@@ -0,0 +1,86 @@
+/**
+ *  \file mpi_trace.h
+ *  \brief On-disk format of the per-rank MPI communication traces.
+ *
+ *  Linking mpi_trace.o into an MPI program interposes (via PMPI) on
+ *  the point-to-point and collective calls used in these labs. Each
+ *  rank buffers one record per call and writes them to the file
+ *  '<prefix>.<rank>.bin', where '<prefix>' is the value of the
+ *  environment variable 'MPIH_TRACE' (default: 'mpi-trace'). The
+ *  'trace-merge' tool combines these files into a Chrome trace
+ *  (chrome://tracing) and summarizes the achieved bandwidth.
+ *
+ *  \note This header deliberately does not include mpi.h, so that
+ *  readers of the trace files need not be MPI programs.
+ */
+
+#if !defined (INC_MPI_TRACE_H)
+#define INC_MPI_TRACE_H
+
+#include <stdint.h>
+
+/** Magic string at the start of every trace file. */
+#define MPIT_MAGIC "MPIT"
+
+/** Trace file format version. */
+#define MPIT_VERSION 1
+
+/** Default trace file prefix, if 'MPIH_TRACE' is not set. */
+#define MPIT_DEFAULT_PREFIX "mpi-trace"
+
+/** \brief Traced operations. */
+typedef enum {
+  MPIT_SEND = 0,
+  MPIT_RECV,
+  MPIT_SENDRECV,
+  MPIT_ISEND,       /*!< Spans post (or MPI_Start) to completion */
+  MPIT_IRECV,       /*!< Spans post (or MPI_Start) to completion */
+  MPIT_BCAST,
+  MPIT_REDUCE,
+  MPIT_ALLREDUCE,
+  MPIT_BARRIER,
+  MPIT_SCATTERV,
+  MPIT_GATHERV,
+  MPIT_ALLTOALLW,
+  MPIT_N_OPS
+} mpit_op_t;
+
+/** \brief Names of the operations, indexed by mpit_op_t. */
+#define MPIT_OP_NAMES { \
+    "MPI_Send", "MPI_Recv", "MPI_Sendrecv", "MPI_Isend", "MPI_Irecv", \
+    "MPI_Bcast", "MPI_Reduce", "MPI_Allreduce", "MPI_Barrier", \
+    "MPI_Scatterv", "MPI_Gatherv", "MPI_Alltoallw" }
+
+/** \brief Trace file header, written once per rank. */
+typedef struct {
+  char magic[4];    /*!< MPIT_MAGIC, without the terminating NUL */
+  int32_t version;  /*!< MPIT_VERSION */
+  int32_t rank;     /*!< Rank in MPI_COMM_WORLD */
+  int32_t nprocs;   /*!< Size of MPI_COMM_WORLD */
+  double t_origin;  /*!< MPI_Wtime () just after MPI_Init, post-barrier */
+} mpit_header_t;
+
+/**
+ *  \brief One traced call; the header is followed by these records
+ *  until the end of the file.
+ *
+ *  'bytes' counts the local payload: the bytes sent for sends
+ *  (including the send half of MPI_Sendrecv), the bytes posted for
+ *  receives, and the sum of this rank's send and receive buffers for
+ *  collectives. 'peer' is the partner (world) rank of point-to-point
+ *  calls, the root of rooted collectives, and -1 otherwise. Times are
+ *  in seconds relative to the header's t_origin.
+ */
+typedef struct {
+  int32_t op;       /*!< An mpit_op_t */
+  int32_t rank;
+  int32_t peer;
+  int32_t tag;
+  int64_t bytes;
+  double t_start;
+  double t_end;
+} mpit_record_t;
+
+#endif
+
+/* eof */
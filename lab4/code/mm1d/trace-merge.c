@@ -0,0 +1,160 @@
+/**
+ *  \file trace-merge.c
+ *
+ *  \brief Merges the per-rank traces written by mpi_trace.o into a
+ *  single Chrome trace (load it at chrome://tracing), and prints the
+ *  point-to-point bandwidth achieved per message size.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpi_trace.h"
+
+/** Message sizes are binned by powers of two, up to 2^(N_BINS-1) bytes. */
+#define N_BINS 48
+
+static const char* op_names__[MPIT_N_OPS] = MPIT_OP_NAMES;
+
+/** \brief Per-size-bin totals for the bandwidth summary. */
+typedef struct {
+  long count;
+  double bytes;
+  double seconds;
+} bin__t;
+
+static
+void
+usage__ (const char* progname)
+{
+  fprintf (stderr, "\n");
+  fprintf (stderr, "usage: %s <prefix> [<out.json>]\n", progname);
+  fprintf (stderr, "\n");
+  fprintf (stderr, "Reads <prefix>.<rank>.bin for every rank and writes a Chrome trace\n"
+	   "to <out.json> (default: <prefix>.json).\n");
+  fprintf (stderr, "\n");
+}
+
+/** Returns 1 if op is a send-side point-to-point operation. */
+static
+int
+isSend__ (int op)
+{
+  return op == MPIT_SEND || op == MPIT_ISEND || op == MPIT_SENDRECV;
+}
+
+/** Returns the bin index of a message of the given size. */
+static
+int
+getBin__ (long long bytes)
+{
+  int b = 0;
+  while (b < N_BINS - 1 && (2LL << b) <= bytes)
+    ++b;
+  return b;
+}
+
+/**
+ *  \brief Appends the records of one rank's trace to the JSON file,
+ *  and accumulates its sends into bins. Returns the number of ranks
+ *  in the job, or -1 if the trace file does not exist.
+ */
+static
+int
+mergeRank__ (const char* prefix, int rank, FILE* fp_json, long* p_n_events,
+	     bin__t* bins)
+{
+  char filename[FILENAME_MAX];
+  snprintf (filename, sizeof (filename), "%s.%d.bin", prefix, rank);
+  FILE* fp = fopen (filename, "rb");
+  if (!fp) return -1;
+
+  mpit_header_t h;
+  if (fread (&h, sizeof (h), 1, fp) != 1
+      || memcmp (h.magic, MPIT_MAGIC, sizeof (h.magic)) != 0
+      || h.version != MPIT_VERSION) {
+    fprintf (stderr, "*** '%s' is not a version %d trace file ***\n",
+	     filename, MPIT_VERSION);
+    exit (1);
+  }
+
+  fprintf (fp_json, "%s{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d,"
+	   " \"args\": {\"name\": \"rank %d\"}}",
+	   *p_n_events ? ",\n" : "", rank, rank);
+  ++(*p_n_events);
+
+  mpit_record_t rec;
+  while (fread (&rec, sizeof (rec), 1, fp) == 1) {
+    assert (rec.op >= 0 && rec.op < MPIT_N_OPS);
+    /* Chrome traces are in microseconds */
+    fprintf (fp_json, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\","
+	     " \"pid\": %d, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f,"
+	     " \"args\": {\"peer\": %d, \"tag\": %d, \"bytes\": %lld}}",
+	     op_names__[rec.op], (rec.op <= MPIT_IRECV) ? "p2p" : "collective",
+	     rec.rank, rec.t_start * 1e6, (rec.t_end - rec.t_start) * 1e6,
+	     rec.peer, rec.tag, (long long)rec.bytes);
+    ++(*p_n_events);
+
+    if (isSend__ (rec.op) && rec.bytes > 0) {
+      bin__t* b = &bins[getBin__ (rec.bytes)];
+      b->count++;
+      b->bytes += rec.bytes;
+      b->seconds += rec.t_end - rec.t_start;
+    }
+  }
+  fclose (fp);
+  return h.nprocs;
+}
+
+int
+main (int argc, char** argv)
+{
+  if (argc < 2 || argc > 3) {
+    usage__ (argv[0]);
+    return 1;
+  }
+  const char* prefix = argv[1];
+  char json_name[FILENAME_MAX];
+  if (argc == 3)
+    snprintf (json_name, sizeof (json_name), "%s", argv[2]);
+  else
+    snprintf (json_name, sizeof (json_name), "%s.json", prefix);
+
+  FILE* fp_json = fopen (json_name, "w");
+  if (!fp_json) {
+    fprintf (stderr, "*** Can't open '%s' for writing ***\n", json_name);
+    return 1;
+  }
+  fprintf (fp_json, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+  bin__t bins[N_BINS];
+  memset (bins, 0, sizeof (bins));
+  long n_events = 0;
+  int P = mergeRank__ (prefix, 0, fp_json, &n_events, bins);
+  if (P < 0) {
+    fprintf (stderr, "*** Can't open '%s.0.bin' ***\n", prefix);
+    return 1;
+  }
+  for (int r = 1; r < P; ++r)
+    if (mergeRank__ (prefix, r, fp_json, &n_events, bins) < 0)
+      fprintf (stderr, "*** Missing trace for rank %d ***\n", r);
+
+  fprintf (fp_json, "\n]}\n");
+  fclose (fp_json);
+  fprintf (stderr, "Wrote %ld events from %d ranks to %s\n", n_events, P, json_name);
+
+  /* Bandwidth summary, in a gnuplot-friendly format */
+  printf ("# Point-to-point sends (Send, Isend, Sendrecv), binned by size\n");
+  printf ("# %12s %10s %14s %14s\n", "min_bytes", "count", "avg_time_us", "MB/s");
+  for (int b = 0; b < N_BINS; ++b) {
+    if (!bins[b].count) continue;
+    printf ("  %12lld %10ld %14.3f %14.3f\n", 1LL << b, bins[b].count,
+	    1e6 * bins[b].seconds / bins[b].count,
+	    (bins[b].seconds > 0) ? 1e-6 * bins[b].bytes / bins[b].seconds : 0.0);
+  }
+  return 0;
+}
+
+/* eof */
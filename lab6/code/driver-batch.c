@@ -0,0 +1,183 @@
+/**
+ *  \file driver-batch.c
+ *
+ *  \brief Checks and times the batched CPU matrix multiply of
+ *  mm-batch.c, and reports aggregate GFLOP/s for each size class.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#include "driver.h"
+#include "mm-batch.h"
+#include "timer.h"
+
+#if !defined (NUM_ITER)
+#  define NUM_ITER 5
+#endif
+
+/** Size classes run when no size is given. */
+static const unsigned int SIZES[] = { 16, 24, 32, 48, 64, 96, 128 };
+#define N_SIZES (sizeof (SIZES) / sizeof (SIZES[0]))
+
+/** At most this many matrices of each batch are checked against the reference. */
+#define N_CHECK 16
+
+void
+parseArgs (int argc, char** argv, unsigned int *batch, unsigned int *N)
+{
+	if(argc < 2 || argc > 3) {
+		fprintf (stderr, "usage: %s <batch> [<N>]\n", argv[0]);
+		fprintf (stderr, "Without N, runs N = 16, 24, 32, 48, 64, 96, 128\n");
+		exit (EXIT_FAILURE);
+	} else {
+		*batch = atoi (argv[1]);
+		*N = (argc == 3) ? atoi (argv[2]) : 0;
+	}
+}
+
+void
+initArray (dtype* A, size_t N)
+{
+	for(size_t i = 0; i < N; i++) {
+		A[i] = rand () / (float) RAND_MAX;
+	}
+}
+
+/** Reference product, accumulated in double. */
+void
+refMM (const dtype* A, const dtype* B, dtype* C, unsigned int N)
+{
+	for (unsigned int i = 0; i < N; ++i) {
+		for (unsigned int j = 0; j < N; ++j) {
+			double sum = 0;
+			for (unsigned int k = 0; k < N; ++k)
+				sum += (double) A[i * N + k] * B[k * N + j];
+			C[i * N + j] = (float)sum;
+		}
+	}
+}
+
+/** Returns the relative L2 error of data. */
+double
+relErrorL2 (const dtype* reference, const dtype* data, unsigned int len)
+{
+	double error = 0, ref = 0;
+	for(unsigned int i = 0; i < len; ++i) {
+		double diff = reference[i] - data[i];
+		error += diff * diff;
+		ref += (double) reference[i] * reference[i];
+	}
+	return (ref > 0) ? sqrt (error / ref) : sqrt (error);
+}
+
+/**
+ *  Runs one size class: times the strided and pointer-array forms,
+ *  checks a sample of the products, and returns 1 if they are correct.
+ */
+int
+runSize (unsigned int N, unsigned int batch)
+{
+	const size_t NN = (size_t) N * N;
+	dtype* A = (dtype *) malloc (NN * batch * sizeof (dtype));
+	dtype* B = (dtype *) malloc (NN * batch * sizeof (dtype));
+	dtype* C = (dtype *) malloc (NN * batch * sizeof (dtype));
+	dtype* C_ptr = (dtype *) malloc (NN * batch * sizeof (dtype));
+	dtype* ref = (dtype *) malloc (NN * sizeof (dtype));
+	const dtype** A_array = (const dtype **) malloc (batch * sizeof (dtype *));
+	const dtype** B_array = (const dtype **) malloc (batch * sizeof (dtype *));
+	dtype** C_array = (dtype **) malloc (batch * sizeof (dtype *));
+	assert (A && B && C && C_ptr && ref && A_array && B_array && C_array);
+
+	initArray (A, NN * batch);
+	initArray (B, NN * batch);
+	memset (C, 0, NN * batch * sizeof (dtype));
+	memset (C_ptr, 0, NN * batch * sizeof (dtype));
+
+	/* The pointer array visits the matrices in reverse order */
+	for (unsigned int b = 0; b < batch; ++b) {
+		A_array[b] = A + (batch - 1 - b) * NN;
+		B_array[b] = B + (batch - 1 - b) * NN;
+		C_array[b] = C_ptr + (batch - 1 - b) * NN;
+	}
+
+	struct stopwatch_t* timer = stopwatch_create ();
+	long double t_strided = -1, t_ptr = -1;
+	for (int iter = 0; iter < NUM_ITER; iter++) {
+		stopwatch_start (timer);
+		cpuMMBatchedStrided (A, NN, B, NN, C, NN, N, batch);
+		long double t = stopwatch_stop (timer);
+		if (t_strided < 0 || t < t_strided) t_strided = t;
+
+		stopwatch_start (timer);
+		cpuMMBatched (A_array, B_array, C_array, N, batch);
+		t = stopwatch_stop (timer);
+		if (t_ptr < 0 || t < t_ptr) t_ptr = t;
+	}
+	stopwatch_destroy (timer);
+
+	/* Both forms run the same kernel on the same data */
+	int ok = memcmp (C, C_ptr, NN * batch * sizeof (dtype)) == 0;
+	double err = 0;
+	const unsigned int step = (batch + N_CHECK - 1) / N_CHECK;
+	for (unsigned int b = 0; b < batch; b += (step ? step : 1)) {
+		refMM (A + b * NN, B + b * NN, ref, N);
+		double e = relErrorL2 (ref, C + b * NN, NN);
+		if (e > err) err = e;
+	}
+	ok &= err < 1.0e-6;
+
+	const double flops = 2.0 * N * N * N * (double) batch;
+	printf ("%4u  %-11s %8u  %10.3Lf  %10.3Lf  %9.2e  %s\n", N,
+		cpuMMBatchedIsSpecialized (N) ? "specialized" : "generic",
+		batch, flops / t_strided * 1e-9L, flops / t_ptr * 1e-9L, err,
+		ok ? "Correct answer" : "Incorrect answer");
+
+	free (A);
+	free (B);
+	free (C);
+	free (C_ptr);
+	free (ref);
+	free (A_array);
+	free (B_array);
+	free (C_array);
+	return ok;
+}
+
+int
+main (int argc, char** argv)
+{
+	unsigned int batch, N;
+
+	parseArgs (argc, argv, &batch, &N);
+	assert (batch > 0);
+
+	srand (2006);
+	stopwatch_init ();
+#if defined (_OPENMP)
+	fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+#endif
+	fprintf (stderr, "Micro-kernels: %s\n", cpuMMBatchedIsa ());
+
+	printf ("%4s  %-11s %8s  %10s  %10s  %9s\n", "N", "kernel", "batch",
+		"GFLOP/s", "GFLOP/s", "rel. err");
+	printf ("%4s  %-11s %8s  %10s  %10s\n", "", "", "", "(strided)", "(pointers)");
+	int ok = 1;
+	if (N) {
+		ok = runSize (N, batch);
+	} else {
+		for (unsigned int s = 0; s < N_SIZES; s++)
+			ok &= runSize (SIZES[s], batch);
+	}
+
+	return ok ? 0 : EXIT_FAILURE;
+}
+
+/* eof */
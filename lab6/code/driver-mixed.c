@@ -0,0 +1,167 @@
+/**
+ *  \file driver-mixed.c
+ *
+ *  \brief Checks and times the mixed-precision matrix multiply of
+ *  mm-mixed.c for each input and accumulation type, and the cost of
+ *  its fused error bound.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#include "driver.h"
+#include "mm-mixed.h"
+#include "timer.h"
+
+#if !defined (NUM_ITER)
+#  define NUM_ITER 5
+#endif
+
+void
+parseArgs (int argc, char** argv, unsigned int *N)
+{
+	if(argc != 2) {
+		fprintf (stderr, "usage: %s <N>\n", argv[0]);
+		exit (EXIT_FAILURE);
+	} else {
+		*N = atoi (argv[1]);
+	}
+}
+
+void
+initArray (dtype* A, unsigned int N)
+{
+	for(unsigned int i = 0; i < N; i++) {
+		/* Both signs, so that |A|*|B| is well above |A*B| */
+		A[i] = 2.0f * rand () / (float) RAND_MAX - 1.0f;
+	}
+}
+
+/** C <- A*B in double; its own error is below N*2^-53 of |A|*|B|. */
+void
+refMM (const dtype* A, const dtype* B, double* C, unsigned int N)
+{
+	for (unsigned int i = 0; i < N; ++i) {
+		for (unsigned int j = 0; j < N; ++j)
+			C[i * N + j] = 0;
+		for (unsigned int k = 0; k < N; ++k) {
+			const double a = A[i * N + k];
+			for (unsigned int j = 0; j < N; ++j)
+				C[i * N + j] += a * B[k * N + j];
+		}
+	}
+}
+
+/** Returns the best of NUM_ITER runs of cpuMMMixed (), in seconds. */
+long double
+timeMM (mmInput_t input, mmAccum_t accum, const void* A, const void* B,
+	dtype* C, dtype* C_bound, unsigned int N)
+{
+	struct stopwatch_t* timer = stopwatch_create ();
+	long double t_best = -1;
+	for (int iter = 0; iter < NUM_ITER; iter++) {
+		stopwatch_start (timer);
+		cpuMMMixed (input, accum, A, B, C, C_bound, N);
+		long double t = stopwatch_stop (timer);
+		if (t_best < 0 || t < t_best) t_best = t;
+	}
+	stopwatch_destroy (timer);
+	return t_best;
+}
+
+int
+main (int argc, char** argv)
+{
+	unsigned int N = 0;
+	parseArgs (argc, argv, &N);
+	assert (N > 0);
+
+	const size_t NN = (size_t) N * N;
+	dtype* A = (dtype *) malloc (NN * sizeof (dtype));
+	dtype* B = (dtype *) malloc (NN * sizeof (dtype));
+	dtype* A_r = (dtype *) malloc (NN * sizeof (dtype));
+	dtype* B_r = (dtype *) malloc (NN * sizeof (dtype));
+	bf16_t* A_h = (bf16_t *) malloc (NN * sizeof (bf16_t));
+	bf16_t* B_h = (bf16_t *) malloc (NN * sizeof (bf16_t));
+	dtype* C = (dtype *) malloc (NN * sizeof (dtype));
+	dtype* C_bound = (dtype *) malloc (NN * sizeof (dtype));
+	double* ref = (double *) malloc (NN * sizeof (double));
+	double* ref_h = (double *) malloc (NN * sizeof (double));
+	assert (A && B && A_r && B_r && A_h && B_h && C && C_bound && ref && ref_h);
+
+	srand (2006);
+	initArray (A, NN);
+	initArray (B, NN);
+	for (size_t i = 0; i < NN; i++) {
+		A_h[i] = floatToBf16 (A[i]);
+		B_h[i] = floatToBf16 (B[i]);
+		A_r[i] = bf16ToFloat (A_h[i]);
+		B_r[i] = bf16ToFloat (B_h[i]);
+	}
+
+	/* The bound is for the product of the stored inputs, so bf16 runs
+	 * are checked against the product of the rounded inputs. */
+	refMM (A, B, ref, N);
+	refMM (A_r, B_r, ref_h, N);
+
+	stopwatch_init ();
+#if defined (_OPENMP)
+	fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+#endif
+	fprintf (stderr, "Kernels: %s\n", cpuMMMixedIsa ());
+
+	printf ("%-5s %-6s  %10s  %10s  %9s  %10s  %9s\n", "input", "accum",
+		"GFLOP/s", "(no bound)", "bound ovh", "err/bound", "rel. L2");
+	int ok = 1;
+	for (int input = MM_INPUT_FLOAT; input <= MM_INPUT_BF16; input++) {
+		for (int accum = MM_ACCUM_FLOAT; accum <= MM_ACCUM_DOUBLE; accum++) {
+			const void* A_in = (input == MM_INPUT_FLOAT) ? (const void *) A : (const void *) A_h;
+			const void* B_in = (input == MM_INPUT_FLOAT) ? (const void *) B : (const void *) B_h;
+			const double* R = (input == MM_INPUT_FLOAT) ? ref : ref_h;
+
+			long double t_plain = timeMM (input, accum, A_in, B_in, C, NULL, N);
+			long double t_fused = timeMM (input, accum, A_in, B_in, C, C_bound, N);
+
+			/* Largest error as a fraction of its bound: <= 1 */
+			const double factor = cpuMMMixedBoundFactor (accum, N) + N * ldexp (1.0, -53);
+			double worst = 0, err2 = 0, ref2 = 0;
+			for (size_t i = 0; i < NN; i++) {
+				const double e = fabs (C[i] - R[i]);
+				const double ratio = (C_bound[i] > 0) ? e / (factor * C_bound[i]) : (e > 0) * INFINITY;
+				if (ratio > worst) worst = ratio;
+				err2 += e * e;
+				ref2 += R[i] * R[i];
+			}
+			ok &= worst <= 1.0;
+
+			const double flops = 2.0 * N * N * (double) N;
+			printf ("%-5s %-6s  %10.3Lf  %10.3Lf  %8.1Lf%%  %10.3g  %9.2e  %s\n",
+				(input == MM_INPUT_FLOAT) ? "float" : "bf16",
+				(accum == MM_ACCUM_FLOAT) ? "float" : "double",
+				flops / t_fused * 1e-9L, flops / t_plain * 1e-9L,
+				100.0L * (t_fused - t_plain) / t_plain, worst,
+				sqrt (err2 / ref2),
+				(worst <= 1.0) ? "Correct answer" : "Incorrect answer");
+		}
+	}
+
+	free (A);
+	free (B);
+	free (A_r);
+	free (B_r);
+	free (A_h);
+	free (B_h);
+	free (C);
+	free (C_bound);
+	free (ref);
+	free (ref_h);
+	return ok ? 0 : EXIT_FAILURE;
+}
+
+/* eof */
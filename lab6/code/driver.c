@@ -5,50 +5,24 @@
 #include <math.h>
 
 #include "driver.h"
+#include "mm-mixed.h"
 
+/**
+ *  Returns the number of entries of data farther from reference than
+ *  factor * bound, where bound = |A|*|B| from cpuMMMixed ().
+ */
 int
-compareL2fe(const float* reference, const float* data, const unsigned int len, 
-						const float epsilon)
+cmpBound (const dtype* reference, const dtype* data, const dtype* bound,
+	  unsigned int len, double factor)
 {
 	unsigned int i;
-	float error = 0;
-	float ref = 0;
+	int cnt = 0;
 
 	for(i = 0; i < len; ++i) {
-		float diff = reference[i] - data[i];
-		error += diff * diff;
-		ref += reference[i] * reference[i];
+		if(fabs ((double) reference[i] - data[i]) > factor * bound[i]) cnt++;
 	}
 
-	float normRef = sqrtf(ref);
-	if (fabs(ref) < 1e-7) {
-			return 0;
-	}
-	float normError = sqrtf(error);
-	error = normError / normRef;
-
-	int result;
-	if(error < epsilon) result = 1; else result = 0;
-
-	return result;
-}
-
-void
-cpuMM (dtype* A, dtype* B, dtype* C, unsigned int N)
-{
-	unsigned int i, j, k;
-	for (i = 0; i < N; ++i) {
-		for (j = 0; j < N; ++j) {
-			double sum = 0;
-			for (k = 0; k < N; ++k) {
-				double a = A[i * N + k];
-				double b = B[k * N + j];
-				sum += a * b;
-			}
-			C[i * N + j] = (float)sum;
-		}
-	}	
-
+	return cnt;
 }
 
 void
@@ -78,24 +52,11 @@ initArray (dtype* A, unsigned int N)
 	}
 }
 
-int
-cmpArr (dtype* a, dtype* b, int N, float tol)
-{
-	int cnt, i;
-
-	cnt = 0;
-	for(i = 0; i < N; i++) {
-		if(fabs(a[i] - b[i]) > tol) cnt++;
-	}
-
-	return cnt;
-}
-
 
 int main (int argc, char** argv)
 {
 	/* declare variables */
-	dtype *h_A, *d_A, *h_B, *d_B, *h_C, *d_C, *h_Reference;
+	dtype *h_A, *d_A, *h_B, *d_B, *h_C, *d_C, *h_Reference, *h_Bound;
 	unsigned int N, OPT;
 	int cnt;
 
@@ -112,6 +73,7 @@ int main (int argc, char** argv)
 	h_B = (dtype*) malloc (N * N * sizeof (dtype));
 	h_C = (dtype*) malloc (N * N * sizeof (dtype));
 	h_Reference = (dtype*) malloc (N * N * sizeof (dtype));
+	h_Bound = (dtype*) malloc (N * N * sizeof (dtype));
 	initArray (h_A, N * N);
 	initArray (h_B, N * N);
 	initCudaArray (&d_A, h_A, N * N);
@@ -121,18 +83,24 @@ int main (int argc, char** argv)
 	/* do matrix multiply */
 	cudaMM (d_A, d_B, d_C, N, OPT, h_C);
 
-	/* compare answers */	
-	cpuMM (h_A, h_B, h_Reference, N);
-	if(compareL2fe(h_Reference, h_C, N * N, 1.0e-6f)) {
+	/* compare answers: the reference accumulates in double, the GPU in
+	 * float, and the bound |A|*|B| comes from the same pass */
+	cpuMMMixed (MM_INPUT_FLOAT, MM_ACCUM_DOUBLE, h_A, h_B, h_Reference, h_Bound, N);
+	cnt = cmpBound (h_Reference, h_C, h_Bound, N * N,
+			cpuMMMixedBoundFactor (MM_ACCUM_DOUBLE, N)
+			+ cpuMMMixedBoundFactor (MM_ACCUM_FLOAT, N));
+	if(cnt == 0) {
 		fprintf (stderr, "Correct answer\n");
 	} else {
-		fprintf (stderr, "Incorrect answer\n");
-		cnt = cmpArr (h_Reference, h_C, N * N, 1.0e-5f);
+		fprintf (stderr, "Incorrect answer (%d entries outside the error bound)\n", cnt);
 	}
 
 
 	free (h_A);
 	free (h_B);
+	free (h_C);
+	free (h_Reference);
+	free (h_Bound);
 	
 	return 0;
 }
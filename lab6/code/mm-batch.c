@@ -0,0 +1,250 @@
+/**
+ *  \file mm-batch.c
+ *
+ *  \brief Batched matrix multiply for the CPU; see mm-batch.h.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+
+#if defined (__AVX__)
+#  include <immintrin.h>
+#endif
+
+#include "driver.h"
+#include "mm-batch.h"
+
+/** Batches with fewer flops than this run on the calling thread only. */
+#define PARALLEL_MIN_FLOPS (1 << 20)
+
+#define TILE_M MM_BATCH_TILE_M
+#define TILE_N MM_BATCH_TILE_N
+
+/** Computes C[b] <- A[b] * B[b] for one n x n product. */
+typedef void (*mm_kernel_t) (const dtype* restrict A, const dtype* restrict B,
+			     dtype* restrict C, unsigned int n);
+
+/* =================================================== */
+/*
+ * Register tile: the TILE_M x TILE_N block of C at (i, j) is kept in
+ * registers while k runs over all of A's row i and B's column j. The
+ * tile is inlined into each kernel below, so for the size-specialized
+ * kernels n (and so the trip count and all strides) is a constant.
+ */
+
+#if defined (__AVX__)
+#  if defined (__FMA__)
+#    define MADD(a, b, c) _mm256_fmadd_ps ((a), (b), (c))
+#  else
+#    define MADD(a, b, c) _mm256_add_ps (_mm256_mul_ps ((a), (b)), (c))
+#  endif
+
+static inline
+void
+tile (const dtype* restrict A, const dtype* restrict B, dtype* restrict C,
+      unsigned int n)
+{
+	__m256 c00 = _mm256_setzero_ps (), c01 = _mm256_setzero_ps ();
+	__m256 c10 = _mm256_setzero_ps (), c11 = _mm256_setzero_ps ();
+	__m256 c20 = _mm256_setzero_ps (), c21 = _mm256_setzero_ps ();
+	__m256 c30 = _mm256_setzero_ps (), c31 = _mm256_setzero_ps ();
+	for (unsigned int k = 0; k < n; ++k) {
+		const __m256 b0 = _mm256_loadu_ps (B + k * n);
+		const __m256 b1 = _mm256_loadu_ps (B + k * n + 8);
+		__m256 a = _mm256_broadcast_ss (A + 0 * n + k);
+		c00 = MADD (a, b0, c00);
+		c01 = MADD (a, b1, c01);
+		a = _mm256_broadcast_ss (A + 1 * n + k);
+		c10 = MADD (a, b0, c10);
+		c11 = MADD (a, b1, c11);
+		a = _mm256_broadcast_ss (A + 2 * n + k);
+		c20 = MADD (a, b0, c20);
+		c21 = MADD (a, b1, c21);
+		a = _mm256_broadcast_ss (A + 3 * n + k);
+		c30 = MADD (a, b0, c30);
+		c31 = MADD (a, b1, c31);
+	}
+	_mm256_storeu_ps (C + 0 * n, c00);
+	_mm256_storeu_ps (C + 0 * n + 8, c01);
+	_mm256_storeu_ps (C + 1 * n, c10);
+	_mm256_storeu_ps (C + 1 * n + 8, c11);
+	_mm256_storeu_ps (C + 2 * n, c20);
+	_mm256_storeu_ps (C + 2 * n + 8, c21);
+	_mm256_storeu_ps (C + 3 * n, c30);
+	_mm256_storeu_ps (C + 3 * n + 8, c31);
+}
+
+/* The same for a TILE_M x TILE_N/2 block, at the right edge of C */
+static inline
+void
+halfTile (const dtype* restrict A, const dtype* restrict B, dtype* restrict C,
+	  unsigned int n)
+{
+	__m256 c0 = _mm256_setzero_ps (), c1 = _mm256_setzero_ps ();
+	__m256 c2 = _mm256_setzero_ps (), c3 = _mm256_setzero_ps ();
+	for (unsigned int k = 0; k < n; ++k) {
+		const __m256 b = _mm256_loadu_ps (B + k * n);
+		c0 = MADD (_mm256_broadcast_ss (A + 0 * n + k), b, c0);
+		c1 = MADD (_mm256_broadcast_ss (A + 1 * n + k), b, c1);
+		c2 = MADD (_mm256_broadcast_ss (A + 2 * n + k), b, c2);
+		c3 = MADD (_mm256_broadcast_ss (A + 3 * n + k), b, c3);
+	}
+	_mm256_storeu_ps (C + 0 * n, c0);
+	_mm256_storeu_ps (C + 1 * n, c1);
+	_mm256_storeu_ps (C + 2 * n, c2);
+	_mm256_storeu_ps (C + 3 * n, c3);
+}
+
+#else
+
+static inline
+void
+tile (const dtype* restrict A, const dtype* restrict B, dtype* restrict C,
+      unsigned int n)
+{
+	dtype c[TILE_M][TILE_N] = {{0}};
+	for (unsigned int k = 0; k < n; ++k)
+		for (int r = 0; r < TILE_M; ++r) {
+			const dtype a = A[r * n + k];
+			for (int s = 0; s < TILE_N; ++s)
+				c[r][s] += a * B[k * n + s];
+		}
+	for (int r = 0; r < TILE_M; ++r)
+		for (int s = 0; s < TILE_N; ++s)
+			C[r * n + s] = c[r][s];
+}
+
+static inline
+void
+halfTile (const dtype* restrict A, const dtype* restrict B, dtype* restrict C,
+	  unsigned int n)
+{
+	dtype c[TILE_M][TILE_N / 2] = {{0}};
+	for (unsigned int k = 0; k < n; ++k)
+		for (int r = 0; r < TILE_M; ++r) {
+			const dtype a = A[r * n + k];
+			for (int s = 0; s < TILE_N / 2; ++s)
+				c[r][s] += a * B[k * n + s];
+		}
+	for (int r = 0; r < TILE_M; ++r)
+		for (int s = 0; s < TILE_N / 2; ++s)
+			C[r * n + s] = c[r][s];
+}
+#endif
+
+/* =================================================== */
+/*
+ * Kernels. DEFINE_KERNEL (NAME, SIZE) makes a kernel for n = SIZE;
+ * with SIZE = n_arg the size is only known at run time. When n is not
+ * a multiple of TILE_N, the rows of full tiles end with one half tile
+ * if at least TILE_N/2 columns are left (e.g. n = 24, 48 or 96). The
+ * elements of C that remain (fewer than TILE_N/2 columns, or the last
+ * n % TILE_M rows) are accumulated a row of C at a time, so B is still
+ * read along its rows.
+ */
+
+#define DEFINE_KERNEL(NAME, SIZE)					\
+static									\
+void									\
+NAME (const dtype* restrict A, const dtype* restrict B,		\
+      dtype* restrict C, unsigned int n_arg)				\
+{									\
+	const unsigned int n = (SIZE);					\
+	const unsigned int m_tiles = n - n % TILE_M;			\
+	const unsigned int n_tiles = n - n % TILE_N;			\
+	const unsigned int n_halves = n - n % (TILE_N / 2);		\
+	(void) n_arg;							\
+	for (unsigned int i = 0; i < m_tiles; i += TILE_M) {		\
+		for (unsigned int j = 0; j < n_tiles; j += TILE_N)	\
+			tile (A + i * n, B + j, C + i * n + j, n);	\
+		if (n_halves > n_tiles)					\
+			halfTile (A + i * n, B + n_tiles, C + i * n + n_tiles, n); \
+	}								\
+	for (unsigned int i = 0; i < n; ++i) {				\
+		const unsigned int j_first = (i < m_tiles) ? n_halves : 0; \
+		if (j_first == n)					\
+			continue;					\
+		for (unsigned int j = j_first; j < n; ++j)		\
+			C[i * n + j] = 0;				\
+		for (unsigned int k = 0; k < n; ++k) {			\
+			const dtype a = A[i * n + k];			\
+			for (unsigned int j = j_first; j < n; ++j)	\
+				C[i * n + j] += a * B[k * n + j];	\
+		}							\
+	}								\
+}
+
+DEFINE_KERNEL (mmFixed16, 16)
+DEFINE_KERNEL (mmFixed32, 32)
+DEFINE_KERNEL (mmFixed64, 64)
+DEFINE_KERNEL (mmFixed128, 128)
+DEFINE_KERNEL (mmAny, n_arg)
+
+static
+mm_kernel_t
+getKernel (unsigned int N)
+{
+	switch (N) {
+		case 16: return mmFixed16;
+		case 32: return mmFixed32;
+		case 64: return mmFixed64;
+		case 128: return mmFixed128;
+		default: return mmAny;
+	}
+}
+
+static
+int
+isParallel (unsigned int N, unsigned int batch)
+{
+	return batch > 1 && 2.0 * N * N * N * batch >= PARALLEL_MIN_FLOPS;
+}
+
+/* =================================================== */
+
+void
+cpuMMBatched (const dtype* const* A, const dtype* const* B,
+	      dtype* const* C, unsigned int N, unsigned int batch)
+{
+	const mm_kernel_t kernel = getKernel (N);
+	assert (batch == 0 || (A && B && C));
+
+	#pragma omp parallel for schedule (static) if (isParallel (N, batch))
+	for (long b = 0; b < (long) batch; ++b)
+		kernel (A[b], B[b], C[b], N);
+}
+
+void
+cpuMMBatchedStrided (const dtype* A, size_t strideA,
+		     const dtype* B, size_t strideB,
+		     dtype* C, size_t strideC,
+		     unsigned int N, unsigned int batch)
+{
+	const mm_kernel_t kernel = getKernel (N);
+	assert (strideC >= (size_t) N * N || batch <= 1);
+
+	#pragma omp parallel for schedule (static) if (isParallel (N, batch))
+	for (long b = 0; b < (long) batch; ++b)
+		kernel (A + b * strideA, B + b * strideB, C + b * strideC, N);
+}
+
+int
+cpuMMBatchedIsSpecialized (unsigned int N)
+{
+	const mm_kernel_t kernel = getKernel (N);
+	return kernel != mmAny;
+}
+
+const char*
+cpuMMBatchedIsa (void)
+{
+#if defined (__AVX__) && defined (__FMA__)
+	return "AVX+FMA";
+#elif defined (__AVX__)
+	return "AVX";
+#else
+	return "scalar";
+#endif
+}
+
+/* eof */
@@ -0,0 +1,54 @@
+/**
+ *  \file mm-batch.h
+ *
+ *  \brief Batched matrix multiply for the CPU.
+ *
+ *  Each call computes C[b] <- A[b] * B[b] for b = 0, ..., batch-1,
+ *  where all matrices are N x N, row-major and dense, as in cudaMM ().
+ *  The matrices are given either as arrays of pointers or as a base
+ *  pointer and a stride (in elements) between consecutive matrices.
+ *
+ *  The batch is split across OpenMP threads; each matrix product runs
+ *  on one thread. Sizes 16, 32, 64 and 128 use micro-kernels compiled
+ *  for that size; other sizes use the same register-tiled kernel with
+ *  a run-time size.
+ *
+ *  Include "driver.h" (for dtype) first.
+ */
+
+#if !defined (INC_MM_BATCH_H)
+#define INC_MM_BATCH_H
+
+#include <stddef.h>
+
+/** Rows and columns of C computed at once by the micro-kernel. */
+#define MM_BATCH_TILE_M 4
+#define MM_BATCH_TILE_N 16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \brief C[b] <- A[b] * B[b], for b < batch. */
+void cpuMMBatched (const dtype* const* A, const dtype* const* B,
+		   dtype* const* C, unsigned int N, unsigned int batch);
+
+/** \brief C + b*strideC <- (A + b*strideA) * (B + b*strideB), for b < batch. */
+void cpuMMBatchedStrided (const dtype* A, size_t strideA,
+			  const dtype* B, size_t strideB,
+			  dtype* C, size_t strideC,
+			  unsigned int N, unsigned int batch);
+
+/** \brief Returns 1 if size N has a size-specialized micro-kernel. */
+int cpuMMBatchedIsSpecialized (unsigned int N);
+
+/** \brief Name of the SIMD instruction set used by the micro-kernels. */
+const char* cpuMMBatchedIsa (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* eof */
@@ -0,0 +1,223 @@
+/**
+ *  \file mm-mixed.c
+ *
+ *  \brief Mixed-precision matrix multiply with a fused error bound;
+ *  see mm-mixed.h.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <immintrin.h>
+
+#include "driver.h"
+#include "mm-mixed.h"
+
+/* =================================================== */
+
+bf16_t
+floatToBf16 (float x)
+{
+	uint32_t u;
+	memcpy (&u, &x, sizeof (u));
+	if ((u & 0x7fffffff) > 0x7f800000) /* NaN: keep it quiet */
+		return (bf16_t) ((u >> 16) | 0x40);
+	u += 0x7fff + ((u >> 16) & 1);
+	return (bf16_t) (u >> 16);
+}
+
+float
+bf16ToFloat (bf16_t x)
+{
+	uint32_t u = (uint32_t) x << 16;
+	float f;
+	memcpy (&f, &u, sizeof (f));
+	return f;
+}
+
+/** Element i of an input array, as a float. */
+static inline float getFloat (const void* X, size_t i) { return ((const float *) X)[i]; }
+static inline float getBf16 (const void* X, size_t i) { return bf16ToFloat (((const bf16_t *) X)[i]); }
+
+/* =================================================== */
+/*
+ * Register tiles. A tile computes the TILE_M x TILE_N block of C at
+ * (i, j), and the same block of C_bound if bound is set, with k
+ * running over all of A's rows i and over Bp, the columns of B from j
+ * on, packed as floats with row pitch J_BLOCK. Accumulating |a|*|b|
+ * costs one more FMA per product, but no more loads.
+ *
+ * The tiles are compiled for AVX2 and FMA whatever the build targets,
+ * and only called if the CPU running them has both (haveTiles ()), so
+ * the same binary also runs on nodes without them.
+ */
+
+#define TILE_M 4
+#define TILE_N_FLOAT 8  /* one vector of floats */
+#define TILE_N_DOUBLE 4 /* one vector of doubles */
+
+/** Columns of B packed at a time; a multiple of both tile widths. */
+#define J_BLOCK 64
+
+#define ABS_PS(x) _mm256_andnot_ps (_mm256_set1_ps (-0.0f), (x))
+#define ABS_PD(x) _mm256_andnot_pd (_mm256_set1_pd (-0.0), (x))
+
+/* Float accumulation: TILE_M x 8 */
+#define DEFINE_TILE_F(NAME, GET)					\
+__attribute__ ((target ("avx2,fma")))					\
+static									\
+void									\
+NAME (const void* A, const float* Bp, dtype* C, dtype* Cb,		\
+      unsigned int N, size_t i, size_t j, int bound)			\
+{									\
+	__m256 c[TILE_M], d[TILE_M];					\
+	for (int r = 0; r < TILE_M; ++r)				\
+		c[r] = d[r] = _mm256_setzero_ps ();			\
+	for (size_t k = 0; k < N; ++k) {				\
+		const __m256 b = _mm256_loadu_ps (Bp + k * J_BLOCK);	\
+		const __m256 b_abs = ABS_PS (b);			\
+		for (int r = 0; r < TILE_M; ++r) {			\
+			const float a = GET (A, (i + r) * N + k);	\
+			c[r] = _mm256_fmadd_ps (_mm256_set1_ps (a), b, c[r]); \
+			if (bound)					\
+				d[r] = _mm256_fmadd_ps (_mm256_set1_ps (fabsf (a)), b_abs, d[r]); \
+		}							\
+	}								\
+	for (int r = 0; r < TILE_M; ++r) {				\
+		_mm256_storeu_ps (C + (i + r) * N + j, c[r]);		\
+		if (bound)						\
+			_mm256_storeu_ps (Cb + (i + r) * N + j, d[r]);	\
+	}								\
+}
+
+/* Double accumulation: TILE_M x 4 */
+#define DEFINE_TILE_D(NAME, GET)					\
+__attribute__ ((target ("avx2,fma")))					\
+static									\
+void									\
+NAME (const void* A, const float* Bp, dtype* C, dtype* Cb,		\
+      unsigned int N, size_t i, size_t j, int bound)			\
+{									\
+	__m256d c[TILE_M], d[TILE_M];					\
+	for (int r = 0; r < TILE_M; ++r)				\
+		c[r] = d[r] = _mm256_setzero_pd ();			\
+	for (size_t k = 0; k < N; ++k) {				\
+		const __m256d b = _mm256_cvtps_pd (_mm_loadu_ps (Bp + k * J_BLOCK)); \
+		const __m256d b_abs = ABS_PD (b);			\
+		for (int r = 0; r < TILE_M; ++r) {			\
+			const double a = GET (A, (i + r) * N + k);	\
+			c[r] = _mm256_fmadd_pd (_mm256_set1_pd (a), b, c[r]); \
+			if (bound)					\
+				d[r] = _mm256_fmadd_pd (_mm256_set1_pd (fabs (a)), b_abs, d[r]); \
+		}							\
+	}								\
+	for (int r = 0; r < TILE_M; ++r) {				\
+		_mm_storeu_ps (C + (i + r) * N + j, _mm256_cvtpd_ps (c[r])); \
+		if (bound)						\
+			_mm_storeu_ps (Cb + (i + r) * N + j, _mm256_cvtpd_ps (d[r])); \
+	}								\
+}
+
+DEFINE_TILE_F (tileFloatF, getFloat)
+DEFINE_TILE_F (tileBf16F, getBf16)
+DEFINE_TILE_D (tileFloatD, getFloat)
+DEFINE_TILE_D (tileBf16D, getBf16)
+
+static
+int
+haveTiles (void)
+{
+	__builtin_cpu_init ();
+	return __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma");
+}
+
+/* =================================================== */
+/*
+ * Products. Full tiles are done J_BLOCK columns of C at a time: those
+ * columns of B are first packed (and converted to float) into a
+ * contiguous buffer, since rows of B that are a power of two apart
+ * would otherwise conflict in the cache. The tiles are split across
+ * OpenMP threads by rows. The ragged right and bottom edges are done
+ * one element at a time in the same precision; without AVX2 and FMA,
+ * everything is done that way.
+ */
+
+#define DEFINE_MM(NAME, GET, ACC_T, FMA, TILE_N, TILE_FN)		\
+static									\
+void									\
+NAME (const void* A, const void* B, dtype* C, dtype* Cb, unsigned int N) \
+{									\
+	const int bound = (Cb != NULL);					\
+	const int tiles = haveTiles ();					\
+	const size_t m_tiles = tiles ? N - N % TILE_M : 0;		\
+	const size_t n_tiles = tiles ? N - N % (TILE_N) : 0;		\
+	float* Bp = m_tiles ? (float *) malloc ((size_t) N * J_BLOCK * sizeof (float)) : NULL; \
+	assert (Bp || !m_tiles);					\
+	_Pragma ("omp parallel if (m_tiles)")				\
+	for (size_t jb = 0; jb < (m_tiles ? n_tiles : 0); jb += J_BLOCK) { \
+		const size_t j_end = (jb + J_BLOCK < n_tiles) ? jb + J_BLOCK : n_tiles; \
+		_Pragma ("omp for schedule (static)")			\
+		for (long k = 0; k < (long) N; ++k)			\
+			for (size_t j = jb; j < j_end; ++j)		\
+				Bp[k * J_BLOCK + j - jb] = GET (B, k * N + j); \
+		_Pragma ("omp for schedule (static)")			\
+		for (long i = 0; i < (long) m_tiles; i += TILE_M)	\
+			for (size_t j = jb; j < j_end; j += (TILE_N))	\
+				TILE_FN (A, Bp + j - jb, C, Cb, N, i, j, bound); \
+	}								\
+	free (Bp);							\
+	_Pragma ("omp parallel for schedule (static)")			\
+	for (long i = 0; i < (long) N; ++i)				\
+		for (size_t j = ((size_t) i < m_tiles) ? n_tiles : 0; j < N; ++j) { \
+			ACC_T cij = 0, cij_bound = 0;			\
+			for (size_t k = 0; k < N; ++k) {		\
+				const ACC_T a = GET (A, i * N + k);	\
+				const ACC_T b = GET (B, k * N + j);	\
+				cij = FMA (a, b, cij);			\
+				cij_bound = FMA (fabs (a), fabs (b), cij_bound); \
+			}						\
+			C[i * N + j] = cij;				\
+			if (bound)					\
+				Cb[i * N + j] = cij_bound;		\
+		}							\
+}
+
+DEFINE_MM (mmFloatF, getFloat, float, fmaf, TILE_N_FLOAT, tileFloatF)
+DEFINE_MM (mmBf16F, getBf16, float, fmaf, TILE_N_FLOAT, tileBf16F)
+DEFINE_MM (mmFloatD, getFloat, double, fma, TILE_N_DOUBLE, tileFloatD)
+DEFINE_MM (mmBf16D, getBf16, double, fma, TILE_N_DOUBLE, tileBf16D)
+
+/* =================================================== */
+
+void
+cpuMMMixed (mmInput_t input, mmAccum_t accum,
+	    const void* A, const void* B, dtype* C, dtype* C_bound,
+	    unsigned int N)
+{
+	assert ((A && B && C) || !N);
+	if (input == MM_INPUT_FLOAT)
+		(accum == MM_ACCUM_FLOAT ? mmFloatF : mmFloatD) (A, B, C, C_bound, N);
+	else
+		(accum == MM_ACCUM_FLOAT ? mmBf16F : mmBf16D) (A, B, C, C_bound, N);
+}
+
+double
+cpuMMMixedBoundFactor (mmAccum_t accum, unsigned int N)
+{
+	/* gamma_N for the accumulation, then the rounding of C and of
+	 * C_bound to float (Higham, Accuracy and Stability, 3.1) */
+	const double u = ldexp (1.0, (accum == MM_ACCUM_FLOAT) ? -24 : -53);
+	const double u_f = ldexp (1.0, -24);
+	const double gamma = N * u / (1.0 - N * u);
+	return (gamma + u_f * (1.0 + gamma)) / ((1.0 - gamma) * (1.0 - u_f));
+}
+
+const char*
+cpuMMMixedIsa (void)
+{
+	return haveTiles () ? "AVX2+FMA" : "scalar";
+}
+
+/* eof */
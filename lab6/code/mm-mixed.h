@@ -0,0 +1,69 @@
+/**
+ *  \file mm-mixed.h
+ *
+ *  \brief Mixed-precision matrix multiply for the CPU, with a fused
+ *  error bound.
+ *
+ *  Computes C <- A * B for N x N row-major matrices whose inputs are
+ *  stored as float or bf16 and whose products are accumulated (with
+ *  FMA) in float or double; C is always stored as float. In the same
+ *  pass it can also compute C_bound <- |A| * |B|, so that
+ *
+ *    |C - A*B| <= cpuMMMixedBoundFactor (accum, N) * C_bound
+ *
+ *  elementwise, where A*B is the exact product of the stored inputs.
+ *  The bound shares its loads with the product, so checking a result
+ *  against it costs no second multiply.
+ *
+ *  Include "driver.h" (for dtype) first.
+ */
+
+#if !defined (INC_MM_MIXED_H)
+#define INC_MM_MIXED_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** bfloat16: the upper 16 bits of an IEEE float. */
+typedef uint16_t bf16_t;
+
+typedef enum {
+	MM_INPUT_FLOAT = 0,
+	MM_INPUT_BF16
+} mmInput_t;
+
+typedef enum {
+	MM_ACCUM_FLOAT = 0,
+	MM_ACCUM_DOUBLE
+} mmAccum_t;
+
+/** \brief Rounds x to the nearest bf16 (ties to even). */
+bf16_t floatToBf16 (float x);
+
+/** \brief Converts x to float (exactly). */
+float bf16ToFloat (bf16_t x);
+
+/**
+ *  \brief C <- A * B, and C_bound <- |A| * |B| unless C_bound is
+ *  NULL. A and B hold N*N elements of the type given by 'input'.
+ */
+void cpuMMMixed (mmInput_t input, mmAccum_t accum,
+		 const void* A, const void* B, dtype* C, dtype* C_bound,
+		 unsigned int N);
+
+/** \brief Returns the factor of C_bound that bounds the error of cpuMMMixed (). */
+double cpuMMMixedBoundFactor (mmAccum_t accum, unsigned int N);
+
+/** \brief Name of the SIMD instruction set used by the kernels. */
+const char* cpuMMMixedIsa (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* eof */
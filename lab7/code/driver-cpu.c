@@ -0,0 +1,310 @@
+/**
+ *  \file driver-cpu.c
+ *
+ *  \brief Checks and times the CPU reductions of reduce-cpu.c, in the
+ *  format of the CUDA driver, and compares their bandwidth to a
+ *  STREAM triad.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#include "timer.h"
+#include "reduce-cpu.h"
+#include "tune.h"
+
+#if !defined (NUM_ITER)
+#  define NUM_ITER 5
+#endif
+
+/** The STREAM arrays have at least this many elements (out of cache). */
+#define STREAM_MIN_N (1 << 22)
+
+#define N_TESTS 12
+
+/** Thread counts under which the reproducible sums must agree bitwise. */
+#define REPRO_MAX_THREADS 4
+
+void
+parseArgs (int argc, char** argv, unsigned int *N, unsigned int *OPT)
+{
+	if(argc < 2 || argc > 3) {
+		fprintf (stderr, "usage: %s <N> [<test type>]\n", argv[0]);
+		fprintf (stderr, "[0]: All (default) | [1-4]: Sum, Min, Max, Argmax of floats | [5-8]: Sum, Min, Max, Argmax of doubles\n");
+		fprintf (stderr, "[9-10]: Compensated, Binned sum of floats | [11-12]: Compensated, Binned sum of doubles\n");
+		exit (EXIT_FAILURE);
+	} else {
+		*N = atoi (argv[1]);
+		*OPT = (argc == 3) ? atoi (argv[2]) : 0;
+	}
+}
+
+void
+initArray (float* A, unsigned int N)
+{
+	unsigned int i;
+
+	srand (time (NULL));
+
+	for(i = 0;i < N; i++) {
+		A[i] = (rand () & 0xFF) / ((float) RAND_MAX);
+	}
+}
+
+/* =================================================== */
+/*
+ * Scalar references
+ */
+
+double
+refSum (const double* A, unsigned int N)
+{
+	double ans = 0.0;
+	for(unsigned int i = 0; i < N; i++)
+		ans += A[i];
+	return ans;
+}
+
+double
+refMin (const double* A, unsigned int N)
+{
+	double ans = INFINITY;
+	for(unsigned int i = 0; i < N; i++)
+		if(A[i] < ans) ans = A[i];
+	return ans;
+}
+
+double
+refMax (const double* A, unsigned int N)
+{
+	double ans = -INFINITY;
+	for(unsigned int i = 0; i < N; i++)
+		if(A[i] > ans) ans = A[i];
+	return ans;
+}
+
+size_t
+refArgmax (const double* A, unsigned int N)
+{
+	size_t ans = 0;
+	for(unsigned int i = 1; i < N; i++)
+		if(A[i] > A[ans]) ans = i;
+	return ans;
+}
+
+/* =================================================== */
+
+/** Returns the STREAM triad bandwidth, in GB/s (best of NUM_ITER). */
+double
+streamTriad (unsigned int N)
+{
+	size_t n = (N < STREAM_MIN_N) ? STREAM_MIN_N : N;
+	double* a = (double *) malloc (n * sizeof (double));
+	double* b = (double *) malloc (n * sizeof (double));
+	double* c = (double *) malloc (n * sizeof (double));
+	assert (a && b && c);
+
+	#pragma omp parallel for
+	for(size_t i = 0; i < n; i++) {
+		a[i] = 0.0;
+		b[i] = 1.0;
+		c[i] = 2.0;
+	}
+
+	struct stopwatch_t* timer = stopwatch_create ();
+	long double t_best = -1;
+	for(int iter = 0; iter < NUM_ITER; iter++) {
+		stopwatch_start (timer);
+		#pragma omp parallel for
+		for(size_t i = 0; i < n; i++)
+			a[i] = b[i] + 3.0 * c[i];
+		long double t = stopwatch_stop (timer);
+		if(t_best < 0 || t < t_best) t_best = t;
+	}
+	stopwatch_destroy (timer);
+	assert (a[n-1] == 7.0);
+
+	free (a);
+	free (b);
+	free (c);
+	return 3.0 * sizeof (double) * n / t_best * 1e-9;
+}
+
+/** Returns the answer of test OPT. */
+double
+doTest (unsigned int OPT, const float* A, const double* A_d, unsigned int N)
+{
+	switch (OPT) {
+		case 1: return reduceSumFloat (A, N);
+		case 2: return reduceMinFloat (A, N);
+		case 3: return reduceMaxFloat (A, N);
+		case 4: return reduceArgmaxFloat (A, N);
+		case 5: return reduceSumDouble (A_d, N);
+		case 6: return reduceMinDouble (A_d, N);
+		case 7: return reduceMaxDouble (A_d, N);
+		case 8: return reduceArgmaxDouble (A_d, N);
+		case 9: return reduceSumModeFloat (A, N, REDUCE_SUM_COMPENSATED);
+		case 10: return reduceSumModeFloat (A, N, REDUCE_SUM_BINNED);
+		case 11: return reduceSumModeDouble (A_d, N, REDUCE_SUM_COMPENSATED);
+		case 12: return reduceSumModeDouble (A_d, N, REDUCE_SUM_BINNED);
+		default: assert (0);
+	}
+	return 0;
+}
+
+/** Returns the average time of NUM_ITER runs of test OPT, in ms. */
+long double
+timeTest (unsigned int OPT, const float* A, const double* A_d, unsigned int N,
+	  double* ans)
+{
+	struct stopwatch_t* timer = stopwatch_create ();
+	stopwatch_start (timer);
+	for(int iter = 0; iter < NUM_ITER; iter++)
+		*ans = doTest (OPT, A, A_d, N);
+	long double elapsedTime = stopwatch_stop (timer) * 1e3 / NUM_ITER;
+	stopwatch_destroy (timer);
+	return elapsedTime;
+}
+
+/**
+ *  Checks that reproducible sum OPT gives bitwise the same answer
+ *  with 1 to REPRO_MAX_THREADS threads, and (for the binned sum)
+ *  with the elements in reverse order. Returns 1 if so.
+ */
+int
+checkRepro (unsigned int OPT, const float* A, const double* A_d, unsigned int N,
+	    double ans)
+{
+	int ok = 1;
+#if defined (_OPENMP)
+	const int nt_saved = omp_get_max_threads ();
+	for(int nt = 1; nt <= REPRO_MAX_THREADS; nt++) {
+		omp_set_num_threads (nt);
+		ok &= memcmp (&ans, &(double){ doTest (OPT, A, A_d, N) }, sizeof (ans)) == 0;
+	}
+	omp_set_num_threads (nt_saved);
+#endif
+	if(OPT == 10 || OPT == 12) {
+		float* R = (float *) malloc (N * sizeof (float));
+		double* R_d = (double *) malloc (N * sizeof (double));
+		assert (R && R_d);
+		for(unsigned int i = 0; i < N; i++) {
+			R[i] = A[N-1-i];
+			R_d[i] = A_d[N-1-i];
+		}
+		ok &= memcmp (&ans, &(double){ doTest (OPT, R, R_d, N) }, sizeof (ans)) == 0;
+		free (R);
+		free (R_d);
+	}
+	fprintf (stderr, "Bitwise reproducible (1-%d threads%s): %s\n",
+		 REPRO_MAX_THREADS, (OPT == 10 || OPT == 12) ? ", reversed" : "",
+		 ok ? "yes" : "*** NO ***");
+	return ok;
+}
+
+/**
+ *  Runs test OPT on A (float) and A_d (the same values, as doubles),
+ *  prints its time and bandwidth, and returns 1 if the answer is
+ *  correct.
+ */
+int
+runTest (unsigned int OPT, const float* A, const double* A_d, unsigned int N,
+	 double stream_gbs)
+{
+	const char* names[N_TESTS] = {
+		"Sum (float)", "Min (float)", "Max (float)", "Argmax (float)",
+		"Sum (double)", "Min (double)", "Max (double)", "Argmax (double)",
+		"Compensated sum (float)", "Binned sum (float)",
+		"Compensated sum (double)", "Binned sum (double)"
+	};
+	const size_t elem = (OPT <= 4 || OPT == 9 || OPT == 10) ? sizeof (float) : sizeof (double);
+	double ans = 0, ref = 0;
+	double tol = 0;
+
+	fprintf (stderr, "Executing CPU test case [%d]: %s, %s\n", OPT,
+		 names[OPT-1], reduceCpuIsa ());
+
+	long double elapsedTime = timeTest (OPT, A, A_d, N, &ans);
+
+	switch ((OPT <= 8) ? (OPT - 1) % 4 : 0) {
+		case 0: ref = refSum (A_d, N); tol = 1e-8 * N; break;
+		case 1: ref = refMin (A_d, N); break;
+		case 2: ref = refMax (A_d, N); break;
+		case 3: ref = refArgmax (A_d, N); break;
+	}
+
+	const double gbs = (N * elem / elapsedTime) * 1e-6;
+	fprintf (stderr, "Execution time: %Lf ms\n", elapsedTime);
+	fprintf (stderr, "Equivalent performance: %f GB/s\n", gbs);
+	fprintf (stderr, "Fraction of STREAM triad: %.1f%%\n", 100.0 * gbs / stream_gbs);
+
+	int ok = fabs (ans - ref) <= tol;
+	if(OPT > 8) {
+		double fast;
+		long double t_fast = timeTest ((OPT <= 10) ? 1 : 5, A, A_d, N, &fast);
+		fprintf (stderr, "Cost relative to the fast sum: %.2Lfx\n", elapsedTime / t_fast);
+		ok &= checkRepro (OPT, A, A_d, N, ans);
+	}
+	if(ok) {
+		fprintf (stderr, "Answer is correct\n");
+	} else {
+		fprintf (stderr, "*** Answer is WRONG ***\n");
+	}
+	fprintf (stderr, "Reference answer is %.17g\n", ref);
+	fprintf (stderr, "CPU answer is %.17g\n", ans);
+	return ok;
+}
+
+int main (int argc, char** argv)
+{
+	float *A;
+	double *A_d;
+	unsigned int N, OPT;
+
+	/* read arguments */
+	N = 0;
+	OPT = 0;
+	parseArgs (argc, argv, &N, &OPT);
+	assert ((N > 0));
+	assert ((OPT <= N_TESTS));
+
+	/* Settings from reduce-tune, if it has been run */
+	reduceCpuSetParams (tuneGetLong ("reduce", N, "parallel_min", 0),
+			    tuneGetLong ("reduce", N, "argmax_block", 0));
+
+	/* declare and initialize data */
+	A = (float*) malloc (N * sizeof (float));
+	A_d = (double*) malloc (N * sizeof (double));
+	assert (A && A_d);
+	initArray (A, N);
+	for(unsigned int i = 0; i < N; i++)
+		A_d[i] = A[i];
+
+	stopwatch_init ();
+#if defined (_OPENMP)
+	fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+#endif
+	size_t parallel_min, argmax_block;
+	reduceCpuGetParams (&parallel_min, &argmax_block);
+	fprintf (stderr, "Parallel min: %zu, argmax block: %zu\n", parallel_min, argmax_block);
+	double stream_gbs = streamTriad (N);
+	fprintf (stderr, "STREAM triad: %f GB/s\n", stream_gbs);
+
+	int ok = 1;
+	for(unsigned int opt = 1; opt <= N_TESTS; opt++)
+		if(!OPT || opt == OPT)
+			ok &= runTest (opt, A, A_d, N, stream_gbs);
+
+	free (A);
+	free (A_d);
+
+	return ok ? 0 : EXIT_FAILURE;
+}
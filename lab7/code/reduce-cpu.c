@@ -0,0 +1,587 @@
+/**
+ *  \file reduce-cpu.c
+ *
+ *  \brief Multithreaded SIMD reductions; see reduce-cpu.h.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#if defined (__AVX__)
+#  include <immintrin.h>
+#endif
+
+#include "reduce-cpu.h"
+
+/** Inputs shorter than this are reduced by the calling thread only. */
+static size_t parallel_min = REDUCE_PARALLEL_MIN;
+
+/** Chunk boundaries are multiples of this many elements (a cache line). */
+#define CHUNK_ALIGN 16
+
+/** Block length of the first (block maximum) pass of argmax. */
+static size_t argmax_block = REDUCE_ARGMAX_BLOCK;
+
+/* =================================================== */
+/*
+ * Vector primitives. Without AVX, the "vectors" are scalars, so that
+ * the kernels below still get four independent accumulators.
+ */
+
+#if defined (__AVX__)
+#  define VL_F 8
+#  define VEC_F __m256
+#  define LOAD_F(p) _mm256_loadu_ps (p)
+#  define STORE_F(p, v) _mm256_storeu_ps ((p), (v))
+#  define SET1_F(x) _mm256_set1_ps (x)
+#  define ADD_F(a, b) _mm256_add_ps ((a), (b))
+#  define MIN_F(a, b) _mm256_min_ps ((a), (b))
+#  define MAX_F(a, b) _mm256_max_ps ((a), (b))
+#  define LOADABS_F(p) _mm256_andnot_ps (_mm256_set1_ps (-0.0f), _mm256_loadu_ps (p))
+
+#  define VL_D 4
+#  define VEC_D __m256d
+#  define LOAD_D(p) _mm256_loadu_pd (p)
+#  define STORE_D(p, v) _mm256_storeu_pd ((p), (v))
+#  define SET1_D(x) _mm256_set1_pd (x)
+#  define ADD_D(a, b) _mm256_add_pd ((a), (b))
+#  define MIN_D(a, b) _mm256_min_pd ((a), (b))
+#  define MAX_D(a, b) _mm256_max_pd ((a), (b))
+#  define SUB_D(a, b) _mm256_sub_pd ((a), (b))
+#  define LOADABS_D(p) _mm256_andnot_pd (_mm256_set1_pd (-0.0), _mm256_loadu_pd (p))
+#  define LOADCVT_D(p) _mm256_cvtps_pd (_mm_loadu_ps (p)) /* 4 floats */
+#else
+#  define VL_F 1
+#  define VEC_F float
+#  define LOAD_F(p) (*(p))
+#  define STORE_F(p, v) (*(p) = (v))
+#  define SET1_F(x) (x)
+#  define ADD_F(a, b) ((a) + (b))
+#  define MIN_F(a, b) SMIN ((a), (b))
+#  define MAX_F(a, b) SMAX ((a), (b))
+#  define LOADABS_F(p) fabsf (*(p))
+
+#  define VL_D 1
+#  define VEC_D double
+#  define LOAD_D(p) (*(p))
+#  define STORE_D(p, v) (*(p) = (v))
+#  define SET1_D(x) (x)
+#  define ADD_D(a, b) ((a) + (b))
+#  define MIN_D(a, b) SMIN ((a), (b))
+#  define MAX_D(a, b) SMAX ((a), (b))
+#  define SUB_D(a, b) ((a) - (b))
+#  define LOADABS_D(p) fabs (*(p))
+#  define LOADCVT_D(p) ((double) *(p))
+#endif
+
+#define SVAL(x) (x)
+#define SADD(a, b) ((a) + (b))
+#define SMIN(a, b) (((b) < (a)) ? (b) : (a))
+#define SMAX(a, b) (((b) > (a)) ? (b) : (a))
+
+/* =================================================== */
+/*
+ * Sequential kernels over A[0:n-1]: four vector accumulators, then a
+ * vector tail, the lanes, and a scalar tail.
+ */
+
+#define DEFINE_RANGE(NAME, T, V, VL, LOAD, STORE, SET1, OP, SOP, SLOAD, INIT) \
+static									\
+T									\
+NAME (const T* A, size_t n)						\
+{									\
+	V a0 = SET1 (INIT), a1 = a0, a2 = a0, a3 = a0;			\
+	size_t i = 0;							\
+	for(; i + 4*(VL) <= n; i += 4*(VL)) {				\
+		a0 = OP (a0, LOAD (A + i));				\
+		a1 = OP (a1, LOAD (A + i + (VL)));			\
+		a2 = OP (a2, LOAD (A + i + 2*(VL)));			\
+		a3 = OP (a3, LOAD (A + i + 3*(VL)));			\
+	}								\
+	for(; i + (VL) <= n; i += (VL))					\
+		a0 = OP (a0, LOAD (A + i));				\
+	a0 = OP (OP (a0, a1), OP (a2, a3));				\
+									\
+	T lanes[VL];							\
+	STORE (lanes, a0);						\
+	T r = lanes[0];							\
+	for(int k = 1; k < (VL); k++)					\
+		r = SOP (r, lanes[k]);					\
+	for(; i < n; i++)						\
+		r = SOP (r, SLOAD (A[i]));				\
+	return r;							\
+}
+
+DEFINE_RANGE (sumRangeFloat, float, VEC_F, VL_F, LOAD_F, STORE_F, SET1_F, ADD_F, SADD, SVAL, 0.0f)
+DEFINE_RANGE (minRangeFloat, float, VEC_F, VL_F, LOAD_F, STORE_F, SET1_F, MIN_F, SMIN, SVAL, INFINITY)
+DEFINE_RANGE (maxRangeFloat, float, VEC_F, VL_F, LOAD_F, STORE_F, SET1_F, MAX_F, SMAX, SVAL, -INFINITY)
+DEFINE_RANGE (sumRangeDouble, double, VEC_D, VL_D, LOAD_D, STORE_D, SET1_D, ADD_D, SADD, SVAL, 0.0)
+DEFINE_RANGE (minRangeDouble, double, VEC_D, VL_D, LOAD_D, STORE_D, SET1_D, MIN_D, SMIN, SVAL, INFINITY)
+DEFINE_RANGE (maxRangeDouble, double, VEC_D, VL_D, LOAD_D, STORE_D, SET1_D, MAX_D, SMAX, SVAL, -INFINITY)
+DEFINE_RANGE (absMaxRangeFloat, float, VEC_F, VL_F, LOADABS_F, STORE_F, SET1_F, MAX_F, SMAX, fabsf, 0.0f)
+DEFINE_RANGE (absMaxRangeDouble, double, VEC_D, VL_D, LOADABS_D, STORE_D, SET1_D, MAX_D, SMAX, fabs, 0.0)
+
+/**
+ *  Argmax over A[0:n-1] (n > 0) in two passes: find the first block
+ *  whose maximum is the largest with the vector kernel, then scan just
+ *  that block for the first index holding that maximum.
+ */
+#define DEFINE_ARGMAX_RANGE(NAME, T, MAX_RANGE)				\
+static									\
+size_t									\
+NAME (const T* A, size_t n, T* p_max)					\
+{									\
+	T best = MAX_RANGE (A, (n < argmax_block) ? n : argmax_block);	\
+	size_t best_block = 0;						\
+	for(size_t b = argmax_block; b < n; b += argmax_block) {	\
+		size_t len = (n - b < argmax_block) ? n - b : argmax_block; \
+		T m = MAX_RANGE (A + b, len);				\
+		if(m > best) {						\
+			best = m;					\
+			best_block = b;					\
+		}							\
+	}								\
+	*p_max = best;							\
+	for(size_t i = best_block; i < n; i++)				\
+		if(A[i] == best)					\
+			return i;					\
+	return best_block; /* Only if A holds NaNs */			\
+}
+
+DEFINE_ARGMAX_RANGE (argmaxRangeFloat, float, maxRangeFloat)
+DEFINE_ARGMAX_RANGE (argmaxRangeDouble, double, maxRangeDouble)
+
+/* =================================================== */
+/*
+ * Parallel drivers: one chunk per thread, then a tree combine of the
+ * per-thread results.
+ */
+
+#if defined (_OPENMP)
+#  define IF_OPENMP(x) x
+#else
+#  define IF_OPENMP(x)
+#endif
+
+/** Returns the number of threads to use for N elements. */
+static
+int
+getNumThreads (size_t N)
+{
+#if defined (_OPENMP)
+	if(N >= parallel_min)
+		return omp_get_max_threads ();
+#endif
+	return 1;
+}
+
+/** Sets [*lo, *hi) to the chunk of A[0:N-1] of thread t of nt. */
+static
+void
+getChunk (size_t N, int t, int nt, size_t* lo, size_t* hi)
+{
+	size_t len = (N + nt - 1) / nt;
+	len = (len + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+	*lo = (t * len < N) ? t * len : N;
+	*hi = (*lo + len < N) ? *lo + len : N;
+}
+
+#define DEFINE_REDUCE(NAME, T, RANGE, SOP, INIT)			\
+T									\
+NAME (const T* A, size_t N)						\
+{									\
+	const int nt = getNumThreads (N);				\
+	T* partial = (T *) malloc (nt * sizeof (T));			\
+	assert (partial);						\
+									\
+	_Pragma ("omp parallel num_threads (nt) if (nt > 1)")		\
+	{								\
+		int t = 0;						\
+		IF_OPENMP (t = omp_get_thread_num ());			\
+		size_t lo, hi;						\
+		getChunk (N, t, nt, &lo, &hi);				\
+		partial[t] = (hi > lo) ? RANGE (A + lo, hi - lo) : (INIT); \
+	}								\
+									\
+	for(int stride = 1; stride < nt; stride *= 2)			\
+		for(int t = 0; t + stride < nt; t += 2*stride)		\
+			partial[t] = SOP (partial[t], partial[t + stride]); \
+	T r = partial[0];						\
+	free (partial);							\
+	return r;							\
+}
+
+DEFINE_REDUCE (reduceSumFloat, float, sumRangeFloat, SADD, 0.0f)
+DEFINE_REDUCE (reduceMinFloat, float, minRangeFloat, SMIN, INFINITY)
+DEFINE_REDUCE (reduceMaxFloat, float, maxRangeFloat, SMAX, -INFINITY)
+DEFINE_REDUCE (reduceSumDouble, double, sumRangeDouble, SADD, 0.0)
+DEFINE_REDUCE (reduceMinDouble, double, minRangeDouble, SMIN, INFINITY)
+DEFINE_REDUCE (reduceMaxDouble, double, maxRangeDouble, SMAX, -INFINITY)
+DEFINE_REDUCE (reduceAbsMaxFloat, float, absMaxRangeFloat, SMAX, 0.0f)
+DEFINE_REDUCE (reduceAbsMaxDouble, double, absMaxRangeDouble, SMAX, 0.0)
+
+/** On ties, the smaller index wins, so that the result is the first maximum. */
+#define DEFINE_ARGMAX(NAME, T, RANGE)					\
+size_t									\
+NAME (const T* A, size_t N)						\
+{									\
+	assert (N > 0);							\
+	const int nt = getNumThreads (N);				\
+	T* val = (T *) malloc (nt * sizeof (T));			\
+	size_t* idx = (size_t *) malloc (nt * sizeof (size_t));		\
+	assert (val && idx);						\
+									\
+	_Pragma ("omp parallel num_threads (nt) if (nt > 1)")		\
+	{								\
+		int t = 0;						\
+		IF_OPENMP (t = omp_get_thread_num ());			\
+		size_t lo, hi;						\
+		getChunk (N, t, nt, &lo, &hi);				\
+		val[t] = -INFINITY;					\
+		idx[t] = N;						\
+		if(hi > lo)						\
+			idx[t] = lo + RANGE (A + lo, hi - lo, &val[t]);	\
+	}								\
+									\
+	for(int stride = 1; stride < nt; stride *= 2)			\
+		for(int t = 0; t + stride < nt; t += 2*stride) {	\
+			int u = t + stride;				\
+			if(val[u] > val[t] || (val[u] == val[t] && idx[u] < idx[t])) { \
+				val[t] = val[u];			\
+				idx[t] = idx[u];			\
+			}						\
+		}							\
+	size_t r = idx[0];						\
+	free (val);							\
+	free (idx);							\
+	return r;							\
+}
+
+DEFINE_ARGMAX (reduceArgmaxFloat, float, argmaxRangeFloat)
+DEFINE_ARGMAX (reduceArgmaxDouble, double, argmaxRangeDouble)
+
+/* =================================================== */
+/*
+ * Reproducible sums. Both modes accumulate in double, also for float
+ * inputs, and round to the input type once at the end.
+ *
+ * REDUCE_SUM_COMPENSATED: the input is cut into chunks of REPRO_CHUNK
+ * elements, independent of the number of threads. Each chunk is summed
+ * with Knuth's TwoSum (the error-free form of Neumaier's update) in
+ * every SIMD lane, and the chunk results are combined left to right.
+ * The answer is therefore independent of the thread count, though it
+ * may differ between builds with different vector widths.
+ *
+ * REDUCE_SUM_BINNED: in the style of ReproBLAS, every element is split
+ * into BIN_FOLDS pieces on fixed grids, 2^(E - k*BIN_WIDTH) for
+ * k = 1 .. BIN_FOLDS, where 2^E bounds max |A[i]|. A piece is extracted
+ * by rounding against the constant 1.5 * 2^52, which depends only on
+ * the element, and is accumulated as an exact integer. Integer sums
+ * are associative, so the answer is the same for any order, thread
+ * count, or vector width.
+ */
+
+/** Elements per chunk of the compensated sum. */
+#define REPRO_CHUNK 2048
+
+/** Number and width (in bits) of the bins of the binned sum. */
+#define BIN_FOLDS 3
+#define BIN_WIDTH 30
+
+/** Extracts the integer part of |t| < 2^51: t + MAGIC - MAGIC. */
+#define BIN_MAGIC 6755399441055744.0 /* 1.5 * 2^52 */
+
+/** TwoSum: s + c <- s + c + x, where the rounding error of s + x is exact. */
+static inline
+void
+twoSum (double* s, double* c, double x)
+{
+	double t = *s + x;
+	double z = t - *s;
+	*c += (*s - (t - z)) + (x - z);
+	*s = t;
+}
+
+#define TWOSUM_V(s, c, x) do {						\
+		VEC_D x_ = (x);						\
+		VEC_D t_ = ADD_D ((s), x_);				\
+		VEC_D z_ = SUB_D (t_, (s));				\
+		(c) = ADD_D ((c), ADD_D (SUB_D ((s), SUB_D (t_, z_)), SUB_D (x_, z_))); \
+		(s) = t_;						\
+	} while (0)
+
+#define DEFINE_COMPENSATED_RANGE(NAME, T, LOAD)			\
+static									\
+void									\
+NAME (const T* A, size_t n, double* p_s, double* p_c)			\
+{									\
+	VEC_D s0 = SET1_D (0.0), s1 = s0, s2 = s0, s3 = s0;		\
+	VEC_D c0 = s0, c1 = s0, c2 = s0, c3 = s0;			\
+	size_t i = 0;							\
+	for(; i + 4*VL_D <= n; i += 4*VL_D) {				\
+		TWOSUM_V (s0, c0, LOAD (A + i));			\
+		TWOSUM_V (s1, c1, LOAD (A + i + VL_D));			\
+		TWOSUM_V (s2, c2, LOAD (A + i + 2*VL_D));		\
+		TWOSUM_V (s3, c3, LOAD (A + i + 3*VL_D));		\
+	}								\
+	for(; i + VL_D <= n; i += VL_D)					\
+		TWOSUM_V (s0, c0, LOAD (A + i));			\
+									\
+	double ss[4*VL_D], cc[4*VL_D];					\
+	STORE_D (ss, s0); STORE_D (ss + VL_D, s1);			\
+	STORE_D (ss + 2*VL_D, s2); STORE_D (ss + 3*VL_D, s3);		\
+	STORE_D (cc, c0); STORE_D (cc + VL_D, c1);			\
+	STORE_D (cc + 2*VL_D, c2); STORE_D (cc + 3*VL_D, c3);		\
+	double s = 0.0, c = 0.0;					\
+	for(int k = 0; k < 4*VL_D; k++) {				\
+		twoSum (&s, &c, ss[k]);					\
+		c += cc[k];						\
+	}								\
+	for(; i < n; i++)						\
+		twoSum (&s, &c, (double) A[i]);				\
+	*p_s = s;							\
+	*p_c = c;							\
+}
+
+DEFINE_COMPENSATED_RANGE (compensatedRangeFloat, float, LOADCVT_D)
+DEFINE_COMPENSATED_RANGE (compensatedRangeDouble, double, LOAD_D)
+
+#define DEFINE_COMPENSATED(NAME, T, RANGE)				\
+static									\
+double									\
+NAME (const T* A, size_t N)						\
+{									\
+	const int nt = getNumThreads (N);				\
+	const long n_chunks = (N + REPRO_CHUNK - 1) / REPRO_CHUNK;	\
+	double* s = (double *) malloc (2 * n_chunks * sizeof (double));	\
+	double* c = s + n_chunks;					\
+	assert (s || !n_chunks);					\
+									\
+	_Pragma ("omp parallel for schedule (static) num_threads (nt) if (nt > 1)") \
+	for(long j = 0; j < n_chunks; j++) {				\
+		size_t lo = (size_t) j * REPRO_CHUNK;			\
+		size_t len = (N - lo < REPRO_CHUNK) ? N - lo : REPRO_CHUNK; \
+		RANGE (A + lo, len, &s[j], &c[j]);			\
+	}								\
+									\
+	double S = 0.0, C = 0.0;					\
+	for(long j = 0; j < n_chunks; j++) {				\
+		twoSum (&S, &C, s[j]);					\
+		C += c[j];						\
+	}								\
+	free (s);							\
+	return S + C;							\
+}
+
+DEFINE_COMPENSATED (sumCompensatedFloat, float, compensatedRangeFloat)
+DEFINE_COMPENSATED (sumCompensatedDouble, double, compensatedRangeDouble)
+
+/**
+ *  Adds the bins of x, scaled by c1 * c2 so that the top bin holds
+ *  integers of at most BIN_WIDTH bits, to I[0:BIN_FOLDS-1]. Returns
+ *  0 if x is a NaN.
+ */
+static inline
+int
+binScalar (double x, double c1, double c2, int64_t* I)
+{
+	const double w = (double) (1L << BIN_WIDTH);
+	double t = (x * c1) * c2;
+	if(t != t) return 0;
+	for(int k = 0; k < BIN_FOLDS; k++) {
+		double m = t + BIN_MAGIC;
+		double q = m - BIN_MAGIC;
+		int64_t m_bits, magic_bits;
+		double magic = BIN_MAGIC;
+		memcpy (&m_bits, &m, sizeof (m_bits));
+		memcpy (&magic_bits, &magic, sizeof (magic_bits));
+		I[k] += m_bits - magic_bits;
+		t = (t - q) * w;
+	}
+	return 1;
+}
+
+/** Same as binScalar (), over A[0:n-1]. */
+#if defined (__AVX2__)
+#  define BIN_VL 4
+#  define DEFINE_BINNED_RANGE(NAME, T, LOAD)				\
+static									\
+int									\
+NAME (const T* A, size_t n, double c1, double c2, int64_t* I)		\
+{									\
+	const __m256d v_c1 = _mm256_set1_pd (c1);			\
+	const __m256d v_c2 = _mm256_set1_pd (c2);			\
+	const __m256d v_w = _mm256_set1_pd ((double) (1L << BIN_WIDTH)); \
+	const __m256d v_magic = _mm256_set1_pd (BIN_MAGIC);		\
+	const __m256i v_magic_bits = _mm256_castpd_si256 (v_magic);	\
+	__m256i acc[BIN_FOLDS];						\
+	__m256d bad = _mm256_setzero_pd ();				\
+	for(int k = 0; k < BIN_FOLDS; k++)				\
+		acc[k] = _mm256_setzero_si256 ();			\
+	size_t i = 0;							\
+	for(; i + BIN_VL <= n; i += BIN_VL) {				\
+		__m256d t = _mm256_mul_pd (_mm256_mul_pd (LOAD (A + i), v_c1), v_c2); \
+		bad = _mm256_or_pd (bad, _mm256_cmp_pd (t, t, _CMP_UNORD_Q)); \
+		for(int k = 0; k < BIN_FOLDS; k++) {			\
+			__m256d m = _mm256_add_pd (t, v_magic);		\
+			__m256d q = _mm256_sub_pd (m, v_magic);		\
+			acc[k] = _mm256_add_epi64 (acc[k],		\
+				 _mm256_sub_epi64 (_mm256_castpd_si256 (m), v_magic_bits)); \
+			t = _mm256_mul_pd (_mm256_sub_pd (t, q), v_w);	\
+		}							\
+	}								\
+	for(int k = 0; k < BIN_FOLDS; k++) {				\
+		int64_t lanes[BIN_VL];					\
+		_mm256_storeu_si256 ((__m256i *) lanes, acc[k]);	\
+		for(int l = 0; l < BIN_VL; l++)				\
+			I[k] += lanes[l];				\
+	}								\
+	int ok = !_mm256_movemask_pd (bad);				\
+	for(; i < n; i++)						\
+		ok &= binScalar ((double) A[i], c1, c2, I);		\
+	return ok;							\
+}
+#else
+#  define DEFINE_BINNED_RANGE(NAME, T, LOAD)				\
+static									\
+int									\
+NAME (const T* A, size_t n, double c1, double c2, int64_t* I)		\
+{									\
+	int ok = 1;							\
+	for(size_t i = 0; i < n; i++)					\
+		ok &= binScalar ((double) A[i], c1, c2, I);		\
+	return ok;							\
+}
+#endif
+
+DEFINE_BINNED_RANGE (binnedRangeFloat, float, LOADCVT_D)
+DEFINE_BINNED_RANGE (binnedRangeDouble, double, LOAD_D)
+
+/**
+ *  Converts the bins I[0:BIN_FOLDS-1], with unit 2^(E - (k+1)*W) for
+ *  bin k, back to a double. The carries make every bin but the first
+ *  lie in [0, 2^W), so that only the final additions round.
+ */
+static
+double
+binsToDouble (int64_t* I, int E)
+{
+	for(int k = BIN_FOLDS - 1; k > 0; k--) {
+		int64_t carry = I[k] >> BIN_WIDTH; /* floor */
+		I[k] -= carry << BIN_WIDTH;
+		I[k-1] += carry;
+	}
+	double v = 0.0;
+	for(int k = BIN_FOLDS - 1; k >= 0; k--)
+		v += ldexp ((double) I[k], -(k + 1) * BIN_WIDTH);
+	return ldexp (v, E);
+}
+
+/**
+ *  The integers of the top bin have at most BIN_WIDTH bits, and the
+ *  others at most BIN_WIDTH-1, so the bins cannot overflow for N <
+ *  2^(63 - BIN_WIDTH). Each element loses less than half a unit of
+ *  the last bin, so the absolute error is below N * 2^(E - 1 -
+ *  BIN_FOLDS*BIN_WIDTH), i.e., about N * max |A[i]| * 2^-90.
+ */
+#define DEFINE_BINNED(NAME, T, ABSMAX, RANGE, FAST)			\
+static									\
+double									\
+NAME (const T* A, size_t N)						\
+{									\
+	assert ((N >> (63 - BIN_WIDTH)) == 0);				\
+	const double M = (double) ABSMAX (A, N);			\
+	if(M == 0.0 || !isfinite (M))					\
+		return (double) FAST (A, N);				\
+									\
+	int E;								\
+	frexp (M, &E); /* M < 2^E */					\
+	/* Scale by 2^(W - E), in two steps if 2^(W - E) overflows */	\
+	const int pre = (BIN_WIDTH - E > 1000) ? 600 : 0;		\
+	const double c1 = ldexp (1.0, pre);				\
+	const double c2 = ldexp (1.0, BIN_WIDTH - E - pre);		\
+									\
+	const int nt = getNumThreads (N);				\
+	int64_t* I = (int64_t *) calloc (nt * BIN_FOLDS, sizeof (int64_t)); \
+	int* ok = (int *) malloc (nt * sizeof (int));			\
+	assert (I && ok);						\
+									\
+	_Pragma ("omp parallel num_threads (nt) if (nt > 1)")		\
+	{								\
+		int t = 0;						\
+		IF_OPENMP (t = omp_get_thread_num ());			\
+		size_t lo, hi;						\
+		getChunk (N, t, nt, &lo, &hi);				\
+		ok[t] = RANGE (A + lo, hi - lo, c1, c2, &I[t * BIN_FOLDS]); \
+	}								\
+									\
+	int all_ok = 1;							\
+	for(int t = 1; t < nt; t++) {					\
+		all_ok &= ok[t];					\
+		for(int k = 0; k < BIN_FOLDS; k++)			\
+			I[k] += I[t * BIN_FOLDS + k];			\
+	}								\
+	all_ok &= ok[0];						\
+	double r = all_ok ? binsToDouble (I, E) : (double) FAST (A, N); \
+	free (I);							\
+	free (ok);							\
+	return r;							\
+}
+
+DEFINE_BINNED (sumBinnedFloat, float, reduceAbsMaxFloat, binnedRangeFloat, reduceSumFloat)
+DEFINE_BINNED (sumBinnedDouble, double, reduceAbsMaxDouble, binnedRangeDouble, reduceSumDouble)
+
+float
+reduceSumModeFloat (const float* A, size_t N, reduceSumMode_t mode)
+{
+	switch (mode) {
+		case REDUCE_SUM_COMPENSATED: return (float) sumCompensatedFloat (A, N);
+		case REDUCE_SUM_BINNED: return (float) sumBinnedFloat (A, N);
+		default: return reduceSumFloat (A, N);
+	}
+}
+
+double
+reduceSumModeDouble (const double* A, size_t N, reduceSumMode_t mode)
+{
+	switch (mode) {
+		case REDUCE_SUM_COMPENSATED: return sumCompensatedDouble (A, N);
+		case REDUCE_SUM_BINNED: return sumBinnedDouble (A, N);
+		default: return reduceSumDouble (A, N);
+	}
+}
+
+void
+reduceCpuSetParams (size_t min_parallel, size_t block)
+{
+	parallel_min = min_parallel ? min_parallel : REDUCE_PARALLEL_MIN;
+	argmax_block = block ? block : REDUCE_ARGMAX_BLOCK;
+}
+
+void
+reduceCpuGetParams (size_t* min_parallel, size_t* block)
+{
+	if(min_parallel) *min_parallel = parallel_min;
+	if(block) *block = argmax_block;
+}
+
+const char*
+reduceCpuIsa (void)
+{
+#if defined (__AVX2__)
+	return "AVX2";
+#elif defined (__AVX__)
+	return "AVX";
+#else
+	return "scalar";
+#endif
+}
+
+/* eof */
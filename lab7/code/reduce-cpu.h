@@ -0,0 +1,84 @@
+/**
+ *  \file reduce-cpu.h
+ *
+ *  \brief Multithreaded SIMD reductions for the CPU.
+ *
+ *  Each OpenMP thread reduces one contiguous chunk of the input with
+ *  several independent SIMD accumulators, which hides the latency of
+ *  the add (or min/max) that limits the scalar loop in reduceCpu ().
+ *  The per-thread partial results are then combined pairwise, as in
+ *  the tree of the CUDA kernels.
+ */
+
+#if !defined (INC_REDUCE_CPU_H)
+#define INC_REDUCE_CPU_H
+
+#include <stddef.h>
+
+/** Default input length below which only the calling thread reduces. */
+#define REDUCE_PARALLEL_MIN (1 << 16)
+
+/** Default block length of the first pass of argmax. */
+#define REDUCE_ARGMAX_BLOCK 1024
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+float reduceSumFloat (const float* A, size_t N);
+float reduceMinFloat (const float* A, size_t N);
+float reduceMaxFloat (const float* A, size_t N);
+
+double reduceSumDouble (const double* A, size_t N);
+double reduceMinDouble (const double* A, size_t N);
+double reduceMaxDouble (const double* A, size_t N);
+
+/** \brief Returns max |A[i]|, or 0 if N == 0. */
+float reduceAbsMaxFloat (const float* A, size_t N);
+double reduceAbsMaxDouble (const double* A, size_t N);
+
+/** \brief Returns the index of the first maximum of A[0:N-1] (N > 0). */
+size_t reduceArgmaxFloat (const float* A, size_t N);
+size_t reduceArgmaxDouble (const double* A, size_t N);
+
+/**
+ *  \brief Summation modes.
+ *
+ *  REDUCE_SUM_FAST is reduceSum*(); its answer depends on the number
+ *  of threads. REDUCE_SUM_COMPENSATED uses compensated (TwoSum)
+ *  accumulation over fixed-size chunks, so its answer is nearly
+ *  correctly rounded and independent of the thread count for a given
+ *  build. REDUCE_SUM_BINNED accumulates exact integer bins (as in
+ *  ReproBLAS), so its answer is also independent of the order of the
+ *  elements and of the SIMD width, at some extra cost. Both of the
+ *  latter accumulate in double, also for float inputs.
+ */
+typedef enum {
+	REDUCE_SUM_FAST = 0,
+	REDUCE_SUM_COMPENSATED,
+	REDUCE_SUM_BINNED
+} reduceSumMode_t;
+
+float reduceSumModeFloat (const float* A, size_t N, reduceSumMode_t mode);
+double reduceSumModeDouble (const double* A, size_t N, reduceSumMode_t mode);
+
+/**
+ *  \brief Sets the parallel threshold and the argmax block length; 0
+ *  restores a default. Not thread-safe with respect to running
+ *  reductions. reduce-tune finds good values for a host.
+ */
+void reduceCpuSetParams (size_t parallel_min, size_t argmax_block);
+
+/** \brief Gets the parallel threshold and the argmax block length. */
+void reduceCpuGetParams (size_t* parallel_min, size_t* argmax_block);
+
+/** \brief Name of the SIMD instruction set used by the kernels. */
+const char* reduceCpuIsa (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+/* eof */
@@ -0,0 +1,138 @@
+/**
+ *  \file reduce-tune.c
+ *
+ *  \brief Tunes the CPU reductions of reduce-cpu.c for each input
+ *  length, and saves the fastest settings in the tuning config file
+ *  (see tune.h), which reduce-cpu reads at startup.
+ *
+ *  For each length N, the parallel threshold is set so that N is
+ *  reduced in parallel only if that beats the calling thread alone,
+ *  and the argmax block length is swept over powers of two.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#if defined (_OPENMP)
+#  include <omp.h>
+#endif
+
+#include "timer.h"
+#include "reduce-cpu.h"
+#include "tune.h"
+
+#if !defined (NUM_ITER)
+#  define NUM_ITER 5
+#endif
+
+/** Lengths tuned when none are given: 2^12, 2^14, ..., 2^24. */
+#define LOG2_N_MIN 12
+#define LOG2_N_MAX 24
+
+static const size_t ARGMAX_BLOCKS[] = { 256, 512, 1024, 2048, 4096, 8192, 16384 };
+#define N_BLOCKS (sizeof (ARGMAX_BLOCKS) / sizeof (ARGMAX_BLOCKS[0]))
+
+/** Returns the best of NUM_ITER sums (argmax == 0) or argmaxes of A. */
+long double
+timeReduce (const float* A, size_t N, int argmax, size_t* p_result)
+{
+	struct stopwatch_t* timer = stopwatch_create ();
+	long double t_best = -1;
+	volatile float sum = 0;
+	for(int iter = 0; iter < NUM_ITER; iter++) {
+		stopwatch_start (timer);
+		if(argmax)
+			*p_result = reduceArgmaxFloat (A, N);
+		else
+			sum += reduceSumFloat (A, N);
+		long double t = stopwatch_stop (timer);
+		if(t_best < 0 || t < t_best) t_best = t;
+	}
+	stopwatch_destroy (timer);
+	return t_best;
+}
+
+/** Tunes length N; returns 0 if every argmax was right. */
+int
+tuneLength (size_t N)
+{
+	float* A = (float *) malloc (N * sizeof (float));
+	assert (A);
+	for(size_t i = 0; i < N; i++)
+		A[i] = (rand () & 0xFF) / (float) RAND_MAX;
+	size_t ref = 0;
+	for(size_t i = 1; i < N; i++)
+		if(A[i] > A[ref]) ref = i;
+
+	/* Threshold: the bucket of N goes parallel, or the next one up */
+	const size_t bucket_lo = (size_t) 1 << tuneBucket (N);
+	size_t parallel_min = REDUCE_PARALLEL_MIN;
+	size_t dummy;
+	int nt = 1;
+#if defined (_OPENMP)
+	nt = omp_get_max_threads ();
+#endif
+	if(nt > 1) {
+		reduceCpuSetParams (N + 1, 0);
+		long double t_seq = timeReduce (A, N, 0, &dummy);
+		reduceCpuSetParams (1, 0);
+		long double t_par = timeReduce (A, N, 0, &dummy);
+		parallel_min = (t_par < t_seq) ? bucket_lo : 2 * bucket_lo;
+		printf ("%10zu  sum: sequential %8.3Lf GB/s, parallel %8.3Lf GB/s\n", N,
+			N * sizeof (float) / t_seq * 1e-9, N * sizeof (float) / t_par * 1e-9);
+	}
+
+	int failed = 0;
+	size_t best_block = REDUCE_ARGMAX_BLOCK;
+	long double t_best = -1;
+	for(unsigned int b = 0; b < N_BLOCKS; b++) {
+		size_t idx = N;
+		reduceCpuSetParams (parallel_min, ARGMAX_BLOCKS[b]);
+		long double t = timeReduce (A, N, 1, &idx);
+		printf ("%10zu  argmax block %6zu: %8.3Lf GB/s%s\n", N, ARGMAX_BLOCKS[b],
+			N * sizeof (float) / t * 1e-9, (idx == ref) ? "" : "  WRONG");
+		if(idx != ref) {
+			failed = 1;
+			continue;
+		}
+		if(t_best < 0 || t < t_best) {
+			t_best = t;
+			best_block = ARGMAX_BLOCKS[b];
+		}
+	}
+
+	char params[128];
+	snprintf (params, sizeof (params), "parallel_min=%zu argmax_block=%zu",
+		  parallel_min, best_block);
+	printf ("%10zu  best: %s\n", N, params);
+	if(tuneSave ("reduce", N, params) != 0)
+		fprintf (stderr, "*** Could not write %s ***\n", tuneFile ());
+
+	free (A);
+	return failed;
+}
+
+int main (int argc, char** argv)
+{
+	srand (2006);
+	stopwatch_init ();
+#if defined (_OPENMP)
+	fprintf (stderr, "OpenMP threads: %d\n", omp_get_max_threads ());
+#endif
+	fprintf (stderr, "Host: %s, config: %s\n", tuneHost (), tuneFile ());
+
+	int failed = 0;
+	if(argc > 1) {
+		for(int i = 1; i < argc; i++)
+			failed |= tuneLength (atoi (argv[i]));
+	} else {
+		for(int e = LOG2_N_MIN; e <= LOG2_N_MAX; e += 2)
+			failed |= tuneLength ((size_t) 1 << e);
+	}
+	if(failed)
+		fprintf (stderr, "*** Some settings gave a wrong argmax ***\n");
+	return failed ? EXIT_FAILURE : 0;
+}
+
+/* eof */
@@ -0,0 +1,154 @@
+/**
+ *  \file tune.c
+ *
+ *  \brief Reads and writes the autotuning config file; see tune.h.
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tune.h"
+
+#define LINE_MAX_LEN 1024
+#define HOST_MAX_LEN 256
+#define KERNEL_MAX_LEN 64
+
+const char*
+tuneFile (void)
+{
+	const char* file = getenv ("TUNE_CONFIG");
+	return (file && *file) ? file : TUNE_DEFAULT_FILE;
+}
+
+const char*
+tuneHost (void)
+{
+	static char host[HOST_MAX_LEN] = "";
+	if(!host[0]) {
+		if(gethostname (host, HOST_MAX_LEN - 1) != 0 || !host[0])
+			strcpy (host, "unknown");
+		host[HOST_MAX_LEN - 1] = '\0';
+		char* dot = strchr (host, '.');
+		if(dot)
+			*dot = '\0';
+	}
+	return host;
+}
+
+int
+tuneBucket (size_t size)
+{
+	int b = 0;
+	while(size > 1) {
+		size >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/**
+ *  Splits a setting line into its host, kernel, bucket and parameter
+ *  list. Returns 0 for comments, blank lines and malformed lines.
+ */
+static
+int
+parseLine (const char* line, char* host, char* kernel, int* bucket,
+	   const char** params)
+{
+	int n = 0;
+	if(line[0] == '#')
+		return 0;
+	if(sscanf (line, "%255s %63s %d %n", host, kernel, bucket, &n) < 3)
+		return 0;
+	*params = line + n;
+	return 1;
+}
+
+/** Finds "<param>=<value>" in a parameter list. */
+static
+int
+findParam (const char* params, const char* param, long* value)
+{
+	const size_t len = strlen (param);
+	const char* p = params;
+	while(*p) {
+		while(isspace ((unsigned char) *p))
+			p++;
+		if(!strncmp (p, param, len) && p[len] == '=') {
+			*value = strtol (p + len + 1, NULL, 0);
+			return 1;
+		}
+		while(*p && !isspace ((unsigned char) *p))
+			p++;
+	}
+	return 0;
+}
+
+long
+tuneGetLong (const char* kernel, size_t size, const char* param, long def_val)
+{
+	FILE* fp = fopen (tuneFile (), "r");
+	if(!fp)
+		return def_val;
+
+	const int bucket = tuneBucket (size);
+	int best_dist = INT_MAX;
+	long value = def_val;
+	char line[LINE_MAX_LEN], host[HOST_MAX_LEN], name[KERNEL_MAX_LEN];
+	while(fgets (line, sizeof (line), fp)) {
+		int b;
+		long v;
+		const char* params;
+		if(!parseLine (line, host, name, &b, &params)
+		   || strcmp (host, tuneHost ()) || strcmp (name, kernel)
+		   || !findParam (params, param, &v))
+			continue;
+		const int dist = abs (b - bucket);
+		if(dist < best_dist) {
+			best_dist = dist;
+			value = v;
+		}
+	}
+	fclose (fp);
+	return value;
+}
+
+int
+tuneSave (const char* kernel, size_t size, const char* params)
+{
+	const char* file = tuneFile ();
+	const int bucket = tuneBucket (size);
+	char tmp[LINE_MAX_LEN];
+	snprintf (tmp, sizeof (tmp), "%s.tmp", file);
+
+	FILE* out = fopen (tmp, "w");
+	if(!out)
+		return -1;
+	FILE* in = fopen (file, "r");
+	if(in) {
+		char line[LINE_MAX_LEN], host[HOST_MAX_LEN], name[KERNEL_MAX_LEN];
+		while(fgets (line, sizeof (line), in)) {
+			int b;
+			const char* p;
+			if(parseLine (line, host, name, &b, &p) && b == bucket
+			   && !strcmp (host, tuneHost ()) && !strcmp (name, kernel))
+				continue;
+			fputs (line, out);
+		}
+		fclose (in);
+	} else {
+		fprintf (out, "# <host> <kernel> <log2(size)> <param>=<value> ...\n");
+	}
+	fprintf (out, "%s %s %d %s\n", tuneHost (), kernel, bucket, params);
+	if(fclose (out) != 0 || rename (tmp, file) != 0) {
+		remove (tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/* eof */
@@ -2,6 +2,16 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define BYTES_PER_PIXEL 3 // RGB, 24 bits per pixel
 
 #pragma pack(push, 1)
 
@@ -12,18 +22,25 @@ struct bitmap_file_header {
 	uint32_t data_offset;
 };
 
-struct bitmap_core_header {
+struct bitmap_info_header {
 	uint32_t structure_size;
-	uint16_t image_width;
-	uint16_t image_height;
+	int32_t image_width;
+	int32_t image_height; // Negative for rows stored top to bottom
 	uint16_t image_planes;
 	uint16_t image_bpp; // Bits per pixel
+	uint32_t compression;
+	uint32_t image_size;
+	int32_t horizontal_resolution;
+	int32_t vertical_resolution;
+	uint32_t palette_size;
+	uint32_t important_colors;
 };
 
-struct r8g8b8 {
-	uint8_t red;
-	uint8_t green;
+struct b8g8r8a8 {
 	uint8_t blue;
+	uint8_t green;
+	uint8_t red;
+	uint8_t reserved;
 };
 
 #pragma pack(pop)
@@ -47,59 +64,269 @@ void read_raw_image(const char* image_file_path, void* image_buffer, size_t imag
 	}
 }
 
-void write_bmp_image(const char* image_file_path, void* image_buffer, size_t image_width, size_t image_height) {
-	const size_t image_size = image_width * image_height;
-	
-	FILE* image_file = fopen(image_file_path, "w");
-	if (image_file != 0) {
-		bitmap_file_header file_header;
-		file_header.magic = 0x4D42; // 'BM'
-		file_header.file_size = sizeof(bitmap_file_header) + sizeof(bitmap_core_header) + 256 * 3 + image_size;
-		file_header.reserved[0] = 0;
-		file_header.reserved[1] = 0;
-		file_header.data_offset = sizeof(bitmap_file_header) + sizeof(bitmap_core_header) + 256 * 3;
-		size_t image_bytes_written = fwrite(&file_header, 1, sizeof(bitmap_file_header), image_file);
-		if (image_bytes_written == sizeof(bitmap_file_header)) {
-			bitmap_core_header bitmap_header;
-			bitmap_header.structure_size = sizeof(bitmap_core_header);
-			bitmap_header.image_width = image_width;
-			bitmap_header.image_height = image_height;
-			bitmap_header.image_planes = 1;
-			bitmap_header.image_bpp = 8;
-			image_bytes_written = fwrite(&bitmap_header, 1, sizeof(bitmap_core_header), image_file);
-			if (image_bytes_written == sizeof(bitmap_core_header)) {
-				r8g8b8 palette[256];
-				for (size_t index = 0; index < 256; index++) {
-					palette[index].red = index;
-					palette[index].green = index;
-					palette[index].blue = index;
-				}
-				image_bytes_written = fwrite(palette, 1, sizeof(palette), image_file);
-				if (image_bytes_written != image_size) {
-					const uint8_t* image_data = static_cast<const uint8_t*>(image_buffer);
-					for (size_t row = image_height; row != 0; row--) {
-						image_bytes_written = fwrite(image_data + (row - 1) * image_width, 1, image_width, image_file);
-						if (image_bytes_written != image_width) {
-							fprintf(stderr, "Could only write %u out of %u expected bytes to image %s\n",
-								unsigned(image_bytes_written), unsigned(image_size), image_file_path);
-							break;
-						}
-					}
-				} else {
-					fprintf(stderr, "Could only write %u out of %u expected bytes to image %s\n",
-						unsigned(image_bytes_written), unsigned(sizeof(palette)), image_file_path);
+static bool map_file(const char* file_path, mapped_file& mapping) {
+	mapping.data = NULL;
+	mapping.size = 0;
+	const int file_descriptor = open(file_path, O_RDONLY);
+	if (file_descriptor == -1) {
+		fprintf(stderr, "Failed to open the input file %s\n", file_path);
+		return false;
+	}
+	struct stat file_status;
+	if (fstat(file_descriptor, &file_status) == -1 || file_status.st_size == 0) {
+		fprintf(stderr, "Failed to query the size of the input file %s\n", file_path);
+		close(file_descriptor);
+		return false;
+	}
+	void* data = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	close(file_descriptor); // The mapping keeps the file open
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Failed to map the input file %s: error code %d\n", file_path, errno);
+		return false;
+	}
+	// Read-ahead for the single front-to-back pass the kernels make over the images
+	madvise(data, file_status.st_size, MADV_SEQUENTIAL);
+	madvise(data, file_status.st_size, MADV_WILLNEED);
+	mapping.data = static_cast<const uint8_t*>(data);
+	mapping.size = file_status.st_size;
+	return true;
+}
+
+void unmap_file(mapped_file& mapping) {
+	if (mapping.data != NULL) {
+		munmap(const_cast<uint8_t*>(mapping.data), mapping.size);
+		mapping.data = NULL;
+		mapping.size = 0;
+	}
+}
+
+const uint8_t* map_raw_images(const char* image_file_path, mapped_file& mapping, size_t image_width, size_t image_height, size_t image_count) {
+	const size_t expected_file_size = image_width * image_height * BYTES_PER_PIXEL * image_count;
+	if (!map_file(image_file_path, mapping))
+		return NULL;
+	if (mapping.size < expected_file_size) {
+		fprintf(stderr, "Could only map %u out of %u expected bytes from %s\n",
+			unsigned(mapping.size), unsigned(expected_file_size), image_file_path);
+		unmap_file(mapping);
+		return NULL;
+	}
+	return mapping.data;
+}
+
+const uint8_t* map_raw_image(const char* image_file_path, mapped_file& mapping, size_t image_width, size_t image_height) {
+	return map_raw_images(image_file_path, mapping, image_width, image_height, 1);
+}
+
+/*
+ * BMP output. The whole file is built in memory and written with one writev: the
+ * headers and palette, then the pixels. Rows are stored top to bottom (negative
+ * height), so an 8-bit image whose width is a multiple of 4 goes out straight from
+ * the caller's buffer; other images are re-encoded once into a padded copy (and RGB
+ * to BMP's BGR order).
+ */
+
+struct bmp_job {
+	char* image_file_path;
+	uint8_t* image_data;
+	size_t image_width;
+	size_t image_height;
+	size_t image_bpp;
+	bmp_job* next;
+};
+
+static const b8g8r8a8* get_grayscale_palette() {
+	static b8g8r8a8 palette[256];
+	static pthread_once_t palette_once = PTHREAD_ONCE_INIT;
+	struct initializer {
+		static void initialize() {
+			for (size_t index = 0; index < 256; index++) {
+				palette[index].blue = palette[index].green = palette[index].red = index;
+				palette[index].reserved = 0;
+			}
+		}
+	};
+	pthread_once(&palette_once, initializer::initialize);
+	return palette;
+}
+
+static void write_bmp_file(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height, size_t image_bpp) {
+	const size_t pixel_bytes = image_bpp / 8;
+	const size_t row_size = image_width * pixel_bytes;
+	const size_t padded_row_size = (row_size + 3) & ~size_t(3);
+	const size_t palette_size = (image_bpp == 8) ? 256 * sizeof(b8g8r8a8) : 0;
+	const size_t data_offset = sizeof(bitmap_file_header) + sizeof(bitmap_info_header) + palette_size;
+	const size_t image_size = padded_row_size * image_height;
+
+	uint8_t headers[sizeof(bitmap_file_header) + sizeof(bitmap_info_header)];
+	bitmap_file_header* file_header = reinterpret_cast<bitmap_file_header*>(headers);
+	file_header->magic = 0x4D42; // 'BM'
+	file_header->file_size = data_offset + image_size;
+	file_header->reserved[0] = 0;
+	file_header->reserved[1] = 0;
+	file_header->data_offset = data_offset;
+	bitmap_info_header* bitmap_header = reinterpret_cast<bitmap_info_header*>(headers + sizeof(bitmap_file_header));
+	memset(bitmap_header, 0, sizeof(bitmap_info_header));
+	bitmap_header->structure_size = sizeof(bitmap_info_header);
+	bitmap_header->image_width = image_width;
+	bitmap_header->image_height = -int32_t(image_height);
+	bitmap_header->image_planes = 1;
+	bitmap_header->image_bpp = image_bpp;
+	bitmap_header->image_size = image_size;
+	bitmap_header->palette_size = (image_bpp == 8) ? 256 : 0;
+
+	const uint8_t* pixels = static_cast<const uint8_t*>(image_buffer);
+	uint8_t* encoded_pixels = NULL;
+	if (image_bpp == 24 || padded_row_size != row_size) {
+		encoded_pixels = static_cast<uint8_t*>(allocate_aligned_memory(image_size, 64));
+		for (size_t row = 0; row < image_height; row++) {
+			const uint8_t* source = pixels + row * row_size;
+			uint8_t* destination = encoded_pixels + row * padded_row_size;
+			if (image_bpp == 24) {
+				for (size_t column = 0; column < image_width; column++) {
+					destination[3 * column + 0] = source[3 * column + 2];
+					destination[3 * column + 1] = source[3 * column + 1];
+					destination[3 * column + 2] = source[3 * column + 0];
 				}
 			} else {
-				fprintf(stderr, "Could only write %u out of %u expected bytes to image %s\n",
-					unsigned(image_bytes_written), unsigned(sizeof(bitmap_core_header)), image_file_path);
-			}						
-		} else {
-			fprintf(stderr, "Could only write %u out of %u expected bytes to image %s\n",
-				unsigned(image_bytes_written), unsigned(sizeof(bitmap_file_header)), image_file_path);
+				memcpy(destination, source, row_size);
+			}
+			memset(destination + row_size, 0, padded_row_size - row_size);
 		}
-		
-		fclose(image_file);
+		pixels = encoded_pixels;
+	}
+
+	const int image_file = open(image_file_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (image_file != -1) {
+		struct iovec parts[3];
+		size_t parts_count = 0;
+		parts[parts_count].iov_base = headers;
+		parts[parts_count++].iov_len = sizeof(headers);
+		if (palette_size != 0) {
+			parts[parts_count].iov_base = const_cast<b8g8r8a8*>(get_grayscale_palette());
+			parts[parts_count++].iov_len = palette_size;
+		}
+		parts[parts_count].iov_base = const_cast<uint8_t*>(pixels);
+		parts[parts_count++].iov_len = image_size;
+
+		const ssize_t image_bytes_written = writev(image_file, parts, parts_count);
+		if (image_bytes_written != ssize_t(data_offset + image_size)) {
+			fprintf(stderr, "Could only write %d out of %u expected bytes to image %s\n",
+				int(image_bytes_written), unsigned(data_offset + image_size), image_file_path);
+		}
+		close(image_file);
 	} else {
 		fprintf(stderr, "Failed to open the output file %s\n", image_file_path);
 	}
+	if (encoded_pixels != NULL)
+		release_aligned_memory(encoded_pixels);
+}
+
+void write_bmp_image(const char* image_file_path, void* image_buffer, size_t image_width, size_t image_height) {
+	write_bmp_file(image_file_path, image_buffer, image_width, image_height, 8);
+}
+
+void write_bmp_image_rgb(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height) {
+	write_bmp_file(image_file_path, image_buffer, image_width, image_height, 24);
+}
+
+/*
+ * Background writer: the caller's pixels are copied into a job, and one thread encodes
+ * and writes the jobs in order. It starts with the first job and is joined by
+ * flush_bmp_images (also run at exit).
+ */
+
+static pthread_mutex_t bmp_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bmp_queue_changed = PTHREAD_COND_INITIALIZER;
+static bmp_job* bmp_queue_head = NULL;
+static bmp_job* bmp_queue_tail = NULL;
+static bool bmp_writer_running = false;
+static bool bmp_writer_stopping = false;
+static pthread_t bmp_writer_thread;
+
+static void* bmp_writer(void*) {
+	pthread_mutex_lock(&bmp_queue_mutex);
+	for (;;) {
+		while (bmp_queue_head == NULL && !bmp_writer_stopping)
+			pthread_cond_wait(&bmp_queue_changed, &bmp_queue_mutex);
+		bmp_job* job = bmp_queue_head;
+		if (job == NULL)
+			break;
+		bmp_queue_head = job->next;
+		if (bmp_queue_head == NULL)
+			bmp_queue_tail = NULL;
+		pthread_mutex_unlock(&bmp_queue_mutex);
+
+		write_bmp_file(job->image_file_path, job->image_data, job->image_width, job->image_height, job->image_bpp);
+		release_aligned_memory(job->image_data);
+		free(job->image_file_path);
+		delete job;
+
+		pthread_mutex_lock(&bmp_queue_mutex);
+	}
+	pthread_mutex_unlock(&bmp_queue_mutex);
+	return NULL;
+}
+
+void flush_bmp_images() {
+	pthread_mutex_lock(&bmp_queue_mutex);
+	const bool running = bmp_writer_running;
+	bmp_writer_stopping = true;
+	pthread_cond_signal(&bmp_queue_changed);
+	pthread_mutex_unlock(&bmp_queue_mutex);
+	if (running)
+		pthread_join(bmp_writer_thread, NULL);
+	pthread_mutex_lock(&bmp_queue_mutex);
+	bmp_writer_running = false;
+	bmp_writer_stopping = false;
+	pthread_mutex_unlock(&bmp_queue_mutex);
+}
+
+static void write_bmp_image_async(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height, size_t image_bpp) {
+	const size_t image_size = image_width * image_height * (image_bpp / 8);
+	bmp_job* job = new bmp_job;
+	job->image_file_path = strdup(image_file_path);
+	job->image_data = static_cast<uint8_t*>(allocate_aligned_memory(image_size, 64));
+	memcpy(job->image_data, image_buffer, image_size);
+	job->image_width = image_width;
+	job->image_height = image_height;
+	job->image_bpp = image_bpp;
+	job->next = NULL;
+
+	pthread_mutex_lock(&bmp_queue_mutex);
+	if (!bmp_writer_running && !bmp_writer_stopping) {
+		/* The queue is empty: the last flush drained it */
+		static bool flush_at_exit = false;
+		if (!flush_at_exit) {
+			atexit(flush_bmp_images);
+			flush_at_exit = true;
+		}
+		bmp_writer_running = pthread_create(&bmp_writer_thread, NULL, bmp_writer, NULL) == 0;
+	}
+	/* While a flush joins the writer, the writer may already have seen the empty queue and exited */
+	if (bmp_writer_running && !bmp_writer_stopping) {
+		if (bmp_queue_tail != NULL)
+			bmp_queue_tail->next = job;
+		else
+			bmp_queue_head = job;
+		bmp_queue_tail = job;
+		pthread_cond_signal(&bmp_queue_changed);
+		job = NULL;
+	}
+	pthread_mutex_unlock(&bmp_queue_mutex);
+
+	if (job != NULL) {
+		/* No writer thread, or it is being flushed: write the image here */
+		write_bmp_file(job->image_file_path, job->image_data, job->image_width, job->image_height, job->image_bpp);
+		release_aligned_memory(job->image_data);
+		free(job->image_file_path);
+		delete job;
+	}
+}
+
+void write_bmp_image_queued(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height) {
+	write_bmp_image_async(image_file_path, image_buffer, image_width, image_height, 8);
+}
+
+void write_bmp_image_rgb_queued(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height) {
+	write_bmp_image_async(image_file_path, image_buffer, image_width, image_height, 24);
 }
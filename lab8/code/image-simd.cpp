@@ -1,246 +1,434 @@
 #include <hpcdefs.hpp>
 #include <image.hpp>
 
-void convert_rgb_to_grayscale_optimized(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, size_t width, size_t height) {
-
-	const __m128i rconst = _mm_set1_epi16(54);
-	const __m128i gconst = _mm_set1_epi16(183);
-	const __m128i bconst = _mm_set1_epi16(19);
-
-	__m128i gray_mask1 = _mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,14,12,10,8,6,4,2,0);
-	__m128i gray_mask2 = _mm_set_epi8(14,12,10,8,6,4,2,0,-1,-1,-1,-1,-1,-1,-1,-1);
-	__m128i mask1 = _mm_set_epi8(-1,7,-1,6,-1,5,-1,4,-1,3,-1,2,-1,1,-1,0);
-	__m128i mask2 = _mm_set_epi8(-1,15,-1,14,-1,13,-1,12,-1,11,-1,10,-1,9,-1,8);	
+#if defined(_OPENMP)
+	#include <omp.h>
+#endif
+
+/*
+ * RGB -> grayscale: luma = (54 R + 183 G + 19 B) >> 8.
+ *
+ * Every kernel shuffles each pixel's bytes into (R, G, B, G), so that
+ * one pmaddubsw forms the pairwise products 54 R + 74 G and
+ * 19 B + 109 G (183 = 74 + 109 is split so that neither pair exceeds
+ * 128 * 255 and saturates), and one pmaddwd with ones adds the pair.
+ * The kernels differ in how they deinterleave: 4 pixels per 128-bit
+ * lane with pshufb (SSSE3), after a vpermd that gives each lane its
+ * 12 bytes (AVX2, AVX-512BW), or 16 pixels at once with vpermb
+ * (AVX-512VBMI). None of them reads past the end of the image: the
+ * AVX2 kernel overlaps its last block with the previous one, and the
+ * AVX-512 kernels use masked loads and stores.
+ */
+
+#define GRAY_WEIGHTS_RG 54, 74
+#define GRAY_WEIGHTS_BG 19, 109
+
+static inline uint8_t convert_pixel(const uint8_t* rgb) {
+	return (rgb[0] * 54 + rgb[1] * 183 + rgb[2] * 19) >> 8;
+}
 
-	const __m128i zero = _mm_setzero_si128();
-	size_t ptr=0;
+/* SSSE3: 16 pixels (48 bytes) per step */
+static inline __m128i convert_16_pixels_ssse3(const uint8_t* rgb) {
+	const __m128i shuffle = _mm_setr_epi8(0,1,2,1, 3,4,5,4, 6,7,8,7, 9,10,11,10);
+	const __m128i weights = _mm_setr_epi8(GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG, GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG,
+		GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG, GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG);
+	const __m128i ones = _mm_set1_epi16(1);
+
+	const __m128i in0 = _mm_loadu_si128((const __m128i*)rgb);
+	const __m128i in1 = _mm_loadu_si128((const __m128i*)(rgb + 16));
+	const __m128i in2 = _mm_loadu_si128((const __m128i*)(rgb + 32));
+
+	/* Pixels 0-3, 4-7, 8-11, 12-15 start at bytes 0, 12, 24, 36 */
+	__m128i p0 = _mm_shuffle_epi8(in0, shuffle);
+	__m128i p1 = _mm_shuffle_epi8(_mm_alignr_epi8(in1, in0, 12), shuffle);
+	__m128i p2 = _mm_shuffle_epi8(_mm_alignr_epi8(in2, in1, 8), shuffle);
+	__m128i p3 = _mm_shuffle_epi8(_mm_srli_si128(in2, 4), shuffle);
+
+	p0 = _mm_srli_epi32(_mm_madd_epi16(_mm_maddubs_epi16(p0, weights), ones), 8);
+	p1 = _mm_srli_epi32(_mm_madd_epi16(_mm_maddubs_epi16(p1, weights), ones), 8);
+	p2 = _mm_srli_epi32(_mm_madd_epi16(_mm_maddubs_epi16(p2, weights), ones), 8);
+	p3 = _mm_srli_epi32(_mm_madd_epi16(_mm_maddubs_epi16(p3, weights), ones), 8);
+
+	return _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+}
 
-	while(ptr < (width*height-32))
-	{
-		/*Loading 16 8-bit ints to perform deinterleaving*/
-		__m128i base = _mm_loadu_si128((__m128i*)(rgb_image));
-		__m128i base2 = _mm_loadu_si128((__m128i*)(rgb_image+16));
-		__m128i base3 = _mm_loadu_si128((__m128i*)(rgb_image+32));
-		__m128i base4 = _mm_loadu_si128((__m128i*)(rgb_image+48));
-		__m128i base5 = _mm_loadu_si128((__m128i*)(rgb_image+64));
-		__m128i base6 = _mm_loadu_si128((__m128i*)(rgb_image+80));
-
-		/*Deinterleaving starts here*/
-		__m128i lvl11 = _mm_unpacklo_epi8(base, base4);
-		__m128i lvl12 = _mm_unpackhi_epi8(base, base4);
-		__m128i lvl13 = _mm_unpacklo_epi8(base2, base5);
-		__m128i lvl14 = _mm_unpackhi_epi8(base2, base5);
-		__m128i lvl15 = _mm_unpacklo_epi8(base3, base6);
-		__m128i lvl16 = _mm_unpackhi_epi8(base3, base6);
-
-		__m128i lvl21 = _mm_unpacklo_epi8(lvl11, lvl14);
-		__m128i lvl22 = _mm_unpackhi_epi8(lvl11, lvl14);
-		__m128i lvl23 = _mm_unpacklo_epi8(lvl12, lvl15);
-		__m128i lvl24 = _mm_unpackhi_epi8(lvl12, lvl15);
-		__m128i lvl25 = _mm_unpacklo_epi8(lvl13, lvl16);
-		__m128i lvl26 = _mm_unpackhi_epi8(lvl13, lvl16);
-
-		__m128i lvl31 = _mm_unpacklo_epi8(lvl21, lvl24);
-		__m128i lvl32 = _mm_unpackhi_epi8(lvl21, lvl24);
-		__m128i lvl33 = _mm_unpacklo_epi8(lvl22, lvl25);
-		__m128i lvl34 = _mm_unpackhi_epi8(lvl22, lvl25);
-		__m128i lvl35 = _mm_unpacklo_epi8(lvl23, lvl26);
-		__m128i lvl36 = _mm_unpackhi_epi8(lvl23, lvl26);
-
-		__m128i lvl41 = _mm_unpacklo_epi8(lvl31, lvl34);
-		__m128i lvl42 = _mm_unpackhi_epi8(lvl31, lvl34);
-		__m128i lvl43 = _mm_unpacklo_epi8(lvl32, lvl35);
-		__m128i lvl44 = _mm_unpackhi_epi8(lvl32, lvl35);
-		__m128i lvl45 = _mm_unpacklo_epi8(lvl33, lvl36);
-		__m128i lvl46 = _mm_unpackhi_epi8(lvl33, lvl36);
-
-		__m128i lvl51 = _mm_unpacklo_epi8(lvl41, lvl44);
-		__m128i lvl52 = _mm_unpackhi_epi8(lvl41, lvl44);
-		__m128i lvl53 = _mm_unpacklo_epi8(lvl42, lvl45);
-		__m128i lvl54 = _mm_unpackhi_epi8(lvl42, lvl45);
-		__m128i lvl55 = _mm_unpacklo_epi8(lvl43, lvl46);
-		__m128i lvl56 = _mm_unpackhi_epi8(lvl43, lvl46);
-
-		/*Deinterleaving ends - lvl51 and lvl52 contain red, 3 and 4 contain green, 5 and 6 blue*/
-
-		/*converting 8 bit unsigned ints to 16bit unsigned ints - using unpack for red and green; shuffle for blue*/
-		__m128i red1 = _mm_unpacklo_epi8(lvl51,lvl51);
-		__m128i red2 = _mm_unpackhi_epi8(lvl51,lvl51);
-		__m128i red3 = _mm_unpacklo_epi8(lvl52,lvl52);
-		__m128i red4 = _mm_unpackhi_epi8(lvl52,lvl52);
-		__m128i green1 = _mm_unpacklo_epi8(lvl53,lvl53);
-		__m128i green2 = _mm_unpackhi_epi8(lvl53,lvl53);
-		__m128i green3 = _mm_unpacklo_epi8(lvl54,lvl54);
-		__m128i green4 = _mm_unpackhi_epi8(lvl54,lvl54);
-		red1 = _mm_srli_epi16(red1,8);
-		red2 = _mm_srli_epi16(red2,8);
-		red3 = _mm_srli_epi16(red3,8);
-		red4 = _mm_srli_epi16(red4,8);
-		green1 = _mm_srli_epi16(green1,8);
-		green2 = _mm_srli_epi16(green2,8);
-		green3 = _mm_srli_epi16(green3,8);
-		green4 = _mm_srli_epi16(green4,8);
-
-		__m128i blue1 = _mm_shuffle_epi8(lvl55,mask1);
-		__m128i blue2 = _mm_shuffle_epi8(lvl55,mask2);
-		__m128i blue3 = _mm_shuffle_epi8(lvl56,mask1);
-		__m128i blue4 = _mm_shuffle_epi8(lvl56,mask2);	
-		/*conversion ends*/
-	
-		/*Multiply each color with respective constant*/
-		__m128i r1 = _mm_mullo_epi16(red1 , rconst);
-		__m128i g1 = _mm_mullo_epi16(green1, gconst);
-		__m128i b1 = _mm_mullo_epi16(blue1, bconst);
-		__m128i r2 =_mm_mullo_epi16(red2 , rconst);
-		__m128i g2 = _mm_mullo_epi16(green2, gconst);
-		__m128i b2 = _mm_mullo_epi16(blue2, bconst);
-		__m128i r3 = _mm_mullo_epi16(red3 , rconst);
-		__m128i g3 =  _mm_mullo_epi16(green3, gconst);
-		__m128i b3 =  _mm_mullo_epi16(blue3, bconst);
-		__m128i r4 = _mm_mullo_epi16(red4 , rconst);
-		__m128i g4 =  _mm_mullo_epi16(green4, gconst);
-		__m128i b4 =  _mm_mullo_epi16(blue4, bconst);
-
-		/*Add all each rgb set together */
-		__m128i rgb1 = _mm_add_epi16(r1,g1);
-		rgb1 = _mm_add_epi16(rgb1,b1);
-		__m128i rgb2 = _mm_add_epi16(r2,g2);
-		rgb2 = _mm_add_epi16(rgb2,b2);
-		__m128i rgb3 = _mm_add_epi16(r3,g3);
-		rgb3 = _mm_add_epi16(rgb3,b3);
-		__m128i rgb4 = _mm_add_epi16(r4,g4);
-		rgb4 = _mm_add_epi16(rgb4,b4);
-
-		/*Right shift the sum*/
-		__m128i rgb11 = _mm_srli_epi16(rgb1,8);
-		__m128i rgb12 = _mm_srli_epi16(rgb2,8);
-		__m128i rgb13 = _mm_srli_epi16(rgb3,8);
-		__m128i rgb14 = _mm_srli_epi16(rgb4,8);
-
-		/*Extract only lower bits using shuffle to convert back into 16 8bit uint*/
-		__m128i gray1 = _mm_or_si128(_mm_shuffle_epi8(rgb12,gray_mask2),_mm_shuffle_epi8(rgb11,gray_mask1));
-		__m128i gray2 = _mm_or_si128(_mm_shuffle_epi8(rgb14,gray_mask2),_mm_shuffle_epi8(rgb13,gray_mask1));
-
-		/*Store*/
-		_mm_storeu_si128((__m128i*)grayscale_image,gray1);
-		_mm_storeu_si128((__m128i*)(grayscale_image+16),gray2);
-
-		ptr +=32;
-		grayscale_image += 32;
-		rgb_image += 96;
+static void convert_rgb_to_grayscale_ssse3(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, size_t width, size_t height) {
+	const size_t pixels = width * height;
+	size_t i = 0;
+	for (; i + 16 <= pixels; i += 16)
+		_mm_storeu_si128((__m128i*)(grayscale_image + i), convert_16_pixels_ssse3(rgb_image + 3 * i));
+	for (; i < pixels; i++)
+		grayscale_image[i] = convert_pixel(rgb_image + 3 * i);
+}
 
-	}
+/* AVX2: 32 pixels per block */
+__attribute__((target("avx2")))
+static inline void convert_block_avx2(const uint8_t *CSE6230_RESTRICT rgb, uint8_t *CSE6230_RESTRICT gray) {
+	const __m256i shuffle = _mm256_setr_epi8(0,1,2,1, 3,4,5,4, 6,7,8,7, 9,10,11,10,
+		0,1,2,1, 3,4,5,4, 6,7,8,7, 9,10,11,10);
+	const __m256i weights = _mm256_setr_epi8(GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG, GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG,
+		GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG, GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG,
+		GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG, GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG,
+		GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG, GRAY_WEIGHTS_RG, GRAY_WEIGHTS_BG);
+	const __m256i ones = _mm256_set1_epi16(1);
+	/* Lanes get bytes 0-11 and 12-23 of a load, or 8-19 and 20-31 for the last one */
+	const __m256i spread = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+	const __m256i spread_last = _mm256_setr_epi32(2, 3, 4, 0, 5, 6, 7, 0);
+	const __m256i unpack = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	__m256i p0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(rgb)), spread);
+	__m256i p1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(rgb + 24)), spread);
+	__m256i p2 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(rgb + 48)), spread);
+	__m256i p3 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)(rgb + 64)), spread_last);
+
+	p0 = _mm256_srli_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_shuffle_epi8(p0, shuffle), weights), ones), 8);
+	p1 = _mm256_srli_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_shuffle_epi8(p1, shuffle), weights), ones), 8);
+	p2 = _mm256_srli_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_shuffle_epi8(p2, shuffle), weights), ones), 8);
+	p3 = _mm256_srli_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_shuffle_epi8(p3, shuffle), weights), ones), 8);
+
+	/* The packs work within lanes, so groups of 4 pixels end up as 0 2 4 6 | 1 3 5 7 */
+	const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p0, p1), _mm256_packs_epi32(p2, p3));
+	_mm256_storeu_si256((__m256i*)gray, _mm256_permutevar8x32_epi32(packed, unpack));
+}
 
-	/*Handles cases which exceed a multiple of 96*/
-	while(ptr < (width*height))
-	{
-		const uint16_t red   = *(rgb_image);
-		const uint16_t green = *(rgb_image+ 1);
-		const uint16_t blue  = *(rgb_image + 2);
-		const uint8_t  luma  = (red * 54 + green * 183 + blue * 19) >> 8;
-		*(grayscale_image++) = luma;
-		ptr++;
-		rgb_image+=3;
+__attribute__((target("avx2")))
+static void convert_rgb_to_grayscale_avx2(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, size_t width, size_t height) {
+	const size_t pixels = width * height;
+	if (pixels < 32) {
+		convert_rgb_to_grayscale_ssse3(rgb_image, grayscale_image, width, height);
+		return;
 	}
+	size_t i = 0;
+	for (; i + 32 <= pixels; i += 32)
+		convert_block_avx2(rgb_image + 3 * i, grayscale_image + i);
+	/* The last block overlaps the previous one rather than reading past the end */
+	if (i < pixels)
+		convert_block_avx2(rgb_image + 3 * (pixels - 32), grayscale_image + pixels - 32);
 }
 
-void integrate_image_optimized(const uint8_t *CSE6230_RESTRICT source_image, 
-		uint32_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+/*
+ * AVX-512: 16 pixels (48 bytes) per step, with masked loads and stores
+ * for the tail. vpermb (VBMI) deinterleaves in one instruction; with
+ * only AVX-512BW, vpermd spreads the pixels to 12 bytes per lane and
+ * vpshufb does the rest.
+ */
+
+#define DEFINE_CONVERT_AVX512(isa, target_isa, deinterleave) \
+	__attribute__((target(target_isa))) \
+	static inline void convert_step_##isa(const uint8_t *CSE6230_RESTRICT rgb, uint8_t *CSE6230_RESTRICT gray, size_t n) { \
+		const __m512i weights = _mm512_set1_epi32(54 | (74 << 8) | (19 << 16) | (109 << 24)); \
+		const __m512i ones = _mm512_set1_epi16(1); \
+		const __mmask64 load_mask = (n == 16) ? 0xFFFFFFFFFFFFull : (1ull << (3 * n)) - 1; \
+		const __mmask16 store_mask = (n == 16) ? 0xFFFF : (1u << n) - 1; \
+		const __m512i in = _mm512_maskz_loadu_epi8(load_mask, rgb); \
+		__m512i p = deinterleave(in); \
+		p = _mm512_srli_epi32(_mm512_madd_epi16(_mm512_maddubs_epi16(p, weights), ones), 8); \
+		_mm512_mask_cvtepi32_storeu_epi8(gray, store_mask, p); \
+	} \
+	__attribute__((target(target_isa))) \
+	static void convert_rgb_to_grayscale_##isa(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, size_t width, size_t height) { \
+		const size_t pixels = width * height; \
+		size_t i = 0; \
+		for (; i + 64 <= pixels; i += 64) { \
+			convert_step_##isa(rgb_image + 3 * i, grayscale_image + i, 16); \
+			convert_step_##isa(rgb_image + 3 * i + 48, grayscale_image + i + 16, 16); \
+			convert_step_##isa(rgb_image + 3 * i + 96, grayscale_image + i + 32, 16); \
+			convert_step_##isa(rgb_image + 3 * i + 144, grayscale_image + i + 48, 16); \
+		} \
+		for (; i < pixels; i += 16) \
+			convert_step_##isa(rgb_image + 3 * i, grayscale_image + i, (pixels - i < 16) ? pixels - i : 16); \
+	}
 
-	__m128i c = _mm_set1_epi32(0);
-	size_t j = 0;       
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i deinterleave_avx512bw(__m512i in) {
+	const __m512i spread = _mm512_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0);
+	const __m512i shuffle = _mm512_set4_epi32(0x0A0B0A09, 0x07080706, 0x04050403, 0x01020100);
+	return _mm512_shuffle_epi8(_mm512_permutexvar_epi32(spread, in), shuffle);
+}
 
-	int prefix_last_ele = 0;
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static inline __m512i deinterleave_avx512vbmi(__m512i in) {
+	const __m512i deinterleave = _mm512_set_epi8(
+		46,47,46,45, 43,44,43,42, 40,41,40,39, 37,38,37,36,
+		34,35,34,33, 31,32,31,30, 28,29,28,27, 25,26,25,24,
+		22,23,22,21, 19,20,19,18, 16,17,16,15, 13,14,13,12,
+		10,11,10,9, 7,8,7,6, 4,5,4,3, 1,2,1,0);
+	return _mm512_permutexvar_epi8(deinterleave, in);
+}
 
-	for(size_t i=0;i<height; ++i) {
+DEFINE_CONVERT_AVX512(avx512bw, "avx512f,avx512bw", deinterleave_avx512bw)
+DEFINE_CONVERT_AVX512(avx512vbmi, "avx512f,avx512bw,avx512vbmi", deinterleave_avx512vbmi)
+
+/*
+ * Runtime dispatch: convert_rgb_to_grayscale_optimized calls the best
+ * kernel the CPU supports. The library does not use libc (it is linked
+ * statically into a shared object), so a test driver that wants another
+ * kernel asks for it with select_convert_rgb_to_grayscale_isa.
+ */
+
+enum convert_isa { ISA_AVX512VBMI, ISA_AVX512BW, ISA_AVX2, ISA_SSSE3, ISA_COUNT };
+
+static const char* const convert_isa_names[ISA_COUNT] = { "avx512vbmi", "avx512bw", "avx2", "ssse3" };
+static const convert_rgb_to_grayscale_function convert_kernels[ISA_COUNT] = {
+	convert_rgb_to_grayscale_avx512vbmi,
+	convert_rgb_to_grayscale_avx512bw,
+	convert_rgb_to_grayscale_avx2,
+	convert_rgb_to_grayscale_ssse3
+};
+
+static int convert_isa_selected = -1;
+
+static bool cpu_supports(int isa) {
+	switch (isa) {
+		case ISA_AVX512VBMI:
+			return __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw");
+		case ISA_AVX512BW:
+			return __builtin_cpu_supports("avx512bw");
+		case ISA_AVX2:
+			return __builtin_cpu_supports("avx2");
+		default:
+			return true;
+	}
+}
 
-		__m128i carry = _mm_set1_epi32(0);
-	
-		size_t start_addr = i * width; 	
-		j = 0;
+static bool same_name(const char* a, const char* b) {
+	while (*a != '\0' && *a == *b) {
+		a++;
+		b++;
+	}
+	return *a == *b;
+}
 
-		for(; j + 16 < width; j += 16) {
+const char* select_convert_rgb_to_grayscale_isa(const char* max_isa) {
+	__builtin_cpu_init();
+	bool allowed = (max_isa == NULL || *max_isa == '\0');
+	int isa = 0;
+	for (; isa < ISA_COUNT - 1; isa++) {
+		allowed = allowed || same_name(max_isa, convert_isa_names[isa]);
+		if (allowed && cpu_supports(isa))
+			break;
+	}
+	convert_isa_selected = isa;
+	return convert_isa_names[isa];
+}
 
-			//load 128 bits or 16 8-bit integers
-			__m128i elements = _mm_loadu_si128((const __m128i*)(source_image + start_addr + j));
+void convert_rgb_to_grayscale_optimized(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, size_t width, size_t height) {
+	if (convert_isa_selected < 0)
+		select_convert_rgb_to_grayscale_isa(NULL);
+	convert_kernels[convert_isa_selected](rgb_image, grayscale_image, width, height);
+}
 
-			//take lower 8 8-bit integers and convert them to 16 bit
-			__m128i al_8_16 = _mm_unpacklo_epi8(elements, c);
-			//do the same for higher 8-bit integers
-			__m128i ah_8_16 = _mm_unpackhi_epi8(elements, c);
+/*
+ * Integral image in one row-major pass: row i of the result is the prefix
+ * sum of source row i plus row i - 1 of the result, so the vertical pass
+ * is a vector add over whole rows instead of a walk down each column.
+ *
+ * With OpenMP, the rows are split into one horizontal band per thread:
+ *  1. each band sums its source columns into its last output row,
+ *  2. one thread accumulates those rows from band to band and turns each
+ *     into the final integral row (its row prefix sum),
+ *  3. each band integrates its other rows, starting from the last row of
+ *     the band above, which no band writes in this step.
+ * Steps 1 and 3 read the source twice, but the output is written once.
+ *
+ * The row prefix sums are 32-bit, so rows must be under 2^24 pixels wide.
+ * The 32-bit variant needs the total under 2^32 (e.g. fewer than 2^24
+ * pixels); integrate_image_optimized_u64 has no such limit.
+ */
+
+#define INTEGRAL_MIN_BAND_ROWS 32
+
+/* out = q + above, for 4 consecutive 32-bit row sums q */
+template <bool has_above>
+static inline void store_integral(uint32_t* out, const uint32_t* above, __m128i q) {
+	if (has_above)
+		q = _mm_add_epi32(q, _mm_loadu_si128((const __m128i*)above));
+	_mm_storeu_si128((__m128i*)out, q);
+}
 
-			//prefix sum vector containing lower 8 integers
-			al_8_16 = _mm_add_epi16(al_8_16, _mm_slli_si128(al_8_16, 2));
-			al_8_16 = _mm_add_epi16(al_8_16, _mm_slli_si128(al_8_16, 4));
-			al_8_16 = _mm_add_epi16(al_8_16, _mm_slli_si128(al_8_16, 8));
+template <bool has_above>
+static inline void store_integral(uint64_t* out, const uint64_t* above, __m128i q) {
+	__m128i lo = _mm_cvtepu32_epi64(q);
+	__m128i hi = _mm_cvtepu32_epi64(_mm_srli_si128(q, 8));
+	if (has_above) {
+		lo = _mm_add_epi64(lo, _mm_loadu_si128((const __m128i*)above));
+		hi = _mm_add_epi64(hi, _mm_loadu_si128((const __m128i*)(above + 2)));
+	}
+	_mm_storeu_si128((__m128i*)out, lo);
+	_mm_storeu_si128((__m128i*)(out + 2), hi);
+}
 
-			//prefix sum vector containing higher 8 integers
-			ah_8_16 = _mm_add_epi16(ah_8_16, _mm_slli_si128(ah_8_16, 2));
-			ah_8_16 = _mm_add_epi16(ah_8_16, _mm_slli_si128(ah_8_16, 4));
-			ah_8_16 = _mm_add_epi16(ah_8_16, _mm_slli_si128(ah_8_16, 8));
+/* above + offset, or NULL without a row above: offsetting a NULL pointer is undefined */
+template <bool has_above, typename integral_t>
+static inline const integral_t* above_at(const integral_t* above, size_t offset) {
+	return has_above ? above + offset : NULL;
+}
 
-			//add the last element from the previous vector and store it in integral image
-			//which defaults to zero for the first set
-			__m128i al_8_16l_32 = _mm_add_epi32(_mm_unpacklo_epi16(al_8_16, c), carry);
-			_mm_storeu_si128((__m128i *) (integral_image + start_addr + j + 0), al_8_16l_32);
+/* Prefix sum of 8 16-bit lanes by shift-and-add */
+static inline __m128i prefix_sum_epi16(__m128i x) {
+	x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+	x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+	return _mm_add_epi16(x, _mm_slli_si128(x, 8));
+}
 
-			__m128i al_8_16h_32 = _mm_add_epi32(_mm_unpackhi_epi16(al_8_16, c), carry);
-			_mm_storeu_si128((__m128i *) (integral_image + start_addr + j + 4), al_8_16h_32);
+/* Integrates 16 pixels; carry holds the row sum so far in every lane */
+template <bool has_above, typename integral_t>
+static inline void integrate_16_pixels(__m128i pixels, __m128i& carry, integral_t *CSE6230_RESTRICT out, const integral_t* above) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i lo = prefix_sum_epi16(_mm_unpacklo_epi8(pixels, zero));
+	const __m128i hi = prefix_sum_epi16(_mm_unpackhi_epi8(pixels, zero));
+
+	const __m128i q0 = _mm_add_epi32(_mm_unpacklo_epi16(lo, zero), carry);
+	const __m128i q1 = _mm_add_epi32(_mm_unpackhi_epi16(lo, zero), carry);
+	carry = _mm_shuffle_epi32(q1, _MM_SHUFFLE(3, 3, 3, 3));
+	const __m128i q2 = _mm_add_epi32(_mm_unpacklo_epi16(hi, zero), carry);
+	const __m128i q3 = _mm_add_epi32(_mm_unpackhi_epi16(hi, zero), carry);
+	carry = _mm_shuffle_epi32(q3, _MM_SHUFFLE(3, 3, 3, 3));
+
+	store_integral<has_above>(out, above, q0);
+	store_integral<has_above>(out + 4, above_at<has_above>(above, 4), q1);
+	store_integral<has_above>(out + 8, above_at<has_above>(above, 8), q2);
+	store_integral<has_above>(out + 12, above_at<has_above>(above, 12), q3);
+}
 
-			//take the last element of the higher 32 bit vector, to be added to the next 8 32 bit elements
-			prefix_last_ele = _mm_extract_epi32(al_8_16h_32, 3);                
-			carry = _mm_set1_epi32(prefix_last_ele);
+/* out[j] = source[0] + ... + source[j] (+ above[j]) */
+template <bool has_above, typename integral_t>
+static void integrate_row(const uint8_t *CSE6230_RESTRICT source, integral_t *CSE6230_RESTRICT out, const integral_t* above, size_t width) {
+	__m128i carry = _mm_setzero_si128();
+	size_t j = 0;
+	for (; j + 16 <= width; j += 16)
+		integrate_16_pixels<has_above>(_mm_loadu_si128((const __m128i*)(source + j)), carry, out + j, above_at<has_above>(above, j));
+	uint32_t sum = _mm_cvtsi128_si32(carry);
+	for (; j < width; j++) {
+		sum += source[j];
+		out[j] = has_above ? sum + above[j] : sum;
+	}
+}
 
-			//unpack to 32 bit and add the last element
-			__m128i ah_8_16l_32 = _mm_add_epi32(_mm_unpacklo_epi16(ah_8_16, c), carry);
-			_mm_storeu_si128((__m128i *) (integral_image + start_addr + j + 8), ah_8_16l_32);
+template <typename integral_t>
+static void integrate_rows(const uint8_t *CSE6230_RESTRICT source, integral_t *CSE6230_RESTRICT out, const integral_t* above, size_t width, size_t rows) {
+	if (rows == 0)
+		return;
+	if (above == NULL)
+		integrate_row<false>(source, out, above, width);
+	else
+		integrate_row<true>(source, out, above, width);
+	for (size_t i = 1; i < rows; i++)
+		integrate_row<true>(source + i * width, out + i * width, out + (i - 1) * width, width);
+}
 
-			__m128i ah_8_16h_32 = _mm_add_epi32(_mm_unpackhi_epi16(ah_8_16, c), carry);
-			_mm_storeu_si128((__m128i *) (integral_image + start_addr + j + 12), ah_8_16h_32);
+template <typename integral_t>
+static void integrate_image_banded(const uint8_t *CSE6230_RESTRICT source_image, integral_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+#if defined(_OPENMP)
+	size_t bands = omp_get_max_threads();
+	if (bands > height / INTEGRAL_MIN_BAND_ROWS)
+		bands = height / INTEGRAL_MIN_BAND_ROWS;
+#else
+	const size_t bands = 1;
+#endif
+	if (bands <= 1) {
+		integrate_rows(source_image, integral_image, (const integral_t*)NULL, width, height);
+		return;
+	}
 
-			//prepare the carry to contain the last element for adding to following vectors
-			prefix_last_ele = _mm_extract_epi32(ah_8_16h_32, 3);
-			carry = _mm_set1_epi32(prefix_last_ele);
+	/* Band b is rows [height * b / bands, height * (b + 1) / bands) */
+	#pragma omp parallel num_threads(bands)
+	{
+		#pragma omp for schedule(static, 1)
+		for (size_t b = 0; b < bands; b++) {
+			const size_t first = height * b / bands;
+			const size_t last = height * (b + 1) / bands - 1;
+			integral_t* column_sums = integral_image + last * width;
+			for (size_t j = 0; j < width; j++)
+				column_sums[j] = source_image[first * width + j];
+			for (size_t i = first + 1; i <= last; i++)
+				for (size_t j = 0; j < width; j++)
+					column_sums[j] += source_image[i * width + j];
 		}
 
-		//now i have like 8 elements remaining
-                for (; j < width ; ++j) {
-                        prefix_last_ele += source_image[i * width + j];
-                        integral_image[i * width + j] = prefix_last_ele;
-                }
-
-        }
-
+		#pragma omp single
+		{
+			const integral_t* previous = NULL;
+			for (size_t b = 0; b < bands; b++) {
+				integral_t* row = integral_image + (height * (b + 1) / bands - 1) * width;
+				if (previous != NULL)
+					for (size_t j = 0; j < width; j++)
+						row[j] += previous[j];
+				previous = row;
+			}
+			/* From column totals to integral rows */
+			for (size_t b = 0; b < bands; b++) {
+				integral_t* row = integral_image + (height * (b + 1) / bands - 1) * width;
+				for (size_t j = 1; j < width; j++)
+					row[j] += row[j - 1];
+			}
+		}
 
-	//now performing the columnwise prefix sum
-	for(size_t i = 1; i < height ; ++i) {
+		#pragma omp for schedule(static, 1)
+		for (size_t b = 0; b < bands; b++) {
+			const size_t first = height * b / bands;
+			const size_t last = height * (b + 1) / bands - 1;
+			const integral_t* above = (b == 0) ? NULL : integral_image + (first - 1) * width;
+			integrate_rows(source_image + first * width, integral_image + first * width, above, width, last - first);
+		}
+	}
+}
 
-		size_t j = 0;
-		for(j = 0; j + 16 < width; j += 16) {
-			__m128i row1 = _mm_loadu_si128((const __m128i*)(integral_image + ((i-1) * width) + j));
-			__m128i row2 = _mm_loadu_si128((const __m128i*)(integral_image + (i * width) + j));
-			row2 = _mm_add_epi32(row1, row2);
-                        _mm_storeu_si128((__m128i *) (integral_image + (i * width) + j ), row2);
+void integrate_image_optimized(const uint8_t *CSE6230_RESTRICT source_image, uint32_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+	integrate_image_banded(source_image, integral_image, width, height);
+}
 
-			row1 = _mm_loadu_si128((const __m128i*)(integral_image + ((i-1) * width) + j + 4));
-			row2 = _mm_loadu_si128((const __m128i*)(integral_image + (i * width) + j + 4));
-			row2 = _mm_add_epi32(row1, row2);
-                        _mm_storeu_si128((__m128i *) (integral_image + (i * width) + j + 4), row2);
+void integrate_image_optimized_u64(const uint8_t *CSE6230_RESTRICT source_image, uint64_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+	integrate_image_banded(source_image, integral_image, width, height);
+}
 
-			row1 = _mm_loadu_si128((const __m128i*)(integral_image + ((i-1) * width) + j + 8));
-			row2 = _mm_loadu_si128((const __m128i*)(integral_image + (i * width) + j + 8));
-			row2 = _mm_add_epi32(row1, row2);
-			_mm_storeu_si128((__m128i *) (integral_image + (i * width) + j + 8), row2);
+void integrate_image_optimized_serial(const uint8_t *CSE6230_RESTRICT source_image, uint32_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+	integrate_rows(source_image, integral_image, (const uint32_t*)NULL, width, height);
+}
 
-			row1 = _mm_loadu_si128((const __m128i*)(integral_image + ((i-1) * width) + j + 12));
-			row2 = _mm_loadu_si128((const __m128i*)(integral_image + (i * width) + j + 12));
-			row2 = _mm_add_epi32(row1, row2);
-			_mm_storeu_si128((__m128i *) (integral_image + (i * width) + j + 12), row2);
-		}
+/*
+ * Fused conversion and integration: each 16 pixels of luma go from the
+ * SSSE3 conversion straight into the row prefix sum, so the grayscale
+ * plane is only written if the caller asks for it (grayscale_image may
+ * be NULL). This runs on the calling thread only; the luma would have
+ * to be computed twice to split it into bands like the integration.
+ */
+
+template <bool has_above, bool has_grayscale>
+static void convert_and_integrate_row(const uint8_t *CSE6230_RESTRICT rgb, uint8_t *CSE6230_RESTRICT gray, uint32_t *CSE6230_RESTRICT out, const uint32_t* above, size_t width) {
+	__m128i carry = _mm_setzero_si128();
+	size_t j = 0;
+	for (; j + 16 <= width; j += 16) {
+		const __m128i pixels = convert_16_pixels_ssse3(rgb + 3 * j);
+		if (has_grayscale)
+			_mm_storeu_si128((__m128i*)(gray + j), pixels);
+		integrate_16_pixels<has_above>(pixels, carry, out + j, above_at<has_above>(above, j));
+	}
+	uint32_t sum = _mm_cvtsi128_si32(carry);
+	for (; j < width; j++) {
+		const uint8_t pixel = convert_pixel(rgb + 3 * j);
+		if (has_grayscale)
+			gray[j] = pixel;
+		sum += pixel;
+		out[j] = has_above ? sum + above[j] : sum;
+	}
+}
 
-		for (; j < width; ++j) {
-			integral_image[ i * width + j] += integral_image[ (i-1) * width + j];
-		}
+template <bool has_grayscale>
+static void convert_and_integrate_rows(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, uint32_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+	if (height == 0)
+		return;
+	convert_and_integrate_row<false, has_grayscale>(rgb_image, grayscale_image, integral_image, NULL, width);
+	for (size_t i = 1; i < height; i++) {
+		convert_and_integrate_row<true, has_grayscale>(rgb_image + 3 * i * width,
+			has_grayscale ? grayscale_image + i * width : NULL,
+			integral_image + i * width, integral_image + (i - 1) * width, width);
 	}
 }
 
+void convert_and_integrate_optimized(const uint8_t *CSE6230_RESTRICT rgb_image, uint8_t *CSE6230_RESTRICT grayscale_image, uint32_t *CSE6230_RESTRICT integral_image, size_t width, size_t height) {
+	if (grayscale_image != NULL)
+		convert_and_integrate_rows<true>(rgb_image, grayscale_image, integral_image, width, height);
+	else
+		convert_and_integrate_rows<false>(rgb_image, NULL, integral_image, width, height);
+}
@@ -0,0 +1,252 @@
+#include <hpcdefs.hpp>
+#include <image.hpp>
+#include <spsc-ring.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+// Streams raw RGB frames (3 bytes per pixel, no header) from a file or stdin through
+//   reader -> grayscale -> integral -> consumer
+// Each stage is a thread pinned to its own core (modulo the number of cores), and the
+// stages pass frames through bounded lock-free single-producer/single-consumer queues.
+// The integral stage uses the serial kernel: an OpenMP team started from that thread would
+// inherit its one-core affinity and its bands would only take turns on that core.
+// The frame buffers come from a fixed pool: the consumer hands them back to the reader
+// through one more queue, so nothing is allocated while streaming.
+//
+// Usage: image-stream <width> <height> [<frames.rgb> | - [<pool frames>]]
+
+enum stage {
+	STAGE_READ,
+	STAGE_GRAYSCALE,
+	STAGE_INTEGRAL,
+	STAGE_CONSUME,
+	STAGE_COUNT
+};
+
+static const char* const stage_names[STAGE_COUNT] = { "Read", "Grayscale", "Integral", "Consume" };
+
+struct frame {
+	uint64_t index;
+	uint8_t* rgb_image;
+	uint8_t* grayscale_image;
+	uint32_t* integral_image;
+	uint64_t start_ns[STAGE_COUNT];
+	uint64_t end_ns[STAGE_COUNT];
+};
+
+typedef spsc_ring<frame*> frame_queue;
+
+struct pipeline {
+	FILE* input;
+	size_t image_width;
+	size_t image_height;
+	convert_rgb_to_grayscale_function convert_rgb_to_grayscale;
+	integrate_image_function integrate_image;
+
+	// queues[s] carries frames from stage s to stage s + 1; queues[STAGE_CONSUME] returns them to the reader.
+	// A NULL frame marks the end of the stream.
+	frame_queue* queues[STAGE_COUNT];
+
+	// Filled in by the consumer
+	std::vector<double> latency_ms[STAGE_COUNT + 1]; // Per stage, then end to end
+	uint64_t frames_count;
+	uint64_t first_start_ns;
+	uint64_t last_end_ns;
+	uint64_t checksum;
+};
+
+static uint64_t get_ns() {
+	struct timespec current_time;
+	clock_gettime(CLOCK_MONOTONIC, &current_time);
+	return current_time.tv_sec * 1000000000ull + current_time.tv_nsec;
+}
+
+static void pin_to_core(int stage_index) {
+	const long cores_count = sysconf(_SC_NPROCESSORS_ONLN);
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+	CPU_SET(stage_index % (cores_count > 0 ? cores_count : 1), &cpu_set);
+	const int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+	if (result != 0) {
+		fprintf(stderr, "Warning: could not pin the %s stage: error code %d\n", stage_names[stage_index], result);
+	}
+}
+
+static void* read_frames(void* argument) {
+	pipeline* p = static_cast<pipeline*>(argument);
+	pin_to_core(STAGE_READ);
+	const size_t frame_size = p->image_width * p->image_height * 3;
+	for (uint64_t index = 0; ; index++) {
+		frame* f = p->queues[STAGE_CONSUME]->pop();
+		f->index = index;
+		f->start_ns[STAGE_READ] = get_ns();
+		const size_t bytes_read = fread(f->rgb_image, 1, frame_size, p->input);
+		if (bytes_read != frame_size) {
+			if (bytes_read != 0) {
+				fprintf(stderr, "Warning: dropped a partial frame of %u out of %u bytes\n",
+					unsigned(bytes_read), unsigned(frame_size));
+			}
+			p->queues[STAGE_READ]->push(NULL);
+			return NULL;
+		}
+		f->end_ns[STAGE_READ] = get_ns();
+		p->queues[STAGE_READ]->push(f);
+	}
+}
+
+static void* convert_frames(void* argument) {
+	pipeline* p = static_cast<pipeline*>(argument);
+	pin_to_core(STAGE_GRAYSCALE);
+	for (frame* f; (f = p->queues[STAGE_READ]->pop()) != NULL; ) {
+		f->start_ns[STAGE_GRAYSCALE] = get_ns();
+		p->convert_rgb_to_grayscale(f->rgb_image, f->grayscale_image, p->image_width, p->image_height);
+		f->end_ns[STAGE_GRAYSCALE] = get_ns();
+		p->queues[STAGE_GRAYSCALE]->push(f);
+	}
+	p->queues[STAGE_GRAYSCALE]->push(NULL);
+	return NULL;
+}
+
+static void* integrate_frames(void* argument) {
+	pipeline* p = static_cast<pipeline*>(argument);
+	pin_to_core(STAGE_INTEGRAL);
+	for (frame* f; (f = p->queues[STAGE_GRAYSCALE]->pop()) != NULL; ) {
+		f->start_ns[STAGE_INTEGRAL] = get_ns();
+		p->integrate_image(f->grayscale_image, f->integral_image, p->image_width, p->image_height);
+		f->end_ns[STAGE_INTEGRAL] = get_ns();
+		p->queues[STAGE_INTEGRAL]->push(f);
+	}
+	p->queues[STAGE_INTEGRAL]->push(NULL);
+	return NULL;
+}
+
+// Stands in for a real consumer: folds the frame's total into a checksum and records the timings
+static void* consume_frames(void* argument) {
+	pipeline* p = static_cast<pipeline*>(argument);
+	pin_to_core(STAGE_CONSUME);
+	const size_t last_pixel = p->image_width * p->image_height - 1;
+	for (frame* f; (f = p->queues[STAGE_INTEGRAL]->pop()) != NULL; ) {
+		f->start_ns[STAGE_CONSUME] = get_ns();
+		p->checksum = p->checksum * 31 + f->integral_image[last_pixel];
+		f->end_ns[STAGE_CONSUME] = get_ns();
+
+		for (int s = 0; s < STAGE_COUNT; s++)
+			p->latency_ms[s].push_back((f->end_ns[s] - f->start_ns[s]) / 1.0e+6);
+		p->latency_ms[STAGE_COUNT].push_back((f->end_ns[STAGE_CONSUME] - f->start_ns[STAGE_READ]) / 1.0e+6);
+		if (p->frames_count++ == 0)
+			p->first_start_ns = f->start_ns[STAGE_READ];
+		p->last_end_ns = f->end_ns[STAGE_CONSUME];
+
+		p->queues[STAGE_CONSUME]->push(f);
+	}
+	return NULL;
+}
+
+static double percentile(const std::vector<double>& sorted_values, double fraction) {
+	if (sorted_values.empty())
+		return 0.0;
+	const size_t index = size_t(fraction * (sorted_values.size() - 1) + 0.5);
+	return sorted_values[index];
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <width> <height> [<frames.rgb> | - [<pool frames>]]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	pipeline p;
+	p.image_width = strtoul(argv[1], NULL, 10);
+	p.image_height = strtoul(argv[2], NULL, 10);
+	const char* input_path = (argc > 3) ? argv[3] : "-";
+	const size_t pool_size = (argc > 4) ? strtoul(argv[4], NULL, 10) : 8;
+	if (p.image_width == 0 || p.image_height == 0 || pool_size == 0) {
+		fprintf(stderr, "Error: the frame size and pool size must be positive\n");
+		exit(EXIT_FAILURE);
+	}
+
+	void* libsimdimage = dlopen("./libsimdimage.so", RTLD_NOW | RTLD_LOCAL);
+	if (libsimdimage == NULL) {
+		fprintf(stderr, "Error: %s\n", dlerror());
+		exit(EXIT_FAILURE);
+	}
+	p.convert_rgb_to_grayscale =
+		reinterpret_cast<convert_rgb_to_grayscale_function>(dlsym(libsimdimage, "convert_rgb_to_grayscale_optimized"));
+	p.integrate_image =
+		reinterpret_cast<integrate_image_function>(dlsym(libsimdimage, "integrate_image_optimized_serial"));
+	if (p.convert_rgb_to_grayscale == NULL || p.integrate_image == NULL) {
+		fprintf(stderr, "Error: %s\n", dlerror());
+		exit(EXIT_FAILURE);
+	}
+
+	if (strcmp(input_path, "-") == 0) {
+		p.input = stdin;
+	} else {
+		p.input = fopen(input_path, "rb");
+		if (p.input == NULL) {
+			fprintf(stderr, "Failed to open the input file %s\n", input_path);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Every queue can hold the whole pool and the end marker, so a push never waits
+	for (int s = 0; s < STAGE_COUNT; s++)
+		p.queues[s] = new frame_queue(pool_size + 1);
+	const size_t pixels = p.image_width * p.image_height;
+	std::vector<frame> pool(pool_size);
+	for (size_t i = 0; i < pool_size; i++) {
+		pool[i].rgb_image = static_cast<uint8_t*>(allocate_aligned_memory(pixels * 3, 64));
+		pool[i].grayscale_image = static_cast<uint8_t*>(allocate_aligned_memory(pixels, 64));
+		pool[i].integral_image = static_cast<uint32_t*>(allocate_aligned_memory(pixels * sizeof(uint32_t), 64));
+		p.queues[STAGE_CONSUME]->push(&pool[i]);
+	}
+	p.frames_count = 0;
+	p.first_start_ns = p.last_end_ns = 0;
+	p.checksum = 0;
+
+	void* (*const stage_functions[STAGE_COUNT])(void*) = { read_frames, convert_frames, integrate_frames, consume_frames };
+	pthread_t threads[STAGE_COUNT];
+	for (int s = 0; s < STAGE_COUNT; s++) {
+		const int result = pthread_create(&threads[s], NULL, stage_functions[s], &p);
+		if (result != 0) {
+			fprintf(stderr, "Failed to start the %s stage: error code %d\n", stage_names[s], result);
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (int s = 0; s < STAGE_COUNT; s++)
+		pthread_join(threads[s], NULL);
+
+	const double elapsed_s = (p.last_end_ns - p.first_start_ns) / 1.0e+9;
+	printf("%zux%zu frames, pool of %zu\n", p.image_width, p.image_height, pool_size);
+	printf("\tFrames:      %llu\n", (unsigned long long)p.frames_count);
+	printf("\tFPS:         %.1lf\n", (elapsed_s > 0.0) ? p.frames_count / elapsed_s : 0.0);
+	printf("\tChecksum:    %016llx\n", (unsigned long long)p.checksum);
+	printf("\t%-12s %10s %10s %10s %10s (ms)\n", "Latency", "p50", "p90", "p99", "max");
+	for (int s = 0; s <= STAGE_COUNT; s++) {
+		std::vector<double>& values = p.latency_ms[s];
+		std::sort(values.begin(), values.end());
+		printf("\t%-12s %10.3lf %10.3lf %10.3lf %10.3lf\n", (s < STAGE_COUNT) ? stage_names[s] : "End to end",
+			percentile(values, 0.50), percentile(values, 0.90), percentile(values, 0.99),
+			values.empty() ? 0.0 : values.back());
+	}
+
+	for (size_t i = 0; i < pool_size; i++) {
+		release_aligned_memory(pool[i].integral_image);
+		release_aligned_memory(pool[i].grayscale_image);
+		release_aligned_memory(pool[i].rgb_image);
+	}
+	for (int s = 0; s < STAGE_COUNT; s++)
+		delete p.queues[s];
+	if (p.input != stdin)
+		fclose(p.input);
+	dlclose(libsimdimage);
+}
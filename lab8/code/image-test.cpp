@@ -22,13 +22,13 @@ void write_integral_error_image(const char* integral_error_image_path,
 			integral_error_image[i * image_width + j] = (integral_pixel == reference_integral_pixel) ? 0xFF : 0x00;
 		}
 	}
-	write_bmp_image(integral_error_image_path, integral_error_image, image_width, image_height);
+	write_bmp_image_queued(integral_error_image_path, integral_error_image, image_width, image_height);
 	release_aligned_memory(integral_error_image);
 }
 
 void test_conversion(const char* method_name, const char* grayscale_image_path, const char* integral_error_image_path,
 	convert_rgb_to_grayscale_function convert_rgb_to_grayscale, integrate_image_function integrate_image,
-	void* rgb_image, void* grayscale_image, void* reference_grayscale_image, void* integral_image, void* reference_integral_image,
+	const void* rgb_image, void* grayscale_image, void* reference_grayscale_image, void* integral_image, void* reference_integral_image,
 	size_t image_width, size_t image_height, size_t experiments_count, bool is_naive)
 {
 	memset(grayscale_image, 0, image_width * image_height * sizeof(uint8_t));
@@ -62,7 +62,8 @@ void test_conversion(const char* method_name, const char* grayscale_image_path,
 	}
 	printf("%s\n", method_name);
 	printf("\tPerformance test:\n");
-	printf("\t\tConversion:  %.2lf\n", min_conversion_ms);
+	printf("\t\tConversion:  %.2lf (%.2lf GB/s)\n", min_conversion_ms,
+		4.0 * image_width * image_height / (min_conversion_ms * 1.0e+6)); // 3 bytes read, 1 written per pixel
 	printf("\t\tIntegration: %.2lf\n", min_integration_ms);
 	printf("\t\tTotal:       %.2lf\n", (min_conversion_ms + min_integration_ms));
 	printf("\t\tFPS:         %.1lf\n", (1000.0 / (min_conversion_ms + min_integration_ms)));
@@ -83,7 +84,118 @@ void test_conversion(const char* method_name, const char* grayscale_image_path,
 				image_width, image_height);
 		}
 	}
-	write_bmp_image(grayscale_image_path, grayscale_image, image_width, image_height);
+	write_bmp_image_queued(grayscale_image_path, grayscale_image, image_width, image_height);
+}
+
+// Compares the conversion against the naive one on random images whose pixel
+// counts are not multiples of any vector length
+bool test_conversion_sizes(convert_rgb_to_grayscale_function convert_rgb_to_grayscale, const char* isa_name) {
+	static const size_t sizes[][2] = { { 1, 1 }, { 7, 3 }, { 5, 3 }, { 31, 1 }, { 33, 5 }, { 100, 37 }, { 521, 3 } };
+	bool passed = true;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		const size_t image_width = sizes[s][0];
+		const size_t image_height = sizes[s][1];
+		const size_t pixels = image_width * image_height;
+		// Exact-size buffers, so that reads or writes past the end are caught by tools like valgrind
+		uint8_t* rgb_image = static_cast<uint8_t*>(malloc(pixels * 3));
+		uint8_t* grayscale_image = static_cast<uint8_t*>(malloc(pixels + 1));
+		uint8_t* reference_grayscale_image = static_cast<uint8_t*>(malloc(pixels));
+		for (size_t i = 0; i < pixels * 3; i++)
+			rgb_image[i] = rand() & 0xFF;
+		grayscale_image[pixels] = 0xA5;
+		convert_rgb_to_grayscale_naive(rgb_image, reference_grayscale_image, image_width, image_height);
+		convert_rgb_to_grayscale(rgb_image, grayscale_image, image_width, image_height);
+		if (memcmp(grayscale_image, reference_grayscale_image, pixels) != 0 || grayscale_image[pixels] != 0xA5) {
+			printf("\t\t\t%zux%zu image converted incorrectly (%s)\n", image_width, image_height, isa_name);
+			passed = false;
+		}
+		free(reference_grayscale_image);
+		free(grayscale_image);
+		free(rgb_image);
+	}
+	return passed;
+}
+
+// Runs test_conversion_sizes on every kernel the CPU supports, then restores
+// the kernel SIMDIMAGE_ISA selects; without select_isa, on the dispatched one only
+bool test_conversion_sizes_all_isas(convert_rgb_to_grayscale_function convert_rgb_to_grayscale, select_isa_function select_isa) {
+	if (select_isa == NULL)
+		return test_conversion_sizes(convert_rgb_to_grayscale, "dispatched");
+	static const char* const isa_names[] = { "avx512vbmi", "avx512bw", "avx2", "ssse3" };
+	bool passed = true;
+	for (size_t i = 0; i < sizeof(isa_names) / sizeof(isa_names[0]); i++) {
+		// The selection falls back to a lower ISA if this one is not supported
+		if (strcmp(select_isa(isa_names[i]), isa_names[i]) == 0)
+			passed = test_conversion_sizes(convert_rgb_to_grayscale, isa_names[i]) && passed;
+	}
+	select_isa(getenv("SIMDIMAGE_ISA"));
+	return passed;
+}
+
+// Checks the 64-bit integral of a white image that is large enough for 32-bit
+// sums to overflow, against the closed form 255 (i + 1) (j + 1)
+bool test_integration_u64(integrate_image_u64_function integrate_image_u64, const uint8_t* grayscale_image,
+	const uint32_t* reference_integral_image, size_t image_width, size_t image_height)
+{
+	bool passed = true;
+	uint64_t* integral_image = static_cast<uint64_t*>(allocate_aligned_memory(image_width * image_height * sizeof(uint64_t), 64));
+	integrate_image_u64(grayscale_image, integral_image, image_width, image_height);
+	for (size_t i = 0; i < image_width * image_height; i++)
+		passed = passed && integral_image[i] == reference_integral_image[i];
+	release_aligned_memory(integral_image);
+
+	const size_t large_width = 4096;
+	const size_t large_height = 4160;
+	const size_t large_size = large_width * large_height;
+	uint8_t* large_image = static_cast<uint8_t*>(allocate_aligned_memory(large_size, 64));
+	uint64_t* large_integral_image = static_cast<uint64_t*>(allocate_aligned_memory(large_size * sizeof(uint64_t), 64));
+	memset(large_image, 0xFF, large_size);
+	timer integration_timer;
+	integrate_image_u64(large_image, large_integral_image, large_width, large_height);
+	const double integration_ms = integration_timer.get_ms();
+	for (size_t i = 0; i < large_height; i++)
+		for (size_t j = 0; j < large_width; j++)
+			passed = passed && large_integral_image[i * large_width + j] == uint64_t(255) * (i + 1) * (j + 1);
+	printf("\t\t\t%zux%zu 64-bit integration: %.2lf ms\n", large_width, large_height, integration_ms);
+	release_aligned_memory(large_integral_image);
+	release_aligned_memory(large_image);
+	return passed;
+}
+
+void test_fused(convert_and_integrate_function convert_and_integrate,
+	const void* rgb_image, void* grayscale_image, void* reference_grayscale_image, void* integral_image, void* reference_integral_image,
+	size_t image_width, size_t image_height, size_t experiments_count)
+{
+	const size_t grayscale_image_size = image_width * image_height * sizeof(uint8_t);
+	const size_t integral_image_size = image_width * image_height * sizeof(uint32_t);
+	bool test_passed = true;
+	double min_ms[2];
+	for (int with_grayscale = 0; with_grayscale < 2; with_grayscale++) {
+		uint8_t* grayscale_output = with_grayscale ? static_cast<uint8_t*>(grayscale_image) : NULL;
+		memset(grayscale_image, 0, grayscale_image_size);
+		memset(integral_image, 0, integral_image_size);
+		min_ms[with_grayscale] = 0.0;
+		for (size_t experiment = 0; experiment <= experiments_count; experiment++) {
+			timer fused_timer;
+			convert_and_integrate(static_cast<const uint8_t*>(rgb_image), grayscale_output,
+				static_cast<uint32_t*>(integral_image), image_width, image_height);
+			const double fused_ms = fused_timer.get_ms();
+			if (experiment == 0 || fused_ms < min_ms[with_grayscale])
+				min_ms[with_grayscale] = fused_ms;
+		}
+		test_passed = test_passed && memcmp(integral_image, reference_integral_image, integral_image_size) == 0;
+		if (with_grayscale)
+			test_passed = test_passed && memcmp(grayscale_image, reference_grayscale_image, grayscale_image_size) == 0;
+	}
+	printf("Fused\n");
+	printf("\tPerformance test:\n");
+	printf("\t\tIntegral:    %.2lf\n", min_ms[0]);
+	printf("\t\tWith gray:   %.2lf\n", min_ms[1]);
+	printf("\t\tFPS:         %.1lf\n", (1000.0 / min_ms[0]));
+	printf("\tUnit test:\n");
+	printf("\t\tFused:       %s\n", (test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
 }
 
 int main(int argc, char** argv) {
@@ -112,22 +224,40 @@ int main(int argc, char** argv) {
 		exit(EXIT_FAILURE);
 	}
 
+	// Optional: libraries without these are only tested for the separate 32-bit steps
+	integrate_image_u64_function integrate_image_optimized_u64 =
+		reinterpret_cast<integrate_image_u64_function>(dlsym(libsimdimage, "integrate_image_optimized_u64"));
+	integrate_image_function integrate_image_optimized_serial =
+		reinterpret_cast<integrate_image_function>(dlsym(libsimdimage, "integrate_image_optimized_serial"));
+
+	convert_and_integrate_function convert_and_integrate_optimized =
+		reinterpret_cast<convert_and_integrate_function>(dlsym(libsimdimage, "convert_and_integrate_optimized"));
+
+	// Optional: SIMDIMAGE_ISA=avx512vbmi|avx512bw|avx2|ssse3 caps the kernel the library dispatches to
+	select_isa_function select_convert_rgb_to_grayscale_isa =
+		reinterpret_cast<select_isa_function>(dlsym(libsimdimage, "select_convert_rgb_to_grayscale_isa"));
+	if (select_convert_rgb_to_grayscale_isa != NULL) {
+		printf("Conversion kernel: %s\n", select_convert_rgb_to_grayscale_isa(getenv("SIMDIMAGE_ISA")));
+	}
+
 	const size_t image_width = 520;
 	const size_t image_height = 390;
-	const size_t rgb_image_size = image_width * image_height * 3; // 24 bits per pixel
 	const size_t grayscale_image_size = image_width * image_height; // 8 bits per pixel
 	const size_t integral_image_size = image_width * image_height * 4; // 32 bits per pixel
 
-	void* rgb_image = allocate_aligned_memory(rgb_image_size, 64);
+	mapped_file rgb_image_mapping;
+	const uint8_t* rgb_image = map_raw_image("cat.rgb", rgb_image_mapping, image_width, image_height);
+	if (rgb_image == NULL) {
+		exit(EXIT_FAILURE);
+	}
 	void* grayscale_image = allocate_aligned_memory(grayscale_image_size, 64);
 	void* reference_grayscale_image = allocate_aligned_memory(grayscale_image_size, 64);
 	void* integral_image = allocate_aligned_memory(integral_image_size, 64);
 	void* reference_integral_image = allocate_aligned_memory(integral_image_size, 64);
 
-	read_raw_image("cat.rgb", rgb_image, image_width, image_height);
-	convert_rgb_to_grayscale_naive(static_cast<const uint8_t*>(rgb_image), static_cast<uint8_t*>(reference_grayscale_image), image_width, image_height);
+	convert_rgb_to_grayscale_naive(rgb_image, static_cast<uint8_t*>(reference_grayscale_image), image_width, image_height);
 	integrate_image_naive(static_cast<const uint8_t*>(reference_grayscale_image), static_cast<uint32_t*>(reference_integral_image), image_width, image_height);
-	write_bmp_image("cat.bmp", reference_grayscale_image, image_width, image_height);
+	write_bmp_image_queued("cat.bmp", reference_grayscale_image, image_width, image_height);
 
 	printf("%15s\t%10s\t%10s\n", "Version", "Time (ms)", "Unit test");
 
@@ -143,11 +273,39 @@ int main(int argc, char** argv) {
 		integral_image, reference_integral_image,
 		image_width, image_height, experiments_count, false);
 
+	printf("\t\tOdd sizes:   %s\n", (test_conversion_sizes_all_isas(convert_rgb_to_grayscale_optimized, select_convert_rgb_to_grayscale_isa) ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	if (integrate_image_optimized_u64 != NULL) {
+		printf("\t\t64-bit sums: %s\n", (test_integration_u64(integrate_image_optimized_u64,
+				static_cast<const uint8_t*>(reference_grayscale_image), static_cast<const uint32_t*>(reference_integral_image),
+				image_width, image_height) ?
+			CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+			CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	}
+
+	if (integrate_image_optimized_serial != NULL) {
+		uint32_t* serial_integral_image = static_cast<uint32_t*>(allocate_aligned_memory(integral_image_size, 64));
+		integrate_image_optimized_serial(static_cast<const uint8_t*>(reference_grayscale_image), serial_integral_image, image_width, image_height);
+		printf("\t\tSerial:      %s\n", (memcmp(serial_integral_image, reference_integral_image, integral_image_size) == 0 ?
+			CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+			CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+		release_aligned_memory(serial_integral_image);
+	}
+
+	if (convert_and_integrate_optimized != NULL) {
+		test_fused(convert_and_integrate_optimized,
+			rgb_image, grayscale_image, reference_grayscale_image,
+			integral_image, reference_integral_image,
+			image_width, image_height, experiments_count);
+	}
+
 	release_aligned_memory(reference_integral_image);
 	release_aligned_memory(integral_image);
 	release_aligned_memory(reference_grayscale_image);
 	release_aligned_memory(grayscale_image);
-	release_aligned_memory(rgb_image);
+	flush_bmp_images();
+	unmap_file(rgb_image_mapping);
 
 	dlclose(libsimdimage);
 }
@@ -4,12 +4,42 @@
 
 typedef void (*convert_rgb_to_grayscale_function)(const uint8_t*, uint8_t*, size_t, size_t);
 typedef void (*integrate_image_function)(const uint8_t*, uint32_t*, size_t, size_t);
+typedef void (*integrate_image_u64_function)(const uint8_t*, uint64_t*, size_t, size_t);
+typedef void (*convert_and_integrate_function)(const uint8_t*, uint8_t*, uint32_t*, size_t, size_t);
+typedef const char* (*select_isa_function)(const char*);
 
 extern "C" void convert_rgb_to_grayscale_naive(const uint8_t* rgb_image, uint8_t* grayscale_image, size_t image_width, size_t image_height);
 extern "C" void integrate_image_naive(const uint8_t* grayscale_image, uint32_t* integral_image, size_t image_width, size_t image_height);
 
 extern "C" void convert_rgb_to_grayscale_optimized(const uint8_t* rgb_image, uint8_t* grayscale_image, size_t image_width, size_t image_height);
+// Makes convert_rgb_to_grayscale_optimized use the best kernel up to max_isa
+// ("avx512vbmi", "avx512bw", "avx2", "ssse3"; NULL for any) and returns its name
+extern "C" const char* select_convert_rgb_to_grayscale_isa(const char* max_isa);
 extern "C" void integrate_image_optimized(const uint8_t* grayscale_image, uint32_t* integral_image, size_t image_width, size_t image_height);
+// 64-bit sums, for images whose total can overflow uint32_t (2^24 pixels or more)
+extern "C" void integrate_image_optimized_u64(const uint8_t* grayscale_image, uint64_t* integral_image, size_t image_width, size_t image_height);
+// One band on the calling thread, for callers that run it on a core of their own (e.g. a pipeline stage)
+extern "C" void integrate_image_optimized_serial(const uint8_t* grayscale_image, uint32_t* integral_image, size_t image_width, size_t image_height);
+// Both steps in one pass over the RGB image; grayscale_image may be NULL if the plane is not needed
+extern "C" void convert_and_integrate_optimized(const uint8_t* rgb_image, uint8_t* grayscale_image, uint32_t* integral_image, size_t image_width, size_t image_height);
 
 void read_raw_image(const char* image_file_path, void* image_buffer, size_t image_width, size_t image_height);
 void write_bmp_image(const char* image_file_path, void* image_buffer, size_t image_width, size_t image_height);
+
+// Read-only, zero-copy views of raw image files; release them with unmap_file
+struct mapped_file {
+	const uint8_t* data;
+	size_t size;
+};
+const uint8_t* map_raw_image(const char* image_file_path, mapped_file& mapping, size_t image_width, size_t image_height);
+// A pack is raw images stored back to back in one file; it holds at least image_count images
+const uint8_t* map_raw_images(const char* image_file_path, mapped_file& mapping, size_t image_width, size_t image_height, size_t image_count);
+void unmap_file(mapped_file& mapping);
+
+// BMP output with one write per file; 8-bit grayscale or 24-bit RGB
+void write_bmp_image_rgb(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height);
+// The same, encoded and written later by a background thread; the pixels are copied, so the buffer can be reused at once
+void write_bmp_image_queued(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height);
+void write_bmp_image_rgb_queued(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height);
+// Waits until every queued image is written
+void flush_bmp_images();
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <hpcdefs.hpp>
+
+#include <atomic>
+#include <sched.h>
+
+// Bounded lock-free queue for one producer thread and one consumer thread.
+// The capacity is rounded up to a power of two. The head (written by the consumer)
+// and the tail (written by the producer) sit on separate cache lines, and each side
+// caches the other's index so that it only reads the shared one when the queue
+// looks full or empty.
+template <typename T>
+class spsc_ring {
+public:
+	explicit spsc_ring(size_t min_capacity) : capacity(1), head(0), tail(0), cached_head(0), cached_tail(0) {
+		while (capacity < min_capacity)
+			capacity *= 2;
+		mask = capacity - 1;
+		slots = static_cast<T*>(allocate_aligned_memory(capacity * sizeof(T), 64));
+	}
+
+	~spsc_ring() {
+		release_aligned_memory(slots);
+	}
+
+	// Producer only. Returns false if the queue is full.
+	bool try_push(const T& item) {
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - cached_head == capacity) {
+			cached_head = head.load(std::memory_order_acquire);
+			if (t - cached_head == capacity)
+				return false;
+		}
+		slots[t & mask] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only. Returns false if the queue is empty.
+	bool try_pop(T& item) {
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == cached_tail) {
+			cached_tail = tail.load(std::memory_order_acquire);
+			if (h == cached_tail)
+				return false;
+		}
+		item = slots[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Blocking versions: spin, yielding the core so that a stage sharing it can run
+	void push(const T& item) {
+		while (!try_push(item))
+			sched_yield();
+	}
+
+	T pop() {
+		T item;
+		while (!try_pop(item))
+			sched_yield();
+		return item;
+	}
+
+private:
+	spsc_ring(const spsc_ring&);
+	spsc_ring& operator=(const spsc_ring&);
+
+	size_t capacity;
+	size_t mask;
+	T* slots;
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+	alignas(64) size_t cached_head; // Producer's copy
+	alignas(64) size_t cached_tail; // Consumer's copy
+};
@@ -0,0 +1,335 @@
+#include <hpcdefs.hpp>
+#include <blas1.hpp>
+#include <math.h>
+#include <stdlib.h>
+#if defined(_OPENMP)
+	#include <omp.h>
+#endif
+
+/* Vector primitives: AVX if the compiler targets it, SSE2 otherwise */
+#if defined(CSE6230_AVX_INTRINSICS_SUPPORTED)
+	typedef __m256d vector_t;
+	#define VECTOR_LENGTH 4
+	#define vector_load(p) _mm256_loadu_pd(p)
+	#define vector_store(p, v) _mm256_storeu_pd((p), (v))
+	#define vector_stream(p, v) _mm256_stream_pd((p), (v))
+	#define vector_set1(x) _mm256_set1_pd(x)
+	#define vector_zero() _mm256_setzero_pd()
+	#define vector_add(a, b) _mm256_add_pd((a), (b))
+	#define vector_sub(a, b) _mm256_sub_pd((a), (b))
+	#define vector_mul(a, b) _mm256_mul_pd((a), (b))
+	#define vector_max(a, b) _mm256_max_pd((a), (b))
+	#define vector_abs(a) _mm256_andnot_pd(_mm256_set1_pd(-0.0), (a))
+
+	static inline double vector_reduce_add(vector_t v) {
+		const __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+	}
+
+	static inline double vector_reduce_max(vector_t v) {
+		const __m128d max = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_max_sd(max, _mm_unpackhi_pd(max, max)));
+	}
+#else
+	typedef __m128d vector_t;
+	#define VECTOR_LENGTH 2
+	#define vector_load(p) _mm_loadu_pd(p)
+	#define vector_store(p, v) _mm_storeu_pd((p), (v))
+	#define vector_stream(p, v) _mm_stream_pd((p), (v))
+	#define vector_set1(x) _mm_set1_pd(x)
+	#define vector_zero() _mm_setzero_pd()
+	#define vector_add(a, b) _mm_add_pd((a), (b))
+	#define vector_sub(a, b) _mm_sub_pd((a), (b))
+	#define vector_mul(a, b) _mm_mul_pd((a), (b))
+	#define vector_max(a, b) _mm_max_pd((a), (b))
+	#define vector_abs(a) _mm_andnot_pd(_mm_set1_pd(-0.0), (a))
+
+	static inline double vector_reduce_add(vector_t v) {
+		return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+
+	static inline double vector_reduce_max(vector_t v) {
+		return _mm_cvtsd_f64(_mm_max_sd(v, _mm_unpackhi_pd(v, v)));
+	}
+#endif
+
+/* Thread chunks start on a cache line (of a 64-byte aligned vector) */
+#define CHUNK_ALIGNMENT 8
+
+/* Returns the [begin, end) chunk of the calling thread; the chunks of a team cover [0, length) */
+static inline void get_chunk(size_t length, size_t& begin, size_t& end) {
+#if defined(_OPENMP)
+	const size_t threads_count = omp_get_num_threads();
+	const size_t thread_number = omp_get_thread_num();
+#else
+	const size_t threads_count = 1;
+	const size_t thread_number = 0;
+#endif
+	const size_t chunk = ((length + threads_count - 1) / threads_count + CHUNK_ALIGNMENT - 1) / CHUNK_ALIGNMENT * CHUNK_ALIGNMENT;
+	begin = thread_number * chunk;
+	if (begin > length)
+		begin = length;
+	end = begin + chunk;
+	if (end > length)
+		end = length;
+}
+
+static inline bool is_streaming(size_t length) {
+	return length * sizeof(double) > BLAS1_STREAMING_BYTES;
+}
+
+/*
+ * Kernels on the range [begin, end) of the vectors.
+ * Non-temporal stores need aligned addresses, so streaming kernels first peel scalar elements.
+ */
+
+static inline size_t peel_length(const double* vector, size_t begin, size_t end, bool streaming) {
+	if (!streaming)
+		return begin;
+	size_t i = begin;
+	while ((i != end) && (reinterpret_cast<uintptr_t>(vector + i) % (VECTOR_LENGTH * sizeof(double)) != 0))
+		i++;
+	return i;
+}
+
+/* x := alpha * x on the range; returns the sum of squares of the original x, which the loads make free */
+static double scal_range(double *CSE6230_RESTRICT x, size_t begin, size_t end, double alpha, bool streaming) {
+	double sum_squares = 0.0;
+	size_t i = peel_length(x, begin, end, streaming);
+	for (size_t j = begin; j < i; j++) {
+		sum_squares += x[j] * x[j];
+		x[j] *= alpha;
+	}
+	const vector_t a = vector_set1(alpha);
+	vector_t squares0 = vector_zero(), squares1 = vector_zero();
+	for (; i + 2 * VECTOR_LENGTH <= end; i += 2 * VECTOR_LENGTH) {
+		const vector_t x0 = vector_load(x + i);
+		const vector_t x1 = vector_load(x + i + VECTOR_LENGTH);
+		squares0 = vector_add(squares0, vector_mul(x0, x0));
+		squares1 = vector_add(squares1, vector_mul(x1, x1));
+		if (streaming) {
+			vector_stream(x + i, vector_mul(x0, a));
+			vector_stream(x + i + VECTOR_LENGTH, vector_mul(x1, a));
+		} else {
+			vector_store(x + i, vector_mul(x0, a));
+			vector_store(x + i + VECTOR_LENGTH, vector_mul(x1, a));
+		}
+	}
+	sum_squares += vector_reduce_add(vector_add(squares0, squares1));
+	for (; i < end; i++) {
+		sum_squares += x[i] * x[i];
+		x[i] *= alpha;
+	}
+	return sum_squares;
+}
+
+/* y := alpha * x + y on the range; returns y . z for the updated y if z is not NULL */
+static double axpy_dot_range(double *CSE6230_RESTRICT y, const double *CSE6230_RESTRICT x, const double *CSE6230_RESTRICT z,
+	size_t begin, size_t end, double alpha, bool streaming)
+{
+	double dot = 0.0;
+	size_t i = peel_length(y, begin, end, streaming);
+	for (size_t j = begin; j < i; j++) {
+		y[j] += alpha * x[j];
+		if (z != NULL)
+			dot += y[j] * z[j];
+	}
+	const vector_t a = vector_set1(alpha);
+	vector_t dot0 = vector_zero(), dot1 = vector_zero();
+	for (; i + 2 * VECTOR_LENGTH <= end; i += 2 * VECTOR_LENGTH) {
+		const vector_t y0 = vector_add(vector_load(y + i), vector_mul(a, vector_load(x + i)));
+		const vector_t y1 = vector_add(vector_load(y + i + VECTOR_LENGTH), vector_mul(a, vector_load(x + i + VECTOR_LENGTH)));
+		if (streaming) {
+			vector_stream(y + i, y0);
+			vector_stream(y + i + VECTOR_LENGTH, y1);
+		} else {
+			vector_store(y + i, y0);
+			vector_store(y + i + VECTOR_LENGTH, y1);
+		}
+		if (z != NULL) {
+			dot0 = vector_add(dot0, vector_mul(y0, vector_load(z + i)));
+			dot1 = vector_add(dot1, vector_mul(y1, vector_load(z + i + VECTOR_LENGTH)));
+		}
+	}
+	dot += vector_reduce_add(vector_add(dot0, dot1));
+	for (; i < end; i++) {
+		y[i] += alpha * x[i];
+		if (z != NULL)
+			dot += y[i] * z[i];
+	}
+	return dot;
+}
+
+static double dot_range(const double *CSE6230_RESTRICT x, const double *CSE6230_RESTRICT y, size_t begin, size_t end) {
+	vector_t dot0 = vector_zero(), dot1 = vector_zero();
+	size_t i = begin;
+	for (; i + 2 * VECTOR_LENGTH <= end; i += 2 * VECTOR_LENGTH) {
+		dot0 = vector_add(dot0, vector_mul(vector_load(x + i), vector_load(y + i)));
+		dot1 = vector_add(dot1, vector_mul(vector_load(x + i + VECTOR_LENGTH), vector_load(y + i + VECTOR_LENGTH)));
+	}
+	double dot = vector_reduce_add(vector_add(dot0, dot1));
+	for (; i < end; i++) {
+		dot += x[i] * y[i];
+	}
+	return dot;
+}
+
+/* Sums of x[i] * x[i] and of x[i] * y[i] over the range, in one pass over x */
+static void sum_squares_dot_range(const double *CSE6230_RESTRICT x, const double *CSE6230_RESTRICT y, size_t begin, size_t end,
+	double& sum_squares, double& dot)
+{
+	vector_t squares0 = vector_zero(), squares1 = vector_zero();
+	vector_t dot0 = vector_zero(), dot1 = vector_zero();
+	size_t i = begin;
+	for (; i + 2 * VECTOR_LENGTH <= end; i += 2 * VECTOR_LENGTH) {
+		const vector_t x0 = vector_load(x + i);
+		const vector_t x1 = vector_load(x + i + VECTOR_LENGTH);
+		squares0 = vector_add(squares0, vector_mul(x0, x0));
+		squares1 = vector_add(squares1, vector_mul(x1, x1));
+		dot0 = vector_add(dot0, vector_mul(x0, vector_load(y + i)));
+		dot1 = vector_add(dot1, vector_mul(x1, vector_load(y + i + VECTOR_LENGTH)));
+	}
+	sum_squares = vector_reduce_add(vector_add(squares0, squares1));
+	dot = vector_reduce_add(vector_add(dot0, dot1));
+	for (; i < end; i++) {
+		sum_squares += x[i] * x[i];
+		dot += x[i] * y[i];
+	}
+}
+
+static double amax_diff_range(const double *CSE6230_RESTRICT x, const double *CSE6230_RESTRICT y, size_t begin, size_t end) {
+	vector_t max0 = vector_zero(), max1 = vector_zero();
+	size_t i = begin;
+	for (; i + 2 * VECTOR_LENGTH <= end; i += 2 * VECTOR_LENGTH) {
+		max0 = vector_max(max0, vector_abs(vector_sub(vector_load(x + i), vector_load(y + i))));
+		max1 = vector_max(max1, vector_abs(vector_sub(vector_load(x + i + VECTOR_LENGTH), vector_load(y + i + VECTOR_LENGTH))));
+	}
+	double max = vector_reduce_max(vector_max(max0, max1));
+	for (; i < end; i++) {
+		max = fmax(max, fabs(x[i] - y[i]));
+	}
+	return max;
+}
+
+/* Non-temporal stores are weakly ordered; make them visible before the kernel returns */
+static inline void finish_streaming(bool streaming) {
+	if (streaming)
+		_mm_sfence();
+}
+
+void blas1_scal(double *CSE6230_RESTRICT vector_x, size_t length, double alpha) {
+	const bool streaming = is_streaming(length);
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+		scal_range(vector_x, begin, end, alpha, streaming);
+		finish_streaming(streaming);
+	}
+}
+
+void blas1_axpy(double *CSE6230_RESTRICT vector_y, const double *CSE6230_RESTRICT vector_x, size_t length, double alpha) {
+	const bool streaming = is_streaming(length);
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+		axpy_dot_range(vector_y, vector_x, NULL, begin, end, alpha, streaming);
+		finish_streaming(streaming);
+	}
+}
+
+double blas1_dot(const double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_y, size_t length) {
+	double dot = 0.0;
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN) reduction(+:dot)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+		dot += dot_range(vector_x, vector_y, begin, end);
+	}
+	return dot;
+}
+
+double blas1_nrm2(const double *CSE6230_RESTRICT vector_x, size_t length) {
+	return sqrt(blas1_dot(vector_x, vector_x, length));
+}
+
+double blas1_amax_diff(const double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_y, size_t length) {
+	double max_abs_diff = 0.0;
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN) reduction(max:max_abs_diff)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+		max_abs_diff = fmax(max_abs_diff, amax_diff_range(vector_x, vector_y, begin, end));
+	}
+	return max_abs_diff;
+}
+
+double blas1_axpy_dot(double *CSE6230_RESTRICT vector_y, const double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_z, size_t length, double alpha) {
+	const bool streaming = is_streaming(length);
+	double dot = 0.0;
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN) reduction(+:dot)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+		dot += axpy_dot_range(vector_y, vector_x, vector_z, begin, end, alpha, streaming);
+		finish_streaming(streaming);
+	}
+	return dot;
+}
+
+double blas1_scal_nrm2(double *CSE6230_RESTRICT vector_x, size_t length, double alpha) {
+	/* ||alpha * x|| = |alpha| * ||x||, so the norm comes from the same pass as the scaling */
+	double sum_squares = 0.0;
+	const bool streaming = is_streaming(length);
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN) reduction(+:sum_squares)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+		sum_squares += scal_range(vector_x, begin, end, alpha, streaming);
+		finish_streaming(streaming);
+	}
+	return fabs(alpha) * sqrt(sum_squares);
+}
+
+double blas1_normalize_dot(double *CSE6230_RESTRICT vector_x, const double *CSE6230_RESTRICT vector_y, size_t length) {
+	double sum_squares = 0.0, dot = 0.0;
+	const bool streaming = is_streaming(length);
+	double* partials = NULL;
+	/* Each thread scales the chunk it has just read, while the chunk is still in its cache */
+	#pragma omp parallel if (length >= BLAS1_PARALLEL_MIN)
+	{
+		size_t begin, end;
+		get_chunk(length, begin, end);
+#if defined(_OPENMP)
+		const size_t threads_count = omp_get_num_threads();
+		const size_t thread_number = omp_get_thread_num();
+#else
+		const size_t threads_count = 1;
+		const size_t thread_number = 0;
+#endif
+		#pragma omp single
+		partials = static_cast<double*>(malloc(2 * threads_count * sizeof(double)));
+		sum_squares_dot_range(vector_x, (vector_y != NULL) ? vector_y : vector_x, begin, end,
+			partials[2 * thread_number], partials[2 * thread_number + 1]);
+		#pragma omp barrier
+		/* Every thread adds the partials in thread order, so the norm does not depend on timing */
+		double total_sum_squares = 0.0, total_dot = 0.0;
+		for (size_t thread = 0; thread < threads_count; thread++) {
+			total_sum_squares += partials[2 * thread];
+			total_dot += partials[2 * thread + 1];
+		}
+		scal_range(vector_x, begin, end, 1.0 / sqrt(total_sum_squares), streaming);
+		finish_streaming(streaming);
+		if (thread_number == 0) {
+			sum_squares = total_sum_squares;
+			dot = total_dot;
+		}
+	}
+	free(partials);
+	return (vector_y != NULL) ? dot / sqrt(sum_squares) : sqrt(sum_squares);
+}
+
+double blas1_normalize(double *CSE6230_RESTRICT vector_x, size_t length) {
+	return blas1_normalize_dot(vector_x, NULL, length);
+}
@@ -0,0 +1,318 @@
+#include <hpcdefs.hpp>
+#include <eigen.hpp>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#if defined(_OPENMP)
+	#include <omp.h>
+#endif
+
+#define JACOBI_MAX_SWEEPS 64
+/* Vectors of the block that are multiplied by the matrix together, i.e. per row of the matrix read from cache */
+#define BLOCK_TILE 4
+
+/* The vectors here are short and already in cache, so these are plain loops rather than the multithreaded BLAS-1 kernels */
+static inline double dot(const double *CSE6230_RESTRICT x, const double *CSE6230_RESTRICT y, size_t length) {
+	/* Four partial sums, which the compiler keeps in two SSE registers */
+	double sum_0 = 0.0, sum_1 = 0.0, sum_2 = 0.0, sum_3 = 0.0;
+	size_t k = 0;
+	for (; k + 4 <= length; k += 4) {
+		sum_0 += x[k] * y[k];
+		sum_1 += x[k + 1] * y[k + 1];
+		sum_2 += x[k + 2] * y[k + 2];
+		sum_3 += x[k + 3] * y[k + 3];
+	}
+	for (; k < length; k++)
+		sum_0 += x[k] * y[k];
+	return (sum_0 + sum_1) + (sum_2 + sum_3);
+}
+
+static inline void scale(double* x, size_t length, double alpha) {
+	for (size_t k = 0; k < length; k++)
+		x[k] *= alpha;
+}
+
+/*
+ * Cyclic Jacobi: rotates away every off-diagonal element in turn until they are negligible next to the diagonal.
+ * On return matrix is diagonal (the eigenvalues), and row i of vectors is the eigenvector of matrix[i][i].
+ */
+static void jacobi(double *CSE6230_RESTRICT matrix, double *CSE6230_RESTRICT vectors, size_t length) {
+	for (size_t i = 0; i < length; i++)
+		for (size_t j = 0; j < length; j++)
+			vectors[i * length + j] = (i == j) ? 1.0 : 0.0;
+
+	for (size_t sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++) {
+		double diagonal_squares = 0.0, off_diagonal_squares = 0.0;
+		for (size_t p = 0; p < length; p++) {
+			diagonal_squares += matrix[p * length + p] * matrix[p * length + p];
+			for (size_t q = p + 1; q < length; q++)
+				off_diagonal_squares += matrix[p * length + q] * matrix[p * length + q];
+		}
+		if (off_diagonal_squares <= DBL_EPSILON * DBL_EPSILON * diagonal_squares)
+			break;
+		/* Elements below this threshold could all be dropped without failing the test above, so they are not rotated away */
+		const double threshold = DBL_EPSILON * sqrt(diagonal_squares / double(length * (length - 1) / 2));
+
+		for (size_t p = 0; p < length; p++) {
+			for (size_t q = p + 1; q < length; q++) {
+				const double apq = matrix[p * length + q];
+				if (fabs(apq) <= threshold)
+					continue;
+				/* The smaller root t = tan(phi) of t^2 + 2 theta t - 1 = 0 zeroes matrix[p][q] */
+				const double theta = (matrix[q * length + q] - matrix[p * length + p]) / (2.0 * apq);
+				double t = 1.0 / (fabs(theta) + sqrt(theta * theta + 1.0));
+				if (theta < 0.0)
+					t = -t;
+				const double c = 1.0 / sqrt(t * t + 1.0);
+				const double s = t * c;
+				for (size_t k = 0; k < length; k++) {
+					const double akp = matrix[k * length + p], akq = matrix[k * length + q];
+					matrix[k * length + p] = c * akp - s * akq;
+					matrix[k * length + q] = s * akp + c * akq;
+				}
+				for (size_t k = 0; k < length; k++) {
+					const double apk = matrix[p * length + k], aqk = matrix[q * length + k];
+					matrix[p * length + k] = c * apk - s * aqk;
+					matrix[q * length + k] = s * apk + c * aqk;
+				}
+				matrix[p * length + q] = matrix[q * length + p] = 0.0;
+				for (size_t k = 0; k < length; k++) {
+					const double vpk = vectors[p * length + k], vqk = vectors[q * length + k];
+					vectors[p * length + k] = c * vpk - s * vqk;
+					vectors[q * length + k] = s * vpk + c * vqk;
+				}
+			}
+		}
+	}
+}
+
+/* Sorts eigenvalues in descending order, along with the rows of eigenvectors */
+static void sort_eigenpairs(double *CSE6230_RESTRICT eigenvalues, double *CSE6230_RESTRICT eigenvectors, size_t count, size_t length) {
+	for (size_t i = 0; i < count; i++) {
+		size_t largest = i;
+		for (size_t j = i + 1; j < count; j++)
+			if (eigenvalues[j] > eigenvalues[largest])
+				largest = j;
+		if (largest != i) {
+			const double eigenvalue = eigenvalues[i];
+			eigenvalues[i] = eigenvalues[largest];
+			eigenvalues[largest] = eigenvalue;
+			for (size_t k = 0; k < length; k++) {
+				const double element = eigenvectors[i * length + k];
+				eigenvectors[i * length + k] = eigenvectors[largest * length + k];
+				eigenvectors[largest * length + k] = element;
+			}
+		}
+	}
+}
+
+static void orient_eigenvectors(double* eigenvectors, size_t count, size_t length) {
+	for (size_t i = 0; i < count; i++) {
+		double sum = 0.0;
+		for (size_t k = 0; k < length; k++)
+			sum += eigenvectors[i * length + k];
+		if (sum < 0.0)
+			scale(&eigenvectors[i * length], length, -1.0);
+	}
+}
+
+void symmetric_eigen(double *CSE6230_RESTRICT eigenvectors, double *CSE6230_RESTRICT eigenvalues, const double *CSE6230_RESTRICT matrix, size_t length) {
+	double* diagonalized = static_cast<double*>(allocate_aligned_memory(length * length * sizeof(double), 64));
+	memcpy(diagonalized, matrix, length * length * sizeof(double));
+	jacobi(diagonalized, eigenvectors, length);
+	for (size_t i = 0; i < length; i++)
+		eigenvalues[i] = diagonalized[i * length + i];
+	sort_eigenpairs(eigenvalues, eigenvectors, length, length);
+	orient_eigenvectors(eigenvectors, length, length);
+	release_aligned_memory(diagonalized);
+}
+
+/* Uniform in [-1, 1), from a 64-bit linear congruential generator */
+static double random_element(uint64_t& state) {
+	state = state * 6364136223846793005ull + 1442695040888963407ull;
+	return double(int64_t(state) >> 11) / double(int64_t(1) << 52);
+}
+
+/*
+ * Modified Gram-Schmidt, twice, which keeps the vectors orthogonal to working precision. A vector that is
+ * (numerically) in the span of the previous ones, e.g. because the matrix is singular, is replaced with a random one.
+ */
+static void orthonormalize(double* vectors, size_t count, size_t length, uint64_t& random_state) {
+	for (size_t i = 0; i < count; i++) {
+		double* vector = &vectors[i * length];
+		for (;;) {
+			const double original_norm = sqrt(dot(vector, vector, length));
+			for (size_t pass = 0; pass < 2; pass++) {
+				for (size_t j = 0; j < i; j++) {
+					const double* previous = &vectors[j * length];
+					const double projection = dot(previous, vector, length);
+					for (size_t k = 0; k < length; k++)
+						vector[k] -= projection * previous[k];
+				}
+			}
+			const double norm = sqrt(dot(vector, vector, length));
+			if (norm > sqrt(DBL_EPSILON) * original_norm && norm != 0.0) {
+				scale(vector, length, 1.0 / norm);
+				break;
+			}
+			for (size_t k = 0; k < length; k++)
+				vector[k] = random_element(random_state);
+		}
+	}
+}
+
+/* output_i += coefficient_i * row, 4 elements per FMA with the coefficients broadcast once */
+__attribute__((target("avx2,fma")))
+static void accumulate_tile_avx2(double *CSE6230_RESTRICT output_0, double *CSE6230_RESTRICT output_1,
+	double *CSE6230_RESTRICT output_2, double *CSE6230_RESTRICT output_3, const double *CSE6230_RESTRICT row,
+	double coefficient_0, double coefficient_1, double coefficient_2, double coefficient_3, size_t length)
+{
+	const __m256d c0 = _mm256_set1_pd(coefficient_0);
+	const __m256d c1 = _mm256_set1_pd(coefficient_1);
+	const __m256d c2 = _mm256_set1_pd(coefficient_2);
+	const __m256d c3 = _mm256_set1_pd(coefficient_3);
+	size_t k = 0;
+	for (; k + 4 <= length; k += 4) {
+		const __m256d element = _mm256_loadu_pd(row + k);
+		_mm256_storeu_pd(output_0 + k, _mm256_fmadd_pd(c0, element, _mm256_loadu_pd(output_0 + k)));
+		_mm256_storeu_pd(output_1 + k, _mm256_fmadd_pd(c1, element, _mm256_loadu_pd(output_1 + k)));
+		_mm256_storeu_pd(output_2 + k, _mm256_fmadd_pd(c2, element, _mm256_loadu_pd(output_2 + k)));
+		_mm256_storeu_pd(output_3 + k, _mm256_fmadd_pd(c3, element, _mm256_loadu_pd(output_3 + k)));
+	}
+	for (; k < length; k++) {
+		const double element = row[k];
+		output_0[k] = fma(coefficient_0, element, output_0[k]);
+		output_1[k] = fma(coefficient_1, element, output_1[k]);
+		output_2[k] = fma(coefficient_2, element, output_2[k]);
+		output_3[k] = fma(coefficient_3, element, output_3[k]);
+	}
+}
+
+/* The same with whatever the build targets (SSE4.2 for -march=corei7): separate multiplies and adds */
+static void accumulate_tile_portable(double *CSE6230_RESTRICT output_0, double *CSE6230_RESTRICT output_1,
+	double *CSE6230_RESTRICT output_2, double *CSE6230_RESTRICT output_3, const double *CSE6230_RESTRICT row,
+	double coefficient_0, double coefficient_1, double coefficient_2, double coefficient_3, size_t length)
+{
+	for (size_t k = 0; k < length; k++) {
+		const double element = row[k];
+		output_0[k] += coefficient_0 * element;
+		output_1[k] += coefficient_1 * element;
+		output_2[k] += coefficient_2 * element;
+		output_3[k] += coefficient_3 * element;
+	}
+}
+
+/*
+ * output[i] := sum over j < rows_count of coefficients[i * coefficients_stride + j] * rows[j], for i < output_count.
+ * The outputs are computed in parallel, BLOCK_TILE at a time, so every row is loaded once per tile.
+ */
+static void combine_rows(double *CSE6230_RESTRICT output, const double *CSE6230_RESTRICT coefficients, size_t coefficients_stride,
+	const double *CSE6230_RESTRICT rows, size_t output_count, size_t rows_count, size_t length)
+{
+	__builtin_cpu_init();
+	const bool use_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	#pragma omp parallel for schedule(dynamic, 1)
+	for (size_t first = 0; first < output_count; first += BLOCK_TILE) {
+		const size_t tile = (output_count - first < BLOCK_TILE) ? output_count - first : BLOCK_TILE;
+		double* tile_output = &output[first * length];
+		const double* tile_coefficients = &coefficients[first * coefficients_stride];
+		memset(tile_output, 0, tile * length * sizeof(double));
+		for (size_t j = 0; j < rows_count; j++) {
+			const double* row = &rows[j * length];
+			if (tile == BLOCK_TILE) {
+				(use_avx2 ? accumulate_tile_avx2 : accumulate_tile_portable)(
+					tile_output, tile_output + length, tile_output + 2 * length, tile_output + 3 * length, row,
+					tile_coefficients[j], tile_coefficients[coefficients_stride + j],
+					tile_coefficients[2 * coefficients_stride + j], tile_coefficients[3 * coefficients_stride + j], length);
+			} else {
+				for (size_t i = 0; i < tile; i++) {
+					const double coefficient = tile_coefficients[i * coefficients_stride + j];
+					for (size_t k = 0; k < length; k++)
+						tile_output[i * length + k] += coefficient * row[k];
+				}
+			}
+		}
+	}
+}
+
+bool subspace_iteration(double *CSE6230_RESTRICT eigenvectors, double *CSE6230_RESTRICT eigenvalues, const double *CSE6230_RESTRICT matrix,
+	size_t length, size_t count, size_t max_iterations, size_t& iterations)
+{
+	const size_t block = (count + SUBSPACE_GUARD_VECTORS < length) ? count + SUBSPACE_GUARD_VECTORS : length;
+	const double tolerance = sqrt(DBL_EPSILON);
+	/* The last iteration always ends with a Rayleigh-Ritz step, which produces the output */
+	if (max_iterations == 0)
+		max_iterations = 1;
+	double* basis = static_cast<double*>(allocate_aligned_memory(block * length * sizeof(double), 64));
+	double* products = static_cast<double*>(allocate_aligned_memory(block * length * sizeof(double), 64));
+	double* ritz_vectors = static_cast<double*>(allocate_aligned_memory(block * length * sizeof(double), 64));
+	double* ritz_products = static_cast<double*>(allocate_aligned_memory(block * length * sizeof(double), 64));
+	double* projection = static_cast<double*>(allocate_aligned_memory(block * block * sizeof(double), 64));
+	double* rotation = static_cast<double*>(allocate_aligned_memory(block * block * sizeof(double), 64));
+	double* ritz_values = static_cast<double*>(allocate_aligned_memory(block * sizeof(double), 64));
+
+	uint64_t random_state = 1;
+	for (size_t k = 0; k < block * length; k++)
+		basis[k] = random_element(random_state);
+	orthonormalize(basis, block, length, random_state);
+
+	bool converged = false;
+	for (iterations = 1; iterations <= max_iterations; iterations++) {
+		/* The matrix is symmetric, so matrix * basis[i] is the sum of its rows scaled by the elements of basis[i] */
+		combine_rows(products, basis, length, matrix, block, length, length);
+		if (iterations % SUBSPACE_RAYLEIGH_RITZ_INTERVAL != 0 && iterations != max_iterations) {
+			double* next_basis = products;
+			products = basis;
+			basis = next_basis;
+			orthonormalize(basis, block, length, random_state);
+			continue;
+		}
+
+		/* Rayleigh-Ritz: the eigenpairs of basis^T * matrix * basis give the best approximations from the block */
+		#pragma omp parallel for schedule(dynamic, 1)
+		for (size_t i = 0; i < block; i++)
+			for (size_t j = i; j < block; j++)
+				projection[i * block + j] = projection[j * block + i] = dot(&basis[i * length], &products[j * length], length);
+		jacobi(projection, rotation, block);
+		for (size_t i = 0; i < block; i++)
+			ritz_values[i] = projection[i * block + i];
+		sort_eigenpairs(ritz_values, rotation, block, block);
+		combine_rows(ritz_vectors, rotation, block, basis, block, block, length);
+		combine_rows(ritz_products, rotation, block, products, block, block, length);
+
+		double max_residual = 0.0;
+		for (size_t i = 0; i < count; i++) {
+			double residual_squares = 0.0;
+			for (size_t k = 0; k < length; k++) {
+				const double residual = ritz_products[i * length + k] - ritz_values[i] * ritz_vectors[i * length + k];
+				residual_squares += residual * residual;
+			}
+			max_residual = fmax(max_residual, sqrt(residual_squares));
+		}
+		if (max_residual <= tolerance * fabs(ritz_values[0])) {
+			converged = true;
+			break;
+		}
+
+		/* The next block spans matrix * basis */
+		double* next_basis = ritz_products;
+		ritz_products = basis;
+		basis = next_basis;
+		orthonormalize(basis, block, length, random_state);
+	}
+	if (iterations > max_iterations)
+		iterations = max_iterations;
+
+	memcpy(eigenvectors, ritz_vectors, count * length * sizeof(double));
+	memcpy(eigenvalues, ritz_values, count * sizeof(double));
+	orient_eigenvectors(eigenvectors, count, length);
+
+	release_aligned_memory(basis);
+	release_aligned_memory(products);
+	release_aligned_memory(ritz_vectors);
+	release_aligned_memory(ritz_products);
+	release_aligned_memory(projection);
+	release_aligned_memory(rotation);
+	release_aligned_memory(ritz_values);
+	return converged;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <hpcdefs.hpp>
+
+/*
+ * Eigenpairs of a symmetric matrix (e.g. the Gram matrix of the image stack): all of them by the
+ * Jacobi method, or the largest few by block subspace iteration.
+ *
+ * Subspace iteration multiplies a block of SUBSPACE_GUARD_VECTORS more vectors than requested by the
+ * matrix at once, so the matrix is read once per iteration for the whole block, and orthonormalizes the
+ * products. Every SUBSPACE_RAYLEIGH_RITZ_INTERVAL iterations a Rayleigh-Ritz step projects the matrix
+ * onto the block, solves the small eigenproblem with the Jacobi method, rotates the block onto the
+ * Ritz vectors and checks their residuals. The block products and rotations run in parallel (OpenMP).
+ *
+ * Matrices are row-major; sets of vectors are stored one vector per row. Eigenvalues come out in
+ * descending order, and each eigenvector's sign is chosen so that its elements have a nonnegative sum.
+ */
+
+/* Extra vectors in the block: the requested eigenvectors converge like (lambda[count + guard] / lambda[i])^iterations */
+#define SUBSPACE_GUARD_VECTORS 16
+/* Rotating onto the Ritz vectors does not change the span of the block, so it is only needed to check for convergence */
+#define SUBSPACE_RAYLEIGH_RITZ_INTERVAL 4
+
+/* All length eigenpairs; matrix is length x length, eigenvectors is length x length */
+void symmetric_eigen(double *CSE6230_RESTRICT eigenvectors, double *CSE6230_RESTRICT eigenvalues, const double *CSE6230_RESTRICT matrix, size_t length);
+
+/*
+ * The count <= length eigenpairs of largest eigenvalue; eigenvectors is count x length. Iterates until every residual
+ * ||M v - lambda v|| is at most sqrt(epsilon) * lambda[0], and returns false if that takes more than max_iterations.
+ */
+bool subspace_iteration(double *CSE6230_RESTRICT eigenvectors, double *CSE6230_RESTRICT eigenvalues, const double *CSE6230_RESTRICT matrix,
+	size_t length, size_t count, size_t max_iterations, size_t& iterations);
@@ -5,6 +5,8 @@
 #include <fenv.h>
 #include <float.h>
 
+#include <limits>
+
 void convert_to_floating_point_naive(const uint8_t *CSE6230_RESTRICT fixed_point_images, double *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
 	for (size_t image_number = 0; image_number < image_count; image_number++) {
 		for (size_t image_row = 0; image_row < image_height; image_row++) {
@@ -82,35 +84,116 @@ bool check_images(const double *CSE6230_RESTRICT images, const double *CSE6230_R
 	return true;
 }
 
-void square_matrix(double *CSE6230_RESTRICT output_matrix, const double *CSE6230_RESTRICT input_matrix, size_t matrix_width, size_t matrix_height) {
+template <typename pixel_t>
+static inline pixel_t pixel_from_uint8(uint8_t pixel) {
+	return pixel_t(pixel) / pixel_t(255);
+}
+
+template <>
+inline int16_t pixel_from_uint8<int16_t>(uint8_t pixel) {
+	return int16_t(pixel << PIXEL_FIXED_POINT_SHIFT);
+}
+
+template <typename pixel_t>
+void convert_to_pixels(const uint8_t *CSE6230_RESTRICT fixed_point_images, pixel_t *CSE6230_RESTRICT pixel_images, size_t image_width, size_t image_height, size_t image_count) {
+	for (size_t i = 0; i < image_width * image_height * image_count; i++) {
+		pixel_images[i] = pixel_from_uint8<pixel_t>(fixed_point_images[i]);
+	}
+}
+
+template <typename pixel_t>
+void square_matrix(typename pixel_traits<pixel_t>::real_t *CSE6230_RESTRICT output_matrix, const pixel_t *CSE6230_RESTRICT input_matrix, size_t matrix_width, size_t matrix_height) {
+	typedef typename pixel_traits<pixel_t>::real_t real_t;
+	typedef typename pixel_traits<pixel_t>::product_t product_t;
+	const real_t product_unit = real_t(pixel_traits<pixel_t>::unit() * pixel_traits<pixel_t>::unit());
 	for (size_t i = 0; i < matrix_height; i++) {
 		for (size_t j = 0; j < matrix_height; j++) {
-			double accumulated_sum = 0.0;
+			product_t accumulated_sum = 0;
 			for (size_t k = 0; k < matrix_width; k++) {
-				accumulated_sum += input_matrix[i * matrix_width + k] * input_matrix[j * matrix_width + k];
+				accumulated_sum += product_t(input_matrix[i * matrix_width + k]) * product_t(input_matrix[j * matrix_width + k]);
 			}
-			output_matrix[i * matrix_height + j] = accumulated_sum;
+			output_matrix[i * matrix_height + j] = real_t(accumulated_sum) * product_unit;
 		}
 	}
 }
 
-void demean_images(double *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+/* The mean of each pixel, rounded to nearest in fixed point (the sums are never negative) */
+template <typename pixel_t>
+static inline pixel_t pixel_mean(typename pixel_traits<pixel_t>::sum_t pixel_sum, size_t image_count) {
+	return pixel_sum / typename pixel_traits<pixel_t>::sum_t(image_count);
+}
+
+template <>
+inline int16_t pixel_mean<int16_t>(int32_t pixel_sum, size_t image_count) {
+	return int16_t((pixel_sum + int32_t(image_count / 2)) / int32_t(image_count));
+}
+
+template <typename pixel_t>
+void demean_images(pixel_t *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+	typedef typename pixel_traits<pixel_t>::sum_t sum_t;
 	for (size_t image_row = 0; image_row < image_height; image_row++) {
 		for (size_t image_column = 0; image_column < image_width; image_column++) {
 			/* Sum pixel (image_row, image_column) of all images */
-			double pixel_sum = 0.0;
+			sum_t pixel_sum = 0;
 			for (size_t image_number = 0; image_number < image_count; image_number++) {
 				pixel_sum += floating_point_images[(image_number * image_height + image_row) * image_width + image_column];
 			}
-			const double pixel_mean = pixel_sum / double(image_count);
+			const pixel_t pixel_mean_value = pixel_mean<pixel_t>(pixel_sum, image_count);
 			/* Subtract the mean for pixel (image_row, image_column) on all images */
 			for (size_t image_number = 0; image_number < image_count; image_number++) {
-				floating_point_images[(image_number * image_height + image_row) * image_width + image_column] -= pixel_mean;
+				floating_point_images[(image_number * image_height + image_row) * image_width + image_column] -= pixel_mean_value;
+			}
+		}
+	}
+}
+
+/* Starts from the normalized all-ones vector and stops when successive iterates differ by at most sqrt(epsilon) */
+template <typename real_t>
+double power_iteration(real_t *CSE6230_RESTRICT eigenvector, real_t *CSE6230_RESTRICT workspace, const real_t *CSE6230_RESTRICT matrix, size_t length, size_t max_iterations, size_t& iterations) {
+	const real_t tolerance = sqrt(std::numeric_limits<real_t>::epsilon());
+	for (size_t i = 0; i < length; i++) {
+		eigenvector[i] = real_t(1.0 / sqrt(double(length)));
+	}
+	double eigenvalue = 0.0;
+	for (iterations = 1; iterations <= max_iterations; iterations++) {
+		real_t sum_squares = 0;
+		for (size_t i = 0; i < length; i++) {
+			real_t accumulated_sum = 0;
+			for (size_t j = 0; j < length; j++) {
+				accumulated_sum += matrix[i * length + j] * eigenvector[j];
 			}
+			workspace[i] = accumulated_sum;
+			sum_squares += accumulated_sum * accumulated_sum;
+		}
+		/* ||M v|| for a unit vector v, which converges to the eigenvalue */
+		eigenvalue = sqrt(double(sum_squares));
+		const real_t scale_factor = real_t(1.0 / eigenvalue);
+		real_t difference_squares = 0;
+		for (size_t i = 0; i < length; i++) {
+			const real_t element = workspace[i] * scale_factor;
+			difference_squares += (element - eigenvector[i]) * (element - eigenvector[i]);
+			eigenvector[i] = element;
 		}
+		if (sqrt(difference_squares) <= tolerance)
+			break;
 	}
+	if (iterations > max_iterations)
+		iterations = max_iterations;
+	return eigenvalue;
 }
 
+template void convert_to_pixels<double>(const uint8_t*, double*, size_t, size_t, size_t);
+template void convert_to_pixels<float>(const uint8_t*, float*, size_t, size_t, size_t);
+template void convert_to_pixels<int16_t>(const uint8_t*, int16_t*, size_t, size_t, size_t);
+template void square_matrix<double>(double*, const double*, size_t, size_t);
+template void square_matrix<float>(float*, const float*, size_t, size_t);
+template void square_matrix<int16_t>(float*, const int16_t*, size_t, size_t);
+template void demean_images<double>(double*, size_t, size_t, size_t);
+template void demean_images<float>(float*, size_t, size_t, size_t);
+template void demean_images<int16_t>(int16_t*, size_t, size_t, size_t);
+template double power_iteration<double>(double*, double*, const double*, size_t, size_t, size_t&);
+template double power_iteration<float>(float*, float*, const float*, size_t, size_t, size_t&);
+
 void vector_matrix_multiplication(double *CSE6230_RESTRICT output_vector, const double *CSE6230_RESTRICT input_vector, const double *CSE6230_RESTRICT matrix, size_t matrix_width, size_t matrix_height) {
 	for (size_t j = 0; j < matrix_width; j++) {
 		double accumulated_sum = 0.0;
@@ -147,6 +230,14 @@ void convert_to_fixed_point(const double *CSE6230_RESTRICT input_image, uint8_t
 	}
 }
 
+void pack_upper_triangle(double *CSE6230_RESTRICT packed_matrix, const double *CSE6230_RESTRICT matrix, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		for (size_t j = i; j < length; j++) {
+			*packed_matrix++ = matrix[i * length + j];
+		}
+	}
+}
+
 void vector_set(double *CSE6230_RESTRICT vector, size_t length, double constant) {
 	for (size_t i = 0; i < length; i++) {
 		vector[i] = constant;
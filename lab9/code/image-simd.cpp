@@ -1,60 +1,493 @@
 #include <hpcdefs.hpp>
 #include <image.hpp>
+#include <string.h>
+
+#if defined(_OPENMP)
+	#include <omp.h>
+#endif
+
+/*
+ * uint8 -> floating point: zero-extend bytes to 32-bit integers (pmovzxbd),
+ * convert them (cvtdq2pd / cvtdq2ps) and multiply by a constant scale.
+ * For scale = 1/255 the product lies between x/255 rounded down and rounded
+ * up for every byte x, which is what check_images accepts. The int16 (Q7
+ * fixed point) outputs zero-extend to 16 bits (pmovzxbw) and multiply by 2^7.
+ *
+ * Kernels: SSE4.1 (the baseline of -march=corei7), AVX2 and AVX-512
+ * (F, BW, VL), for double, float and int16 outputs. The SSE4.1 and AVX2 kernels
+ * finish with scalar code; the AVX-512 kernels use a masked load and
+ * masked stores. None of them reads or writes past the end of the arrays.
+ *
+ * Stacks of at least CONVERT_PARALLEL_MIN pixels are split between OpenMP
+ * threads in chunks of whole cache lines of output. Outputs larger than
+ * CONVERT_STREAMING_BYTES do not fit in the last-level cache and are written
+ * with non-temporal stores, which skip reading the lines before writing them
+ * (about twice as fast for the 199 120x120 images in double precision).
+ */
+
+#define CONVERT_PARALLEL_MIN (size_t(1) << 16)
+#define CONVERT_STREAMING_BYTES (size_t(8) << 20)
+#define CONVERT_CHUNK_ALIGNMENT 64
+
+template <typename real_t>
+static inline void convert_tail(const uint8_t *CSE6230_RESTRICT input, real_t *CSE6230_RESTRICT output, size_t length, real_t scale) {
+	for (size_t i = 0; i < length; i++)
+		output[i] = real_t(input[i]) * scale;
+}
+
+/* Non-temporal stores need an aligned address: the callers start streaming kernels on a cache line */
+static inline void store(double* output, __m128d v, bool streaming) {
+	if (streaming)
+		_mm_stream_pd(output, v);
+	else
+		_mm_storeu_pd(output, v);
+}
+
+static inline void store(float* output, __m128 v, bool streaming) {
+	if (streaming)
+		_mm_stream_ps(output, v);
+	else
+		_mm_storeu_ps(output, v);
+}
+
+__attribute__((target("avx2")))
+static inline void store(double* output, __m256d v, bool streaming) {
+	if (streaming)
+		_mm256_stream_pd(output, v);
+	else
+		_mm256_storeu_pd(output, v);
+}
+
+__attribute__((target("avx2")))
+static inline void store(float* output, __m256 v, bool streaming) {
+	if (streaming)
+		_mm256_stream_ps(output, v);
+	else
+		_mm256_storeu_ps(output, v);
+}
+
+__attribute__((target("avx512f")))
+static inline void store(double* output, __m512d v, bool streaming) {
+	if (streaming)
+		_mm512_stream_pd(output, v);
+	else
+		_mm512_storeu_pd(output, v);
+}
+
+__attribute__((target("avx512f")))
+static inline void store(float* output, __m512 v, bool streaming) {
+	if (streaming)
+		_mm512_stream_ps(output, v);
+	else
+		_mm512_storeu_ps(output, v);
+}
+
+static inline void store(int16_t* output, __m128i v, bool streaming) {
+	if (streaming)
+		_mm_stream_si128(reinterpret_cast<__m128i*>(output), v);
+	else
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(output), v);
+}
+
+__attribute__((target("avx2")))
+static inline void store(int16_t* output, __m256i v, bool streaming) {
+	if (streaming)
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(output), v);
+	else
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(output), v);
+}
+
+/* SSE4.1: 16 pixels per step */
+static void convert_sse41(const uint8_t *CSE6230_RESTRICT input, double *CSE6230_RESTRICT output, size_t length, double scale, bool streaming) {
+	const __m128d factor = _mm_set1_pd(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		const __m128i words[4] = {
+			_mm_cvtepu8_epi32(bytes),
+			_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4)),
+			_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8)),
+			_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12))
+		};
+		for (size_t k = 0; k < 4; k++) {
+			store(output + i + 4 * k, _mm_mul_pd(_mm_cvtepi32_pd(words[k]), factor), streaming);
+			store(output + i + 4 * k + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(words[k], words[k])), factor), streaming);
+		}
+	}
+	convert_tail(input + i, output + i, length - i, scale);
+}
+
+static void convert_sse41(const uint8_t *CSE6230_RESTRICT input, float *CSE6230_RESTRICT output, size_t length, float scale, bool streaming) {
+	const __m128 factor = _mm_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		store(output + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes)), factor), streaming);
+		store(output + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4))), factor), streaming);
+		store(output + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 8))), factor), streaming);
+		store(output + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 12))), factor), streaming);
+	}
+	convert_tail(input + i, output + i, length - i, scale);
+}
+
+static void convert_sse41(const uint8_t *CSE6230_RESTRICT input, int16_t *CSE6230_RESTRICT output, size_t length, int16_t scale, bool streaming) {
+	const __m128i factor = _mm_set1_epi16(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		store(output + i, _mm_mullo_epi16(_mm_cvtepu8_epi16(bytes), factor), streaming);
+		store(output + i + 8, _mm_mullo_epi16(_mm_cvtepu8_epi16(_mm_unpackhi_epi64(bytes, bytes)), factor), streaming);
+	}
+	convert_tail(input + i, output + i, length - i, scale);
+}
+
+/* AVX2: 16 pixels per step */
+__attribute__((target("avx2")))
+static void convert_avx2(const uint8_t *CSE6230_RESTRICT input, double *CSE6230_RESTRICT output, size_t length, double scale, bool streaming) {
+	const __m256d factor = _mm256_set1_pd(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		const __m256i low = _mm256_cvtepu8_epi32(bytes);
+		const __m256i high = _mm256_cvtepu8_epi32(_mm_unpackhi_epi64(bytes, bytes));
+		store(output + i, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(low)), factor), streaming);
+		store(output + i + 4, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(low, 1)), factor), streaming);
+		store(output + i + 8, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(high)), factor), streaming);
+		store(output + i + 12, _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(high, 1)), factor), streaming);
+	}
+	convert_tail(input + i, output + i, length - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void convert_avx2(const uint8_t *CSE6230_RESTRICT input, float *CSE6230_RESTRICT output, size_t length, float scale, bool streaming) {
+	const __m256 factor = _mm256_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		store(output + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes)), factor), streaming);
+		store(output + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_unpackhi_epi64(bytes, bytes))), factor), streaming);
+	}
+	convert_tail(input + i, output + i, length - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void convert_avx2(const uint8_t *CSE6230_RESTRICT input, int16_t *CSE6230_RESTRICT output, size_t length, int16_t scale, bool streaming) {
+	const __m256i factor = _mm256_set1_epi16(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		store(output + i, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(bytes), factor), streaming);
+	}
+	convert_tail(input + i, output + i, length - i, scale);
+}
+
+/* AVX-512: 16 pixels per step, and one masked step for the last 1-15 */
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static void convert_avx512(const uint8_t *CSE6230_RESTRICT input, double *CSE6230_RESTRICT output, size_t length, double scale, bool streaming) {
+	const __m512d factor = _mm512_set1_pd(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m512i words = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i)));
+		store(output + i, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(words)), factor), streaming);
+		store(output + i + 8, _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(words, 1)), factor), streaming);
+	}
+	if (i != length) {
+		const __mmask16 mask = __mmask16((1u << (length - i)) - 1);
+		const __m512i words = _mm512_cvtepu8_epi32(_mm_maskz_loadu_epi8(mask, input + i));
+		_mm512_mask_storeu_pd(output + i, __mmask8(mask), _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(words)), factor));
+		_mm512_mask_storeu_pd(output + i + 8, __mmask8(mask >> 8), _mm512_mul_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(words, 1)), factor));
+	}
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static void convert_avx512(const uint8_t *CSE6230_RESTRICT input, float *CSE6230_RESTRICT output, size_t length, float scale, bool streaming) {
+	const __m512 factor = _mm512_set1_ps(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		store(output + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes)), factor), streaming);
+	}
+	if (i != length) {
+		const __mmask16 mask = __mmask16((1u << (length - i)) - 1);
+		const __m128i bytes = _mm_maskz_loadu_epi8(mask, input + i);
+		_mm512_mask_storeu_ps(output + i, mask, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(bytes)), factor));
+	}
+}
+
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+static void convert_avx512(const uint8_t *CSE6230_RESTRICT input, int16_t *CSE6230_RESTRICT output, size_t length, int16_t scale, bool streaming) {
+	const __m256i factor = _mm256_set1_epi16(scale);
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+		store(output + i, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(bytes), factor), streaming);
+	}
+	if (i != length) {
+		const __mmask16 mask = __mmask16((1u << (length - i)) - 1);
+		const __m128i bytes = _mm_maskz_loadu_epi8(mask, input + i);
+		_mm256_mask_storeu_epi16(output + i, mask, _mm256_mullo_epi16(_mm256_cvtepu8_epi16(bytes), factor));
+	}
+}
+
+/*
+ * Runtime dispatch between the kernels above. A test driver can cap the
+ * instruction set with select_convert_to_floating_point_isa.
+ */
+
+enum convert_isa { ISA_AVX512, ISA_AVX2, ISA_SSE41, ISA_COUNT };
+
+static const char* const convert_isa_names[ISA_COUNT] = { "avx512", "avx2", "sse4.1" };
+
+static int convert_isa_selected = -1;
+
+static bool cpu_supports(int isa) {
+	switch (isa) {
+		case ISA_AVX512:
+			return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl");
+		case ISA_AVX2:
+			return __builtin_cpu_supports("avx2");
+		default:
+			return true;
+	}
+}
+
+const char* select_convert_to_floating_point_isa(const char* max_isa) {
+	__builtin_cpu_init();
+	bool allowed = (max_isa == NULL || *max_isa == '\0');
+	int isa = 0;
+	for (; isa < ISA_COUNT - 1; isa++) {
+		allowed = allowed || strcmp(max_isa, convert_isa_names[isa]) == 0;
+		if (allowed && cpu_supports(isa))
+			break;
+	}
+	convert_isa_selected = isa;
+	return convert_isa_names[isa];
+}
+
+template <typename real_t>
+static void convert_range(const uint8_t *CSE6230_RESTRICT input, real_t *CSE6230_RESTRICT output, size_t length, real_t scale, bool streaming) {
+	if (streaming) {
+		size_t peel = 0;
+		while (peel != length && reinterpret_cast<uintptr_t>(output + peel) % CONVERT_CHUNK_ALIGNMENT != 0)
+			peel++;
+		convert_tail(input, output, peel, scale);
+		input += peel;
+		output += peel;
+		length -= peel;
+	}
+	switch (convert_isa_selected) {
+		case ISA_AVX512:
+			convert_avx512(input, output, length, scale, streaming);
+			break;
+		case ISA_AVX2:
+			convert_avx2(input, output, length, scale, streaming);
+			break;
+		default:
+			convert_sse41(input, output, length, scale, streaming);
+			break;
+	}
+	/* Non-temporal stores are weakly ordered; make them visible before the conversion returns */
+	if (streaming)
+		_mm_sfence();
+}
+
+template <typename real_t>
+static void convert_scaled(const uint8_t *CSE6230_RESTRICT input, real_t *CSE6230_RESTRICT output, size_t length, real_t scale) {
+	if (convert_isa_selected < 0)
+		select_convert_to_floating_point_isa(NULL);
+	const bool streaming = length * sizeof(real_t) > CONVERT_STREAMING_BYTES;
+	#pragma omp parallel if (length >= CONVERT_PARALLEL_MIN)
+	{
+#if defined(_OPENMP)
+		const size_t threads_count = omp_get_num_threads();
+		const size_t thread_number = omp_get_thread_num();
+#else
+		const size_t threads_count = 1;
+		const size_t thread_number = 0;
+#endif
+		const size_t chunk_alignment = CONVERT_CHUNK_ALIGNMENT / sizeof(real_t);
+		const size_t chunk = ((length + threads_count - 1) / threads_count + chunk_alignment - 1) / chunk_alignment * chunk_alignment;
+		const size_t begin = (thread_number * chunk < length) ? thread_number * chunk : length;
+		const size_t end = (begin + chunk < length) ? begin + chunk : length;
+		convert_range(input + begin, output + begin, end - begin, scale, streaming);
+	}
+}
 
 void convert_to_floating_point_optimized(const uint8_t *CSE6230_RESTRICT fixed_point_images, double *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+	convert_scaled(fixed_point_images, floating_point_images, image_width * image_height * image_count, 1.0 / 255.0);
+}
 
-    __m128i mask1=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,-1,-1,-1,0);
-    __m128i mask2=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,3,-1,-1,-1,2);
-    __m128i mask3=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,5,-1,-1,-1,4);
-    __m128i mask4=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,7,-1,-1,-1,6);
-    __m128i mask5=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,9,-1,-1,-1,8);
-    __m128i mask6=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,11,-1,-1,-1,10);
-    __m128i mask7=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,13,-1,-1,-1,12);
-    __m128i mask8=_mm_set_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,15,-1,-1,-1,14);
-    __m128d constant = _mm_set1_pd(1.0/255);
-    size_t ptr=0;
-    size_t im_size = image_width * image_height * image_count;
-    while(ptr <= (im_size-16))
-    {
-        __m128i fixed=_mm_loadu_si128((const __m128i*)fixed_point_images);
-        fixed_point_images+=16;
-        __m128d fl1 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask1)),constant);
-        __m128d fl2 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask2)),constant);
-        __m128d fl3 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask3)),constant);
-        __m128d fl4 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask4)),constant);
-        __m128d fl5 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask5)),constant);
-        __m128d fl6 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask6)),constant);
-        __m128d fl7 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask7)),constant);
-        __m128d fl8 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi8(fixed,mask8)),constant);  
-
-        _mm_storeu_pd((floating_point_images),fl1);
-        _mm_storeu_pd((floating_point_images+2),fl2);     
-        _mm_storeu_pd((floating_point_images+4),fl3);
-        _mm_storeu_pd((floating_point_images+6),fl4);
-        _mm_storeu_pd((floating_point_images+8),fl5);
-        _mm_storeu_pd((floating_point_images+10),fl6);
-        _mm_storeu_pd((floating_point_images+12),fl7);
-        _mm_storeu_pd((floating_point_images+14),fl8);
-
-        floating_point_images+=16;
-        ptr+=16;
-    }
+void convert_to_floating_point_optimized_float(const uint8_t *CSE6230_RESTRICT fixed_point_images, float *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+	convert_scaled(fixed_point_images, floating_point_images, image_width * image_height * image_count, 1.0f / 255.0f);
+}
+
+void convert_to_int16_optimized(const uint8_t *CSE6230_RESTRICT fixed_point_images, int16_t *CSE6230_RESTRICT pixel_images, size_t image_width, size_t image_height, size_t image_count) {
+	convert_scaled(fixed_point_images, pixel_images, image_width * image_height * image_count, int16_t(1 << PIXEL_FIXED_POINT_SHIFT));
+}
+
+/*
+ * Demeaning: subtract from every pixel its mean over the stack.
+ *
+ * Both passes walk the stack one block of DEMEAN_BLOCK_PIXELS pixels at a
+ * time: the first adds the block of every image, in order, into a vector of
+ * sums that stays in L1, and the second subtracts the means from the block of
+ * every image, which is still in cache. Every access is sequential within an
+ * image, instead of striding across all images for each pixel. The blocks
+ * are independent and are split between OpenMP threads.
+ *
+ * convert_and_demean_* also fuse the conversion: the sums are of the uint8
+ * pixels (exact, in integers), and the second pass converts each block into
+ * an L1 buffer with the conversion kernels, then subtracts the means while
+ * writing the block out (with non-temporal stores for large stacks). The
+ * floating-point stack is written once and never read.
+ */
+
+#define DEMEAN_BLOCK_PIXELS 512
 
+/* sums[j] := sum over images of images[n * image_pixels + j]; the compiler vectorizes the inner loops */
+template <typename real_t>
+static void sum_block(const real_t *CSE6230_RESTRICT images, real_t *CSE6230_RESTRICT sums, size_t image_pixels, size_t image_count, size_t length) {
+	for (size_t j = 0; j < length; j++)
+		sums[j] = images[j];
+	for (size_t n = 1; n < image_count; n++) {
+		const real_t* image = images + n * image_pixels;
+		for (size_t j = 0; j < length; j++)
+			sums[j] += image[j];
+	}
+}
+
+/* The same for uint8 pixels: 16-bit sums of up to 257 images at a time, which cannot overflow */
+static void sum_block(const uint8_t *CSE6230_RESTRICT images, uint32_t *CSE6230_RESTRICT sums, size_t image_pixels, size_t image_count, size_t length) {
+	uint16_t partial_sums[DEMEAN_BLOCK_PIXELS];
+	for (size_t j = 0; j < length; j++)
+		sums[j] = 0;
+	for (size_t first = 0; first < image_count; first += 257) {
+		const size_t last = (first + 257 < image_count) ? first + 257 : image_count;
+		for (size_t j = 0; j < length; j++)
+			partial_sums[j] = 0;
+		for (size_t n = first; n < last; n++) {
+			const uint8_t* image = images + n * image_pixels;
+			for (size_t j = 0; j < length; j++)
+				partial_sums[j] += image[j];
+		}
+		for (size_t j = 0; j < length; j++)
+			sums[j] += partial_sums[j];
+	}
+}
+
+template <typename real_t>
+static void subtract_block(real_t *CSE6230_RESTRICT images, const real_t *CSE6230_RESTRICT means, size_t image_pixels, size_t image_count, size_t length) {
+	for (size_t n = 0; n < image_count; n++) {
+		real_t* image = images + n * image_pixels;
+		for (size_t j = 0; j < length; j++)
+			image[j] -= means[j];
+	}
+}
+
+/* output := block - means, with SSE2; non-temporal stores need a 16-byte aligned output, so a streaming call first peels scalar elements */
+static inline __m128d subtract(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+static inline __m128 subtract(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+static inline __m128i subtract(__m128i a, __m128i b) { return _mm_sub_epi16(a, b); }
+static inline __m128d load(const double* p) { return _mm_loadu_pd(p); }
+static inline __m128 load(const float* p) { return _mm_loadu_ps(p); }
+static inline __m128i load(const int16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+
+template <typename real_t>
+static void subtract_means(real_t *CSE6230_RESTRICT output, const real_t *CSE6230_RESTRICT block, const real_t *CSE6230_RESTRICT means, size_t length, bool streaming) {
+	const size_t vector_length = 16 / sizeof(real_t);
+	size_t j = 0;
+	if (streaming) {
+		for (; j != length && reinterpret_cast<uintptr_t>(output + j) % 16 != 0; j++)
+			output[j] = block[j] - means[j];
+	}
+	for (; j + vector_length <= length; j += vector_length)
+		store(output + j, subtract(load(block + j), load(means + j)), streaming);
+	for (; j < length; j++)
+		output[j] = block[j] - means[j];
+}
+
+/* The mean of a pixel in the output's units, from the sum of its uint8 values */
+static inline double pixel_mean(uint32_t sum, size_t image_count, double scale) {
+	return sum * scale / double(image_count);
+}
+
+static inline float pixel_mean(uint32_t sum, size_t image_count, float scale) {
+	return float(sum * double(scale) / double(image_count));
+}
 
+/* Rounded to nearest, like demean_images<int16_t> */
+static inline int16_t pixel_mean(uint32_t sum, size_t image_count, int16_t scale) {
+	return int16_t((sum * uint32_t(scale) + image_count / 2) / image_count);
+}
+
+template <typename real_t>
+static void convert_and_demean(const uint8_t *CSE6230_RESTRICT input_images, real_t *CSE6230_RESTRICT output_images, size_t image_pixels, size_t image_count, real_t scale) {
+	if (convert_isa_selected < 0)
+		select_convert_to_floating_point_isa(NULL);
+	if (image_count == 0)
+		return;
+	const size_t blocks_count = (image_pixels + DEMEAN_BLOCK_PIXELS - 1) / DEMEAN_BLOCK_PIXELS;
+	const bool streaming = image_pixels * image_count * sizeof(real_t) > CONVERT_STREAMING_BYTES;
+	#pragma omp parallel for schedule(static) if (image_pixels * image_count >= CONVERT_PARALLEL_MIN)
+	for (size_t b = 0; b < blocks_count; b++) {
+		const size_t first = b * DEMEAN_BLOCK_PIXELS;
+		const size_t length = (image_pixels - first < DEMEAN_BLOCK_PIXELS) ? image_pixels - first : DEMEAN_BLOCK_PIXELS;
+		uint32_t sums[DEMEAN_BLOCK_PIXELS];
+		real_t means[DEMEAN_BLOCK_PIXELS];
+		real_t block[DEMEAN_BLOCK_PIXELS];
+		sum_block(input_images + first, sums, image_pixels, image_count, length);
+		for (size_t j = 0; j < length; j++)
+			means[j] = pixel_mean(sums[j], image_count, scale);
+		for (size_t n = 0; n < image_count; n++) {
+			convert_range(input_images + n * image_pixels + first, block, length, scale, false);
+			subtract_means(output_images + n * image_pixels + first, block, means, length, streaming);
+		}
+		if (streaming)
+			_mm_sfence();
+	}
+}
+
+void demean_images_optimized(double *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+	const size_t image_pixels = image_width * image_height;
+	if (image_count == 0)
+		return;
+	const size_t blocks_count = (image_pixels + DEMEAN_BLOCK_PIXELS - 1) / DEMEAN_BLOCK_PIXELS;
+	#pragma omp parallel for schedule(static) if (image_pixels * image_count >= CONVERT_PARALLEL_MIN)
+	for (size_t b = 0; b < blocks_count; b++) {
+		const size_t first = b * DEMEAN_BLOCK_PIXELS;
+		const size_t length = (image_pixels - first < DEMEAN_BLOCK_PIXELS) ? image_pixels - first : DEMEAN_BLOCK_PIXELS;
+		double means[DEMEAN_BLOCK_PIXELS];
+		sum_block(floating_point_images + first, means, image_pixels, image_count, length);
+		for (size_t j = 0; j < length; j++)
+			means[j] /= double(image_count);
+		subtract_block(floating_point_images + first, means, image_pixels, image_count, length);
+	}
+}
+
+void convert_and_demean_optimized(const uint8_t *CSE6230_RESTRICT fixed_point_images, double *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+	convert_and_demean(fixed_point_images, floating_point_images, image_width * image_height, image_count, 1.0 / 255.0);
+}
+
+void convert_and_demean_optimized_float(const uint8_t *CSE6230_RESTRICT fixed_point_images, float *CSE6230_RESTRICT floating_point_images, size_t image_width, size_t image_height, size_t image_count) {
+	convert_and_demean(fixed_point_images, floating_point_images, image_width * image_height, image_count, 1.0f / 255.0f);
+}
+
+void convert_and_demean_int16_optimized(const uint8_t *CSE6230_RESTRICT fixed_point_images, int16_t *CSE6230_RESTRICT pixel_images, size_t image_width, size_t image_height, size_t image_count) {
+	convert_and_demean(fixed_point_images, pixel_images, image_width * image_height, image_count, int16_t(1 << PIXEL_FIXED_POINT_SHIFT));
 }
 
 void matrix_vector_multiplication_optimized(double *CSE6230_RESTRICT output_vector, const double *CSE6230_RESTRICT matrix, const double *CSE6230_RESTRICT input_vector, size_t matrix_width, size_t matrix_height) {
 
     size_t ptr=0,i,j;
     __m128d result1,result2,result3,result2b,result3b,result4;
-    while((ptr)<(matrix_height-4))
+    while(ptr+4<=matrix_height)
     {
          /*Processing 4 rows at once - need to find the right balance between handling more stuff outside the vectorization loop vs inside - the greater the number of rows processed inside, more rows tend to get left out of the above while loop - i<matrix_width-4. At the same time, we also need to exploit the vectorization component by using sufficient number of rows to be processed inside. In short, the degree of unrolling is a factor of the ratio of number of rows processes by vectors to the number of rows processes naively*/
 
         i=0;
         result3=_mm_setzero_pd();
         result4=_mm_setzero_pd();
-        while(i<(matrix_width-4))
+        while(i+4<=matrix_width)
         {
             __m128d mat = _mm_loadu_pd(matrix+(ptr*matrix_width)+i);
             __m128d mat1a = _mm_loadu_pd(matrix+(ptr*matrix_width)+i+2);
@@ -115,3 +548,126 @@ void matrix_vector_multiplication_optimized(double *CSE6230_RESTRICT output_vect
     }
 
 }
+
+/*
+ * y := A x for a symmetric A stored as its packed upper triangle. Every element above the diagonal is used
+ * twice, for the row (y[i] += a[i][j] x[j]) and for the column (y[j] += a[i][j] x[i]), so the matrix is
+ * read once, and only half of it is stored. Rows are processed four at a time: each step of the inner loop
+ * loads four elements of each row, accumulates the row sums in a vector per row, and adds the four rows'
+ * column contributions to one vector of y. The row sums are reduced once per row, after the inner loop.
+ */
+
+#define SYMMETRIC_BLOCK_ROWS 4
+
+/* Rows before row hold length, length - 1, ..., length - row + 1 elements */
+static inline size_t packed_row_offset(size_t row, size_t length) {
+	return row * (2 * length - row + 1) / 2;
+}
+
+/* The diagonal block of rows [first, first + count) and the remainder of those rows past column end, one element at a time */
+static inline void symmetric_rows_scalar(double *CSE6230_RESTRICT output_vector, const double *CSE6230_RESTRICT packed_matrix,
+	const double *CSE6230_RESTRICT input_vector, size_t first, size_t count, size_t end, size_t length)
+{
+	for (size_t i = first; i < first + count; i++) {
+		/* row[j] is element (i, j) */
+		const double* row = packed_matrix + packed_row_offset(i, length) - i;
+		double row_sum = row[i] * input_vector[i];
+		for (size_t j = i + 1; j < first + count; j++) {
+			row_sum += row[j] * input_vector[j];
+			output_vector[j] += row[j] * input_vector[i];
+		}
+		for (size_t j = end; j < length; j++) {
+			row_sum += row[j] * input_vector[j];
+			output_vector[j] += row[j] * input_vector[i];
+		}
+		output_vector[i] += row_sum;
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void symmetric_matrix_vector_avx2(double *CSE6230_RESTRICT output_vector, const double *CSE6230_RESTRICT packed_matrix,
+	const double *CSE6230_RESTRICT input_vector, size_t length)
+{
+	size_t i = 0;
+	for (; i + SYMMETRIC_BLOCK_ROWS <= length; i += SYMMETRIC_BLOCK_ROWS) {
+		const double* row0 = packed_matrix + packed_row_offset(i, length) - i;
+		const double* row1 = packed_matrix + packed_row_offset(i + 1, length) - (i + 1);
+		const double* row2 = packed_matrix + packed_row_offset(i + 2, length) - (i + 2);
+		const double* row3 = packed_matrix + packed_row_offset(i + 3, length) - (i + 3);
+		const __m256d x0 = _mm256_broadcast_sd(input_vector + i);
+		const __m256d x1 = _mm256_broadcast_sd(input_vector + i + 1);
+		const __m256d x2 = _mm256_broadcast_sd(input_vector + i + 2);
+		const __m256d x3 = _mm256_broadcast_sd(input_vector + i + 3);
+		__m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd(), sum2 = _mm256_setzero_pd(), sum3 = _mm256_setzero_pd();
+		size_t j = i + SYMMETRIC_BLOCK_ROWS;
+		for (; j + 4 <= length; j += 4) {
+			const __m256d x = _mm256_loadu_pd(input_vector + j);
+			const __m256d a0 = _mm256_loadu_pd(row0 + j);
+			const __m256d a1 = _mm256_loadu_pd(row1 + j);
+			const __m256d a2 = _mm256_loadu_pd(row2 + j);
+			const __m256d a3 = _mm256_loadu_pd(row3 + j);
+			sum0 = _mm256_fmadd_pd(a0, x, sum0);
+			sum1 = _mm256_fmadd_pd(a1, x, sum1);
+			sum2 = _mm256_fmadd_pd(a2, x, sum2);
+			sum3 = _mm256_fmadd_pd(a3, x, sum3);
+			__m256d y = _mm256_loadu_pd(output_vector + j);
+			y = _mm256_fmadd_pd(a0, x0, y);
+			y = _mm256_fmadd_pd(a1, x1, y);
+			y = _mm256_fmadd_pd(a2, x2, y);
+			y = _mm256_fmadd_pd(a3, x3, y);
+			_mm256_storeu_pd(output_vector + j, y);
+		}
+		/* (sum0, sum1, sum2, sum3) reduced to one vector of the four row sums */
+		const __m256d sum01 = _mm256_hadd_pd(sum0, sum1);
+		const __m256d sum23 = _mm256_hadd_pd(sum2, sum3);
+		const __m256d sums = _mm256_add_pd(_mm256_permute2f128_pd(sum01, sum23, 0x20), _mm256_permute2f128_pd(sum01, sum23, 0x31));
+		_mm256_storeu_pd(output_vector + i, _mm256_add_pd(_mm256_loadu_pd(output_vector + i), sums));
+		symmetric_rows_scalar(output_vector, packed_matrix, input_vector, i, SYMMETRIC_BLOCK_ROWS, j, length);
+	}
+	symmetric_rows_scalar(output_vector, packed_matrix, input_vector, i, length - i, length, length);
+}
+
+/* The same for processors without AVX2 and FMA; the compiler vectorizes the column updates */
+static void symmetric_matrix_vector_portable(double *CSE6230_RESTRICT output_vector, const double *CSE6230_RESTRICT packed_matrix,
+	const double *CSE6230_RESTRICT input_vector, size_t length)
+{
+	size_t i = 0;
+	for (; i + SYMMETRIC_BLOCK_ROWS <= length; i += SYMMETRIC_BLOCK_ROWS) {
+		const double* row0 = packed_matrix + packed_row_offset(i, length) - i;
+		const double* row1 = packed_matrix + packed_row_offset(i + 1, length) - (i + 1);
+		const double* row2 = packed_matrix + packed_row_offset(i + 2, length) - (i + 2);
+		const double* row3 = packed_matrix + packed_row_offset(i + 3, length) - (i + 3);
+		const double x0 = input_vector[i], x1 = input_vector[i + 1], x2 = input_vector[i + 2], x3 = input_vector[i + 3];
+		double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+		for (size_t j = i + SYMMETRIC_BLOCK_ROWS; j < length; j++) {
+			const double x = input_vector[j];
+			sum0 += row0[j] * x;
+			sum1 += row1[j] * x;
+			sum2 += row2[j] * x;
+			sum3 += row3[j] * x;
+			output_vector[j] += row0[j] * x0 + row1[j] * x1 + row2[j] * x2 + row3[j] * x3;
+		}
+		output_vector[i] += sum0;
+		output_vector[i + 1] += sum1;
+		output_vector[i + 2] += sum2;
+		output_vector[i + 3] += sum3;
+		symmetric_rows_scalar(output_vector, packed_matrix, input_vector, i, SYMMETRIC_BLOCK_ROWS, length, length);
+	}
+	symmetric_rows_scalar(output_vector, packed_matrix, input_vector, i, length - i, length, length);
+}
+
+static int symmetric_use_avx2 = -1;
+
+void symmetric_matrix_vector_multiplication_optimized(double *CSE6230_RESTRICT output_vector, const double *CSE6230_RESTRICT packed_matrix,
+	const double *CSE6230_RESTRICT input_vector, size_t length)
+{
+	if (symmetric_use_avx2 < 0) {
+		__builtin_cpu_init();
+		symmetric_use_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	}
+	memset(output_vector, 0, length * sizeof(double));
+	if (symmetric_use_avx2)
+		symmetric_matrix_vector_avx2(output_vector, packed_matrix, input_vector, length);
+	else
+		symmetric_matrix_vector_portable(output_vector, packed_matrix, input_vector, length);
+}
@@ -1,5 +1,9 @@
 #include <hpcdefs.hpp>
 #include <image.hpp>
+#include <pack.hpp>
+#include <blas1.hpp>
+#include <syrk.hpp>
+#include <eigen.hpp>
 #include <timer.hpp>
 
 #include <stdio.h>
@@ -8,6 +12,7 @@
 #include <float.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <unistd.h>
 
 template <class T>
 void swap(T& a, T& b) {
@@ -30,7 +35,7 @@ void write_integral_error_image(const char* integral_error_image_path,
 			integral_error_image[i * image_width + j] = (integral_pixel == reference_integral_pixel) ? 0xFF : 0x00;
 		}
 	}
-	write_bmp_image(integral_error_image_path, integral_error_image, image_width, image_height);
+	write_bmp_image_queued(integral_error_image_path, integral_error_image, image_width, image_height);
 	release_aligned_memory(integral_error_image);
 }
 
@@ -69,6 +74,94 @@ void test_conversion(const char* method_name, convert_to_floating_point_function
 	printf("\t\tPerformance test:  %.3lf ms (%.1lf FPS)\n", min_conversion_ms, (1000.0 / min_conversion_ms));
 }
 
+/* Single-precision output, checked against the double-precision reference */
+void test_conversion_float(convert_to_floating_point_float_function convert_to_floating_point,
+	const uint8_t* fixed_point_images, float* floating_point_images, const double* reference_images,
+	size_t image_width, size_t image_height, size_t image_count, size_t experiments_count)
+{
+	const size_t length = image_width * image_height * image_count;
+	memset(floating_point_images, 0, length * sizeof(float));
+
+	timer conversion_timer;
+	convert_to_floating_point(fixed_point_images, floating_point_images, image_width, image_height, image_count);
+	double min_conversion_ms = conversion_timer.get_ms();
+
+	bool conversion_test_passed = true;
+	for (size_t i = 0; i < length; i++) {
+		if (fabs(double(floating_point_images[i]) - reference_images[i]) > reference_images[i] * FLT_EPSILON) {
+			conversion_test_passed = false;
+			break;
+		}
+	}
+	for (size_t experiment = 0; experiment < experiments_count; experiment++) {
+		timer conversion_timer;
+		convert_to_floating_point(fixed_point_images, floating_point_images, image_width, image_height, image_count);
+		double conversion_ms = conversion_timer.get_ms();
+		if (conversion_ms < min_conversion_ms)
+			min_conversion_ms = conversion_ms;
+	}
+	printf("\tOptimized (single precision)\n");
+	printf("\t\tUnit test:         %s\n", (conversion_test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf ms (%.1lf FPS)\n", min_conversion_ms, (1000.0 / min_conversion_ms));
+}
+
+/*
+ * Converts random stacks whose pixel counts are not multiples of any vector length
+ * (the last one is large enough to be split between threads), into exact-size buffers
+ * followed by a guard element that must not change.
+ */
+bool test_conversion_sizes(convert_to_floating_point_function convert_to_floating_point,
+	convert_to_floating_point_float_function convert_to_floating_point_float, convert_to_int16_function convert_to_int16)
+{
+	static const size_t lengths[] = { 1, 7, 15, 16, 17, 31, 33, 100, 1001, 70001 };
+	bool passed = true;
+	for (size_t s = 0; s < sizeof(lengths) / sizeof(lengths[0]); s++) {
+		const size_t length = lengths[s];
+		uint8_t* fixed_point_images = static_cast<uint8_t*>(malloc(length));
+		double* floating_point_images = static_cast<double*>(malloc((length + 1) * sizeof(double)));
+		double* floating_point_images_upper = static_cast<double*>(malloc(length * sizeof(double)));
+		double* floating_point_images_lower = static_cast<double*>(malloc(length * sizeof(double)));
+		float* single_precision_images = static_cast<float*>(malloc((length + 1) * sizeof(float)));
+		int16_t* fixed_point_16_images = static_cast<int16_t*>(malloc((length + 1) * sizeof(int16_t)));
+		for (size_t i = 0; i < length; i++)
+			fixed_point_images[i] = rand() & 0xFF;
+		floating_point_images[length] = -1.0;
+		single_precision_images[length] = -1.0f;
+		fixed_point_16_images[length] = -1;
+
+		convert_to_floating_point(fixed_point_images, floating_point_images, length, 1, 1);
+		convert_to_floating_point_upper(fixed_point_images, floating_point_images_upper, length, 1, 1);
+		convert_to_floating_point_lower(fixed_point_images, floating_point_images_lower, length, 1, 1);
+		bool length_passed = check_images(floating_point_images, floating_point_images_lower, floating_point_images_upper, length, 1, 1)
+			&& floating_point_images[length] == -1.0;
+		if (convert_to_floating_point_float != NULL) {
+			convert_to_floating_point_float(fixed_point_images, single_precision_images, length, 1, 1);
+			for (size_t i = 0; i < length; i++)
+				length_passed = length_passed && fabs(double(single_precision_images[i]) - floating_point_images_upper[i]) <= floating_point_images_upper[i] * FLT_EPSILON;
+			length_passed = length_passed && single_precision_images[length] == -1.0f;
+		}
+		if (convert_to_int16 != NULL) {
+			convert_to_int16(fixed_point_images, fixed_point_16_images, length, 1, 1);
+			for (size_t i = 0; i < length; i++)
+				length_passed = length_passed && fixed_point_16_images[i] == (fixed_point_images[i] << PIXEL_FIXED_POINT_SHIFT);
+			length_passed = length_passed && fixed_point_16_images[length] == -1;
+		}
+		if (!length_passed) {
+			printf("\t\t\t%zu pixels converted incorrectly\n", length);
+			passed = false;
+		}
+		free(fixed_point_16_images);
+		free(single_precision_images);
+		free(floating_point_images_lower);
+		free(floating_point_images_upper);
+		free(floating_point_images);
+		free(fixed_point_images);
+	}
+	return passed;
+}
+
 double* test_multiplication(const char* method_name, matrix_vector_multiplication_function matrix_vector_multiplication,
 	double* vector_old, double* vector_new, double* vector_ref, double* vector_abs, const double* matrix, size_t length,
 	size_t experiments_count, bool is_naive, double& fps)
@@ -96,8 +189,7 @@ double* test_multiplication(const char* method_name, matrix_vector_multiplicatio
 			if (multiplication_test_passed) {
 				multiplication_test_passed = check_vector(vector_new, vector_ref, vector_abs, sqrt(double(length)), length);
 			}
-			normalize_vector(vector_new, length);
-			const double dp = dot_product(vector_new, vector_old, length);
+			const double dp = blas1_normalize_dot(vector_new, vector_old, length);
 			swap(vector_old, vector_new);
 			if (iteration != 0)
 				if (fabs(1.0 - dp) <= sqrt(DBL_EPSILON))
@@ -116,6 +208,420 @@ double* test_multiplication(const char* method_name, matrix_vector_multiplicatio
 	return vector_old;
 }
 
+/*
+ * The optimized kernels against the naive product on random matrices of sizes around the 4-row blocks.
+ * Each element is a dot product of up to length terms summed in different orders, hence the bound.
+ */
+bool test_multiplication_sizes(matrix_vector_multiplication_function matrix_vector_multiplication,
+	symmetric_matrix_vector_multiplication_function symmetric_matrix_vector_multiplication)
+{
+	static const size_t lengths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 12, 13, 31, 33, 64 };
+	bool passed = true;
+	for (size_t s = 0; s < sizeof(lengths) / sizeof(lengths[0]); s++) {
+		const size_t length = lengths[s];
+		double* matrix = static_cast<double*>(malloc(length * length * sizeof(double)));
+		double* packed_matrix = static_cast<double*>(malloc(length * (length + 1) / 2 * sizeof(double)));
+		double* input_vector = static_cast<double*>(malloc(length * sizeof(double)));
+		double* output_vector = static_cast<double*>(malloc((length + 1) * sizeof(double)));
+		double* vector_ref = static_cast<double*>(malloc(length * sizeof(double)));
+		double* vector_abs = static_cast<double*>(malloc(length * sizeof(double)));
+		for (size_t i = 0; i < length; i++) {
+			input_vector[i] = double(rand()) / RAND_MAX - 0.5;
+			for (size_t j = 0; j <= i; j++)
+				matrix[i * length + j] = matrix[j * length + i] = double(rand()) / RAND_MAX - 0.5;
+		}
+		pack_upper_triangle(packed_matrix, matrix, length);
+		matrix_vector_multiplication_naive(vector_ref, matrix, input_vector, length, length);
+		matrix_vector_multiplication_abs(vector_abs, matrix, input_vector, length, length);
+
+		/* The element past the end must not be written */
+		output_vector[length] = -1.0;
+		matrix_vector_multiplication(output_vector, matrix, input_vector, length, length);
+		if (!check_vector(output_vector, vector_ref, vector_abs, double(length), length) || output_vector[length] != -1.0) {
+			printf("\t\t\tLength %zu: incorrect product\n", length);
+			passed = false;
+		}
+		if (symmetric_matrix_vector_multiplication != NULL) {
+			symmetric_matrix_vector_multiplication(output_vector, packed_matrix, input_vector, length);
+			if (!check_vector(output_vector, vector_ref, vector_abs, double(length), length) || output_vector[length] != -1.0) {
+				printf("\t\t\tLength %zu: incorrect symmetric product\n", length);
+				passed = false;
+			}
+		}
+		free(vector_abs);
+		free(vector_ref);
+		free(output_vector);
+		free(input_vector);
+		free(packed_matrix);
+		free(matrix);
+	}
+	return passed;
+}
+
+/* Power iteration as in test_multiplication, with the symmetric kernel on the packed upper triangle of matrix */
+void test_symmetric_multiplication(symmetric_matrix_vector_multiplication_function symmetric_matrix_vector_multiplication,
+	double* vector_old, double* vector_new, double* vector_ref, double* vector_abs, const double* matrix, size_t length,
+	size_t experiments_count, double& fps)
+{
+	double* packed_matrix = static_cast<double*>(allocate_aligned_memory(length * (length + 1) / 2 * sizeof(double), 64));
+	pack_upper_triangle(packed_matrix, matrix, length);
+	vector_set(vector_old, length, 1.0 / sqrt(double(length)));
+
+	symmetric_matrix_vector_multiplication(vector_new, packed_matrix, vector_old, length);
+	double min_multiplication_ms = 0.0;
+	for (size_t experiment = 0; experiment <= experiments_count; experiment++) {
+		timer multiplication_timer;
+		symmetric_matrix_vector_multiplication(vector_new, packed_matrix, vector_old, length);
+		const double multiplication_ms = multiplication_timer.get_ms();
+		if (experiment == 0 || multiplication_ms < min_multiplication_ms)
+			min_multiplication_ms = multiplication_ms;
+	}
+
+	bool multiplication_test_passed = true;
+	for (size_t iteration = 0; iteration < 10000; iteration++) {
+		symmetric_matrix_vector_multiplication(vector_new, packed_matrix, vector_old, length);
+		matrix_vector_multiplication_naive(vector_ref, matrix, vector_old, length, length);
+		matrix_vector_multiplication_abs(vector_abs, matrix, vector_old, length, length);
+		if (multiplication_test_passed) {
+			multiplication_test_passed = check_vector(vector_new, vector_ref, vector_abs, double(length), length);
+		}
+		const double dp = blas1_normalize_dot(vector_new, vector_old, length);
+		swap(vector_old, vector_new);
+		if (iteration != 0)
+			if (fabs(1.0 - dp) <= sqrt(DBL_EPSILON))
+				break;
+	}
+
+	fps = 1000.0 / min_multiplication_ms;
+	printf("\tSymmetric (packed upper triangle)\n");
+	printf("\t\tUnit test:         %s\n", (multiplication_test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf us (%.1lf FPS)\n", min_multiplication_ms * 1000.0, fps);
+	release_aligned_memory(packed_matrix);
+}
+
+/* Largest difference between demeaned stacks, after scaling the pixels of the first one to full-scale units */
+template <typename pixel_t>
+double max_demean_error(const pixel_t* images, const double* reference_images, size_t length, double unit) {
+	double max_error = 0.0;
+	for (size_t i = 0; i < length; i++)
+		max_error = fmax(max_error, fabs(double(images[i]) * unit - reference_images[i]));
+	return max_error;
+}
+
+/*
+ * demean_images against demean_images_optimized, and conversion followed by demeaning against the
+ * fused convert_and_demean kernels. The floating-point results may differ from the reference by the
+ * rounding of the means (a sum of image_count pixels) and of the conversion. Fixed point rounds each
+ * mean to a whole Q7 unit the same way in both, so it must match bit for bit.
+ */
+void test_demean(demean_images_function demean_images_optimized, convert_to_floating_point_function convert_and_demean_optimized,
+	convert_to_floating_point_float_function convert_and_demean_optimized_float, convert_to_int16_function convert_and_demean_int16_optimized,
+	const uint8_t* fixed_point_images, double* images, double* reference_images,
+	size_t image_width, size_t image_height, size_t image_count, size_t experiments_count)
+{
+	const size_t length = image_width * image_height * image_count;
+	convert_to_floating_point_naive(fixed_point_images, reference_images, image_width, image_height, image_count);
+	timer naive_conversion_timer;
+	convert_to_floating_point_naive(fixed_point_images, reference_images, image_width, image_height, image_count);
+	const double naive_conversion_ms = naive_conversion_timer.get_ms();
+	timer naive_timer;
+	demean_images(reference_images, image_width, image_height, image_count);
+	const double naive_ms = naive_timer.get_ms();
+
+	double min_optimized_ms = 0.0, min_fused_ms = 0.0;
+	for (size_t experiment = 0; experiment <= experiments_count; experiment++) {
+		convert_to_floating_point_naive(fixed_point_images, images, image_width, image_height, image_count);
+		timer optimized_timer;
+		demean_images_optimized(images, image_width, image_height, image_count);
+		const double optimized_ms = optimized_timer.get_ms();
+		if (experiment == 0 || optimized_ms < min_optimized_ms)
+			min_optimized_ms = optimized_ms;
+	}
+	const double tolerance = 2.0 * image_count * DBL_EPSILON;
+	const bool optimized_test_passed = max_demean_error(images, reference_images, length, 1.0) <= tolerance;
+
+	for (size_t experiment = 0; experiment <= experiments_count; experiment++) {
+		timer fused_timer;
+		convert_and_demean_optimized(fixed_point_images, images, image_width, image_height, image_count);
+		const double fused_ms = fused_timer.get_ms();
+		if (experiment == 0 || fused_ms < min_fused_ms)
+			min_fused_ms = fused_ms;
+	}
+	const bool fused_test_passed = max_demean_error(images, reference_images, length, 1.0) <= tolerance;
+
+	float* single_precision_images = static_cast<float*>(allocate_aligned_memory(length * sizeof(float), 64));
+	convert_and_demean_optimized_float(fixed_point_images, single_precision_images, image_width, image_height, image_count);
+	const bool single_precision_test_passed = max_demean_error(single_precision_images, reference_images, length, 1.0) <= tolerance + 4.0 * FLT_EPSILON;
+	release_aligned_memory(single_precision_images);
+
+	int16_t* fixed_point_16_images = static_cast<int16_t*>(allocate_aligned_memory(length * sizeof(int16_t), 64));
+	int16_t* reference_fixed_point_16_images = static_cast<int16_t*>(allocate_aligned_memory(length * sizeof(int16_t), 64));
+	convert_and_demean_int16_optimized(fixed_point_images, fixed_point_16_images, image_width, image_height, image_count);
+	convert_to_pixels(fixed_point_images, reference_fixed_point_16_images, image_width, image_height, image_count);
+	demean_images(reference_fixed_point_16_images, image_width, image_height, image_count);
+	/* Within half a Q7 unit (the rounding of the means) of the double-precision reference */
+	const double fixed_point_unit = pixel_traits<int16_t>::unit();
+	const bool fixed_point_test_passed = memcmp(fixed_point_16_images, reference_fixed_point_16_images, length * sizeof(int16_t)) == 0
+		&& max_demean_error(fixed_point_16_images, reference_images, length, fixed_point_unit) <= 0.5 * fixed_point_unit + tolerance;
+	release_aligned_memory(reference_fixed_point_16_images);
+	release_aligned_memory(fixed_point_16_images);
+
+	printf("\tNaive\n");
+	printf("\t\tPerformance test:  %.3lf ms (%.3lf ms with the conversion)\n", naive_ms, naive_conversion_ms + naive_ms);
+	printf("\tOptimized\n");
+	printf("\t\tUnit test:         %s\n", (optimized_test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf ms\n", min_optimized_ms);
+	printf("\t\tPerformance boost: %.1lfx\n", naive_ms / min_optimized_ms);
+	printf("\tFused with the conversion\n");
+	printf("\t\tUnit test:         %s (single precision %s, fixed point %s)\n", (fused_test_passed ?
+			CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+			CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR),
+		(single_precision_test_passed ?
+			CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+			CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR),
+		(fixed_point_test_passed ?
+			CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+			CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf ms\n", min_fused_ms);
+	printf("\t\tPerformance boost: %.1lfx\n", (naive_conversion_ms + naive_ms) / min_fused_ms);
+}
+
+/*
+ * Checks a Gram matrix against the reference: every element of either is a dot product of length
+ * columns, so they differ by at most 2 columns epsilon sum_k |a_ik a_jk| <= 2 columns epsilon sqrt(c_ii c_jj)
+ */
+template <typename real_t>
+bool check_square_matrix(const real_t* matrix, const double* reference_matrix, size_t columns, size_t rows, double epsilon) {
+	for (size_t i = 0; i < rows; i++) {
+		for (size_t j = 0; j < rows; j++) {
+			const double bound = 2.0 * columns * epsilon * sqrt(reference_matrix[i * rows + i] * reference_matrix[j * rows + j]);
+			if (fabs(double(matrix[i * rows + j]) - reference_matrix[i * rows + j]) > bound)
+				return false;
+		}
+	}
+	return true;
+}
+
+/* square_matrix against syrk on the demeaned images, in double and single precision */
+void test_square_matrix(const double* images, size_t image_pixels, size_t image_count, size_t experiments_count) {
+	double* reference_matrix = static_cast<double*>(allocate_aligned_memory(image_count * image_count * sizeof(double), 64));
+	double* matrix = static_cast<double*>(allocate_aligned_memory(image_count * image_count * sizeof(double), 64));
+	float* single_precision_images = static_cast<float*>(allocate_aligned_memory(image_pixels * image_count * sizeof(float), 64));
+	float* single_precision_matrix = static_cast<float*>(allocate_aligned_memory(image_count * image_count * sizeof(float), 64));
+	for (size_t i = 0; i < image_pixels * image_count; i++)
+		single_precision_images[i] = images[i];
+
+	timer naive_timer;
+	square_matrix(reference_matrix, images, image_pixels, image_count);
+	const double naive_ms = naive_timer.get_ms();
+
+	double min_syrk_ms = 0.0, min_single_precision_ms = 0.0;
+	for (size_t experiment = 0; experiment <= experiments_count; experiment++) {
+		timer syrk_timer;
+		syrk(matrix, images, image_pixels, image_count);
+		const double syrk_ms = syrk_timer.get_ms();
+		if (experiment == 0 || syrk_ms < min_syrk_ms)
+			min_syrk_ms = syrk_ms;
+
+		timer single_precision_timer;
+		syrk(single_precision_matrix, single_precision_images, image_pixels, image_count);
+		const double single_precision_ms = single_precision_timer.get_ms();
+		if (experiment == 0 || single_precision_ms < min_single_precision_ms)
+			min_single_precision_ms = single_precision_ms;
+	}
+	const bool syrk_test_passed = check_square_matrix(matrix, reference_matrix, image_pixels, image_count, DBL_EPSILON);
+	const bool single_precision_test_passed = check_square_matrix(single_precision_matrix, reference_matrix, image_pixels, image_count, FLT_EPSILON);
+
+	/* Lower triangle only, as the flops of a SYRK */
+	const double gflop = double(image_count) * (image_count + 1) * image_pixels * 1.0e-9;
+	printf("\tNaive\n");
+	printf("\t\tPerformance test:  %.3lf ms\n", naive_ms);
+	printf("\tSYRK\n");
+	printf("\t\tUnit test:         %s\n", (syrk_test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf ms (%.1lf GFLOPS)\n", min_syrk_ms, gflop / (min_syrk_ms * 1.0e-3));
+	printf("\t\tPerformance boost: %.1lfx\n", naive_ms / min_syrk_ms);
+	printf("\tSYRK (single precision)\n");
+	printf("\t\tUnit test:         %s\n", (single_precision_test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf ms (%.1lf GFLOPS)\n", min_single_precision_ms, gflop / (min_single_precision_ms * 1.0e-3));
+
+	release_aligned_memory(single_precision_matrix);
+	release_aligned_memory(single_precision_images);
+	release_aligned_memory(matrix);
+	release_aligned_memory(reference_matrix);
+}
+
+/*
+ * The top count eigenpairs by subspace iteration against all of them by the Jacobi method. The eigenvectors must be
+ * orthonormal, and every eigenvalue is within the residual ||M v - lambda v|| (at most sqrt(epsilon) lambda[0]) of the reference.
+ */
+void test_eigenfaces(const double* matrix, size_t length, size_t count, size_t experiments_count) {
+	double* reference_eigenvectors = static_cast<double*>(allocate_aligned_memory(length * length * sizeof(double), 64));
+	double* reference_eigenvalues = static_cast<double*>(allocate_aligned_memory(length * sizeof(double), 64));
+	double* eigenvectors = static_cast<double*>(allocate_aligned_memory(count * length * sizeof(double), 64));
+	double* eigenvalues = static_cast<double*>(allocate_aligned_memory(count * sizeof(double), 64));
+	double* product = static_cast<double*>(allocate_aligned_memory(length * sizeof(double), 64));
+
+	timer jacobi_timer;
+	symmetric_eigen(reference_eigenvectors, reference_eigenvalues, matrix, length);
+	const double jacobi_ms = jacobi_timer.get_ms();
+
+	double min_subspace_ms = 0.0;
+	size_t iterations = 0;
+	bool converged = true;
+	for (size_t experiment = 0; experiment <= experiments_count; experiment++) {
+		timer subspace_timer;
+		converged = subspace_iteration(eigenvectors, eigenvalues, matrix, length, count, 1000, iterations) && converged;
+		const double subspace_ms = subspace_timer.get_ms();
+		if (experiment == 0 || subspace_ms < min_subspace_ms)
+			min_subspace_ms = subspace_ms;
+	}
+
+	const double tolerance = sqrt(DBL_EPSILON) * reference_eigenvalues[0];
+	double max_residual = 0.0, max_eigenvalue_error = 0.0, max_orthogonality_error = 0.0;
+	for (size_t i = 0; i < count; i++) {
+		const double* eigenvector = &eigenvectors[i * length];
+		matrix_vector_multiplication_naive(product, matrix, eigenvector, length, length);
+		double residual_squares = 0.0;
+		for (size_t k = 0; k < length; k++)
+			residual_squares += (product[k] - eigenvalues[i] * eigenvector[k]) * (product[k] - eigenvalues[i] * eigenvector[k]);
+		max_residual = fmax(max_residual, sqrt(residual_squares));
+		max_eigenvalue_error = fmax(max_eigenvalue_error, fabs(eigenvalues[i] - reference_eigenvalues[i]));
+		for (size_t j = 0; j <= i; j++) {
+			double dp = 0.0;
+			for (size_t k = 0; k < length; k++)
+				dp += eigenvector[k] * eigenvectors[j * length + k];
+			max_orthogonality_error = fmax(max_orthogonality_error, fabs(dp - ((i == j) ? 1.0 : 0.0)));
+		}
+	}
+	const bool test_passed = converged && (max_residual <= tolerance) && (max_eigenvalue_error <= tolerance)
+		&& (max_orthogonality_error <= length * DBL_EPSILON);
+
+	printf("\tJacobi (all %zu eigenpairs)\n", length);
+	printf("\t\tPerformance test:  %.3lf ms\n", jacobi_ms);
+	printf("\tSubspace iteration (top %zu eigenpairs)\n", count);
+	printf("\t\tUnit test:         %s\n", (test_passed ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	printf("\t\tPerformance test:  %.3lf ms (%u iterations)\n", min_subspace_ms, unsigned(iterations));
+	printf("\t\tPerformance boost: %.1lfx\n", jacobi_ms / min_subspace_ms);
+	printf("\t\tErrors:            %.2le residual, %.2le eigenvalue (relative to lambda[0]), %.2le orthogonality\n",
+		max_residual / reference_eigenvalues[0], max_eigenvalue_error / reference_eigenvalues[0], max_orthogonality_error);
+
+	release_aligned_memory(product);
+	release_aligned_memory(eigenvalues);
+	release_aligned_memory(eigenvectors);
+	release_aligned_memory(reference_eigenvalues);
+	release_aligned_memory(reference_eigenvectors);
+}
+
+/* What one precision mode of the pipeline produced, widened to double for comparison */
+struct precision_result {
+	double* matrix;
+	double* eigenvector;
+	double eigenvalue;
+};
+
+/* Runs conversion, demeaning, Gram matrix and power iteration with pixel_t pixels, and times each step */
+template <typename pixel_t>
+void test_precision(const char* mode_name, void (*convert_to_pixels_function)(const uint8_t*, pixel_t*, size_t, size_t, size_t),
+	const uint8_t* fixed_point_images, size_t image_width, size_t image_height, size_t image_count, precision_result& result)
+{
+	typedef typename pixel_traits<pixel_t>::real_t real_t;
+	const size_t image_pixels = image_width * image_height;
+	pixel_t* images = static_cast<pixel_t*>(allocate_aligned_memory(image_pixels * image_count * sizeof(pixel_t), 64));
+	real_t* matrix = static_cast<real_t*>(allocate_aligned_memory(image_count * image_count * sizeof(real_t), 64));
+	real_t* eigenvector = static_cast<real_t*>(allocate_aligned_memory(image_count * sizeof(real_t), 64));
+	real_t* workspace = static_cast<real_t*>(allocate_aligned_memory(image_count * sizeof(real_t), 64));
+
+	memset(images, 0, image_pixels * image_count * sizeof(pixel_t));
+	timer conversion_timer;
+	convert_to_pixels_function(fixed_point_images, images, image_width, image_height, image_count);
+	const double conversion_ms = conversion_timer.get_ms();
+
+	timer demean_timer;
+	demean_images(images, image_width, image_height, image_count);
+	const double demean_ms = demean_timer.get_ms();
+
+	timer square_timer;
+	square_matrix(matrix, images, image_pixels, image_count);
+	const double square_ms = square_timer.get_ms();
+
+	timer power_iteration_timer;
+	size_t iterations = 0;
+	result.eigenvalue = power_iteration(eigenvector, workspace, matrix, image_count, 10000, iterations);
+	const double power_iteration_ms = power_iteration_timer.get_ms();
+
+	for (size_t i = 0; i < image_count * image_count; i++)
+		result.matrix[i] = matrix[i];
+	for (size_t i = 0; i < image_count; i++)
+		result.eigenvector[i] = eigenvector[i];
+
+	printf("\t%s (%u bytes per pixel)\n", mode_name, unsigned(sizeof(pixel_t)));
+	printf("\t\tConversion:        %.3lf ms\n", conversion_ms);
+	printf("\t\tDemeaning:         %.3lf ms\n", demean_ms);
+	printf("\t\tSquare matrix:     %.3lf ms\n", square_ms);
+	printf("\t\tPower iteration:   %.3lf ms (%u iterations)\n", power_iteration_ms, unsigned(iterations));
+	printf("\t\tTotal:             %.3lf ms\n", conversion_ms + demean_ms + square_ms + power_iteration_ms);
+
+	release_aligned_memory(workspace);
+	release_aligned_memory(eigenvector);
+	release_aligned_memory(matrix);
+	release_aligned_memory(images);
+}
+
+/* Errors relative to the double-precision results; eigenvectors are compared up to sign */
+void print_precision_error(const precision_result& result, const precision_result& reference, size_t image_count) {
+	double max_error = 0.0, max_element = 0.0;
+	for (size_t i = 0; i < image_count * image_count; i++) {
+		max_error = fmax(max_error, fabs(result.matrix[i] - reference.matrix[i]));
+		max_element = fmax(max_element, fabs(reference.matrix[i]));
+	}
+	double dp = 0.0;
+	for (size_t i = 0; i < image_count; i++)
+		dp += result.eigenvector[i] * reference.eigenvector[i];
+	const double sign = (dp < 0.0) ? -1.0 : 1.0;
+	double max_eigenvector_error = 0.0;
+	for (size_t i = 0; i < image_count; i++)
+		max_eigenvector_error = fmax(max_eigenvector_error, fabs(sign * result.eigenvector[i] - reference.eigenvector[i]));
+	printf("\t\tSquare matrix:     %.2le max error (relative to the largest element)\n", max_error / max_element);
+	printf("\t\tEigenvector:       %.2le max error, 1 - |cos| = %.2le\n", max_eigenvector_error, 1.0 - fabs(dp));
+	printf("\t\tEigenvalue:        %.2le relative error\n", fabs(result.eigenvalue - reference.eigenvalue) / reference.eigenvalue);
+}
+
+/* Round-trips image stacks whose image size is not a multiple of the pack alignment through a pack file */
+bool test_pack_image_stack_sizes() {
+	const char* pack_path = "image-test.pack";
+	const size_t sizes[][3] = { { 33, 17, 5 }, { 1, 1, 3 }, { 7, 9, 1 } };
+	bool test_passed = true;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		const size_t image_width = sizes[s][0], image_height = sizes[s][1], image_count = sizes[s][2];
+		const size_t stack_size = image_width * image_height * image_count;
+		uint8_t* images = static_cast<uint8_t*>(allocate_aligned_memory(stack_size, 64));
+		for (size_t i = 0; i < stack_size; i++)
+			images[i] = uint8_t(rand());
+		pack_file pack;
+		const uint8_t* packed_images = NULL;
+		if (pack_write_image_stack(pack_path, images, image_width, image_height, image_count) && pack_open(pack_path, pack, true)) {
+			packed_images = pack_image_stack(pack, image_width, image_height, image_count);
+			test_passed = test_passed && (packed_images != NULL) && (memcmp(packed_images, images, stack_size) == 0);
+			pack_close(pack);
+		} else {
+			test_passed = false;
+		}
+		release_aligned_memory(images);
+	}
+	unlink(pack_path);
+	return test_passed;
+}
+
 int main(int argc, char** argv) {
 #if defined(DEBUG) || defined(_DEBUG)
 	const size_t experiments_count = 3;
@@ -135,6 +641,17 @@ int main(int argc, char** argv) {
 		fprintf(stderr, "Error: %s\n", dlerror());
 		exit(EXIT_FAILURE);
 	}
+	/* Optional */
+	convert_to_floating_point_float_function convert_to_floating_point_optimized_float =
+		reinterpret_cast<convert_to_floating_point_float_function>(dlsym(libsimdimage, "convert_to_floating_point_optimized_float"));
+	convert_to_int16_function convert_to_int16_optimized =
+		reinterpret_cast<convert_to_int16_function>(dlsym(libsimdimage, "convert_to_int16_optimized"));
+	/* Optional: SIMDIMAGE_ISA=avx512|avx2|sse4.1 caps the conversion kernel the library dispatches to */
+	select_isa_function select_convert_to_floating_point_isa =
+		reinterpret_cast<select_isa_function>(dlsym(libsimdimage, "select_convert_to_floating_point_isa"));
+	if (select_convert_to_floating_point_isa != NULL) {
+		printf("Conversion kernel: %s\n", select_convert_to_floating_point_isa(getenv("SIMDIMAGE_ISA")));
+	}
 	matrix_vector_multiplication_function matrix_vector_multiplication_optimized =
 		reinterpret_cast<matrix_vector_multiplication_function>(dlsym(libsimdimage, "matrix_vector_multiplication_optimized"));
 	if (matrix_vector_multiplication_optimized == NULL) {
@@ -145,10 +662,34 @@ int main(int argc, char** argv) {
 	const size_t image_width = 120;
 	const size_t image_height = 120;
 	const size_t image_count = 199;
+	const size_t eigenfaces_count = 50;
 
 	const size_t image_pixels = image_width * image_height;
 	const size_t image_collection_pixels = image_pixels * image_count;
-	uint8_t* fixed_point_images = static_cast<uint8_t*>(allocate_aligned_memory(image_collection_pixels * sizeof(uint8_t), 64));
+	/* The whole set is one mapping of cats.pack if it exists (make cats.pack), or is read file by file */
+	pack_file images_pack;
+	uint8_t* images_buffer = NULL;
+	const uint8_t* fixed_point_images = NULL;
+	if (pack_open("cats.pack", images_pack, false)) {
+		fixed_point_images = pack_image_stack(images_pack, image_width, image_height, image_count);
+		if (fixed_point_images == NULL) {
+			fprintf(stderr, "cats.pack does not hold %u %ux%u images\n", unsigned(image_count), unsigned(image_width), unsigned(image_height));
+		}
+	}
+	if (fixed_point_images == NULL) {
+		images_buffer = static_cast<uint8_t*>(allocate_aligned_memory(image_collection_pixels * sizeof(uint8_t), 64));
+		for (size_t image_number = 1; image_number <= image_count; image_number++) {
+			char image_name[64];
+			sprintf(image_name, "cats/%04u.y", unsigned(image_number));
+			read_raw_image(image_name, &images_buffer[image_pixels * (image_number - 1)], image_width, image_height);
+		}
+		fixed_point_images = images_buffer;
+	}
+
+	printf("Image stack packs:\n");
+	printf("\t\tOdd sizes:         %s\n", (test_pack_image_stack_sizes() ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
 
 	double* floating_point_images = static_cast<double*>(allocate_aligned_memory(image_collection_pixels * sizeof(double), 64));
 	double* floating_point_images_upper = static_cast<double*>(allocate_aligned_memory(image_collection_pixels * sizeof(double), 64));
@@ -161,12 +702,6 @@ int main(int argc, char** argv) {
 	double* floating_point_eigencat = static_cast<double*>(allocate_aligned_memory(image_pixels * sizeof(double), 64));
 	uint8_t* fixed_point_eigencat = static_cast<uint8_t*>(allocate_aligned_memory(image_pixels * sizeof(uint8_t), 64));
 
-	for (size_t image_number = 1; image_number <= image_count; image_number++) {
-		char image_name[64];
-		sprintf(image_name, "cats/%04u.y", unsigned(image_number));
-		read_raw_image(image_name, &fixed_point_images[image_pixels * (image_number - 1)], image_width, image_height);
-	}
-
 	printf("Conversion from fixed-point to floating-point\n");
 	double naive_conversion_fps = 0.0, naive_multiplication_fps = 0.0, simd_conversion_fps = 0.0, simd_multiplication_fps = 0.0;
 	test_conversion("Naive", convert_to_floating_point_naive, 
@@ -176,6 +711,38 @@ int main(int argc, char** argv) {
 		fixed_point_images, floating_point_images, floating_point_images_upper, floating_point_images_lower,
 		image_width, image_height, image_count, experiments_count, false, simd_conversion_fps);
 	printf("\t\tPerformance boost: %.1lfx\n", simd_conversion_fps / naive_conversion_fps);
+	printf("\t\tOdd sizes:         %s\n", (test_conversion_sizes(convert_to_floating_point_optimized, convert_to_floating_point_optimized_float, convert_to_int16_optimized) ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	if (convert_to_floating_point_optimized_float != NULL) {
+		/* The upper-bound images double as the reference; they were written by the last test_conversion */
+		float* single_precision_images = static_cast<float*>(allocate_aligned_memory(image_collection_pixels * sizeof(float), 64));
+		test_conversion_float(convert_to_floating_point_optimized_float, fixed_point_images, single_precision_images, floating_point_images_upper,
+			image_width, image_height, image_count, experiments_count);
+		release_aligned_memory(single_precision_images);
+	}
+
+	demean_images_function demean_images_optimized =
+		reinterpret_cast<demean_images_function>(dlsym(libsimdimage, "demean_images_optimized"));
+	convert_to_floating_point_function convert_and_demean_optimized =
+		reinterpret_cast<convert_to_floating_point_function>(dlsym(libsimdimage, "convert_and_demean_optimized"));
+	convert_to_floating_point_float_function convert_and_demean_optimized_float =
+		reinterpret_cast<convert_to_floating_point_float_function>(dlsym(libsimdimage, "convert_and_demean_optimized_float"));
+	convert_to_int16_function convert_and_demean_int16_optimized =
+		reinterpret_cast<convert_to_int16_function>(dlsym(libsimdimage, "convert_and_demean_int16_optimized"));
+	if (demean_images_optimized != NULL && convert_and_demean_optimized != NULL
+		&& convert_and_demean_optimized_float != NULL && convert_and_demean_int16_optimized != NULL)
+	{
+		printf("Demeaning:\n");
+		test_demean(demean_images_optimized, convert_and_demean_optimized, convert_and_demean_optimized_float, convert_and_demean_int16_optimized,
+			fixed_point_images, floating_point_images, floating_point_images_upper,
+			image_width, image_height, image_count, experiments_count);
+	}
+
+	printf("Square matrix:\n");
+	convert_to_floating_point_naive(fixed_point_images, floating_point_images, image_width, image_height, image_count);
+	demean_images(floating_point_images, image_width, image_height, image_count);
+	test_square_matrix(floating_point_images, image_pixels, image_count, experiments_count);
 
 	printf("Matrix-vector multiplication:\n");
 	{
@@ -190,30 +757,81 @@ int main(int argc, char** argv) {
 		vector_matrix_multiplication(floating_point_eigencat, eigenvector, floating_point_images, image_pixels, image_count);
 		normalize_vector(floating_point_eigencat, image_pixels);
 		convert_to_fixed_point(floating_point_eigencat, fixed_point_eigencat, image_width, image_height);
-		write_bmp_image("eigencat-naive.bmp", fixed_point_eigencat, image_width, image_height);
+		write_bmp_image_queued("eigencat-naive.bmp", fixed_point_eigencat, image_width, image_height);
 	}
 	{
-		convert_to_floating_point_optimized(fixed_point_images, floating_point_images, image_width, image_height, image_count);
-		demean_images(floating_point_images, image_width, image_height, image_count);
-		square_matrix(squared_matrix, floating_point_images, image_pixels, image_count);
+		if (convert_and_demean_optimized != NULL) {
+			convert_and_demean_optimized(fixed_point_images, floating_point_images, image_width, image_height, image_count);
+		} else {
+			convert_to_floating_point_optimized(fixed_point_images, floating_point_images, image_width, image_height, image_count);
+			demean_images(floating_point_images, image_width, image_height, image_count);
+		}
+		syrk(squared_matrix, floating_point_images, image_pixels, image_count);
 
 		double* eigenvector = test_multiplication("Naive", matrix_vector_multiplication_optimized,
 			eigenvector_old, eigenvector_new, eigenvector_ref, eigenvector_abs, squared_matrix, image_count,
 			experiments_count, false, simd_multiplication_fps);
 
-		vector_matrix_multiplication(floating_point_eigencat, eigenvector, floating_point_images, image_pixels, image_count);
-		normalize_vector(floating_point_eigencat, image_pixels);
+		/* The eigencat is a linear combination of the images */
+		vector_set(floating_point_eigencat, image_pixels, 0.0);
+		for (size_t image_number = 0; image_number < image_count; image_number++) {
+			blas1_axpy(floating_point_eigencat, &floating_point_images[image_pixels * image_number], image_pixels, eigenvector[image_number]);
+		}
+		blas1_normalize(floating_point_eigencat, image_pixels);
 		convert_to_fixed_point(floating_point_eigencat, fixed_point_eigencat, image_width, image_height);
-		write_bmp_image("eigencat-optimized.bmp", fixed_point_eigencat, image_width, image_height);
+		write_bmp_image_queued("eigencat-optimized.bmp", fixed_point_eigencat, image_width, image_height);
 	}
 	printf("\t\tPerformance boost: %.1lfx\n", simd_multiplication_fps / naive_multiplication_fps);
+	/* Optional */
+	symmetric_matrix_vector_multiplication_function symmetric_matrix_vector_multiplication_optimized =
+		reinterpret_cast<symmetric_matrix_vector_multiplication_function>(dlsym(libsimdimage, "symmetric_matrix_vector_multiplication_optimized"));
+	printf("\t\tOdd sizes:         %s\n", (test_multiplication_sizes(matrix_vector_multiplication_optimized, symmetric_matrix_vector_multiplication_optimized) ?
+		CSE6230_ESCAPE_GREEN_COLOR "PASSED" CSE6230_ESCAPE_NORMAL_COLOR:
+		CSE6230_ESCAPE_RED_COLOR "FAILED" CSE6230_ESCAPE_NORMAL_COLOR));
+	if (symmetric_matrix_vector_multiplication_optimized != NULL) {
+		double symmetric_multiplication_fps = 0.0;
+		test_symmetric_multiplication(symmetric_matrix_vector_multiplication_optimized,
+			eigenvector_old, eigenvector_new, eigenvector_ref, eigenvector_abs, squared_matrix, image_count,
+			experiments_count, symmetric_multiplication_fps);
+		printf("\t\tPerformance boost: %.1lfx (%.1lfx over the general kernel)\n",
+			symmetric_multiplication_fps / naive_multiplication_fps, symmetric_multiplication_fps / simd_multiplication_fps);
+	}
+
+	printf("Eigenfaces:\n");
+	/* Each run takes as long as thousands of matrix-vector products */
+	test_eigenfaces(squared_matrix, image_count, eigenfaces_count, experiments_count / 10);
+
+	printf("Precision modes:\n");
+	{
+		precision_result results[3];
+		for (size_t mode = 0; mode < 3; mode++) {
+			results[mode].matrix = static_cast<double*>(allocate_aligned_memory(image_count * image_count * sizeof(double), 64));
+			results[mode].eigenvector = static_cast<double*>(allocate_aligned_memory(image_count * sizeof(double), 64));
+		}
+		test_precision<double>("Double", convert_to_floating_point_optimized,
+			fixed_point_images, image_width, image_height, image_count, results[0]);
+		test_precision<float>("Single", (convert_to_floating_point_optimized_float != NULL) ? convert_to_floating_point_optimized_float : convert_to_pixels<float>,
+			fixed_point_images, image_width, image_height, image_count, results[1]);
+		print_precision_error(results[1], results[0], image_count);
+		test_precision<int16_t>("Fixed point (int16 Q7, single-precision matrix)", (convert_to_int16_optimized != NULL) ? convert_to_int16_optimized : convert_to_pixels<int16_t>,
+			fixed_point_images, image_width, image_height, image_count, results[2]);
+		print_precision_error(results[2], results[0], image_count);
+		for (size_t mode = 0; mode < 3; mode++) {
+			release_aligned_memory(results[mode].matrix);
+			release_aligned_memory(results[mode].eigenvector);
+		}
+	}
 
 	printf("Total (geometric mean):\n");
 	printf("\tNaive FPS:         %.1lf\n", sqrt(naive_conversion_fps * naive_multiplication_fps));
 	printf("\tOptimized FPS:     %.1lf\n", sqrt(simd_conversion_fps * simd_multiplication_fps));
 	printf("\tPerformance boost: %.1lfx\n", sqrt((simd_conversion_fps * simd_multiplication_fps) / (naive_conversion_fps * naive_multiplication_fps)));
 
-	release_aligned_memory(fixed_point_images);
+	flush_bmp_images();
+	if (images_buffer != NULL) {
+		release_aligned_memory(images_buffer);
+	}
+	pack_close(images_pack);
 
 	release_aligned_memory(floating_point_images);
 	release_aligned_memory(floating_point_images_upper);
@@ -3,25 +3,89 @@
 #include <hpcdefs.hpp>
 
 typedef void (*convert_to_floating_point_function)(const uint8_t*, double*, size_t, size_t, size_t);
+typedef void (*convert_to_floating_point_float_function)(const uint8_t*, float*, size_t, size_t, size_t);
+typedef void (*convert_to_int16_function)(const uint8_t*, int16_t*, size_t, size_t, size_t);
+typedef void (*demean_images_function)(double*, size_t, size_t, size_t);
 typedef void (*matrix_vector_multiplication_function)(double*, const double*, const double*, size_t, size_t);
+typedef void (*symmetric_matrix_vector_multiplication_function)(double*, const double*, const double*, size_t);
+typedef const char* (*select_isa_function)(const char*);
 
 void convert_to_floating_point_naive(const uint8_t* input_images, double* output_images, size_t image_width, size_t image_height, size_t image_count);
 void matrix_vector_multiplication_naive(double* output_vector, const double* matrix, const double* input_vector, size_t matrix_width, size_t matrix_height);
 
 extern "C" void convert_to_floating_point_optimized(const uint8_t* input_images, double* output_images, size_t image_width, size_t image_height, size_t image_count);
+extern "C" void convert_to_floating_point_optimized_float(const uint8_t* input_images, float* output_images, size_t image_width, size_t image_height, size_t image_count);
+/* Q7 fixed point (see pixel_traits<int16_t>) */
+extern "C" void convert_to_int16_optimized(const uint8_t* input_images, int16_t* output_images, size_t image_width, size_t image_height, size_t image_count);
+/* Subtract each pixel's mean over the images, one cache-sized block of pixels at a time */
+extern "C" void demean_images_optimized(double* images, size_t image_width, size_t image_height, size_t image_count);
+/* Conversion and demeaning in one pass over the output (the convert_to_* functions followed by demean_images) */
+extern "C" void convert_and_demean_optimized(const uint8_t* input_images, double* output_images, size_t image_width, size_t image_height, size_t image_count);
+extern "C" void convert_and_demean_optimized_float(const uint8_t* input_images, float* output_images, size_t image_width, size_t image_height, size_t image_count);
+extern "C" void convert_and_demean_int16_optimized(const uint8_t* input_images, int16_t* output_images, size_t image_width, size_t image_height, size_t image_count);
+/* Caps the conversion kernels at max_isa ("avx512", "avx2" or "sse4.1"; NULL for the best one) and returns the one selected */
+extern "C" const char* select_convert_to_floating_point_isa(const char* max_isa);
 extern "C" void matrix_vector_multiplication_optimized(double* output_vector, const double* matrix, const double* input_vector, size_t matrix_width, size_t matrix_height);
+/* The same for a symmetric length x length matrix, given as its packed upper triangle (see pack_upper_triangle) */
+extern "C" void symmetric_matrix_vector_multiplication_optimized(double* output_vector, const double* packed_matrix, const double* input_vector, size_t length);
 
 void convert_to_floating_point_upper(const uint8_t* input_images, double* output_images, size_t image_width, size_t image_height, size_t image_count);
 void convert_to_floating_point_lower(const uint8_t* input_images, double* output_images, size_t image_width, size_t image_height, size_t image_count);
 void matrix_vector_multiplication_abs(double* output_vector, const double* matrix, const double* input_vector, size_t matrix_width, size_t matrix_height);
 
+/*
+ * Precision modes of the eigenfaces pipeline (conversion, demeaning, Gram matrix, power iteration).
+ * They apply to the naive loops below only; the optimized Gram matrix (SYRK) and eigensolvers are
+ * double precision. pixel_t is double (the reference), float, or int16_t: pixels in Q7 fixed point,
+ * i.e. in units of 1 / (255 * 2^7) of full scale. Converted pixels are exact in Q7, but each mean is
+ * rounded to a whole Q7 unit before it is subtracted, so demeaned pixels are within half a unit
+ * (1/256 of a grey level) of the exact ones; they stay within -255 * 2^7..255 * 2^7, so int16 holds them.
+ * real_t is the type of the Gram matrix and eigenvectors; sum_t and product_t accumulate pixels
+ * and pixel products.
+ */
+#define PIXEL_FIXED_POINT_SHIFT 7
+
+template <typename pixel_t> struct pixel_traits;
+
+template <> struct pixel_traits<double> {
+	typedef double real_t;
+	typedef double sum_t;
+	typedef double product_t;
+	static double unit() { return 1.0; }
+};
+
+template <> struct pixel_traits<float> {
+	typedef float real_t;
+	typedef float sum_t;
+	typedef float product_t;
+	static double unit() { return 1.0; }
+};
+
+template <> struct pixel_traits<int16_t> {
+	typedef float real_t;
+	typedef int32_t sum_t;
+	typedef int64_t product_t;
+	static double unit() { return 1.0 / (255.0 * (1 << PIXEL_FIXED_POINT_SHIFT)); }
+};
+
+/* Instantiated for double, float and int16_t */
+template <typename pixel_t>
+void convert_to_pixels(const uint8_t* input_images, pixel_t* output_images, size_t image_width, size_t image_height, size_t image_count);
+template <typename pixel_t>
+void demean_images(pixel_t* images, size_t image_width, size_t image_height, size_t image_count);
+template <typename pixel_t>
+void square_matrix(typename pixel_traits<pixel_t>::real_t* output_matrix, const pixel_t* input_matrix, size_t matrix_width, size_t matrix_height);
+/* Instantiated for double and float; returns the eigenvalue of the normalized dominant eigenvector, and the iterations taken */
+template <typename real_t>
+double power_iteration(real_t* eigenvector, real_t* workspace, const real_t* matrix, size_t length, size_t max_iterations, size_t& iterations);
+
 /* Utility matrix and image operations */
-void square_matrix(double* output_matrix, const double* input_matrix, size_t matrix_width, size_t matrix_height);
-void demean_images(double* images, size_t image_width, size_t image_height, size_t image_count);
 void vector_matrix_multiplication(double* output_vector, const double* input_vector, const double* matrix, size_t matrix_width, size_t matrix_height);
 void min_max_image(const double* image_data, size_t image_width, size_t image_height, double& image_min, double& image_max);
 void convert_to_fixed_point(const double* input_image, uint8_t* output_image, size_t image_width, size_t image_height);
 bool check_images(const double* images, const double* images_lower, const double* images_upper, size_t image_width, size_t image_height, size_t image_count);
+/* Row i of the packed matrix holds elements i..length-1 of row i of matrix, so it is length (length + 1) / 2 elements */
+void pack_upper_triangle(double* packed_matrix, const double* matrix, size_t length);
 
 /* Utility vector operations */
 void vector_set(double *CSE6230_RESTRICT vector, size_t length, double constant);
@@ -33,3 +97,11 @@ bool check_vector(const double* vector, const double* vector_ref, const double*
 
 void read_raw_image(const char* image_file_path, void* image_buffer, size_t image_width, size_t image_height);
 void write_bmp_image(const char* image_file_path, void* image_buffer, size_t image_width, size_t image_height);
+
+/* BMP output with one write per file; 8-bit grayscale or 24-bit RGB */
+void write_bmp_image_rgb(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height);
+/* The same, encoded and written later by a background thread; the pixels are copied, so the buffer can be reused at once */
+void write_bmp_image_queued(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height);
+void write_bmp_image_rgb_queued(const char* image_file_path, const void* image_buffer, size_t image_width, size_t image_height);
+/* Waits until every queued image is written */
+void flush_bmp_images();
@@ -0,0 +1,193 @@
+#include <hpcdefs.hpp>
+#include <syrk.hpp>
+#include <string.h>
+#if defined(_OPENMP)
+	#include <omp.h>
+#endif
+
+/*
+ * Tiles of C are TILE_ROWS x panel_traits<real_t>::width: two AVX2 vectors wide, so the kernel keeps
+ * 4 x 2 accumulators in registers and, for every column k, does 2 loads, 4 broadcasts and 8 FMAs.
+ * A panel holds width rows of A: panel[k * width + r] = A[first_row + r][k], zero past the last row.
+ * The tile rows are a quarter or an eighth of a panel, so both operands of a tile come from panels.
+ */
+
+#define TILE_ROWS 4
+
+template <typename real_t> struct panel_traits;
+
+template <> struct panel_traits<double> {
+	enum { width = 8 };
+};
+
+template <> struct panel_traits<float> {
+	enum { width = 16 };
+};
+
+/* AVX2 primitives, overloaded on the element type */
+__attribute__((target("avx2,fma")))
+static inline __m256d vector_load(const double* p) { return _mm256_loadu_pd(p); }
+__attribute__((target("avx2,fma")))
+static inline __m256 vector_load(const float* p) { return _mm256_loadu_ps(p); }
+__attribute__((target("avx2,fma")))
+static inline __m256d vector_broadcast(const double* p) { return _mm256_broadcast_sd(p); }
+__attribute__((target("avx2,fma")))
+static inline __m256 vector_broadcast(const float* p) { return _mm256_broadcast_ss(p); }
+__attribute__((target("avx2,fma")))
+static inline __m256d vector_fmadd(__m256d a, __m256d b, __m256d c) { return _mm256_fmadd_pd(a, b, c); }
+__attribute__((target("avx2,fma")))
+static inline __m256 vector_fmadd(__m256 a, __m256 b, __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+__attribute__((target("avx2,fma")))
+static inline void vector_store(double* p, __m256d v) { _mm256_storeu_pd(p, v); }
+__attribute__((target("avx2,fma")))
+static inline void vector_store(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+
+template <typename real_t> struct avx2_vector;
+template <> struct avx2_vector<double> { typedef __m256d type; enum { length = 4 }; };
+template <> struct avx2_vector<float> { typedef __m256 type; enum { length = 8 }; };
+
+/*
+ * tile[r * width + c] := sum over k < length of a[k * width + r] * b[k * width + c]
+ * a points into a panel at the tile's first row; b is the panel of the tile's columns.
+ */
+template <typename real_t>
+__attribute__((target("avx2,fma")))
+static void tile_kernel_avx2(real_t *CSE6230_RESTRICT tile, const real_t *CSE6230_RESTRICT a, const real_t *CSE6230_RESTRICT b, size_t length) {
+	typedef typename avx2_vector<real_t>::type vector_t;
+	const size_t width = panel_traits<real_t>::width;
+	const size_t half = avx2_vector<real_t>::length;
+	vector_t c00 = vector_t(), c01 = vector_t(), c10 = vector_t(), c11 = vector_t();
+	vector_t c20 = vector_t(), c21 = vector_t(), c30 = vector_t(), c31 = vector_t();
+	for (size_t k = 0; k < length; k++) {
+		const vector_t b0 = vector_load(b + k * width);
+		const vector_t b1 = vector_load(b + k * width + half);
+		const vector_t a0 = vector_broadcast(a + k * width);
+		c00 = vector_fmadd(a0, b0, c00);
+		c01 = vector_fmadd(a0, b1, c01);
+		const vector_t a1 = vector_broadcast(a + k * width + 1);
+		c10 = vector_fmadd(a1, b0, c10);
+		c11 = vector_fmadd(a1, b1, c11);
+		const vector_t a2 = vector_broadcast(a + k * width + 2);
+		c20 = vector_fmadd(a2, b0, c20);
+		c21 = vector_fmadd(a2, b1, c21);
+		const vector_t a3 = vector_broadcast(a + k * width + 3);
+		c30 = vector_fmadd(a3, b0, c30);
+		c31 = vector_fmadd(a3, b1, c31);
+	}
+	vector_store(tile, c00);
+	vector_store(tile + half, c01);
+	vector_store(tile + width, c10);
+	vector_store(tile + width + half, c11);
+	vector_store(tile + 2 * width, c20);
+	vector_store(tile + 2 * width + half, c21);
+	vector_store(tile + 3 * width, c30);
+	vector_store(tile + 3 * width + half, c31);
+}
+
+/* The same for processors without AVX2 and FMA; the compiler vectorizes the inner loop */
+template <typename real_t>
+static void tile_kernel_portable(real_t *CSE6230_RESTRICT tile, const real_t *CSE6230_RESTRICT a, const real_t *CSE6230_RESTRICT b, size_t length) {
+	const size_t width = panel_traits<real_t>::width;
+	real_t sums[TILE_ROWS * panel_traits<real_t>::width] = { 0 };
+	for (size_t k = 0; k < length; k++) {
+		for (size_t r = 0; r < TILE_ROWS; r++) {
+			const real_t a_element = a[k * width + r];
+			for (size_t c = 0; c < width; c++) {
+				sums[r * width + c] += a_element * b[k * width + c];
+			}
+		}
+	}
+	memcpy(tile, sums, sizeof(sums));
+}
+
+static bool has_avx2_fma() {
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+/* Packs columns [first_column, first_column + length) of rows [first_row, first_row + width) */
+template <typename real_t>
+static void pack_panel(real_t *CSE6230_RESTRICT panel, const real_t *CSE6230_RESTRICT matrix_a,
+	size_t columns, size_t rows, size_t first_row, size_t first_column, size_t length)
+{
+	const size_t width = panel_traits<real_t>::width;
+	for (size_t r = 0; r < width; r++) {
+		if (first_row + r < rows) {
+			const real_t* row = matrix_a + (first_row + r) * columns + first_column;
+			for (size_t k = 0; k < length; k++)
+				panel[k * width + r] = row[k];
+		} else {
+			for (size_t k = 0; k < length; k++)
+				panel[k * width + r] = real_t(0);
+		}
+	}
+}
+
+template <typename real_t>
+static void syrk_blocked(real_t *CSE6230_RESTRICT matrix_c, const real_t *CSE6230_RESTRICT matrix_a, size_t columns, size_t rows) {
+	const size_t width = panel_traits<real_t>::width;
+	const size_t panels_count = (rows + width - 1) / width;
+	const size_t tile_rows_count = (rows + TILE_ROWS - 1) / TILE_ROWS;
+	const size_t tiles_count = tile_rows_count * panels_count;
+
+	if (columns == 0) {
+		for (size_t i = 0; i < rows * rows; i++)
+			matrix_c[i] = real_t(0);
+		return;
+	}
+
+	const bool use_avx2 = has_avx2_fma();
+	real_t* panels = static_cast<real_t*>(allocate_aligned_memory(panels_count * width * SYRK_BLOCK_COLUMNS * sizeof(real_t), 64));
+	#pragma omp parallel
+	{
+		real_t tile[TILE_ROWS * panel_traits<real_t>::width];
+		for (size_t first_column = 0; first_column < columns; first_column += SYRK_BLOCK_COLUMNS) {
+			const size_t length = (columns - first_column < SYRK_BLOCK_COLUMNS) ? columns - first_column : SYRK_BLOCK_COLUMNS;
+			#pragma omp for schedule(static)
+			for (size_t p = 0; p < panels_count; p++)
+				pack_panel(panels + p * width * SYRK_BLOCK_COLUMNS, matrix_a, columns, rows, p * width, first_column, length);
+
+			/* Tile t covers TILE_ROWS rows from row TILE_ROWS * (t / panels_count) and the columns of panel t % panels_count; tiles above the diagonal are skipped */
+			#pragma omp for schedule(dynamic, 4)
+			for (size_t t = 0; t < tiles_count; t++) {
+				const size_t first_row = TILE_ROWS * (t / panels_count);
+				const size_t p = t % panels_count;
+				if (p * width > first_row + TILE_ROWS - 1)
+					continue;
+				const real_t* a = panels + (first_row / width) * width * SYRK_BLOCK_COLUMNS + first_row % width;
+				const real_t* b = panels + p * width * SYRK_BLOCK_COLUMNS;
+				if (use_avx2)
+					tile_kernel_avx2(tile, a, b, length);
+				else
+					tile_kernel_portable(tile, a, b, length);
+
+				for (size_t r = 0; r < TILE_ROWS && first_row + r < rows; r++) {
+					real_t* c_row = matrix_c + (first_row + r) * rows + p * width;
+					const size_t c_columns = (rows - p * width < width) ? rows - p * width : width;
+					if (first_column == 0) {
+						for (size_t c = 0; c < c_columns; c++)
+							c_row[c] = tile[r * width + c];
+					} else {
+						for (size_t c = 0; c < c_columns; c++)
+							c_row[c] += tile[r * width + c];
+					}
+				}
+			}
+		}
+
+		/* Mirror the lower triangle; diagonal tiles also computed some elements above the diagonal, which are overwritten */
+		#pragma omp for schedule(static)
+		for (size_t i = 0; i < rows; i++)
+			for (size_t j = i + 1; j < rows; j++)
+				matrix_c[i * rows + j] = matrix_c[j * rows + i];
+	}
+	release_aligned_memory(panels);
+}
+
+void syrk(double *CSE6230_RESTRICT matrix_c, const double *CSE6230_RESTRICT matrix_a, size_t columns, size_t rows) {
+	syrk_blocked(matrix_c, matrix_a, columns, rows);
+}
+
+void syrk(float *CSE6230_RESTRICT matrix_c, const float *CSE6230_RESTRICT matrix_a, size_t columns, size_t rows) {
+	syrk_blocked(matrix_c, matrix_a, columns, rows);
+}
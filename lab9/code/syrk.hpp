@@ -0,0 +1,20 @@
+#pragma once
+
+#include <hpcdefs.hpp>
+
+/*
+ * Symmetric rank-k update: the Gram matrix C = A A^T of a row-major rows x columns matrix A
+ * (e.g. the image stack, one image per row), which square_matrix computes naively.
+ *
+ * Only the tiles on and below the diagonal are computed; the upper triangle is mirrored at the end.
+ * The columns are processed in blocks of SYRK_BLOCK_COLUMNS: each block of all rows is first packed
+ * into panels of a few rows stored column by column, and every tile of the block then streams its
+ * panels from cache. The tiles are computed in parallel (OpenMP) by a register-tiled
+ * AVX2 FMA kernel, or by portable code on processors without AVX2 and FMA.
+ */
+
+#define SYRK_BLOCK_COLUMNS 256
+
+/* C := A A^T; C is rows x rows */
+void syrk(double *CSE6230_RESTRICT matrix_c, const double *CSE6230_RESTRICT matrix_a, size_t columns, size_t rows);
+void syrk(float *CSE6230_RESTRICT matrix_c, const float *CSE6230_RESTRICT matrix_a, size_t columns, size_t rows);